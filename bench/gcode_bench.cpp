@@ -1,13 +1,25 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "gcode/ail.h"
+#include "gcode/compact_ail.h"
+#include "gcode/compact_ast.h"
+#include "gcode/execution_interfaces.h"
 #include "gcode/gcode_parser.h"
 #include "messages.h"
+#include "streaming_execution_engine.h"
 
 namespace {
 
@@ -22,6 +34,16 @@ struct BenchScenarioResult {
   double parse_and_lower_lines_per_sec = 0.0;
   double parse_bytes_per_sec = 0.0;
   double parse_and_lower_bytes_per_sec = 0.0;
+  // Concurrent scenarios only: parsing threads, and throughput relative to
+  // `threads` times the one-thread throughput of the same scenario.
+  unsigned threads = 0;
+  double scaling_efficiency = 0.0;
+  // Lowering scenarios only: lowerToAil() on an already parsed program.
+  double lower_ms_avg = 0.0;
+  // AIL memory scenarios only: bytes held per instruction by AilResult and
+  // by CompactAilResult for the same program.
+  double ail_bytes_per_instruction = 0.0;
+  double compact_ail_bytes_per_instruction = 0.0;
 };
 
 std::string makeProgram(size_t line_count) {
@@ -35,6 +57,74 @@ std::string makeProgram(size_t line_count) {
   return text;
 }
 
+// Words whose values are not plain numbers (AC(...) positions, system
+// variables) on every line, so every numeric read of a value fails.
+std::string makeNonNumericValueProgram(size_t line_count) {
+  std::string text;
+  text.reserve(line_count * 40);
+  for (size_t i = 0; i < line_count; ++i) {
+    text += "N";
+    text += std::to_string(i + 1);
+    text += " G1 X=AC(1.5) Y=$AA_IM[Y] Z=AC(-2) F3\n";
+  }
+  return text;
+}
+
+// MDI-style single lines that need the ANTLR parser (assignments), each
+// parsed on its own.
+std::vector<std::string> makeOneLineInputs(size_t line_count) {
+  std::vector<std::string> inputs;
+  inputs.reserve(line_count);
+  for (size_t i = 0; i < line_count; ++i) {
+    inputs.push_back("R" + std::to_string(i % 10) + " = R" +
+                     std::to_string((i + 1) % 10) + " + " +
+                     std::to_string(i) + "\n");
+  }
+  return inputs;
+}
+
+// A control-flow program, so that every line goes through ANTLR.
+std::string makeControlFlowProgram(size_t line_count) {
+  std::string text;
+  text.reserve(line_count * 24);
+  for (size_t i = 0; i < line_count; i += 4) {
+    const std::string n = std::to_string(i);
+    text += "L" + n + ":\n";
+    text += "R1 = R1 * 2 + " + n + "\n";
+    text += "IF R1 > " + n + " GOTOB L" + n + "\n";
+    text += "G1 X=R1 Y" + n + "\n";
+  }
+  return text;
+}
+
+// `line_count` moves inside one IF block. A streaming engine holds them all
+// in one batch until the ENDIF arrives; the condition is false, so the run
+// measures parsing and lowering rather than execution.
+std::string makeIfBlockProgram(size_t line_count) {
+  std::string text = "R1 = 1\nIF R1 == 0\n";
+  text.reserve(line_count * 16 + 32);
+  for (size_t i = 0; i < line_count; ++i) {
+    text += "G1 X";
+    text += std::to_string(i % 1000);
+    text += " Y2 F3\n";
+  }
+  text += "ENDIF\n";
+  return text;
+}
+
+// A forward GOTOF over `line_count` moves to a label on the last lines.
+std::string makeForwardGotoProgram(size_t line_count) {
+  std::string text = "G1 X0 Y0 F3\nGOTOF END\n";
+  text.reserve(line_count * 16 + 48);
+  for (size_t i = 0; i < line_count; ++i) {
+    text += "G1 X";
+    text += std::to_string(i % 1000);
+    text += " Y2 F3\n";
+  }
+  text += "END:\nG1 X1 Y1\n";
+  return text;
+}
+
 size_t countLines(const std::string &text) {
   size_t lines = 0;
   for (char c : text) {
@@ -45,8 +135,23 @@ size_t countLines(const std::string &text) {
   return lines;
 }
 
+void computeRates(BenchScenarioResult *result) {
+  const double lines = static_cast<double>(result->lines);
+  const double bytes = static_cast<double>(result->bytes);
+  const double parse_sec = result->parse_ms_avg / 1000.0;
+  const double parse_lower_sec = result->parse_and_lower_ms_avg / 1000.0;
+
+  result->parse_lines_per_sec = parse_sec > 0.0 ? lines / parse_sec : 0.0;
+  result->parse_and_lower_lines_per_sec =
+      parse_lower_sec > 0.0 ? lines / parse_lower_sec : 0.0;
+  result->parse_bytes_per_sec = parse_sec > 0.0 ? bytes / parse_sec : 0.0;
+  result->parse_and_lower_bytes_per_sec =
+      parse_lower_sec > 0.0 ? bytes / parse_lower_sec : 0.0;
+}
+
 BenchScenarioResult runScenario(const std::string &name,
-                                const std::string &input, int iterations) {
+                                const std::string &input, int iterations,
+                                const gcode::ParseOptions &parse_options = {}) {
   BenchScenarioResult result;
   result.name = name;
   result.lines = countLines(input);
@@ -58,14 +163,16 @@ BenchScenarioResult runScenario(const std::string &name,
 
   for (int i = 0; i < iterations; ++i) {
     const auto parse_start = std::chrono::steady_clock::now();
-    const auto parsed = gcode::parse(input);
+    const auto parsed = gcode::parse(input, parse_options);
     const auto parse_end = std::chrono::steady_clock::now();
     parse_total_ms +=
         std::chrono::duration<double, std::milli>(parse_end - parse_start)
             .count();
 
     const auto lower_start = std::chrono::steady_clock::now();
-    const auto lowered = gcode::parseAndLower(input);
+    const auto reparsed = gcode::parse(input, parse_options);
+    const auto lowered =
+        gcode::lowerToMessages(reparsed.program, reparsed.diagnostics);
     const auto lower_end = std::chrono::steady_clock::now();
     parse_and_lower_total_ms +=
         std::chrono::duration<double, std::milli>(lower_end - lower_start)
@@ -84,40 +191,454 @@ BenchScenarioResult runScenario(const std::string &name,
   result.parse_ms_avg = parse_total_ms / static_cast<double>(iterations);
   result.parse_and_lower_ms_avg =
       parse_and_lower_total_ms / static_cast<double>(iterations);
+  computeRates(&result);
+  return result;
+}
 
-  const double lines = static_cast<double>(result.lines);
-  const double bytes = static_cast<double>(result.bytes);
-  const double parse_sec = result.parse_ms_avg / 1000.0;
-  const double parse_lower_sec = result.parse_and_lower_ms_avg / 1000.0;
+// One parse (and one parse + lower) per input, all through one
+// ParserContext as a line-by-line MDI session would do.
+BenchScenarioResult runOneLineScenario(const std::string &name,
+                                       const std::vector<std::string> &inputs,
+                                       int iterations) {
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = inputs.size();
+  for (const auto &input : inputs) {
+    result.bytes += input.size();
+  }
+  result.iterations = iterations;
 
-  result.parse_lines_per_sec = parse_sec > 0.0 ? lines / parse_sec : 0.0;
-  result.parse_and_lower_lines_per_sec =
-      parse_lower_sec > 0.0 ? lines / parse_lower_sec : 0.0;
-  result.parse_bytes_per_sec = parse_sec > 0.0 ? bytes / parse_sec : 0.0;
-  result.parse_and_lower_bytes_per_sec =
-      parse_lower_sec > 0.0 ? bytes / parse_lower_sec : 0.0;
+  gcode::ParserContext context;
+  double parse_total_ms = 0.0;
+  double parse_and_lower_total_ms = 0.0;
+  size_t diagnostic_count = 0;
+  for (int i = 0; i < iterations; ++i) {
+    const auto parse_start = std::chrono::steady_clock::now();
+    for (const auto &input : inputs) {
+      diagnostic_count += gcode::parse(input, {}, context).diagnostics.size();
+    }
+    const auto parse_end = std::chrono::steady_clock::now();
+    parse_total_ms +=
+        std::chrono::duration<double, std::milli>(parse_end - parse_start)
+            .count();
+
+    const auto lower_start = std::chrono::steady_clock::now();
+    for (const auto &input : inputs) {
+      const auto parsed = gcode::parse(input, {}, context);
+      diagnostic_count +=
+          gcode::lowerToMessages(parsed.program, parsed.diagnostics)
+              .diagnostics.size();
+    }
+    const auto lower_end = std::chrono::steady_clock::now();
+    parse_and_lower_total_ms +=
+        std::chrono::duration<double, std::milli>(lower_end - lower_start)
+            .count();
+  }
+  if (diagnostic_count != 0) {
+    std::cerr << "benchmark warning: diagnostics count=" << diagnostic_count
+              << "\n";
+  }
+
+  result.parse_ms_avg = parse_total_ms / static_cast<double>(iterations);
+  result.parse_and_lower_ms_avg =
+      parse_and_lower_total_ms / static_cast<double>(iterations);
+  computeRates(&result);
+  return result;
+}
+
+// The first parse() of `input` after the process-wide ANTLR caches are
+// cleared, with or without warmUpParser() in between; parse_and_lower fields
+// stay 0. Measures what the first program after a restart costs.
+BenchScenarioResult runFirstParseScenario(const std::string &name,
+                                          const std::string &input,
+                                          int iterations, bool warm_up) {
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = countLines(input);
+  result.bytes = input.size();
+  result.iterations = iterations;
+
+  double parse_total_ms = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    gcode::clearParserCaches();
+    if (warm_up) {
+      gcode::warmUpParser();
+    }
+    const auto parse_start = std::chrono::steady_clock::now();
+    const auto parsed = gcode::parse(input);
+    const auto parse_end = std::chrono::steady_clock::now();
+    parse_total_ms +=
+        std::chrono::duration<double, std::milli>(parse_end - parse_start)
+            .count();
+    if (!parsed.diagnostics.empty()) {
+      std::cerr << "benchmark warning: parse diagnostics count="
+                << parsed.diagnostics.size() << "\n";
+    }
+  }
 
+  result.parse_ms_avg = parse_total_ms / static_cast<double>(iterations);
+  computeRates(&result);
+  return result;
+}
+
+// `threads` threads each parse `input` `iterations` times with a context of
+// their own, after one untimed parse. A round is every thread parsing once:
+// parse_ms_avg is wall time per round and lines/bytes count a whole round, so
+// the rates are aggregate throughput.
+BenchScenarioResult runConcurrentScenario(const std::string &name,
+                                          const std::string &input,
+                                          int iterations, unsigned threads,
+                                          gcode::ParserDfaCache dfa_cache) {
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = countLines(input) * threads;
+  result.bytes = input.size() * threads;
+  result.iterations = iterations;
+  result.threads = threads;
+
+  gcode::ParseOptions options;
+  options.dfa_cache = dfa_cache;
+  std::atomic<unsigned> ready{0};
+  std::vector<double> thread_ms(threads, 0.0);
+  std::vector<size_t> diagnostic_counts(threads, 0);
+  auto work = [&](unsigned index) {
+    gcode::ParserContext context;
+    gcode::parse(input, options, context);
+    ready.fetch_add(1);
+    while (ready.load() < threads) {
+      std::this_thread::yield();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      diagnostic_counts[index] +=
+          gcode::parse(input, options, context).diagnostics.size();
+    }
+    thread_ms[index] = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  };
+  std::vector<std::thread> workers;
+  for (unsigned index = 1; index < threads; ++index) {
+    workers.emplace_back(work, index);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (size_t count : diagnostic_counts) {
+    if (count != 0) {
+      std::cerr << "benchmark warning: parse diagnostics count=" << count
+                << "\n";
+    }
+  }
+
+  result.parse_ms_avg = *std::max_element(thread_ms.begin(), thread_ms.end()) /
+                        static_cast<double>(iterations);
+  computeRates(&result);
+  return result;
+}
+
+// parseCompact() only; the parse_and_lower fields stay 0 because lowering
+// takes a regular Program.
+BenchScenarioResult runCompactParseScenario(const std::string &name,
+                                            const std::string &input,
+                                            int iterations) {
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = countLines(input);
+  result.bytes = input.size();
+  result.iterations = iterations;
+
+  double parse_total_ms = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    const auto parse_start = std::chrono::steady_clock::now();
+    const auto parsed = gcode::parseCompact(input);
+    const auto parse_end = std::chrono::steady_clock::now();
+    parse_total_ms +=
+        std::chrono::duration<double, std::milli>(parse_end - parse_start)
+            .count();
+    if (!parsed.diagnostics.empty()) {
+      std::cerr << "benchmark warning: parse diagnostics count="
+                << parsed.diagnostics.size() << "\n";
+    }
+  }
+
+  result.parse_ms_avg = parse_total_ms / static_cast<double>(iterations);
+  computeRates(&result);
+  return result;
+}
+
+// lowerToAil() with `lower_threads` on a program parsed once up front; the
+// parse fields report that one parse.
+BenchScenarioResult runLowerScenario(const std::string &name,
+                                     const std::string &input, int iterations,
+                                     unsigned lower_threads) {
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = countLines(input);
+  result.bytes = input.size();
+  result.iterations = iterations;
+
+  gcode::ParseOptions parse_options;
+  parse_options.parse_threads = 0;
+  const auto parse_start = std::chrono::steady_clock::now();
+  const auto parsed = gcode::parse(input, parse_options);
+  const auto parse_end = std::chrono::steady_clock::now();
+  result.parse_ms_avg =
+      std::chrono::duration<double, std::milli>(parse_end - parse_start)
+          .count();
+
+  gcode::LowerOptions lower_options;
+  lower_options.lower_threads = lower_threads;
+  double lower_total_ms = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    const auto lower_start = std::chrono::steady_clock::now();
+    const auto lowered =
+        gcode::lowerToAil(parsed.program, parsed.diagnostics, lower_options);
+    const auto lower_end = std::chrono::steady_clock::now();
+    lower_total_ms +=
+        std::chrono::duration<double, std::milli>(lower_end - lower_start)
+            .count();
+    if (!lowered.diagnostics.empty()) {
+      std::cerr << "benchmark warning: lower diagnostics count="
+                << lowered.diagnostics.size() << "\n";
+    }
+  }
+
+  result.lower_ms_avg = lower_total_ms / static_cast<double>(iterations);
+  result.parse_and_lower_ms_avg = result.parse_ms_avg + result.lower_ms_avg;
+  computeRates(&result);
+  return result;
+}
+
+class NullSink : public gcode::IExecutionSink {
+public:
+  void onDiagnostic(const gcode::Diagnostic &) override { ++diagnostics; }
+  void onRejectedLine(const gcode::RejectedLineEvent &) override {}
+  void onModalUpdate(const gcode::ModalUpdateEvent &) override {}
+  void onLinearMove(const gcode::LinearMoveCommand &) override {}
+  void onArcMove(const gcode::ArcMoveCommand &) override {}
+  void onDwell(const gcode::DwellCommand &) override {}
+  void onToolChange(const gcode::ToolChangeCommand &) override {}
+  size_t diagnostics = 0;
+};
+
+class ReadyRuntime : public gcode::IRuntime {
+public:
+  gcode::RuntimeResult<gcode::WaitToken>
+  submitLinearMove(const gcode::LinearMoveCommand &) override {
+    return ready();
+  }
+  gcode::RuntimeResult<gcode::WaitToken>
+  submitArcMove(const gcode::ArcMoveCommand &) override {
+    return ready();
+  }
+  gcode::RuntimeResult<gcode::WaitToken>
+  submitDwell(const gcode::DwellCommand &) override {
+    return ready();
+  }
+  gcode::RuntimeResult<gcode::WaitToken>
+  submitToolChange(const gcode::ToolChangeCommand &) override {
+    return ready();
+  }
+  gcode::RuntimeResult<double> readSystemVariable(std::string_view) override {
+    gcode::RuntimeResult<double> result;
+    result.status = gcode::RuntimeCallStatus::Error;
+    result.error_message = "not available in the benchmark";
+    return result;
+  }
+  gcode::RuntimeResult<gcode::WaitToken>
+  cancelWait(const gcode::WaitToken &) override {
+    return ready();
+  }
+
+private:
+  static gcode::RuntimeResult<gcode::WaitToken> ready() {
+    gcode::RuntimeResult<gcode::WaitToken> result;
+    result.status = gcode::RuntimeCallStatus::Ready;
+    return result;
+  }
+};
+
+class NeverCancelled : public gcode::ICancellation {
+public:
+  bool isCancelled() const override { return false; }
+};
+
+// Feeds `input` to a StreamingExecutionEngine in 4 KB chunks, pumping after
+// each one, then finishes and runs the program to completion;
+// parse_and_lower_ms_avg is the whole run. Programs that keep one batch open
+// (an IF block waiting for its ENDIF) should stream at the same lines per
+// second whatever their length.
+BenchScenarioResult runStreamingScenario(const std::string &name,
+                                         const std::string &input,
+                                         int iterations) {
+  constexpr size_t kChunkBytes = 4096;
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = countLines(input);
+  result.bytes = input.size();
+  result.iterations = iterations;
+
+  double total_ms = 0.0;
+  size_t diagnostic_count = 0;
+  for (int i = 0; i < iterations; ++i) {
+    NullSink sink;
+    ReadyRuntime runtime;
+    NeverCancelled cancellation;
+    const auto start = std::chrono::steady_clock::now();
+    gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+    for (size_t offset = 0; offset < input.size(); offset += kChunkBytes) {
+      engine.pushChunk(std::string_view(input).substr(offset, kChunkBytes));
+      engine.pump();
+    }
+    auto step = engine.finish();
+    while (step.status == gcode::StepStatus::Progress) {
+      step = engine.pump();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    total_ms += std::chrono::duration<double, std::milli>(end - start).count();
+    diagnostic_count += sink.diagnostics;
+    if (step.status != gcode::StepStatus::Completed) {
+      std::cerr << "benchmark warning: " << name << " did not complete\n";
+    }
+  }
+  if (diagnostic_count != 0) {
+    std::cerr << "benchmark warning: diagnostics count=" << diagnostic_count
+              << "\n";
+  }
+
+  result.parse_and_lower_ms_avg = total_ms / static_cast<double>(iterations);
+  computeRates(&result);
+  return result;
+}
+
+size_t heapBytes(const std::string &text) {
+  // Strings beyond the small-string buffer own a heap block.
+  return text.capacity() > std::string().capacity() ? text.capacity() + 1 : 0;
+}
+
+size_t heapBytes(const std::optional<std::string> &text) {
+  return text.has_value() ? heapBytes(*text) : 0;
+}
+
+// Instruction storage plus the heap blocks of source file names and opcode
+// strings; expression pools and diagnostics are left out.
+size_t
+instructionBytes(const std::vector<gcode::AilInstruction> &instructions) {
+  size_t bytes = instructions.capacity() * sizeof(gcode::AilInstruction);
+  for (const auto &instruction : instructions) {
+    bytes += std::visit(
+        [](const auto &inst) {
+          using T = std::decay_t<decltype(inst)>;
+          size_t owned = heapBytes(inst.source.filename);
+          if constexpr (std::is_same_v<T, gcode::AilLinearMoveInstruction>) {
+            owned += heapBytes(inst.modal.code) + heapBytes(inst.opcode);
+          } else if constexpr (std::is_same_v<T,
+                                              gcode::AilArcMoveInstruction> ||
+                               std::is_same_v<T, gcode::AilDwellInstruction>) {
+            owned += heapBytes(inst.modal.code);
+          }
+          return owned;
+        },
+        instruction);
+  }
+  return bytes;
+}
+
+size_t compactInstructionBytes(const gcode::CompactAilResult &result) {
+  size_t bytes =
+      result.instructions.capacity() * sizeof(gcode::CompactAilInstruction) +
+      result.arcs.capacity() * sizeof(gcode::CompactArcGeometry) +
+      result.files.capacity() * sizeof(std::string) +
+      instructionBytes(result.out_of_line);
+  for (const auto &file : result.files) {
+    bytes += heapBytes(file);
+  }
+  return bytes;
+}
+
+// Memory per instruction of lowerToAil() and lowerToCompactAil() for the same
+// program, lowered with a source file name; lower_ms_avg times the compact
+// lowering.
+BenchScenarioResult runAilMemoryScenario(const std::string &name,
+                                         const std::string &input,
+                                         int iterations) {
+  BenchScenarioResult result;
+  result.name = name;
+  result.lines = countLines(input);
+  result.bytes = input.size();
+  result.iterations = iterations;
+
+  const auto parse_start = std::chrono::steady_clock::now();
+  const auto parsed = gcode::parse(input);
+  const auto parse_end = std::chrono::steady_clock::now();
+  result.parse_ms_avg =
+      std::chrono::duration<double, std::milli>(parse_end - parse_start)
+          .count();
+
+  gcode::LowerOptions lower_options;
+  lower_options.filename = "/srv/nc/programs/synthetic_g1_program.mpf";
+  const auto regular =
+      gcode::lowerToAil(parsed.program, parsed.diagnostics, lower_options);
+  const double count =
+      static_cast<double>(std::max<size_t>(regular.instructions.size(), 1));
+  result.ail_bytes_per_instruction =
+      static_cast<double>(instructionBytes(regular.instructions)) / count;
+
+  double lower_total_ms = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    const auto lower_start = std::chrono::steady_clock::now();
+    const auto compact = gcode::lowerToCompactAil(
+        parsed.program, parsed.diagnostics, lower_options);
+    const auto lower_end = std::chrono::steady_clock::now();
+    lower_total_ms +=
+        std::chrono::duration<double, std::milli>(lower_end - lower_start)
+            .count();
+    result.compact_ail_bytes_per_instruction =
+        static_cast<double>(compactInstructionBytes(compact)) / count;
+  }
+
+  result.lower_ms_avg = lower_total_ms / static_cast<double>(iterations);
+  result.parse_and_lower_ms_avg = result.parse_ms_avg + result.lower_ms_avg;
+  computeRates(&result);
   return result;
 }
 
 void writeResultJson(const std::string &out_path,
-                     const BenchScenarioResult &scenario) {
+                     const std::vector<BenchScenarioResult> &scenarios) {
   nlohmann::json j;
   j["schema_version"] = 1;
   j["scenarios"] = nlohmann::json::array();
 
-  nlohmann::json s;
-  s["name"] = scenario.name;
-  s["iterations"] = scenario.iterations;
-  s["lines"] = scenario.lines;
-  s["bytes"] = scenario.bytes;
-  s["parse_ms_avg"] = scenario.parse_ms_avg;
-  s["parse_and_lower_ms_avg"] = scenario.parse_and_lower_ms_avg;
-  s["parse_lines_per_sec"] = scenario.parse_lines_per_sec;
-  s["parse_and_lower_lines_per_sec"] = scenario.parse_and_lower_lines_per_sec;
-  s["parse_bytes_per_sec"] = scenario.parse_bytes_per_sec;
-  s["parse_and_lower_bytes_per_sec"] = scenario.parse_and_lower_bytes_per_sec;
-  j["scenarios"].push_back(s);
+  for (const auto &scenario : scenarios) {
+    nlohmann::json s;
+    s["name"] = scenario.name;
+    s["iterations"] = scenario.iterations;
+    s["lines"] = scenario.lines;
+    s["bytes"] = scenario.bytes;
+    s["parse_ms_avg"] = scenario.parse_ms_avg;
+    s["parse_and_lower_ms_avg"] = scenario.parse_and_lower_ms_avg;
+    s["parse_lines_per_sec"] = scenario.parse_lines_per_sec;
+    s["parse_and_lower_lines_per_sec"] =
+        scenario.parse_and_lower_lines_per_sec;
+    s["parse_bytes_per_sec"] = scenario.parse_bytes_per_sec;
+    s["parse_and_lower_bytes_per_sec"] =
+        scenario.parse_and_lower_bytes_per_sec;
+    if (scenario.threads != 0) {
+      s["threads"] = scenario.threads;
+      s["scaling_efficiency"] = scenario.scaling_efficiency;
+    }
+    if (scenario.lower_ms_avg > 0.0) {
+      s["lower_ms_avg"] = scenario.lower_ms_avg;
+    }
+    if (scenario.ail_bytes_per_instruction > 0.0) {
+      s["ail_bytes_per_instruction"] = scenario.ail_bytes_per_instruction;
+      s["compact_ail_bytes_per_instruction"] =
+          scenario.compact_ail_bytes_per_instruction;
+    }
+    j["scenarios"].push_back(s);
+  }
 
   if (!out_path.empty()) {
     std::filesystem::path output_path(out_path);
@@ -152,8 +673,95 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  const auto scenario =
-      runScenario("synthetic_g1_10k", makeProgram(lines), iterations);
-  writeResultJson(out_path, scenario);
+  const std::string program = makeProgram(lines);
+  const std::string non_numeric_program = makeNonNumericValueProgram(lines);
+  const auto one_line_inputs = makeOneLineInputs(lines);
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  gcode::ParseOptions parallel;
+  parallel.parse_threads = 0;
+  gcode::ParseOptions parallel_antlr_only = antlr_only;
+  parallel_antlr_only.parse_threads = 0;
+
+  std::vector<BenchScenarioResult> scenarios;
+  scenarios.push_back(runScenario("synthetic_g1_10k", program, iterations));
+  scenarios.push_back(runScenario("synthetic_g1_10k_antlr_only", program,
+                                  iterations, antlr_only));
+  scenarios.push_back(runScenario("synthetic_g1_10k_parallel", program,
+                                  iterations, parallel));
+  scenarios.push_back(runScenario("synthetic_g1_10k_antlr_only_parallel",
+                                  program, iterations, parallel_antlr_only));
+  scenarios.push_back(
+      runCompactParseScenario("synthetic_g1_10k_compact", program, iterations));
+  scenarios.push_back(runScenario("synthetic_non_numeric_values_10k",
+                                  non_numeric_program, iterations));
+  scenarios.push_back(runOneLineScenario("mdi_one_line_parses_10k",
+                                         one_line_inputs, iterations));
+
+  // AIL lowering of a 20x larger program on one thread and on every
+  // hardware thread.
+  const std::string lower_program = makeProgram(lines * 20);
+  scenarios.push_back(
+      runLowerScenario("synthetic_g1_200k_lower_ail", lower_program,
+                       iterations, 1));
+  scenarios.push_back(
+      runLowerScenario("synthetic_g1_200k_lower_ail_parallel", lower_program,
+                       iterations, 0));
+  scenarios.push_back(runAilMemoryScenario("synthetic_g1_10k_ail_memory",
+                                           program, iterations));
+
+  // One IF block of 5x and 10x the lines, streamed in chunks: the same rate
+  // for both means each line is parsed and lowered once.
+  scenarios.push_back(runStreamingScenario(
+      "streaming_if_block_50k", makeIfBlockProgram(lines * 5), iterations));
+  scenarios.push_back(runStreamingScenario(
+      "streaming_if_block_100k", makeIfBlockProgram(lines * 10), iterations));
+  // The same for a forward GOTOF whose label arrives with the last chunk.
+  scenarios.push_back(runStreamingScenario("streaming_forward_goto_50k",
+                                           makeForwardGotoProgram(lines * 5),
+                                           iterations));
+  scenarios.push_back(runStreamingScenario("streaming_forward_goto_100k",
+                                           makeForwardGotoProgram(lines * 10),
+                                           iterations));
+
+  // Throughput of 1, 2, 4, ... hardware-concurrency threads parsing at once,
+  // with the shared and the per-context DFA cache.
+  const std::string concurrent_program = makeControlFlowProgram(2000);
+  std::vector<unsigned> thread_counts;
+  const unsigned max_threads =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+  for (const auto &[label, dfa_cache] :
+       {std::make_pair("shared_dfa", gcode::ParserDfaCache::Shared),
+        std::make_pair("per_context_dfa", gcode::ParserDfaCache::PerContext)}) {
+    double one_thread_lines_per_sec = 0.0;
+    for (unsigned threads : thread_counts) {
+      auto scenario = runConcurrentScenario(
+          "control_flow_2k_threads_" + std::to_string(threads) + "_" + label,
+          concurrent_program, iterations, threads, dfa_cache);
+      if (threads == 1) {
+        one_thread_lines_per_sec = scenario.parse_lines_per_sec;
+      }
+      scenario.scaling_efficiency =
+          one_thread_lines_per_sec > 0.0
+              ? scenario.parse_lines_per_sec /
+                    (one_thread_lines_per_sec * threads)
+              : 0.0;
+      scenarios.push_back(scenario);
+    }
+  }
+
+  // These clear the shared ANTLR caches, so they run last.
+  const std::string control_flow_program = makeControlFlowProgram(200);
+  scenarios.push_back(runFirstParseScenario(
+      "control_flow_200_first_parse_cold", control_flow_program, iterations,
+      false));
+  scenarios.push_back(runFirstParseScenario(
+      "control_flow_200_first_parse_warm", control_flow_program, iterations,
+      true));
+  writeResultJson(out_path, scenarios);
   return 0;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -12,6 +13,8 @@
 #include <vector>
 
 #include "gcode/condition_runtime.h"
+#include "gcode/expr_pool.h"
+#include "gcode/gcode_parser.h"
 #include "gcode/lowering_types.h"
 #include "gcode/policy_types.h"
 #include "gcode/runtime_status.h"
@@ -20,6 +23,7 @@ namespace gcode {
 class IExecutionRuntime;
 class IExecutionSink;
 class IRuntime;
+struct LinearMoveCommand;
 enum class RapidInterpolationMode { Linear, NonLinear };
 enum class ToolRadiusCompMode { Off, Left, Right };
 enum class WorkingPlane { XY, ZX, YZ };
@@ -139,10 +143,13 @@ struct AilSubprogramCallInstruction {
 };
 
 // Placeholder variants for upcoming non-motion semantics.
+// Expression operands reference nodes of `expressions`, the pool shared by
+// every instruction of one lowerToAil() call.
 struct AilAssignInstruction {
   SourceInfo source;
   std::string lhs;
-  std::shared_ptr<ExprNode> rhs;
+  ExprIndex rhs = kNoExpr;
+  std::shared_ptr<const ExprPool> expressions;
 };
 
 struct AilLabelInstruction {
@@ -157,9 +164,14 @@ struct AilGotoInstruction {
   std::string target_kind;
 };
 
+// `condition` is kept for condition resolvers; the executor evaluates the
+// comparison operands through `condition_lhs` / `condition_rhs`.
 struct AilBranchIfInstruction {
   SourceInfo source;
   Condition condition;
+  ExprIndex condition_lhs = kNoExpr;
+  ExprIndex condition_rhs = kNoExpr;
+  std::shared_ptr<const ExprPool> expressions;
   AilGotoInstruction then_branch;
   std::optional<AilGotoInstruction> else_branch;
 };
@@ -191,6 +203,70 @@ AilResult lowerToAil(const Program &program,
 
 AilResult parseAndLowerAil(std::string_view input,
                            const LowerOptions &options = {});
+// Parses with `context` instead of the calling thread's context.
+AilResult parseAndLowerAil(std::string_view input, const LowerOptions &options,
+                           ParserContext &context);
+
+// Pull-based lowerToAil(): yields the same instructions one at a time or in
+// batches, lowering the program line by line as they are requested. Only the
+// instructions after an IF block start are held back, until the block's ELSE
+// or ENDIF fixes the target of its branch, so the lookahead is bounded by the
+// longest IF-to-ELSE span instead of by the program. Expression operands still
+// share one ExprPool that grows with the lines lowered so far.
+class AilLowerer {
+public:
+  // `program` must outlive the lowerer.
+  AilLowerer(const Program &program,
+             const std::vector<Diagnostic> &parse_diagnostics,
+             const LowerOptions &options = {});
+  // Parses `input` like parseAndLowerAil() and keeps the parse result.
+  explicit AilLowerer(std::string_view input,
+                      const LowerOptions &options = {});
+  ~AilLowerer();
+  AilLowerer(AilLowerer &&) noexcept;
+  AilLowerer &operator=(AilLowerer &&) noexcept;
+  AilLowerer(const AilLowerer &) = delete;
+  AilLowerer &operator=(const AilLowerer &) = delete;
+
+  // The next instruction; nullopt once the program is exhausted.
+  std::optional<AilInstruction> next();
+  // Appends up to `max_count` instructions to `out`; returns how many. Fewer
+  // than `max_count` means the program is exhausted.
+  size_t nextBatch(std::vector<AilInstruction> *out, size_t max_count);
+  bool done() const;
+
+  // Diagnostics and rejected lines in lowerToAil() order; complete once
+  // done(), covering the lines lowered so far before that.
+  std::vector<Diagnostic> diagnostics() const;
+  const std::vector<RejectedLine> &rejected_lines() const;
+
+  // For programs that arrive in pieces (the streaming engine), instead of
+  // next()/nextBatch(): lowers the lines added to `program` since
+  // construction or the last call, whose parse diagnostics are
+  // `parse_diagnostics`, and stops there without ending the program, so
+  // later lines can still close its IF blocks. Lowering stops for good at a
+  // rejected line.
+  void lowerAppendedLines(const std::vector<Diagnostic> &parse_diagnostics);
+  // IF blocks the lines lowered so far leave without an ENDIF.
+  size_t openIfBlockCount() const;
+  // GOTOF and GOTO jumps among the lines lowerAppendedLines() lowered so far
+  // whose target none of those lines provides; later lines may.
+  size_t unresolvedForwardJumpCount() const;
+  // What lowerToAil() returns for the lines lowered so far, as if the
+  // program ended after them.
+  AilResult snapshot() const;
+  // snapshot() with the instructions assigned to `*instructions`, reusing its
+  // storage, instead of to the result.
+  AilResult snapshot(std::vector<AilInstruction> *instructions) const;
+
+private:
+  // lowerToAil() lowers large programs as chunks of Impl in parallel.
+  friend AilResult lowerToAil(const Program &program,
+                              const std::vector<Diagnostic> &parse_diagnostics,
+                              const LowerOptions &options);
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
 
 enum class ExecutorStatus { Ready, Blocked, Completed, Fault };
 
@@ -226,6 +302,8 @@ struct AilExecutorInitialState {
   std::optional<ToolSelectionState> pending_tool_selection;
   std::optional<ToolSelectionState> selected_tool_selection;
   std::unordered_map<std::string, double> user_variables;
+  // Moves a previous executor left in flight, oldest first.
+  std::vector<WaitToken> motions_in_flight;
 };
 
 struct AilExecutorOptions {
@@ -243,16 +321,57 @@ struct AilExecutorOptions {
   ToolSelectionResolver tool_selection_resolver;
   SubprogramTargetResolver subprogram_target_resolver;
   std::optional<AilExecutorInitialState> initial_state;
+  // Linear and arc moves that may stay Pending in the runtime while later
+  // instructions execute; 1 (or 0) blocks on every pending move. A full
+  // window blocks on the oldest move, and dwells, tool selections and
+  // changes, branches and system-variable reads first wait for every move in
+  // flight. The program can complete with moves still in flight.
+  size_t max_motions_in_flight = 1;
+  // Consecutive linear moves (without system-variable targets) dispatched in
+  // one step through IExecutionSink::onLinearMoveBatch() and
+  // IRuntime::submitLinearMoveBatch(); 1 (or 0) dispatches them one at a
+  // time. The sink then receives exactly the moves the runtime took, so a
+  // move after one that blocks or fails never reaches it.
+  size_t max_linear_move_batch = 1;
 };
 
 class AilExecutor {
 public:
   explicit AilExecutor(std::vector<AilInstruction> instructions,
                        AilExecutorOptions options = {});
+  ~AilExecutor();
 
   const ExecutorState &state() const { return state_; }
   const std::vector<Diagnostic> &diagnostics() const { return diagnostics_; }
 
+  // Starts over on `instructions` as a new executor with the same options and
+  // `initial_state` would, reusing this one's storage, so a caller running
+  // many short programs (the streaming engine) constructs one executor.
+  void reset(std::vector<AilInstruction> instructions,
+             std::optional<AilExecutorInitialState> initial_state);
+  // reset() that swaps `*instructions` in and leaves the previous program in
+  // it, so a caller that refills one vector for every program allocates no
+  // instruction storage once both vectors have grown.
+  void reset(std::vector<AilInstruction> *instructions,
+             std::optional<AilExecutorInitialState> initial_state);
+  // Changes AilExecutorOptions::max_motions_in_flight; moves already in
+  // flight stay, and the next Pending move blocks if the window is full.
+  void setMaxMotionsInFlight(size_t count) {
+    options_.max_motions_in_flight = count;
+  }
+  // Changes AilExecutorOptions::max_linear_move_batch from the next step.
+  void setMaxLinearMoveBatch(size_t count) {
+    options_.max_linear_move_batch = count;
+  }
+  // Appends `instructions` to the program; a completed executor becomes
+  // ready again and continues with the first of them.
+  void append(std::vector<AilInstruction> instructions);
+  // Pending linear and arc moves whose wait tokens have not been notified
+  // yet, oldest first.
+  const std::deque<WaitToken> &motionsInFlight() const {
+    return motions_in_flight_;
+  }
+
   void notifyEvent(const WaitToken &wait_token);
   bool step(int64_t now_ms, IExecutionSink &sink, IExecutionRuntime &runtime);
   bool step(int64_t now_ms, const IExecutionRuntime &runtime);
@@ -280,18 +399,32 @@ private:
   bool dispatchToolChangeAtPc(const SourceInfo &source,
                               const ToolSelectionState &target_selection,
                               IExecutionSink *sink, IRuntime *runtime);
+  size_t linearMoveRunAtPc() const;
+  bool dispatchLinearMoveBatchAtPc(size_t count, IExecutionSink *sink,
+                                   IRuntime *runtime);
+  void resetState(std::optional<AilExecutorInitialState> initial_state);
   bool advanceOneInstruction(int64_t now_ms,
                              const IConditionResolver &resolver);
   bool advanceOneInstruction(int64_t now_ms, const IConditionResolver &resolver,
                              IExecutionSink *sink, IRuntime *runtime);
   void addFault(const SourceInfo &source, const std::string &message);
   void addWarning(const SourceInfo &source, const std::string &message);
+  void indexNewInstructions();
+  bool wakeIfReady(int64_t now_ms);
+  bool addMotionInFlight(const WaitToken &wait_token);
+  bool waitForMotionsInFlight();
 
   std::vector<AilInstruction> instructions_;
+  // Built on the first GOTO or call, then extended as instructions are
+  // appended; `indexed_instructions_` is how many they cover.
   std::unordered_map<std::string, std::vector<size_t>> label_positions_;
   std::unordered_map<int, std::vector<size_t>> line_number_positions_;
+  size_t indexed_instructions_ = 0;
   std::vector<SubprogramCallFrame> call_stack_frames_;
   std::unordered_set<WaitToken, WaitTokenHash> pending_events_;
+  std::deque<WaitToken> motions_in_flight_;
+  // Reused for every linear move batch.
+  std::vector<LinearMoveCommand> linear_move_batch_;
   AilExecutorOptions options_;
   ExecutorState state_;
   std::vector<Diagnostic> diagnostics_;
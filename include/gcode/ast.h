@@ -3,6 +3,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -20,15 +21,89 @@ struct Diagnostic {
   Location location;
 };
 
+// Word heads the parser, semantic rules, and lowering dispatch on, resolved
+// once when a word is built so passes switch on an enum instead of comparing
+// strings. `Other` is any other head; `Unresolved` marks a Word whose symbol
+// was never set (built by hand), which wordSymbol() looks up from `head`.
+enum class WordSymbol : unsigned char {
+  Unresolved,
+  Other,
+  A,
+  B,
+  C,
+  F,
+  G,
+  I,
+  J,
+  K,
+  M,
+  N,
+  P,
+  R,
+  S,
+  T,
+  X,
+  Y,
+  Z,
+  AP,
+  AR,
+  CIP,
+  CR,
+  CT,
+  I1,
+  J1,
+  K1,
+  PROC,
+  RET,
+  RP,
+  RTLIOF,
+  RTLION,
+};
+
+// Symbol of an upper-case head; `Other` for heads not listed above.
+WordSymbol wordSymbolFromHead(std::string_view head);
+
+// Leading number of `text` read like std::stod / std::stoi (leading
+// whitespace skipped, longest numeric prefix used) without throwing:
+// std::nullopt when there is no number or it is out of range.
+std::optional<double> parseNumberPrefix(std::string_view text);
+std::optional<int> parseIntegerPrefix(std::string_view text);
+
 struct Word {
   std::string text;
   std::string head;
+  WordSymbol symbol = WordSymbol::Unresolved;
   std::optional<std::string> value;
+  // `value` read as a number, once when the word is built; see wordNumber().
+  std::optional<double> number;
+  std::optional<int> integer;
+  bool numbers_cached = false;
   bool has_equal = false;
   bool quoted = false;
   Location location;
 };
 
+inline WordSymbol wordSymbol(const Word &word) {
+  return word.symbol != WordSymbol::Unresolved ? word.symbol
+                                               : wordSymbolFromHead(word.head);
+}
+
+// Numeric value of a word. Words built by the parser carry it
+// (`numbers_cached`); any other Word has its `value` parsed on each call.
+inline std::optional<double> wordNumber(const Word &word) {
+  if (word.numbers_cached || !word.value.has_value()) {
+    return word.number;
+  }
+  return parseNumberPrefix(*word.value);
+}
+
+inline std::optional<int> wordInteger(const Word &word) {
+  if (word.numbers_cached || !word.value.has_value()) {
+    return word.integer;
+  }
+  return parseIntegerPrefix(*word.value);
+}
+
 struct Comment {
   std::string text;
   Location location;
@@ -159,6 +234,75 @@ struct EndLoopStatement {
   Location keyword_location;
 };
 
+// A statement line holds exactly one of these in `Line::statement`.
+using Statement =
+    std::variant<Assignment, LabelDefinition, GotoStatement, IfGotoStatement,
+                 IfBlockStartStatement, ElseStatement, EndIfStatement,
+                 WhileStatement, EndWhileStatement, ForStatement,
+                 EndForStatement, RepeatStatement, UntilStatement,
+                 LoopStatement, EndLoopStatement>;
+
+// Optional Statement kept out of line: most lines only carry words, so they
+// pay for one pointer instead of the largest statement. Copies are deep.
+class LineStatement {
+public:
+  LineStatement() = default;
+  LineStatement(const LineStatement &other)
+      : value_(other.value_ ? std::make_unique<Statement>(*other.value_)
+                            : nullptr) {}
+  LineStatement(LineStatement &&other) noexcept = default;
+  LineStatement &operator=(const LineStatement &other) {
+    if (this != &other) {
+      value_ = other.value_ ? std::make_unique<Statement>(*other.value_)
+                            : nullptr;
+    }
+    return *this;
+  }
+  LineStatement &operator=(LineStatement &&other) noexcept = default;
+
+  bool has_value() const { return value_ != nullptr; }
+  const Statement &operator*() const { return *value_; }
+  Statement &operator*() { return *value_; }
+
+  template <typename T> const T *getIf() const {
+    return value_ ? std::get_if<T>(value_.get()) : nullptr;
+  }
+  template <typename T> T *getIf() {
+    return value_ ? std::get_if<T>(value_.get()) : nullptr;
+  }
+
+  template <typename T> T &emplace(T statement) {
+    value_ = std::make_unique<Statement>(std::in_place_type<T>,
+                                         std::move(statement));
+    return std::get<T>(*value_);
+  }
+  void reset() { value_.reset(); }
+
+private:
+  std::unique_ptr<Statement> value_;
+};
+
+// Optional-style view of one statement kind of a Line; empty when the line
+// holds no statement or one of another kind.
+template <typename T> class StatementRef {
+public:
+  explicit StatementRef(T *statement) : statement_(statement) {}
+
+  bool has_value() const { return statement_ != nullptr; }
+  explicit operator bool() const { return has_value(); }
+  T &operator*() const { return *statement_; }
+  T *operator->() const { return statement_; }
+  T &value() const {
+    if (statement_ == nullptr) {
+      throw std::bad_optional_access();
+    }
+    return *statement_;
+  }
+
+private:
+  T *statement_;
+};
+
 struct LineNumber {
   int value = 0;
   Location location;
@@ -172,22 +316,107 @@ struct Line {
   std::optional<Location> block_delete_level_location;
   std::optional<LineNumber> line_number;
   std::vector<LineItem> items;
-  std::optional<Assignment> assignment;
-  std::optional<LabelDefinition> label_definition;
-  std::optional<GotoStatement> goto_statement;
-  std::optional<IfGotoStatement> if_goto_statement;
-  std::optional<IfBlockStartStatement> if_block_start_statement;
-  std::optional<ElseStatement> else_statement;
-  std::optional<EndIfStatement> endif_statement;
-  std::optional<WhileStatement> while_statement;
-  std::optional<EndWhileStatement> endwhile_statement;
-  std::optional<ForStatement> for_statement;
-  std::optional<EndForStatement> endfor_statement;
-  std::optional<RepeatStatement> repeat_statement;
-  std::optional<UntilStatement> until_statement;
-  std::optional<LoopStatement> loop_statement;
-  std::optional<EndLoopStatement> endloop_statement;
+  LineStatement statement;
   int line_index = 0;
+
+  template <typename T> StatementRef<const T> statementOf() const {
+    return StatementRef<const T>(statement.getIf<T>());
+  }
+  template <typename T> StatementRef<T> statementOf() {
+    return StatementRef<T>(statement.getIf<T>());
+  }
+
+  // Per-kind accessors with the interface of the std::optional members Line
+  // used to have: `line.assignment()->lhs`, `line.goto_statement()
+  // .has_value()`, `*line.if_goto_statement()`.
+  StatementRef<const Assignment> assignment() const {
+    return statementOf<Assignment>();
+  }
+  StatementRef<Assignment> assignment() { return statementOf<Assignment>(); }
+  StatementRef<const LabelDefinition> label_definition() const {
+    return statementOf<LabelDefinition>();
+  }
+  StatementRef<LabelDefinition> label_definition() {
+    return statementOf<LabelDefinition>();
+  }
+  StatementRef<const GotoStatement> goto_statement() const {
+    return statementOf<GotoStatement>();
+  }
+  StatementRef<GotoStatement> goto_statement() {
+    return statementOf<GotoStatement>();
+  }
+  StatementRef<const IfGotoStatement> if_goto_statement() const {
+    return statementOf<IfGotoStatement>();
+  }
+  StatementRef<IfGotoStatement> if_goto_statement() {
+    return statementOf<IfGotoStatement>();
+  }
+  StatementRef<const IfBlockStartStatement> if_block_start_statement() const {
+    return statementOf<IfBlockStartStatement>();
+  }
+  StatementRef<IfBlockStartStatement> if_block_start_statement() {
+    return statementOf<IfBlockStartStatement>();
+  }
+  StatementRef<const ElseStatement> else_statement() const {
+    return statementOf<ElseStatement>();
+  }
+  StatementRef<ElseStatement> else_statement() {
+    return statementOf<ElseStatement>();
+  }
+  StatementRef<const EndIfStatement> endif_statement() const {
+    return statementOf<EndIfStatement>();
+  }
+  StatementRef<EndIfStatement> endif_statement() {
+    return statementOf<EndIfStatement>();
+  }
+  StatementRef<const WhileStatement> while_statement() const {
+    return statementOf<WhileStatement>();
+  }
+  StatementRef<WhileStatement> while_statement() {
+    return statementOf<WhileStatement>();
+  }
+  StatementRef<const EndWhileStatement> endwhile_statement() const {
+    return statementOf<EndWhileStatement>();
+  }
+  StatementRef<EndWhileStatement> endwhile_statement() {
+    return statementOf<EndWhileStatement>();
+  }
+  StatementRef<const ForStatement> for_statement() const {
+    return statementOf<ForStatement>();
+  }
+  StatementRef<ForStatement> for_statement() {
+    return statementOf<ForStatement>();
+  }
+  StatementRef<const EndForStatement> endfor_statement() const {
+    return statementOf<EndForStatement>();
+  }
+  StatementRef<EndForStatement> endfor_statement() {
+    return statementOf<EndForStatement>();
+  }
+  StatementRef<const RepeatStatement> repeat_statement() const {
+    return statementOf<RepeatStatement>();
+  }
+  StatementRef<RepeatStatement> repeat_statement() {
+    return statementOf<RepeatStatement>();
+  }
+  StatementRef<const UntilStatement> until_statement() const {
+    return statementOf<UntilStatement>();
+  }
+  StatementRef<UntilStatement> until_statement() {
+    return statementOf<UntilStatement>();
+  }
+  StatementRef<const LoopStatement> loop_statement() const {
+    return statementOf<LoopStatement>();
+  }
+  StatementRef<LoopStatement> loop_statement() {
+    return statementOf<LoopStatement>();
+  }
+  StatementRef<const EndLoopStatement> endloop_statement() const {
+    return statementOf<EndLoopStatement>();
+  }
+  StatementRef<EndLoopStatement> endloop_statement() {
+    return statementOf<EndLoopStatement>();
+  }
 };
 
 struct Program {
@@ -195,9 +424,15 @@ struct Program {
   std::vector<Line> lines;
 };
 
+// ANTLR prediction stage that produced a parse. `None` means every line was
+// handled by the fast block scanner; with several ANTLR segments the latest
+// stage any segment needed is reported.
+enum class ParsePredictionStage { None, Sll, Ll };
+
 struct ParseResult {
   Program program;
   std::vector<Diagnostic> diagnostics;
+  ParsePredictionStage prediction_stage = ParsePredictionStage::None;
 };
 
 } // namespace gcode
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "gcode/ail.h"
+
+namespace gcode {
+
+// Compact form of AilResult for large programs. File names live once in a
+// program-level table and instructions refer to them by id, modal codes are
+// enum-coded, and the geometry of arcs plus the rarely used instruction kinds
+// (tool selection, calls, assignments, labels, branches, ...) are stored out
+// of line, so a CompactAilInstruction is a fraction of an AilInstruction.
+// toAilInstruction() restores the regular form of any instruction.
+
+using AilFileId = uint16_t;
+inline constexpr AilFileId kNoAilFile = 0xFFFF;
+
+struct CompactSourceInfo {
+  int32_t line = 0;
+  int32_t line_number = 0; // valid when has_line_number
+  AilFileId file = kNoAilFile;
+  bool has_line_number = false;
+};
+
+// ModalState::code of the instructions lowerToAil() produces; None is the
+// empty code.
+enum class ModalCode : uint8_t { None, G0, G1, G2, G3, G4 };
+
+struct CompactModalState {
+  ModalGroupId group = ModalGroupId::Motion;
+  ModalCode code = ModalCode::None;
+  bool updates_state = false;
+};
+
+// opcode "G0" (rapid) or "G1", without target system variables.
+struct CompactAilLinearMove {
+  CompactSourceInfo source;
+  CompactModalState modal;
+  bool rapid = false;
+  std::optional<RapidInterpolationMode> rapid_mode_effective;
+  Pose6 target_pose;
+  std::optional<double> feed;
+};
+
+struct CompactArcGeometry {
+  Pose6 target_pose;
+  ArcParams arc;
+  std::optional<double> feed;
+};
+
+struct CompactAilArcMove {
+  CompactSourceInfo source;
+  CompactModalState modal;
+  bool clockwise = true;
+  WorkingPlane plane_effective = WorkingPlane::XY;
+  uint32_t geometry = 0; // index into CompactAilResult::arcs
+};
+
+struct CompactAilDwell {
+  CompactSourceInfo source;
+  CompactModalState modal;
+  DwellMode dwell_mode = DwellMode::Seconds;
+  double dwell_value = 0.0;
+};
+
+struct CompactAilMCode {
+  CompactSourceInfo source;
+  std::optional<int64_t> address_extension;
+  int64_t value = 0;
+};
+
+struct CompactAilRapidTraverseMode {
+  CompactSourceInfo source;
+  RapidInterpolationMode mode = RapidInterpolationMode::Linear;
+};
+
+struct CompactAilToolRadiusComp {
+  CompactSourceInfo source;
+  ToolRadiusCompMode mode = ToolRadiusCompMode::Off;
+};
+
+struct CompactAilWorkingPlane {
+  CompactSourceInfo source;
+  WorkingPlane plane = WorkingPlane::XY;
+};
+
+struct CompactAilToolChange {
+  CompactSourceInfo source;
+  ToolActionTiming timing = ToolActionTiming::DeferredUntilM6;
+};
+
+// Any other instruction, kept in CompactAilResult::out_of_line with its top
+// level `source.filename` cleared.
+struct CompactAilOutOfLine {
+  CompactSourceInfo source;
+  uint32_t index = 0;
+};
+
+using CompactAilInstruction =
+    std::variant<CompactAilLinearMove, CompactAilArcMove, CompactAilDwell,
+                 CompactAilMCode, CompactAilRapidTraverseMode,
+                 CompactAilToolRadiusComp, CompactAilWorkingPlane,
+                 CompactAilToolChange, CompactAilOutOfLine>;
+
+struct CompactAilResult {
+  std::vector<std::string> files; // indexed by AilFileId
+  std::vector<CompactAilInstruction> instructions;
+  std::vector<CompactArcGeometry> arcs;
+  std::vector<AilInstruction> out_of_line;
+  std::vector<Diagnostic> diagnostics;
+  std::vector<RejectedLine> rejected_lines;
+};
+
+// Same instructions, diagnostics and rejected lines as lowerToAil(), lowered
+// in batches so the regular form of the whole program is never held.
+// `options.lower_threads` is ignored.
+CompactAilResult
+lowerToCompactAil(const Program &program,
+                  const std::vector<Diagnostic> &parse_diagnostics,
+                  const LowerOptions &options = {});
+CompactAilResult toCompactAil(const AilResult &result);
+
+// The AilInstruction equal to the one `instruction` was built from.
+AilInstruction toAilInstruction(const CompactAilResult &result,
+                                const CompactAilInstruction &instruction);
+SourceInfo toSourceInfo(const CompactAilResult &result,
+                        const CompactSourceInfo &source);
+
+} // namespace gcode
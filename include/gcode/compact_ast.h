@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "gcode/ast.h"
+#include "gcode/gcode_parser.h"
+
+namespace gcode {
+
+// Compact form of Program for very large inputs. Text fields are views into
+// storage owned by the result (a copy of the input plus upper-cased word
+// heads), the words and comments of all lines share one array, and the node
+// types below are trivially destructible, so building and freeing a result
+// costs a handful of allocations instead of several per word. Only statement
+// lines (statement_lines) are owning Line values. The views stay
+// valid while the result (or a copy of its `text_storage`) is alive.
+
+struct CompactWord {
+  std::string_view text;
+  std::string_view head; // upper-cased, like Word::head
+  WordSymbol symbol = WordSymbol::Other;
+  std::optional<std::string_view> value;
+  std::optional<double> number; // like Word::number
+  std::optional<int> integer;
+  bool has_equal = false;
+  bool quoted = false;
+  Location location;
+};
+
+struct CompactComment {
+  std::string_view text;
+  Location location;
+};
+
+using CompactLineItem = std::variant<CompactWord, CompactComment>;
+
+struct CompactLine {
+  bool block_delete = false;
+  std::optional<Location> block_delete_location;
+  std::optional<int> block_delete_level;
+  std::optional<std::string_view> block_delete_level_raw;
+  std::optional<Location> block_delete_level_location;
+  std::optional<LineNumber> line_number;
+  // The line's items are CompactParseResult::items[first_item] onwards.
+  uint32_t first_item = 0;
+  uint32_t item_count = 0;
+  // Index into CompactParseResult::statement_lines for a line with an
+  // assignment, label, goto, or control-flow statement; -1 otherwise.
+  int32_t statement_index = -1;
+  int line_index = 0;
+};
+
+struct CompactTextStorage;
+
+struct CompactParseResult {
+  std::shared_ptr<const CompactTextStorage> text_storage;
+  std::optional<ProgramName> program_name;
+  std::vector<CompactLine> lines;
+  std::vector<CompactLineItem> items;
+  // Statement members of statement lines, kept in the regular AST form;
+  // their `items` are empty (the items live in `items` above).
+  std::vector<Line> statement_lines;
+  std::vector<Diagnostic> diagnostics;
+  ParsePredictionStage prediction_stage = ParsePredictionStage::None;
+};
+
+// Same lines and diagnostics as parse(), in compact form, counted from
+// `options.first_line` as well. The input is copied once into the result.
+// `options.parse_threads` is ignored.
+CompactParseResult parseCompact(std::string_view input,
+                                const ParseOptions &options);
+CompactParseResult parseCompact(std::string_view input);
+
+// The owning Line equal to what parse() produces for `line`.
+Line toLine(const CompactParseResult &result, const CompactLine &line);
+
+} // namespace gcode
@@ -25,14 +25,8 @@ struct EffectiveModalSnapshot {
   std::optional<ToolSelectionState> selected_tool_selection;
 };
 
-struct PoseTarget {
-  std::optional<double> x;
-  std::optional<double> y;
-  std::optional<double> z;
-  std::optional<double> a;
-  std::optional<double> b;
-  std::optional<double> c;
-};
+// Commands carry the lowered pose type, so building one copies it whole.
+using PoseTarget = Pose6;
 
 struct LinearMoveCommand {
   SourceRef source;
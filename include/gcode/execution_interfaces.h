@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <optional>
 #include <string_view>
 
@@ -18,6 +19,22 @@ public:
   virtual void onArcMove(const ArcMoveCommand &cmd) = 0;
   virtual void onDwell(const DwellCommand &cmd) = 0;
   virtual void onToolChange(const ToolChangeCommand &cmd) = 0;
+  // `count` consecutive linear moves in program order, emitted together when
+  // the executor coalesces them (AilExecutorOptions::max_linear_move_batch).
+  // The default calls onLinearMove() for each.
+  virtual void onLinearMoveBatch(const LinearMoveCommand *cmds,
+                                 size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      onLinearMove(cmds[i]);
+    }
+  }
+};
+
+// Result of submitting several commands in one call: the runtime took the
+// first `submitted` of them, and `last` is the result of the last one taken.
+struct RuntimeBatchResult {
+  size_t submitted = 0;
+  RuntimeResult<WaitToken> last;
 };
 
 class IRuntime {
@@ -32,6 +49,21 @@ public:
   submitToolChange(const ToolChangeCommand &cmd) = 0;
   virtual RuntimeResult<double> readSystemVariable(std::string_view name) = 0;
   virtual RuntimeResult<WaitToken> cancelWait(const WaitToken &token) = 0;
+  // Submits `count` consecutive linear moves in program order, stopping after
+  // the first one whose result is not Ready. The default calls
+  // submitLinearMove() for each.
+  virtual RuntimeBatchResult
+  submitLinearMoveBatch(const LinearMoveCommand *cmds, size_t count) {
+    RuntimeBatchResult result;
+    result.last.status = RuntimeCallStatus::Ready;
+    while (result.submitted < count) {
+      result.last = submitLinearMove(cmds[result.submitted++]);
+      if (result.last.status != RuntimeCallStatus::Ready) {
+        break;
+      }
+    }
+    return result;
+  }
 };
 
 class ICancellation {
@@ -11,6 +11,7 @@
 
 namespace gcode {
 
+class LineBuffer;
 class StreamingExecutionEngine;
 
 class ExecutionSession {
@@ -30,6 +31,15 @@ public:
   void cancel();
 
   bool replaceEditableSuffix(std::string_view replacement_text);
+  // How many submitted moves may stay Pending while later lines run (see
+  // AilExecutorOptions::max_motions_in_flight); the session completes once
+  // the last of them does. Applies from the next line batch.
+  void setMaxMotionsInFlight(size_t count);
+  // How many consecutive linear moves of a line batch reach
+  // IExecutionSink::onLinearMoveBatch() and IRuntime::submitLinearMoveBatch()
+  // in one call (see AilExecutorOptions::max_linear_move_batch). Applies
+  // from the next line batch.
+  void setMaxLinearMoveBatch(size_t count);
 
   EngineState state() const { return state_; }
   std::optional<int> rejectedLine() const;
@@ -50,13 +60,15 @@ private:
   std::unique_ptr<StreamingExecutionEngine> engine_;
   std::vector<std::string> locked_prefix_lines_;
   std::deque<std::string> editable_lines_;
-  std::string input_buffer_;
+  std::unique_ptr<LineBuffer> input_;
   bool input_finished_ = false;
   bool engine_dirty_ = false;
   EngineState state_ = EngineState::AcceptingInput;
   std::optional<RejectedState> rejected_;
   AilExecutorInitialState prefix_state_;
   size_t in_flight_line_count_ = 0;
+  size_t max_motions_in_flight_ = 1;
+  size_t max_linear_move_batch_ = 1;
 };
 
 } // namespace gcode
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "gcode/ast.h"
+
+namespace gcode {
+
+enum class ExprOp : unsigned char {
+  Literal,
+  Variable,
+  Plus,     // unary +
+  Negate,   // unary -
+  Add,
+  Subtract,
+  Multiply,
+  Divide,
+  UnknownUnary,  // operator spelling kept in the node's text
+  UnknownBinary, // operator spelling kept in the node's text
+  Missing,       // null operand of a hand-built tree
+};
+
+using ExprIndex = uint32_t;
+inline constexpr ExprIndex kNoExpr = std::numeric_limits<ExprIndex>::max();
+
+struct ExprPoolNode {
+  ExprOp op = ExprOp::Literal;
+  bool is_system = false;
+  // Operands; a unary node uses `lhs`.
+  ExprIndex lhs = kNoExpr;
+  ExprIndex rhs = kNoExpr;
+  // First node of the subtree rooted here (the node itself for leaves).
+  ExprIndex first = 0;
+  // Variable name or unknown operator spelling, and the upper-cased variable
+  // name used as user-variable key; indices into the pool's texts. Equal
+  // texts share one index.
+  uint32_t text = 0;
+  uint32_t key = 0;
+  double value = 0.0;
+  Location location;
+};
+
+// Expressions of one program stored contiguously. Nodes are appended in
+// post-order (left operand subtree, right operand subtree, node), so every
+// subtree occupies the index range [node.first, root] and can be evaluated by
+// one forward scan.
+class ExprPool {
+public:
+  // Appends the tree and returns the index of its root; kNoExpr for null.
+  ExprIndex add(const std::shared_ptr<ExprNode> &expr);
+  // Appends every node of `other`; its node i becomes node i + the returned
+  // offset here. Its texts are interned into this pool.
+  ExprIndex merge(const ExprPool &other);
+
+  const ExprPoolNode &node(ExprIndex index) const { return nodes_[index]; }
+  const std::string &text(uint32_t index) const { return texts_[index]; }
+  // "+", "-", "*", "/" or the spelling of an unknown operator.
+  std::string_view opText(const ExprPoolNode &node) const;
+  size_t size() const { return nodes_.size(); }
+
+private:
+  ExprIndex append(const ExprNode *expr);
+  uint32_t addText(std::string_view text);
+
+  std::vector<ExprPoolNode> nodes_;
+  std::vector<std::string> texts_;
+  std::unordered_map<std::string, uint32_t> text_indices_;
+};
+
+} // namespace gcode
@@ -1,18 +1,87 @@
 #pragma once
 
+#include <memory>
 #include <string_view>
+#include <vector>
 
 #include "gcode/ast.h"
 
 namespace gcode {
 
+// SllThenLl first parses with SLL prediction and a bail-out error strategy
+// and re-parses with full LL only when that fails; Ll always uses full LL.
+// Results and diagnostics are the same in both modes.
+enum class ParsePredictionMode { SllThenLl, Ll };
+
+// Where ANTLR keeps the prediction DFA it builds while parsing. Shared: one
+// process-wide cache that every parse fills and reads; it warms up fastest
+// (see warmUpParser), but concurrent parses contend on its locks. PerContext:
+// each ParserContext, and so each thread parsing without one, keeps a cache of
+// its own; concurrent parses share no parser state, and every cache warms up
+// separately. Results are the same either way.
+enum class ParserDfaCache { Shared, PerContext };
+
 struct ParseOptions {
   bool enable_double_slash_comments = false;
   bool tool_management = false;
   bool enable_iso_m98_calls = false;
+  // Build plain blocks with the hand-written scanner and use ANTLR only for
+  // the remaining lines. The result is identical either way.
+  bool enable_fast_block_path = true;
+  ParsePredictionMode prediction_mode = ParsePredictionMode::SllThenLl;
+  // Threads used to parse and validate large inputs as line-aligned chunks:
+  // 1 works on the calling thread, 0 uses every hardware thread. The program
+  // and diagnostics are identical to a single-threaded parse.
+  unsigned parse_threads = 1;
+  ParserDfaCache dfa_cache = ParserDfaCache::Shared;
+  // Line number of the first line of the input, for callers that parse a
+  // text in pieces (the streaming engine): every line and location in the
+  // result is counted from it.
+  int first_line = 1;
 };
 
+// ANTLR lexer, token stream and parser kept alive between parse() calls, so
+// that many small parses (MDI lines, streamed batches) do not construct them
+// every time. Results are the same as with a fresh context. A context serves
+// one parse at a time; give each thread its own.
+class ParserContext {
+public:
+  ParserContext();
+  ~ParserContext();
+  ParserContext(ParserContext &&) noexcept;
+  ParserContext &operator=(ParserContext &&) noexcept;
+  ParserContext(const ParserContext &) = delete;
+  ParserContext &operator=(const ParserContext &) = delete;
+
+private:
+  friend ParseResult parse(std::string_view input, const ParseOptions &options,
+                           ParserContext &context);
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+// Thread safety: parse(), parseCompact() and parseAndLowerAil() may run on
+// any number of threads at once, as long as no ParserContext is used by two
+// of them at the same time; the overloads without a context use one owned by
+// the calling thread. Inputs are only read. With ParserDfaCache::Shared the
+// threads share ANTLR's process-wide cache (safe, but locked).
+ParseResult parse(std::string_view input, const ParseOptions &options,
+                  ParserContext &context);
+// Uses a context owned by the calling thread.
 ParseResult parse(std::string_view input, const ParseOptions &options);
 ParseResult parse(std::string_view input);
 
+// ANTLR caches its prediction DFA in process-wide state that starts empty, so
+// the first programs after start-up parse slower than later ones. This parses
+// a built-in sample covering every statement form, then `programs`, in each
+// prediction mode and with the fast block path on and off, to fill that cache
+// ahead of time. Results are discarded; later parses return the same results
+// as without a warm-up.
+void warmUpParser(const std::vector<std::string_view> &programs = {});
+
+// Empties the cache again, and the calling thread's PerContext cache,
+// returning the parser to its start-up speed (for measuring cold starts).
+// Must not run while another thread is parsing.
+void clearParserCaches();
+
 } // namespace gcode
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <string>
@@ -18,13 +19,66 @@ struct SourceInfo {
   std::optional<int> line_number;
 };
 
-struct Pose6 {
-  std::optional<double> x;
-  std::optional<double> y;
-  std::optional<double> z;
-  std::optional<double> a;
-  std::optional<double> b;
-  std::optional<double> c;
+// N optional doubles stored as N doubles plus a presence mask, indexed by the
+// enumerators of Key. Absent values read as nullopt and are stored as 0.0.
+template <typename Key, size_t N> class PackedOptionalDoubles {
+  static_assert(N <= 8, "the presence mask is 8 bits");
+
+public:
+  bool has(Key key) const { return ((mask_ >> index(key)) & 1u) != 0; }
+  std::optional<double> get(Key key) const {
+    return has(key) ? std::optional<double>(values_[index(key)])
+                    : std::nullopt;
+  }
+  void set(Key key, std::optional<double> value) {
+    const auto bit = static_cast<uint8_t>(1u << index(key));
+    values_[index(key)] = value.value_or(0.0);
+    mask_ = value.has_value() ? static_cast<uint8_t>(mask_ | bit)
+                              : static_cast<uint8_t>(mask_ & ~bit);
+  }
+  // Bit `i` is set when the value of the i-th enumerator is present.
+  uint8_t mask() const { return mask_; }
+  bool empty() const { return mask_ == 0; }
+
+  bool operator==(const PackedOptionalDoubles &other) const {
+    if (mask_ != other.mask_) {
+      return false;
+    }
+    for (size_t i = 0; i < N; ++i) {
+      if (((mask_ >> i) & 1u) != 0 && values_[i] != other.values_[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator!=(const PackedOptionalDoubles &other) const {
+    return !(*this == other);
+  }
+
+private:
+  static size_t index(Key key) { return static_cast<size_t>(key); }
+
+  double values_[N] = {};
+  uint8_t mask_ = 0;
+};
+
+enum class PoseAxis : uint8_t { X, Y, Z, A, B, C };
+
+// Target of a move: 56 bytes, where six std::optional<double> take 96.
+class Pose6 : public PackedOptionalDoubles<PoseAxis, 6> {
+public:
+  std::optional<double> x() const { return get(PoseAxis::X); }
+  std::optional<double> y() const { return get(PoseAxis::Y); }
+  std::optional<double> z() const { return get(PoseAxis::Z); }
+  std::optional<double> a() const { return get(PoseAxis::A); }
+  std::optional<double> b() const { return get(PoseAxis::B); }
+  std::optional<double> c() const { return get(PoseAxis::C); }
+  void setX(std::optional<double> value) { set(PoseAxis::X, value); }
+  void setY(std::optional<double> value) { set(PoseAxis::Y, value); }
+  void setZ(std::optional<double> value) { set(PoseAxis::Z, value); }
+  void setA(std::optional<double> value) { set(PoseAxis::A, value); }
+  void setB(std::optional<double> value) { set(PoseAxis::B, value); }
+  void setC(std::optional<double> value) { set(PoseAxis::C, value); }
 };
 
 enum class ModalGroupId {
@@ -38,11 +92,19 @@ struct ModalState {
   bool updates_state = false;
 };
 
-struct ArcParams {
-  std::optional<double> i;
-  std::optional<double> j;
-  std::optional<double> k;
-  std::optional<double> r;
+enum class ArcParam : uint8_t { I, J, K, R };
+
+// Arc center offsets and radius: 40 bytes instead of 64.
+class ArcParams : public PackedOptionalDoubles<ArcParam, 4> {
+public:
+  std::optional<double> i() const { return get(ArcParam::I); }
+  std::optional<double> j() const { return get(ArcParam::J); }
+  std::optional<double> k() const { return get(ArcParam::K); }
+  std::optional<double> r() const { return get(ArcParam::R); }
+  void setI(std::optional<double> value) { set(ArcParam::I, value); }
+  void setJ(std::optional<double> value) { set(ArcParam::J, value); }
+  void setK(std::optional<double> value) { set(ArcParam::K, value); }
+  void setR(std::optional<double> value) { set(ArcParam::R, value); }
 };
 
 enum class DwellMode { Seconds, Revolutions };
@@ -52,6 +114,11 @@ struct LowerOptions {
   std::vector<int> active_skip_levels;
   std::optional<ToolChangeMode> tool_change_mode;
   bool enable_iso_m98_calls = false;
+  // Threads used by lowerToMessages(), lowerToMessagesStream() and
+  // lowerToAil() on large programs, which are lowered as line chunks from
+  // precomputed modal-state checkpoints: 1 works on the calling thread, 0
+  // uses every hardware thread. The output is identical to serial lowering.
+  unsigned lower_threads = 1;
 };
 
 struct RejectedLine {
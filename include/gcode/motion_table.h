@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "gcode/ail.h"
+
+namespace gcode {
+
+// Columnar (struct-of-arrays) view of the moves of a lowered program, for
+// batch processing such as preview, limit checks and time estimation. Row r
+// of every column describes the r-th linear or arc move; other instructions
+// have no row. Values are contiguous doubles, so kernels can scan a column
+// without visiting variants or unpacking optionals.
+
+// One optional value per row: `values[r]` is 0.0 where the value is absent,
+// and bit `r % 64` of `present[r / 64]` tells whether it is present.
+struct MotionColumn {
+  std::vector<double> values;
+  std::vector<uint64_t> present;
+
+  bool has(size_t row) const {
+    return ((present[row / 64] >> (row % 64)) & 1u) != 0;
+  }
+  std::optional<double> get(size_t row) const {
+    return has(row) ? std::optional<double>(values[row]) : std::nullopt;
+  }
+  void push(std::optional<double> value);
+  void reserve(size_t rows);
+};
+
+enum class MotionKind : uint8_t {
+  Rapid,
+  Linear,
+  ArcClockwise,
+  ArcCounterClockwise,
+};
+
+// Arc parameters, one entry per arc move; `row` is the arc's MotionTable
+// row, in increasing order.
+struct MotionArcColumns {
+  std::vector<uint32_t> row;
+  std::vector<WorkingPlane> plane;
+  MotionColumn i;
+  MotionColumn j;
+  MotionColumn k;
+  MotionColumn r;
+};
+
+struct MotionTable {
+  std::vector<MotionKind> kind;
+  std::vector<int32_t> source_line;
+  // Index of the row's instruction in AilResult::instructions (or of its
+  // packet in PacketResult::packets).
+  std::vector<uint32_t> instruction;
+  MotionColumn x;
+  MotionColumn y;
+  MotionColumn z;
+  MotionColumn a;
+  MotionColumn b;
+  MotionColumn c;
+  MotionColumn feed;
+  MotionArcColumns arcs;
+
+  size_t size() const { return kind.size(); }
+};
+
+// Rows for the linear and arc moves of `result`; the packet overload is in
+// packet.h.
+MotionTable buildMotionTable(const AilResult &result);
+
+} // namespace gcode
@@ -1,13 +1,17 @@
 #include "gcode/ail.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cmath>
+#include <deque>
+#include <iterator>
 #include <limits>
 #include <optional>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "gcode/execution_runtime.h"
 #include "gcode/gcode_parser.h"
@@ -16,6 +20,7 @@
 #include "execution_instruction_dispatcher.h"
 #include "execution_modal_state.h"
 #include "messages.h"
+#include "parallel_for.h"
 #include "runtime_read_trace.h"
 
 namespace gcode {
@@ -288,43 +293,42 @@ rapidTraverseModeFromWord(const Word &word, const SourceInfo &source) {
     return std::nullopt;
   }
   AilRapidTraverseModeInstruction inst;
-  if (word.head == "RTLION") {
+  switch (wordSymbol(word)) {
+  case WordSymbol::RTLION:
     inst.source = source;
     inst.mode = RapidInterpolationMode::Linear;
     return inst;
-  }
-  if (word.head == "RTLIOF") {
+  case WordSymbol::RTLIOF:
     inst.source = source;
     inst.mode = RapidInterpolationMode::NonLinear;
     return inst;
+  default:
+    return std::nullopt;
   }
-  return std::nullopt;
 }
 
 std::optional<AilToolRadiusCompInstruction>
 toolRadiusCompFromWord(const Word &word, const SourceInfo &source) {
-  if (word.head != "G" || !word.value.has_value()) {
+  if (wordSymbol(word) != WordSymbol::G || !word.value.has_value()) {
     return std::nullopt;
   }
 
-  int code = 0;
-  try {
-    code = std::stoi(*word.value);
-  } catch (...) {
+  const auto code = wordInteger(word);
+  if (!code.has_value()) {
     return std::nullopt;
   }
 
   AilToolRadiusCompInstruction inst;
   inst.source = source;
-  if (code == 40) {
+  if (*code == 40) {
     inst.mode = ToolRadiusCompMode::Off;
     return inst;
   }
-  if (code == 41) {
+  if (*code == 41) {
     inst.mode = ToolRadiusCompMode::Left;
     return inst;
   }
-  if (code == 42) {
+  if (*code == 42) {
     inst.mode = ToolRadiusCompMode::Right;
     return inst;
   }
@@ -333,28 +337,26 @@ toolRadiusCompFromWord(const Word &word, const SourceInfo &source) {
 
 std::optional<AilWorkingPlaneInstruction>
 workingPlaneFromWord(const Word &word, const SourceInfo &source) {
-  if (word.head != "G" || !word.value.has_value()) {
+  if (wordSymbol(word) != WordSymbol::G || !word.value.has_value()) {
     return std::nullopt;
   }
 
-  int code = 0;
-  try {
-    code = std::stoi(*word.value);
-  } catch (...) {
+  const auto code = wordInteger(word);
+  if (!code.has_value()) {
     return std::nullopt;
   }
 
   AilWorkingPlaneInstruction inst;
   inst.source = source;
-  if (code == 17) {
+  if (*code == 17) {
     inst.plane = WorkingPlane::XY;
     return inst;
   }
-  if (code == 18) {
+  if (*code == 18) {
     inst.plane = WorkingPlane::ZX;
     return inst;
   }
-  if (code == 19) {
+  if (*code == 19) {
     inst.plane = WorkingPlane::YZ;
     return inst;
   }
@@ -384,71 +386,63 @@ std::string toUpper(std::string value) {
 
 bool isSystemVariableName(std::string_view name);
 
-bool parseDoubleText(const std::optional<std::string> &text, double *value) {
-  if (!text.has_value()) {
-    return false;
-  }
-  try {
-    *value = std::stod(*text);
+bool isAxisSymbol(WordSymbol symbol) {
+  switch (symbol) {
+  case WordSymbol::X:
+  case WordSymbol::Y:
+  case WordSymbol::Z:
+  case WordSymbol::A:
+  case WordSymbol::B:
+  case WordSymbol::C:
     return true;
-  } catch (...) {
+  default:
     return false;
   }
 }
 
-bool isAxisHead(std::string_view head) {
-  return head == "X" || head == "Y" || head == "Z" || head == "A" ||
-         head == "B" || head == "C";
-}
-
-std::optional<double> *poseAxisByHead(Pose6 *pose, std::string_view head) {
-  if (head == "X") {
-    return &pose->x;
-  }
-  if (head == "Y") {
-    return &pose->y;
-  }
-  if (head == "Z") {
-    return &pose->z;
-  }
-  if (head == "A") {
-    return &pose->a;
-  }
-  if (head == "B") {
-    return &pose->b;
-  }
-  if (head == "C") {
-    return &pose->c;
+std::optional<PoseAxis> poseAxisBySymbol(WordSymbol symbol) {
+  switch (symbol) {
+  case WordSymbol::X:
+    return PoseAxis::X;
+  case WordSymbol::Y:
+    return PoseAxis::Y;
+  case WordSymbol::Z:
+    return PoseAxis::Z;
+  case WordSymbol::A:
+    return PoseAxis::A;
+  case WordSymbol::B:
+    return PoseAxis::B;
+  case WordSymbol::C:
+    return PoseAxis::C;
+  default:
+    return std::nullopt;
   }
-  return nullptr;
 }
 
 std::optional<std::string> *
-axisSystemVariableByHead(AxisSystemVariableRefs *refs, std::string_view head) {
-  if (head == "X") {
+axisSystemVariableBySymbol(AxisSystemVariableRefs *refs, WordSymbol symbol) {
+  switch (symbol) {
+  case WordSymbol::X:
     return &refs->x;
-  }
-  if (head == "Y") {
+  case WordSymbol::Y:
     return &refs->y;
-  }
-  if (head == "Z") {
+  case WordSymbol::Z:
     return &refs->z;
-  }
-  if (head == "A") {
+  case WordSymbol::A:
     return &refs->a;
-  }
-  if (head == "B") {
+  case WordSymbol::B:
     return &refs->b;
-  }
-  if (head == "C") {
+  case WordSymbol::C:
     return &refs->c;
+  default:
+    return nullptr;
   }
-  return nullptr;
 }
 
 std::optional<std::string>
 parseSingleSelectorSystemVariableRef(const Word &word) {
-  if (!isAxisHead(word.head) || !word.has_equal || !word.value.has_value()) {
+  if (!isAxisSymbol(wordSymbol(word)) || !word.has_equal ||
+      !word.value.has_value()) {
     return std::nullopt;
   }
   std::string candidate = toUpper(*word.value);
@@ -482,20 +476,20 @@ void applyLinearMoveAxisValuesFromLine(const Line &line,
       continue;
     }
     const auto &word = std::get<Word>(item);
-    if (!isAxisHead(word.head)) {
+    const WordSymbol symbol = wordSymbol(word);
+    if (!isAxisSymbol(symbol)) {
       continue;
     }
 
-    auto *pose_axis = poseAxisByHead(&inst->target_pose, word.head);
+    const auto pose_axis = poseAxisBySymbol(symbol);
     auto *system_variable =
-        axisSystemVariableByHead(&inst->target_system_variables, word.head);
-    if (pose_axis == nullptr || system_variable == nullptr) {
+        axisSystemVariableBySymbol(&inst->target_system_variables, symbol);
+    if (!pose_axis.has_value() || system_variable == nullptr) {
       continue;
     }
 
-    double parsed = 0.0;
-    if (parseDoubleText(word.value, &parsed)) {
-      *pose_axis = parsed;
+    if (const auto number = wordNumber(word)) {
+      inst->target_pose.set(*pose_axis, *number);
       system_variable->reset();
       continue;
     }
@@ -503,7 +497,7 @@ void applyLinearMoveAxisValuesFromLine(const Line &line,
     const auto parsed_system_variable =
         parseSingleSelectorSystemVariableRef(word);
     if (parsed_system_variable.has_value()) {
-      pose_axis->reset();
+      inst->target_pose.set(*pose_axis, std::nullopt);
       *system_variable = *parsed_system_variable;
     }
   }
@@ -580,75 +574,95 @@ ExpressionEvaluation evaluateSystemVariableName(std::string_view name,
   return makeReadyEvaluation(*result.value);
 }
 
+bool readsSystemVariable(const ExprPool *pool, ExprIndex root) {
+  if (pool == nullptr || root == kNoExpr) {
+    return false;
+  }
+  for (ExprIndex index = pool->node(root).first; index <= root; ++index) {
+    const auto &node = pool->node(index);
+    if (node.op == ExprOp::Variable &&
+        (node.is_system || isSystemVariableName(pool->text(node.text)))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Evaluates the subtree rooted at `root` with one forward scan over its
+// nodes. Operands precede their operator in the pool, so reads and errors
+// happen in the same order as in a recursive left-to-right walk.
 ExpressionEvaluation
-evaluateExpressionNode(const std::shared_ptr<ExprNode> &node,
+evaluateExpressionNode(const ExprPool *pool, ExprIndex root,
                        const std::unordered_map<std::string, double> &variables,
                        IRuntime *runtime, const SourceInfo *source) {
-  if (!node) {
+  if (pool == nullptr || root == kNoExpr) {
     return makeErrorEvaluation("missing expression");
   }
 
-  if (const auto *literal = std::get_if<ExprLiteral>(&node->node)) {
-    return makeReadyEvaluation(literal->value);
-  }
-
-  if (const auto *variable = std::get_if<ExprVariable>(&node->node)) {
-    if (variable->is_system || isSystemVariableName(variable->name)) {
-      return evaluateSystemVariableName(variable->name, runtime, source);
-    }
-
-    const auto it = variables.find(toUpper(variable->name));
-    return makeReadyEvaluation(it == variables.end() ? 0.0 : it->second);
-  }
-
-  if (const auto *unary = std::get_if<ExprUnary>(&node->node)) {
-    const auto operand =
-        evaluateExpressionNode(unary->operand, variables, runtime, source);
-    if (operand.kind != ExpressionEvaluationKind::Ready) {
-      return operand;
-    }
-    if (unary->op == "+") {
-      return makeReadyEvaluation(operand.value);
-    }
-    if (unary->op == "-") {
-      return makeReadyEvaluation(-operand.value);
-    }
-    return makeUnsupportedEvaluation("unsupported unary operator: " +
-                                     unary->op);
+  constexpr size_t kInlineValues = 32;
+  double inline_values[kInlineValues];
+  std::vector<double> heap_values;
+  const ExprIndex first = pool->node(root).first;
+  const size_t count = static_cast<size_t>(root - first) + 1;
+  double *values = inline_values;
+  if (count > kInlineValues) {
+    heap_values.resize(count);
+    values = heap_values.data();
   }
 
-  if (const auto *binary = std::get_if<ExprBinary>(&node->node)) {
-    const auto lhs =
-        evaluateExpressionNode(binary->lhs, variables, runtime, source);
-    if (lhs.kind != ExpressionEvaluationKind::Ready) {
-      return lhs;
-    }
-    const auto rhs =
-        evaluateExpressionNode(binary->rhs, variables, runtime, source);
-    if (rhs.kind != ExpressionEvaluationKind::Ready) {
-      return rhs;
-    }
-
-    if (binary->op == "+") {
-      return makeReadyEvaluation(lhs.value + rhs.value);
-    }
-    if (binary->op == "-") {
-      return makeReadyEvaluation(lhs.value - rhs.value);
-    }
-    if (binary->op == "*") {
-      return makeReadyEvaluation(lhs.value * rhs.value);
+  for (ExprIndex index = first; index <= root; ++index) {
+    const auto &node = pool->node(index);
+    double &value = values[index - first];
+    switch (node.op) {
+    case ExprOp::Literal:
+      value = node.value;
+      break;
+    case ExprOp::Variable: {
+      const auto &name = pool->text(node.text);
+      if (node.is_system || isSystemVariableName(name)) {
+        const auto read = evaluateSystemVariableName(name, runtime, source);
+        if (read.kind != ExpressionEvaluationKind::Ready) {
+          return read;
+        }
+        value = read.value;
+        break;
+      }
+      const auto it = variables.find(pool->text(node.key));
+      value = it == variables.end() ? 0.0 : it->second;
+      break;
     }
-    if (binary->op == "/") {
-      if (rhs.value == 0.0) {
+    case ExprOp::Plus:
+      value = values[node.lhs - first];
+      break;
+    case ExprOp::Negate:
+      value = -values[node.lhs - first];
+      break;
+    case ExprOp::Add:
+      value = values[node.lhs - first] + values[node.rhs - first];
+      break;
+    case ExprOp::Subtract:
+      value = values[node.lhs - first] - values[node.rhs - first];
+      break;
+    case ExprOp::Multiply:
+      value = values[node.lhs - first] * values[node.rhs - first];
+      break;
+    case ExprOp::Divide:
+      if (values[node.rhs - first] == 0.0) {
         return makeErrorEvaluation("division by zero in expression");
       }
-      return makeReadyEvaluation(lhs.value / rhs.value);
+      value = values[node.lhs - first] / values[node.rhs - first];
+      break;
+    case ExprOp::UnknownUnary:
+      return makeUnsupportedEvaluation("unsupported unary operator: " +
+                                       std::string(pool->opText(node)));
+    case ExprOp::UnknownBinary:
+      return makeUnsupportedEvaluation("unsupported binary operator: " +
+                                       std::string(pool->opText(node)));
+    case ExprOp::Missing:
+      return makeErrorEvaluation("missing expression");
     }
-    return makeUnsupportedEvaluation("unsupported binary operator: " +
-                                     binary->op);
   }
-
-  return makeUnsupportedEvaluation("unsupported expression form");
+  return makeReadyEvaluation(values[count - 1]);
 }
 
 struct LinearMoveResolution {
@@ -665,14 +679,14 @@ resolveLinearMoveInstruction(const AilLinearMoveInstruction &inst,
   resolution.instruction = inst;
 
   auto resolve_axis = [&](const std::optional<std::string> &system_variable,
-                          std::optional<double> *axis) -> bool {
+                          PoseAxis axis) -> bool {
     if (!system_variable.has_value()) {
       return true;
     }
     const auto value =
         evaluateSystemVariableName(*system_variable, runtime, &inst.source);
     if (value.kind == ExpressionEvaluationKind::Ready) {
-      *axis = value.value;
+      resolution.instruction.target_pose.set(axis, value.value);
       return true;
     }
     resolution.kind = value.kind;
@@ -682,17 +696,17 @@ resolveLinearMoveInstruction(const AilLinearMoveInstruction &inst,
   };
 
   if (!resolve_axis(inst.target_system_variables.x,
-                    &resolution.instruction.target_pose.x) ||
+                    PoseAxis::X) ||
       !resolve_axis(inst.target_system_variables.y,
-                    &resolution.instruction.target_pose.y) ||
+                    PoseAxis::Y) ||
       !resolve_axis(inst.target_system_variables.z,
-                    &resolution.instruction.target_pose.z) ||
+                    PoseAxis::Z) ||
       !resolve_axis(inst.target_system_variables.a,
-                    &resolution.instruction.target_pose.a) ||
+                    PoseAxis::A) ||
       !resolve_axis(inst.target_system_variables.b,
-                    &resolution.instruction.target_pose.b) ||
+                    PoseAxis::B) ||
       !resolve_axis(inst.target_system_variables.c,
-                    &resolution.instruction.target_pose.c)) {
+                    PoseAxis::C)) {
     return resolution;
   }
 
@@ -817,7 +831,8 @@ toolChangeFromMCode(const AilMCodeInstruction &mcode) {
 
 std::optional<AilReturnBoundaryInstruction>
 returnBoundaryFromWord(const Word &word, const SourceInfo &source) {
-  if (word.head != "RET" || word.value.has_value() || word.has_equal) {
+  if (wordSymbol(word) != WordSymbol::RET || word.value.has_value() ||
+      word.has_equal) {
     return std::nullopt;
   }
   AilReturnBoundaryInstruction inst;
@@ -838,7 +853,7 @@ returnBoundaryFromMCode(const AilMCodeInstruction &mcode) {
 }
 
 std::optional<int64_t> parseSubprogramRepeatCount(const Word &word) {
-  if (word.head != "P" || !word.value.has_value()) {
+  if (wordSymbol(word) != WordSymbol::P || !word.value.has_value()) {
     return std::nullopt;
   }
   return parseUnsignedInt64Strict(*word.value);
@@ -861,10 +876,14 @@ bool isSubprogramTargetWord(const Word &word) {
       return false;
     }
   }
-  if (word.head == "RET" || word.head == "RTLION" || word.head == "RTLIOF") {
+  switch (wordSymbol(word)) {
+  case WordSymbol::RET:
+  case WordSymbol::RTLION:
+  case WordSymbol::RTLIOF:
     return false;
+  default:
+    return true;
   }
-  return true;
 }
 
 std::string subprogramTargetFromWord(const Word &word) {
@@ -934,8 +953,8 @@ subprogramDeclarationFromLine(const Line &line, const SourceInfo &source) {
   if (words.size() != 2) {
     return std::nullopt;
   }
-  if (words[0]->head != "PROC" || words[0]->value.has_value() ||
-      words[0]->has_equal) {
+  if (wordSymbol(*words[0]) != WordSymbol::PROC ||
+      words[0]->value.has_value() || words[0]->has_equal) {
     return std::nullopt;
   }
   if (!isSubprogramTargetWord(*words[1])) {
@@ -957,7 +976,7 @@ std::optional<Location> malformedProcDeclarationFromLine(const Line &line) {
     }
     words.push_back(&std::get<Word>(item));
   }
-  if (words.empty() || words[0]->head != "PROC") {
+  if (words.empty() || wordSymbol(*words[0]) != WordSymbol::PROC) {
     return std::nullopt;
   }
   if (words[0]->value.has_value() || words[0]->has_equal) {
@@ -1003,11 +1022,12 @@ subprogramCallFromLine(const Line &line, const SourceInfo &source,
   }
 
   const auto is_m98_word = [](const Word &word) {
-    return word.head == "M" && !word.has_equal && word.value.has_value() &&
+    return wordSymbol(word) == WordSymbol::M && !word.has_equal &&
+           word.value.has_value() &&
            *word.value == "98";
   };
   if (options.enable_iso_m98_calls && is_m98_word(*words[0]) &&
-      words[1]->head == "P" && words[1]->value.has_value()) {
+      wordSymbol(*words[1]) == WordSymbol::P && words[1]->value.has_value()) {
     SubprogramCallMatch match;
     match.instruction.source = source;
     match.instruction.target = toUpper(*words[1]->value);
@@ -1070,313 +1090,797 @@ SourceInfo sourceFromLine(const Line &line, const LowerOptions &options) {
   return source;
 }
 
-AilResult lowerToAil(const Program &program,
-                     const std::vector<Diagnostic> &parse_diagnostics,
-                     const LowerOptions &options) {
-  const auto lowered = lowerToMessages(program, parse_diagnostics, options);
+namespace {
 
-  AilResult result;
-  result.diagnostics = lowered.diagnostics;
-  result.rejected_lines = lowered.rejected_lines;
-  result.instructions.reserve(lowered.messages.size() + program.lines.size());
+enum class ControlLineKind { IfBlockStart, Else, EndIf };
 
-  std::unordered_map<int, AilInstruction> message_by_line;
-  for (const auto &message : lowered.messages) {
-    const int line =
-        std::visit([](const auto &msg) { return msg.source.line; }, message);
-    message_by_line.emplace(line, toInstruction(message));
-  }
+// Instructions an IF block start, ELSE or ENDIF line is lowered to: the
+// branch and its then-label, the skip goto and the else-label, or the
+// end-label.
+size_t controlInstructionCount(ControlLineKind kind) {
+  return kind == ControlLineKind::EndIf ? 1 : 2;
+}
 
-  int stop_line = 0;
-  if (!lowered.rejected_lines.empty()) {
-    stop_line = lowered.rejected_lines.front().source.line;
+std::optional<ControlLineKind> controlLineKind(const Line &line) {
+  if (line.if_block_start_statement().has_value()) {
+    return ControlLineKind::IfBlockStart;
+  }
+  if (line.else_statement().has_value()) {
+    return ControlLineKind::Else;
   }
+  if (line.endif_statement().has_value()) {
+    return ControlLineKind::EndIf;
+  }
+  return std::nullopt;
+}
 
-  struct IfLowerContext {
+// Structured IF/ELSE/ENDIF state: numbers the generated __CF_ labels and
+// links each branch to them. A control line's instructions are emitted with
+// empty label names and targets, then resolved here in program order; `at`
+// maps an instruction index to the emitted instruction.
+class IfBlockLowering {
+public:
+  struct OpenBlock {
     size_t branch_index = 0;
     std::string end_label;
+    int line = 0;
     bool has_else = false;
   };
 
-  std::vector<IfLowerContext> if_stack;
-  int generated_label_counter = 0;
-  std::optional<RapidInterpolationMode> current_rapid_mode;
-  WorkingPlane current_working_plane = WorkingPlane::XY;
-  const auto makeInternalLabel = [&](const std::string &prefix) {
-    ++generated_label_counter;
-    return "__CF_" + prefix + "_" + std::to_string(generated_label_counter);
-  };
+  // Returns false, after adding a diagnostic, when the line has no matching
+  // IF; its instructions must then be removed.
+  template <typename At>
+  bool resolve(ControlLineKind kind, size_t index, int line,
+               const Location &keyword_location, At &&at,
+               std::vector<Diagnostic> *diagnostics) {
+    if (kind == ControlLineKind::IfBlockStart) {
+      auto &branch = std::get<AilBranchIfInstruction>(at(index));
+      branch.then_branch.target = makeLabel("IF_THEN");
+      branch.else_branch->target = makeLabel("IF_END");
+      std::get<AilLabelInstruction>(at(index + 1)).name =
+          branch.then_branch.target;
+      open_.push_back({index, branch.else_branch->target, line, false});
+      return true;
+    }
+    const char *keyword = kind == ControlLineKind::Else ? "ELSE" : "ENDIF";
+    if (open_.empty()) {
+      addError(std::string(keyword) + " without matching IF",
+               keyword_location, diagnostics);
+      return false;
+    }
+    auto &block = open_.back();
+    if (kind == ControlLineKind::EndIf) {
+      std::get<AilLabelInstruction>(at(index)).name = block.end_label;
+      open_.pop_back();
+      return true;
+    }
+    if (block.has_else) {
+      addError("duplicate ELSE for IF block", keyword_location, diagnostics);
+      return false;
+    }
+    std::get<AilGotoInstruction>(at(index)).target = block.end_label;
+    const std::string else_label = makeLabel("IF_ELSE");
+    auto &branch = std::get<AilBranchIfInstruction>(at(block.branch_index));
+    if (branch.else_branch.has_value()) {
+      branch.else_branch->target = else_label;
+    }
+    std::get<AilLabelInstruction>(at(index + 1)).name = else_label;
+    block.has_else = true;
+    return true;
+  }
 
-  const auto emitInternalLabel = [&](const std::string &name,
-                                     const SourceInfo &source) {
-    AilLabelInstruction label;
-    label.source = source;
-    label.name = name;
-    result.instructions.push_back(std::move(label));
+  void addMissingEndIfDiagnostics(std::vector<Diagnostic> *diagnostics) {
+    for (const auto &block : open_) {
+      Diagnostic diag;
+      diag.severity = Diagnostic::Severity::Error;
+      diag.message = "missing ENDIF for IF block";
+      diag.location.line = block.line;
+      diag.location.column = 1;
+      diagnostics->push_back(std::move(diag));
+    }
+    open_.clear();
+  }
+
+  const std::vector<OpenBlock> &openBlocks() const { return open_; }
+
+private:
+  std::string makeLabel(const std::string &prefix) {
+    ++label_counter_;
+    return "__CF_" + prefix + "_" + std::to_string(label_counter_);
+  }
+
+  static void addError(std::string message, const Location &location,
+                       std::vector<Diagnostic> *diagnostics) {
+    Diagnostic diag;
+    diag.severity = Diagnostic::Severity::Error;
+    diag.message = std::move(message);
+    diag.location = location;
+    diagnostics->push_back(std::move(diag));
+  }
+
+  std::vector<OpenBlock> open_;
+  int label_counter_ = 0;
+};
+
+} // namespace
+
+struct AilLowerer::Impl {
+  // A control line of a chunk, resolved when the chunks are merged.
+  struct ControlLine {
+    ControlLineKind kind = ControlLineKind::IfBlockStart;
+    size_t instruction = 0;
+    // ail_diagnostics.size() when the line was lowered.
+    size_t ail_diagnostic = 0;
+    int line = 0;
+    Location keyword_location;
   };
 
-  for (const auto &line : program.lines) {
-    if (stop_line != 0 && line.line_index >= stop_line) {
-      break;
+  Impl(const Program *program_in,
+       const std::vector<Diagnostic> &parse_diagnostics,
+       const LowerOptions &options_in)
+      : options(options_in), program(program_in),
+        end_line(program->lines.size()), message_lowerer(options) {
+    lowered.diagnostics = parse_diagnostics;
+  }
+  Impl(ParseResult parsed_in, const LowerOptions &options_in)
+      : options(options_in), parsed(std::move(parsed_in)),
+        program(&parsed->program), end_line(program->lines.size()),
+        message_lowerer(options) {
+    lowered.diagnostics = std::move(parsed->diagnostics);
+  }
+  // One chunk of lowerToAil() with LowerOptions::lower_threads: lines
+  // [chunk.begin, chunk.end) starting from the message working plane
+  // `plane`, with the parse diagnostics of those lines. The incoming rapid
+  // mode, working plane and IF blocks are not known here; see
+  // lowerToAilInChunks().
+  Impl(const Program *program_in, const LineChunk &chunk,
+       std::vector<Diagnostic> chunk_diagnostics, WorkingPlaneState plane,
+       const LowerOptions &options_in)
+      : options(options_in), program(program_in), end_line(chunk.end),
+        message_lowerer(options, plane), next_line(chunk.begin),
+        chunked(true), rapid_mode_known(false), working_plane_known(false) {
+    lowered.diagnostics = std::move(chunk_diagnostics);
+    parse_diagnostic_count = lowered.diagnostics.size();
+  }
+
+  // Instructions at the front of `pending` that no later line can change:
+  // all of them except an IF branch still waiting for its ELSE or ENDIF and
+  // whatever follows it.
+  size_t readyCount() const {
+    size_t ready = pending.size();
+    for (const auto &block : if_blocks.openBlocks()) {
+      if (!block.has_else) {
+        ready = std::min(ready, block.branch_index - emitted);
+      }
     }
+    return ready;
+  }
+
+  // Lowers lines until an instruction is ready or the program is exhausted.
+  bool fill() {
+    while (readyCount() == 0) {
+      if (finished) {
+        return false;
+      }
+      lowerNextLine();
+    }
+    return true;
+  }
+
+  AilInstruction take() {
+    AilInstruction inst = std::move(pending.front());
+    pending.pop_front();
+    ++emitted;
+    return inst;
+  }
+
+  void lowerNextLine() {
+    if (next_line >= end_line) {
+      finish();
+      return;
+    }
+    const Line &line = program->lines[next_line++];
     if (shouldSkipLine(line, options)) {
-      continue;
+      return;
     }
-    if (lineHasError(result.diagnostics, line.line_index)) {
-      continue;
+    lowered.messages.clear();
+    if (!message_lowerer.lowerLine(line, &lowered)) {
+      finish();
+      return;
     }
-    if (line.assignment.has_value()) {
-      if (toUpper(line.assignment->lhs) == "PROC") {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Error;
-        diag.message = "malformed PROC declaration; expected PROC <name>";
-        diag.location = line.assignment->location;
-        result.diagnostics.push_back(std::move(diag));
-        continue;
-      }
-      if (const auto tool_select = toolSelectFromAssignment(
-              *line.assignment, sourceFromLine(line, options), options);
-          tool_select.has_value()) {
-        result.instructions.push_back(*tool_select);
-        continue;
-      }
-      AilAssignInstruction inst;
-      inst.source = sourceFromLine(line, options);
-      inst.lhs = line.assignment->lhs;
-      inst.rhs = line.assignment->rhs;
-      result.instructions.push_back(std::move(inst));
-      continue;
+    std::optional<AilInstruction> motion;
+    if (!lowered.messages.empty()) {
+      motion = toInstruction(lowered.messages.front());
     }
-    if (line.if_block_start_statement.has_value()) {
-      const auto source = sourceFromLine(line, options);
-
-      AilBranchIfInstruction branch;
-      branch.source = source;
-      branch.condition = line.if_block_start_statement->condition;
-      branch.then_branch.source = source;
-      branch.then_branch.opcode = "GOTO";
-      branch.then_branch.target = makeInternalLabel("IF_THEN");
-      branch.then_branch.target_kind = "label";
+    lowerLine(line, std::move(motion));
+  }
 
-      AilGotoInstruction else_branch;
-      else_branch.source = source;
-      else_branch.opcode = "GOTO";
-      else_branch.target = makeInternalLabel("IF_END");
-      else_branch.target_kind = "label";
-      branch.else_branch = std::move(else_branch);
-
-      const size_t branch_index = result.instructions.size();
-      const std::string then_label = branch.then_branch.target;
-      const std::string end_label = branch.else_branch->target;
-      result.instructions.push_back(std::move(branch));
-      emitInternalLabel(then_label, source);
-
-      IfLowerContext ctx;
-      ctx.branch_index = branch_index;
-      ctx.end_label = end_label;
-      if_stack.push_back(std::move(ctx));
-      continue;
+  void finish() {
+    if (!chunked) {
+      if_blocks.addMissingEndIfDiagnostics(&ail_diagnostics);
     }
-    if (line.else_statement.has_value()) {
-      const auto source = sourceFromLine(line, options);
-      if (if_stack.empty()) {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Error;
-        diag.message = "ELSE without matching IF";
-        diag.location = line.else_statement->keyword_location;
-        result.diagnostics.push_back(std::move(diag));
+    finished = true;
+  }
+
+  void addConditionOperands(AilBranchIfInstruction *branch) {
+    branch->condition_lhs = expressions->add(branch->condition.lhs);
+    branch->condition_rhs = expressions->add(branch->condition.rhs);
+    branch->expressions = expressions;
+  }
+
+  void emitInternalLabel(const SourceInfo &source) {
+    AilLabelInstruction label;
+    label.source = source;
+    pending.push_back(std::move(label));
+  }
+
+  // Tracks the GOTOF and GOTO jumps in the instructions lowered since the
+  // last call whose target no instruction lowered so far provides. Jumps of
+  // IF blocks still waiting for their ENDIF have no target yet and are left
+  // to openIfBlockCount().
+  void noteForwardJumps() {
+    const auto resolve = [this](auto *unresolved, const auto &key) {
+      const auto it = unresolved->find(key);
+      if (it != unresolved->end()) {
+        unresolved_forward_jumps -= it->second;
+        unresolved->erase(it);
+      }
+    };
+    for (; scanned_jumps < pending.size(); ++scanned_jumps) {
+      const auto &inst = pending[scanned_jumps];
+      std::visit(
+          [&](const auto &node) {
+            using T = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<T, AilLabelInstruction>) {
+              if (!node.name.empty() && seen_labels.insert(node.name).second) {
+                resolve(&unresolved_labels, node.name);
+              }
+            }
+            if (node.source.line_number.has_value() &&
+                seen_line_numbers.insert(*node.source.line_number).second) {
+              resolve(&unresolved_line_numbers, *node.source.line_number);
+            }
+          },
+          inst);
+      const auto *jump = std::get_if<AilGotoInstruction>(&inst);
+      if (jump == nullptr || jump->target.empty() ||
+          (jump->opcode != "GOTOF" && jump->opcode != "GOTO")) {
         continue;
       }
-      auto &ctx = if_stack.back();
-      if (ctx.has_else) {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Error;
-        diag.message = "duplicate ELSE for IF block";
-        diag.location = line.else_statement->keyword_location;
-        result.diagnostics.push_back(std::move(diag));
+      const bool backward = jump->opcode == "GOTO";
+      if (jump->target_kind == "label") {
+        if (!(backward && seen_labels.count(jump->target) > 0)) {
+          ++unresolved_labels[jump->target];
+          ++unresolved_forward_jumps;
+        }
         continue;
       }
-
-      AilGotoInstruction skip_else;
-      skip_else.source = source;
-      skip_else.opcode = "GOTO";
-      skip_else.target = ctx.end_label;
-      skip_else.target_kind = "label";
-      result.instructions.push_back(std::move(skip_else));
-
-      const std::string else_label = makeInternalLabel("IF_ELSE");
-      auto &branch_inst = std::get<AilBranchIfInstruction>(
-          result.instructions[ctx.branch_index]);
-      if (branch_inst.else_branch.has_value()) {
-        branch_inst.else_branch->target = else_label;
+      std::string_view target = jump->target;
+      if (jump->target_kind == "line_number" && !target.empty() &&
+          (target[0] == 'N' || target[0] == 'n')) {
+        target.remove_prefix(1);
       }
-      emitInternalLabel(else_label, source);
-      ctx.has_else = true;
-      continue;
-    }
-    if (line.endif_statement.has_value()) {
-      const auto source = sourceFromLine(line, options);
-      if (if_stack.empty()) {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Error;
-        diag.message = "ENDIF without matching IF";
-        diag.location = line.endif_statement->keyword_location;
-        result.diagnostics.push_back(std::move(diag));
-        continue;
+      const auto line_number = parseIntegerPrefix(target);
+      if ((jump->target_kind == "line_number" ||
+           jump->target_kind == "number") &&
+          line_number.has_value() &&
+          !(backward && seen_line_numbers.count(*line_number) > 0)) {
+        ++unresolved_line_numbers[*line_number];
+        ++unresolved_forward_jumps;
       }
-      const auto ctx = if_stack.back();
-      if_stack.pop_back();
-      emitInternalLabel(ctx.end_label, source);
-      continue;
     }
-    if (line.label_definition.has_value()) {
-      AilLabelInstruction inst;
-      inst.source = sourceFromLine(line, options);
-      inst.name = line.label_definition->name;
-      result.instructions.push_back(std::move(inst));
-      continue;
+  }
+
+  void lowerControlLine(const Line &line, ControlLineKind kind);
+  void lowerLine(const Line &line, std::optional<AilInstruction> motion);
+
+  LowerOptions options;
+  std::optional<ParseResult> parsed;
+  const Program *program = nullptr;
+  size_t end_line = 0;
+  MessageLineLowerer message_lowerer;
+  // Message lowering state: parse and motion diagnostics, rejected lines,
+  // and the current line's message.
+  MessageResult lowered;
+  size_t parse_diagnostic_count = 0;
+  // Diagnostics of the AIL pass, reported after `lowered.diagnostics`.
+  std::vector<Diagnostic> ail_diagnostics;
+  std::deque<AilInstruction> pending;
+  size_t emitted = 0;
+  size_t next_line = 0;
+  bool finished = false;
+  IfBlockLowering if_blocks;
+  // noteForwardJumps() state: the instructions of `pending` it has seen, the
+  // labels and N numbers among them, and the jumps still missing a target,
+  // counted per target.
+  size_t scanned_jumps = 0;
+  std::unordered_set<std::string> seen_labels;
+  std::unordered_set<int> seen_line_numbers;
+  std::unordered_map<std::string, size_t> unresolved_labels;
+  std::unordered_map<int, size_t> unresolved_line_numbers;
+  size_t unresolved_forward_jumps = 0;
+  std::shared_ptr<ExprPool> expressions = std::make_shared<ExprPool>();
+  std::optional<RapidInterpolationMode> current_rapid_mode;
+  WorkingPlane current_working_plane = WorkingPlane::XY;
+
+  // Chunk mode: control lines are left to the merge, and the G0 and arc
+  // moves lowered before the chunk sets the rapid mode or working plane are
+  // listed for it to patch.
+  bool chunked = false;
+  bool rapid_mode_known = true;
+  bool working_plane_known = true;
+  std::vector<ControlLine> control_lines;
+  std::vector<size_t> rapid_mode_fixups;
+  std::vector<size_t> working_plane_fixups;
+};
+
+void AilLowerer::Impl::lowerControlLine(const Line &line,
+                                        ControlLineKind kind) {
+  const auto source = sourceFromLine(line, options);
+  const size_t index = emitted + pending.size();
+  Location keyword_location;
+  if (kind == ControlLineKind::IfBlockStart) {
+    AilBranchIfInstruction branch;
+    branch.source = source;
+    branch.condition = line.if_block_start_statement()->condition;
+    addConditionOperands(&branch);
+    branch.then_branch.source = source;
+    branch.then_branch.opcode = "GOTO";
+    branch.then_branch.target_kind = "label";
+
+    AilGotoInstruction else_branch;
+    else_branch.source = source;
+    else_branch.opcode = "GOTO";
+    else_branch.target_kind = "label";
+    branch.else_branch = std::move(else_branch);
+    pending.push_back(std::move(branch));
+  } else if (kind == ControlLineKind::Else) {
+    keyword_location = line.else_statement()->keyword_location;
+    AilGotoInstruction skip_else;
+    skip_else.source = source;
+    skip_else.opcode = "GOTO";
+    skip_else.target_kind = "label";
+    pending.push_back(std::move(skip_else));
+  } else {
+    keyword_location = line.endif_statement()->keyword_location;
+  }
+  emitInternalLabel(source);
+
+  if (chunked) {
+    control_lines.push_back(
+        {kind, index, ail_diagnostics.size(), source.line, keyword_location});
+    return;
+  }
+  const auto at = [this](size_t i) -> AilInstruction & {
+    return pending[i - emitted];
+  };
+  if (!if_blocks.resolve(kind, index, source.line, keyword_location, at,
+                         &ail_diagnostics)) {
+    pending.erase(
+        pending.begin() + static_cast<std::ptrdiff_t>(index - emitted),
+        pending.end());
+  }
+}
+
+void AilLowerer::Impl::lowerLine(const Line &line,
+                                 std::optional<AilInstruction> motion) {
+  if (lineHasError(lowered.diagnostics, line.line_index) ||
+      lineHasError(ail_diagnostics, line.line_index)) {
+    return;
+  }
+  if (line.assignment().has_value()) {
+    if (toUpper(line.assignment()->lhs) == "PROC") {
+      Diagnostic diag;
+      diag.severity = Diagnostic::Severity::Error;
+      diag.message = "malformed PROC declaration; expected PROC <name>";
+      diag.location = line.assignment()->location;
+      ail_diagnostics.push_back(std::move(diag));
+      return;
+    }
+    if (const auto tool_select = toolSelectFromAssignment(
+            *line.assignment(), sourceFromLine(line, options), options);
+        tool_select.has_value()) {
+      pending.push_back(*tool_select);
+      return;
+    }
+    AilAssignInstruction inst;
+    inst.source = sourceFromLine(line, options);
+    inst.lhs = line.assignment()->lhs;
+    inst.rhs = expressions->add(line.assignment()->rhs);
+    inst.expressions = expressions;
+    pending.push_back(std::move(inst));
+    return;
+  }
+  if (const auto control = controlLineKind(line); control.has_value()) {
+    lowerControlLine(line, *control);
+    return;
+  }
+  if (line.label_definition().has_value()) {
+    AilLabelInstruction inst;
+    inst.source = sourceFromLine(line, options);
+    inst.name = line.label_definition()->name;
+    pending.push_back(std::move(inst));
+    return;
+  }
+  if (line.goto_statement().has_value()) {
+    AilGotoInstruction inst;
+    inst.source = sourceFromLine(line, options);
+    inst.opcode = line.goto_statement()->opcode;
+    inst.target = line.goto_statement()->target;
+    inst.target_kind = line.goto_statement()->target_kind;
+    pending.push_back(std::move(inst));
+    return;
+  }
+  if (line.if_goto_statement().has_value()) {
+    AilBranchIfInstruction inst;
+    inst.source = sourceFromLine(line, options);
+    inst.condition = line.if_goto_statement()->condition;
+    addConditionOperands(&inst);
+    inst.then_branch.source = inst.source;
+    inst.then_branch.opcode = line.if_goto_statement()->then_branch.opcode;
+    inst.then_branch.target = line.if_goto_statement()->then_branch.target;
+    inst.then_branch.target_kind =
+        line.if_goto_statement()->then_branch.target_kind;
+    if (line.if_goto_statement()->else_branch.has_value()) {
+      AilGotoInstruction else_branch;
+      else_branch.source = inst.source;
+      else_branch.opcode = line.if_goto_statement()->else_branch->opcode;
+      else_branch.target = line.if_goto_statement()->else_branch->target;
+      else_branch.target_kind =
+          line.if_goto_statement()->else_branch->target_kind;
+      inst.else_branch = std::move(else_branch);
+    }
+    pending.push_back(std::move(inst));
+    return;
+  }
+  const auto source = sourceFromLine(line, options);
+  if (const auto malformed_proc = malformedProcDeclarationFromLine(line);
+      malformed_proc.has_value()) {
+    Diagnostic diag;
+    diag.severity = Diagnostic::Severity::Error;
+    diag.message = "malformed PROC declaration; expected PROC <name>";
+    diag.location = *malformed_proc;
+    ail_diagnostics.push_back(std::move(diag));
+    return;
+  }
+  if (const auto decl = subprogramDeclarationFromLine(line, source);
+      decl.has_value()) {
+    pending.push_back(decl->instruction);
+    if (decl->inline_signature.has_value() &&
+        !decl->inline_signature->empty) {
+      Diagnostic diag;
+      diag.severity = Diagnostic::Severity::Warning;
+      diag.message =
+          "PROC signature parameters are not supported yet; inline "
+          "parenthesized suffix is ignored";
+      diag.location = decl->inline_signature->location;
+      ail_diagnostics.push_back(std::move(diag));
+    }
+    return;
+  }
+  if (const auto call = subprogramCallFromLine(line, source, options);
+      call.has_value()) {
+    pending.push_back(call->instruction);
+    if (call->inline_argument.has_value() && !call->inline_argument->empty) {
+      Diagnostic diag;
+      diag.severity = Diagnostic::Severity::Warning;
+      diag.message =
+          "subprogram call arguments are not supported yet; inline "
+          "parenthesized suffix is ignored";
+      diag.location = call->inline_argument->location;
+      ail_diagnostics.push_back(std::move(diag));
     }
-    if (line.goto_statement.has_value()) {
-      AilGotoInstruction inst;
-      inst.source = sourceFromLine(line, options);
-      inst.opcode = line.goto_statement->opcode;
-      inst.target = line.goto_statement->target;
-      inst.target_kind = line.goto_statement->target_kind;
-      result.instructions.push_back(std::move(inst));
+    return;
+  }
+  for (const auto &item : line.items) {
+    if (!std::holds_alternative<Word>(item)) {
       continue;
     }
-    if (line.if_goto_statement.has_value()) {
-      AilBranchIfInstruction inst;
-      inst.source = sourceFromLine(line, options);
-      inst.condition = line.if_goto_statement->condition;
-      inst.then_branch.source = inst.source;
-      inst.then_branch.opcode = line.if_goto_statement->then_branch.opcode;
-      inst.then_branch.target = line.if_goto_statement->then_branch.target;
-      inst.then_branch.target_kind =
-          line.if_goto_statement->then_branch.target_kind;
-      if (line.if_goto_statement->else_branch.has_value()) {
-        AilGotoInstruction else_branch;
-        else_branch.source = inst.source;
-        else_branch.opcode = line.if_goto_statement->else_branch->opcode;
-        else_branch.target = line.if_goto_statement->else_branch->target;
-        else_branch.target_kind =
-            line.if_goto_statement->else_branch->target_kind;
-        inst.else_branch = std::move(else_branch);
-      }
-      result.instructions.push_back(std::move(inst));
+    const auto &word = std::get<Word>(item);
+    const auto rapid_mode = rapidTraverseModeFromWord(word, source);
+    if (rapid_mode.has_value()) {
+      current_rapid_mode = rapid_mode->mode;
+      rapid_mode_known = true;
+      pending.push_back(*rapid_mode);
+    }
+    const auto tool_radius_comp = toolRadiusCompFromWord(word, source);
+    if (tool_radius_comp.has_value()) {
+      pending.push_back(*tool_radius_comp);
+    }
+    const auto working_plane = workingPlaneFromWord(word, source);
+    if (working_plane.has_value()) {
+      current_working_plane = working_plane->plane;
+      working_plane_known = true;
+      pending.push_back(*working_plane);
+    }
+    const auto tool_select = toolSelectFromWord(word, source, options);
+    if (tool_select.has_value()) {
+      pending.push_back(*tool_select);
+    }
+    const auto return_boundary = returnBoundaryFromWord(word, source);
+    if (return_boundary.has_value()) {
+      pending.push_back(*return_boundary);
       continue;
     }
-    const auto source = sourceFromLine(line, options);
-    if (const auto malformed_proc = malformedProcDeclarationFromLine(line);
-        malformed_proc.has_value()) {
-      Diagnostic diag;
-      diag.severity = Diagnostic::Severity::Error;
-      diag.message = "malformed PROC declaration; expected PROC <name>";
-      diag.location = *malformed_proc;
-      result.diagnostics.push_back(std::move(diag));
+    const auto mcode = mCodeFromWord(word, source);
+    if (!mcode.has_value()) {
       continue;
     }
-    if (const auto decl = subprogramDeclarationFromLine(line, source);
-        decl.has_value()) {
-      result.instructions.push_back(decl->instruction);
-      if (decl->inline_signature.has_value() &&
-          !decl->inline_signature->empty) {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Warning;
-        diag.message =
-            "PROC signature parameters are not supported yet; inline "
-            "parenthesized suffix is ignored";
-        diag.location = decl->inline_signature->location;
-        result.diagnostics.push_back(std::move(diag));
-      }
+    const auto return_boundary_mcode = returnBoundaryFromMCode(*mcode);
+    if (return_boundary_mcode.has_value()) {
+      pending.push_back(*return_boundary_mcode);
       continue;
     }
-    if (const auto call = subprogramCallFromLine(line, source, options);
-        call.has_value()) {
-      result.instructions.push_back(call->instruction);
-      if (call->inline_argument.has_value() && !call->inline_argument->empty) {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Warning;
-        diag.message =
-            "subprogram call arguments are not supported yet; inline "
-            "parenthesized suffix is ignored";
-        diag.location = call->inline_argument->location;
-        result.diagnostics.push_back(std::move(diag));
-      }
+    auto tool_change = toolChangeFromMCode(*mcode);
+    if (tool_change.has_value()) {
+      tool_change->timing = timingFromOptions(options);
+      pending.push_back(std::move(*tool_change));
       continue;
     }
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
-        continue;
-      }
-      const auto &word = std::get<Word>(item);
-      const auto rapid_mode = rapidTraverseModeFromWord(word, source);
-      if (rapid_mode.has_value()) {
-        current_rapid_mode = rapid_mode->mode;
-        result.instructions.push_back(*rapid_mode);
-      }
-      const auto tool_radius_comp = toolRadiusCompFromWord(word, source);
-      if (tool_radius_comp.has_value()) {
-        result.instructions.push_back(*tool_radius_comp);
-      }
-      const auto working_plane = workingPlaneFromWord(word, source);
-      if (working_plane.has_value()) {
-        current_working_plane = working_plane->plane;
-        result.instructions.push_back(*working_plane);
-      }
-      const auto tool_select = toolSelectFromWord(word, source, options);
-      if (tool_select.has_value()) {
-        result.instructions.push_back(*tool_select);
+    pending.push_back(*mcode);
+  }
+  if (motion.has_value()) {
+    if (std::holds_alternative<AilLinearMoveInstruction>(*motion)) {
+      auto &linear = std::get<AilLinearMoveInstruction>(*motion);
+      applyLinearMoveAxisValuesFromLine(line, &linear);
+      if (linear.opcode == "G0") {
+        linear.rapid_mode_effective = current_rapid_mode;
+        if (!rapid_mode_known) {
+          rapid_mode_fixups.push_back(emitted + pending.size());
+        }
       }
-      const auto return_boundary = returnBoundaryFromWord(word, source);
-      if (return_boundary.has_value()) {
-        result.instructions.push_back(*return_boundary);
-        continue;
+    } else if (std::holds_alternative<AilArcMoveInstruction>(*motion)) {
+      auto &arc = std::get<AilArcMoveInstruction>(*motion);
+      arc.plane_effective = current_working_plane;
+      if (!working_plane_known) {
+        working_plane_fixups.push_back(emitted + pending.size());
       }
-      const auto mcode = mCodeFromWord(word, source);
-      if (!mcode.has_value()) {
-        continue;
+    }
+    pending.push_back(std::move(*motion));
+  }
+}
+
+AilLowerer::AilLowerer(const Program &program,
+                       const std::vector<Diagnostic> &parse_diagnostics,
+                       const LowerOptions &options)
+    : impl_(std::make_unique<Impl>(&program, parse_diagnostics, options)) {}
+
+AilLowerer::AilLowerer(std::string_view input, const LowerOptions &options) {
+  ParseOptions parse_options;
+  parse_options.enable_iso_m98_calls = options.enable_iso_m98_calls;
+  impl_ = std::make_unique<Impl>(parse(input, parse_options), options);
+}
+
+AilLowerer::~AilLowerer() = default;
+AilLowerer::AilLowerer(AilLowerer &&) noexcept = default;
+AilLowerer &AilLowerer::operator=(AilLowerer &&) noexcept = default;
+
+std::optional<AilInstruction> AilLowerer::next() {
+  if (!impl_->fill()) {
+    return std::nullopt;
+  }
+  return impl_->take();
+}
+
+size_t AilLowerer::nextBatch(std::vector<AilInstruction> *out,
+                             size_t max_count) {
+  size_t count = 0;
+  while (count < max_count && impl_->fill()) {
+    const size_t ready = std::min(impl_->readyCount(), max_count - count);
+    for (size_t i = 0; i < ready; ++i) {
+      out->push_back(impl_->take());
+    }
+    count += ready;
+  }
+  return count;
+}
+
+bool AilLowerer::done() const {
+  return impl_->finished && impl_->pending.empty();
+}
+
+std::vector<Diagnostic> AilLowerer::diagnostics() const {
+  std::vector<Diagnostic> diagnostics = impl_->lowered.diagnostics;
+  diagnostics.insert(diagnostics.end(), impl_->ail_diagnostics.begin(),
+                     impl_->ail_diagnostics.end());
+  return diagnostics;
+}
+
+const std::vector<RejectedLine> &AilLowerer::rejected_lines() const {
+  return impl_->lowered.rejected_lines;
+}
+
+void AilLowerer::lowerAppendedLines(
+    const std::vector<Diagnostic> &parse_diagnostics) {
+  auto &impl = *impl_;
+  impl.lowered.diagnostics.insert(impl.lowered.diagnostics.end(),
+                                  parse_diagnostics.begin(),
+                                  parse_diagnostics.end());
+  impl.end_line = impl.program->lines.size();
+  while (!impl.finished && impl.next_line < impl.end_line) {
+    impl.lowerNextLine();
+  }
+  impl.noteForwardJumps();
+}
+
+size_t AilLowerer::openIfBlockCount() const {
+  return impl_->if_blocks.openBlocks().size();
+}
+
+size_t AilLowerer::unresolvedForwardJumpCount() const {
+  return impl_->unresolved_forward_jumps;
+}
+
+AilResult AilLowerer::snapshot() const {
+  std::vector<AilInstruction> instructions;
+  AilResult result = snapshot(&instructions);
+  result.instructions = std::move(instructions);
+  return result;
+}
+
+AilResult
+AilLowerer::snapshot(std::vector<AilInstruction> *instructions) const {
+  instructions->assign(impl_->pending.begin(), impl_->pending.end());
+  AilResult result;
+  result.diagnostics = diagnostics();
+  if (!impl_->finished) {
+    // finish() would report the blocks still open; leave them open here.
+    IfBlockLowering if_blocks = impl_->if_blocks;
+    if_blocks.addMissingEndIfDiagnostics(&result.diagnostics);
+  }
+  result.rejected_lines = impl_->lowered.rejected_lines;
+  return result;
+}
+
+namespace {
+
+// Points the pool operands of a chunk's instructions into `expressions`,
+// where the chunk's pool starts at `offset`.
+void rebaseExpressions(AilInstruction *inst,
+                       const std::shared_ptr<ExprPool> &chunk_expressions,
+                       const std::shared_ptr<ExprPool> &expressions,
+                       ExprIndex offset) {
+  const auto shift = [offset](ExprIndex *index) {
+    if (*index != kNoExpr) {
+      *index += offset;
+    }
+  };
+  if (auto *assign = std::get_if<AilAssignInstruction>(inst)) {
+    if (assign->expressions == chunk_expressions) {
+      shift(&assign->rhs);
+      assign->expressions = expressions;
+    }
+  } else if (auto *branch = std::get_if<AilBranchIfInstruction>(inst)) {
+    if (branch->expressions == chunk_expressions) {
+      shift(&branch->condition_lhs);
+      shift(&branch->condition_rhs);
+      branch->expressions = expressions;
+    }
+  }
+}
+
+} // namespace
+
+AilResult lowerToAil(const Program &program,
+                     const std::vector<Diagnostic> &parse_diagnostics,
+                     const LowerOptions &options) {
+  const unsigned threads = resolveThreadCount(options.lower_threads);
+  const auto chunks = splitLowerChunks(
+      program, threads > 1 ? threads * kLowerChunksPerThread : 1);
+  if (chunks.size() == 1) {
+    AilLowerer lowerer(program, parse_diagnostics, options);
+    AilResult result;
+    result.instructions.reserve(program.lines.size());
+    lowerer.nextBatch(&result.instructions,
+                      std::numeric_limits<size_t>::max());
+    result.diagnostics = lowerer.diagnostics();
+    result.rejected_lines = lowerer.rejected_lines();
+    return result;
+  }
+
+  // Chunks are lowered in parallel, each starting from the message working
+  // plane planeCheckpoints() computes for it. Everything else a line depends
+  // on (rapid mode, working plane, IF blocks, the expression pool) is
+  // carried through the merge below, which visits the chunks in order.
+  auto chunk_diagnostics =
+      diagnosticsByChunk(parse_diagnostics, program, chunks);
+  const auto planes = planeCheckpoints(program, chunks, options, threads);
+  std::vector<std::unique_ptr<AilLowerer::Impl>> parts(chunks.size());
+  // Chunks after a rejected line are dropped, so they need not be lowered.
+  std::atomic<size_t> first_rejected{chunks.size()};
+  parallelFor(chunks.size(), threads, [&](size_t chunk) {
+    if (chunk > first_rejected.load()) {
+      return;
+    }
+    parts[chunk] = std::make_unique<AilLowerer::Impl>(
+        &program, chunks[chunk], std::move(chunk_diagnostics[chunk]),
+        planes[chunk], options);
+    auto &part = *parts[chunk];
+    while (!part.finished) {
+      part.lowerNextLine();
+    }
+    if (!part.lowered.rejected_lines.empty()) {
+      size_t current = first_rejected.load();
+      while (chunk < current &&
+             !first_rejected.compare_exchange_weak(current, chunk)) {
       }
-      const auto return_boundary_mcode = returnBoundaryFromMCode(*mcode);
-      if (return_boundary_mcode.has_value()) {
-        result.instructions.push_back(*return_boundary_mcode);
-        continue;
+    }
+  });
+
+  AilResult result;
+  result.diagnostics = parse_diagnostics;
+  size_t instruction_count = 0;
+  for (const auto &part : parts) {
+    instruction_count += part ? part->pending.size() : 0;
+  }
+  result.instructions.reserve(instruction_count);
+  std::vector<Diagnostic> ail_diagnostics;
+  const auto expressions = std::make_shared<ExprPool>();
+  IfBlockLowering if_blocks;
+  std::optional<RapidInterpolationMode> rapid_mode;
+  WorkingPlane working_plane = WorkingPlane::XY;
+  const auto at = [&result](size_t i) -> AilInstruction & {
+    return result.instructions[i];
+  };
+  for (auto &part_ptr : parts) {
+    auto &part = *part_ptr;
+    for (const size_t i : part.rapid_mode_fixups) {
+      std::get<AilLinearMoveInstruction>(part.pending[i]).rapid_mode_effective =
+          rapid_mode;
+    }
+    for (const size_t i : part.working_plane_fixups) {
+      std::get<AilArcMoveInstruction>(part.pending[i]).plane_effective =
+          working_plane;
+    }
+    if (part.rapid_mode_known) {
+      rapid_mode = part.current_rapid_mode;
+    }
+    if (part.working_plane_known) {
+      working_plane = part.current_working_plane;
+    }
+    const ExprIndex offset = expressions->merge(*part.expressions);
+    for (auto &inst : part.pending) {
+      rebaseExpressions(&inst, part.expressions, expressions, offset);
+    }
+    result.diagnostics.insert(
+        result.diagnostics.end(),
+        std::make_move_iterator(part.lowered.diagnostics.begin() +
+                                part.parse_diagnostic_count),
+        std::make_move_iterator(part.lowered.diagnostics.end()));
+
+    size_t next_inst = 0;
+    size_t next_diag = 0;
+    const auto flush = [&](size_t inst_end, size_t diag_end) {
+      for (; next_inst < inst_end; ++next_inst) {
+        result.instructions.push_back(std::move(part.pending[next_inst]));
       }
-      auto tool_change = toolChangeFromMCode(*mcode);
-      if (tool_change.has_value()) {
-        tool_change->timing = timingFromOptions(options);
-        result.instructions.push_back(std::move(*tool_change));
-        continue;
+      for (; next_diag < diag_end; ++next_diag) {
+        ail_diagnostics.push_back(std::move(part.ail_diagnostics[next_diag]));
       }
-      result.instructions.push_back(*mcode);
-    }
-    const auto found = message_by_line.find(line.line_index);
-    if (found != message_by_line.end()) {
-      auto lowered_inst = found->second;
-      if (std::holds_alternative<AilLinearMoveInstruction>(lowered_inst)) {
-        auto &linear = std::get<AilLinearMoveInstruction>(lowered_inst);
-        applyLinearMoveAxisValuesFromLine(line, &linear);
-        if (linear.opcode == "G0") {
-          linear.rapid_mode_effective = current_rapid_mode;
-        }
-      } else if (std::holds_alternative<AilArcMoveInstruction>(lowered_inst)) {
-        auto &arc = std::get<AilArcMoveInstruction>(lowered_inst);
-        arc.plane_effective = current_working_plane;
+    };
+    for (const auto &control : part.control_lines) {
+      flush(control.instruction, control.ail_diagnostic);
+      const size_t index = result.instructions.size();
+      flush(control.instruction + controlInstructionCount(control.kind),
+            control.ail_diagnostic);
+      if (!if_blocks.resolve(control.kind, index, control.line,
+                             control.keyword_location, at,
+                             &ail_diagnostics)) {
+        result.instructions.erase(
+            result.instructions.begin() + static_cast<std::ptrdiff_t>(index),
+            result.instructions.end());
       }
-      result.instructions.push_back(std::move(lowered_inst));
+    }
+    flush(part.pending.size(), part.ail_diagnostics.size());
+    if (!part.lowered.rejected_lines.empty()) {
+      result.rejected_lines = std::move(part.lowered.rejected_lines);
+      break;
     }
   }
-
-  for (const auto &ctx : if_stack) {
-    Diagnostic diag;
-    diag.severity = Diagnostic::Severity::Error;
-    diag.message = "missing ENDIF for IF block";
-    const auto &branch =
-        std::get<AilBranchIfInstruction>(result.instructions[ctx.branch_index]);
-    diag.location.line = branch.source.line;
-    diag.location.column = 1;
-    result.diagnostics.push_back(std::move(diag));
-  }
+  if_blocks.addMissingEndIfDiagnostics(&ail_diagnostics);
+  result.diagnostics.insert(result.diagnostics.end(),
+                            std::make_move_iterator(ail_diagnostics.begin()),
+                            std::make_move_iterator(ail_diagnostics.end()));
   return result;
 }
 
@@ -1388,11 +1892,85 @@ AilResult parseAndLowerAil(std::string_view input,
   return lowerToAil(parsed.program, parsed.diagnostics, options);
 }
 
+AilResult parseAndLowerAil(std::string_view input, const LowerOptions &options,
+                           ParserContext &context) {
+  ParseOptions parse_options;
+  parse_options.enable_iso_m98_calls = options.enable_iso_m98_calls;
+  const auto parsed = parse(input, parse_options, context);
+  return lowerToAil(parsed.program, parsed.diagnostics, options);
+}
+
 AilExecutor::AilExecutor(std::vector<AilInstruction> instructions,
                          AilExecutorOptions options)
     : instructions_(std::move(instructions)), options_(std::move(options)) {
   applyExecutionInitialState(&state_, options_.initial_state);
-  for (size_t i = 0; i < instructions_.size(); ++i) {
+  if (options_.initial_state.has_value()) {
+    motions_in_flight_.assign(
+        options_.initial_state->motions_in_flight.begin(),
+        options_.initial_state->motions_in_flight.end());
+  }
+}
+
+AilExecutor::~AilExecutor() = default;
+
+void AilExecutor::reset(
+    std::vector<AilInstruction> instructions,
+    std::optional<AilExecutorInitialState> initial_state) {
+  // Moved element by element, so instructions_ keeps its capacity.
+  instructions_.assign(std::make_move_iterator(instructions.begin()),
+                       std::make_move_iterator(instructions.end()));
+  resetState(std::move(initial_state));
+}
+
+void AilExecutor::reset(
+    std::vector<AilInstruction> *instructions,
+    std::optional<AilExecutorInitialState> initial_state) {
+  instructions_.swap(*instructions);
+  resetState(std::move(initial_state));
+}
+
+void AilExecutor::resetState(
+    std::optional<AilExecutorInitialState> initial_state) {
+  if (indexed_instructions_ > 0) {
+    label_positions_.clear();
+    line_number_positions_.clear();
+    indexed_instructions_ = 0;
+  }
+  call_stack_frames_.clear();
+  pending_events_.clear();
+  motions_in_flight_.clear();
+  diagnostics_.clear();
+  // Keeps the variable map's bucket array for the initial variables; clear()
+  // frees its nodes.
+  auto user_variables = std::move(state_.user_variables);
+  user_variables.clear();
+  state_ = ExecutorState{};
+  state_.user_variables = std::move(user_variables);
+  options_.initial_state = std::move(initial_state);
+  applyExecutionInitialState(&state_, options_.initial_state);
+  if (options_.initial_state.has_value()) {
+    motions_in_flight_.assign(
+        options_.initial_state->motions_in_flight.begin(),
+        options_.initial_state->motions_in_flight.end());
+  }
+}
+
+void AilExecutor::append(std::vector<AilInstruction> instructions) {
+  if (instructions_.empty()) {
+    instructions_ = std::move(instructions);
+  } else {
+    instructions_.insert(instructions_.end(),
+                         std::make_move_iterator(instructions.begin()),
+                         std::make_move_iterator(instructions.end()));
+  }
+  if (state_.status == ExecutorStatus::Completed &&
+      state_.pc < instructions_.size()) {
+    state_.status = ExecutorStatus::Ready;
+  }
+}
+
+void AilExecutor::indexNewInstructions() {
+  for (size_t i = indexed_instructions_; i < instructions_.size(); ++i) {
     const auto &inst = instructions_[i];
     std::visit(
         [i, this](const auto &node) {
@@ -1406,12 +1984,63 @@ AilExecutor::AilExecutor(std::vector<AilInstruction> instructions,
         },
         inst);
   }
+  indexed_instructions_ = instructions_.size();
 }
 
 void AilExecutor::notifyEvent(const WaitToken &wait_token) {
   pending_events_.insert(wait_token);
 }
 
+bool AilExecutor::wakeIfReady(int64_t now_ms) {
+  std::optional<WaitToken> blocked_token;
+  if (state_.status == ExecutorStatus::Blocked && state_.blocked.has_value()) {
+    blocked_token = state_.blocked->wait_token;
+  }
+  if (!wakeBlockedExecutorIfReady(now_ms, &pending_events_, &state_)) {
+    return false;
+  }
+  // Waits on moves in flight are always on the oldest one.
+  if (blocked_token.has_value() && !motions_in_flight_.empty() &&
+      motions_in_flight_.front() == *blocked_token) {
+    motions_in_flight_.pop_front();
+  }
+  while (!motions_in_flight_.empty() &&
+         pending_events_.erase(motions_in_flight_.front()) > 0) {
+    motions_in_flight_.pop_front();
+  }
+  return true;
+}
+
+// A move the runtime returned as Pending: execution continues past it
+// unless that fills the window of moves in flight.
+bool AilExecutor::addMotionInFlight(const WaitToken &wait_token) {
+  motions_in_flight_.push_back(wait_token);
+  if (motions_in_flight_.size() < options_.max_motions_in_flight) {
+    ++state_.pc;
+    return true;
+  }
+  state_.status = ExecutorStatus::Blocked;
+  ExecutorBlockedState blocked;
+  blocked.instruction_index = state_.pc + 1;
+  blocked.wait_token = motions_in_flight_.front();
+  state_.blocked = std::move(blocked);
+  return true;
+}
+
+// Blocks the instruction at pc until no move is in flight, one move at a
+// time; false if none is.
+bool AilExecutor::waitForMotionsInFlight() {
+  if (motions_in_flight_.empty()) {
+    return false;
+  }
+  state_.status = ExecutorStatus::Blocked;
+  ExecutorBlockedState blocked;
+  blocked.instruction_index = state_.pc;
+  blocked.wait_token = motions_in_flight_.front();
+  state_.blocked = std::move(blocked);
+  return true;
+}
+
 void AilExecutor::addFault(const SourceInfo &source,
                            const std::string &message) {
   state_.status = ExecutorStatus::Fault;
@@ -1437,6 +2066,7 @@ void AilExecutor::addWarning(const SourceInfo &source,
 std::optional<size_t>
 AilExecutor::resolveGotoTarget(size_t current_index,
                                const AilGotoInstruction &inst) {
+  indexNewInstructions();
   std::vector<size_t> candidates;
   if (inst.target_kind == "label") {
     auto it = label_positions_.find(inst.target);
@@ -1445,18 +2075,16 @@ AilExecutor::resolveGotoTarget(size_t current_index,
     }
   } else if (inst.target_kind == "line_number" ||
              inst.target_kind == "number") {
-    int line_number = 0;
-    try {
-      if (inst.target_kind == "line_number" && !inst.target.empty() &&
-          (inst.target[0] == 'N' || inst.target[0] == 'n')) {
-        line_number = std::stoi(inst.target.substr(1));
-      } else {
-        line_number = std::stoi(inst.target);
-      }
-    } catch (...) {
+    std::string_view target = inst.target;
+    if (inst.target_kind == "line_number" && !target.empty() &&
+        (target[0] == 'N' || target[0] == 'n')) {
+      target.remove_prefix(1);
+    }
+    const auto line_number = parseIntegerPrefix(target);
+    if (!line_number.has_value()) {
       return std::nullopt;
     }
-    auto it = line_number_positions_.find(line_number);
+    auto it = line_number_positions_.find(*line_number);
     if (it != line_number_positions_.end()) {
       candidates = it->second;
     }
@@ -1571,10 +2199,11 @@ bool AilExecutor::evaluateBranchAtPc(int64_t now_ms,
   ConditionResolution resolved;
   bool used_direct_evaluation = false;
 
-  if (!branch.condition.has_logical_and && branch.condition.lhs &&
-      branch.condition.rhs) {
-    const auto lhs = evaluateExpressionNode(
-        branch.condition.lhs, state_.user_variables, runtime, &branch.source);
+  if (!branch.condition.has_logical_and && branch.expressions &&
+      branch.condition_lhs != kNoExpr && branch.condition_rhs != kNoExpr) {
+    const auto lhs =
+        evaluateExpressionNode(branch.expressions.get(), branch.condition_lhs,
+                               state_.user_variables, runtime, &branch.source);
     if (lhs.kind == ExpressionEvaluationKind::Pending) {
       state_.status = ExecutorStatus::Blocked;
       ExecutorBlockedState blocked;
@@ -1589,8 +2218,9 @@ bool AilExecutor::evaluateBranchAtPc(int64_t now_ms,
       return true;
     }
 
-    const auto rhs = evaluateExpressionNode(
-        branch.condition.rhs, state_.user_variables, runtime, &branch.source);
+    const auto rhs =
+        evaluateExpressionNode(branch.expressions.get(), branch.condition_rhs,
+                               state_.user_variables, runtime, &branch.source);
     if (rhs.kind == ExpressionEvaluationKind::Pending) {
       state_.status = ExecutorStatus::Blocked;
       ExecutorBlockedState blocked;
@@ -1675,8 +2305,13 @@ bool AilExecutor::evaluateBranchAtPc(int64_t now_ms,
 
 bool AilExecutor::handleAssignAtPc(IRuntime *runtime) {
   const auto &assign = std::get<AilAssignInstruction>(instructions_[state_.pc]);
-  const auto value = evaluateExpressionNode(assign.rhs, state_.user_variables,
-                                            runtime, &assign.source);
+  if (readsSystemVariable(assign.expressions.get(), assign.rhs) &&
+      waitForMotionsInFlight()) {
+    return true;
+  }
+  const auto value =
+      evaluateExpressionNode(assign.expressions.get(), assign.rhs,
+                             state_.user_variables, runtime, &assign.source);
   if (value.kind == ExpressionEvaluationKind::Pending) {
     state_.status = ExecutorStatus::Blocked;
     ExecutorBlockedState blocked;
@@ -1891,6 +2526,65 @@ bool AilExecutor::handleToolChangeAtPc(IExecutionSink *sink,
   return true;
 }
 
+size_t AilExecutor::linearMoveRunAtPc() const {
+  size_t count = 0;
+  while (count < options_.max_linear_move_batch &&
+         state_.pc + count < instructions_.size()) {
+    const auto *linear = std::get_if<AilLinearMoveInstruction>(
+        &instructions_[state_.pc + count]);
+    if (linear == nullptr || !linear->target_system_variables.empty()) {
+      break;
+    }
+    ++count;
+  }
+  return count;
+}
+
+bool AilExecutor::dispatchLinearMoveBatchAtPc(size_t count,
+                                              IExecutionSink *sink,
+                                              IRuntime *runtime) {
+  auto &cmds = linear_move_batch_;
+  cmds.clear();
+  for (size_t i = 0; i < count; ++i) {
+    const auto &inst = instructions_[state_.pc + i];
+    const auto &linear = std::get<AilLinearMoveInstruction>(inst);
+    cmds.push_back(buildLinearMoveCommand(
+        linear, linear.source.line,
+        makeExecutionModalState(state_, motionCodeOverrideForDispatch(inst))));
+  }
+  const RuntimeBatchResult result =
+      runtime->submitLinearMoveBatch(cmds.data(), cmds.size());
+  if (result.submitted == 0 || result.submitted > count) {
+    const auto &first =
+        std::get<AilLinearMoveInstruction>(instructions_[state_.pc]);
+    addFault(first.source,
+             "runtime returned an invalid linear move batch count");
+    return true;
+  }
+  // Only the moves the runtime took reach the sink, as on the single-move
+  // path; the rest are dispatched again on a later step.
+  sink->onLinearMoveBatch(cmds.data(), result.submitted);
+
+  // Every move before the last one taken was Ready.
+  state_.pc += result.submitted - 1;
+  const auto &last = instructions_[state_.pc];
+  if (result.last.status == RuntimeCallStatus::Error) {
+    if (result.submitted > 1) {
+      updateMotionCodeAfterDispatch(instructions_[state_.pc - 1], &state_);
+    }
+    addFault(std::get<AilLinearMoveInstruction>(last).source,
+             result.last.error_message);
+    return true;
+  }
+  updateMotionCodeAfterDispatch(last, &state_);
+  if (result.last.status == RuntimeCallStatus::Pending &&
+      result.last.wait_token.has_value()) {
+    return addMotionInFlight(*result.last.wait_token);
+  }
+  ++state_.pc;
+  return true;
+}
+
 bool AilExecutor::advanceOneInstruction(int64_t now_ms,
                                         const IConditionResolver &resolver) {
   return advanceOneInstruction(now_ms, resolver, nullptr, nullptr);
@@ -1921,6 +2615,9 @@ bool AilExecutor::advanceOneInstruction(int64_t now_ms,
     return true;
   }
   if (std::holds_alternative<AilBranchIfInstruction>(inst)) {
+    if (waitForMotionsInFlight()) {
+      return true;
+    }
     return evaluateBranchAtPc(now_ms, resolver, runtime);
   }
   if (std::holds_alternative<AilAssignInstruction>(inst)) {
@@ -1938,6 +2635,12 @@ bool AilExecutor::advanceOneInstruction(int64_t now_ms,
     ++state_.pc;
     return true;
   }
+  if ((std::holds_alternative<AilToolSelectInstruction>(inst) ||
+       std::holds_alternative<AilToolChangeInstruction>(inst) ||
+       std::holds_alternative<AilDwellInstruction>(inst)) &&
+      waitForMotionsInFlight()) {
+    return true;
+  }
   if (std::holds_alternative<AilToolSelectInstruction>(inst)) {
     return handleToolSelectAtPc(sink, runtime);
   }
@@ -1946,8 +2649,15 @@ bool AilExecutor::advanceOneInstruction(int64_t now_ms,
   }
   if (sink != nullptr && runtime != nullptr &&
       std::holds_alternative<AilLinearMoveInstruction>(inst)) {
+    const size_t run = linearMoveRunAtPc();
+    if (run > 1) {
+      return dispatchLinearMoveBatchAtPc(run, sink, runtime);
+    }
     auto linear = std::get<AilLinearMoveInstruction>(inst);
     if (!linear.target_system_variables.empty()) {
+      if (waitForMotionsInFlight()) {
+        return true;
+      }
       const auto resolved = resolveLinearMoveInstruction(linear, runtime);
       if (resolved.kind == ExpressionEvaluationKind::Pending &&
           resolved.wait_token.has_value()) {
@@ -1976,12 +2686,7 @@ bool AilExecutor::advanceOneInstruction(int64_t now_ms,
     }
     if (dispatch_result.status == ExecutionDispatchResult::Status::Blocked &&
         dispatch_result.wait_token.has_value()) {
-      state_.status = ExecutorStatus::Blocked;
-      ExecutorBlockedState blocked;
-      blocked.instruction_index = state_.pc + 1;
-      blocked.wait_token = dispatch_result.wait_token;
-      state_.blocked = blocked;
-      return true;
+      return addMotionInFlight(*dispatch_result.wait_token);
     }
     if (dispatch_result.status == ExecutionDispatchResult::Status::Error) {
       addFault(linear.source, dispatch_result.message);
@@ -2003,6 +2708,11 @@ bool AilExecutor::advanceOneInstruction(int64_t now_ms,
         dispatch_result.status == ExecutionDispatchResult::Status::Blocked) {
       updateMotionCodeAfterDispatch(inst, &state_);
     }
+    if (dispatch_result.status == ExecutionDispatchResult::Status::Blocked &&
+        dispatch_result.wait_token.has_value() &&
+        std::holds_alternative<AilArcMoveInstruction>(inst)) {
+      return addMotionInFlight(*dispatch_result.wait_token);
+    }
     if (dispatch_result.status == ExecutionDispatchResult::Status::Blocked &&
         dispatch_result.wait_token.has_value()) {
       state_.status = ExecutorStatus::Blocked;
@@ -2047,6 +2757,7 @@ bool AilExecutor::advanceOneInstruction(int64_t now_ms,
   }
   if (std::holds_alternative<AilSubprogramCallInstruction>(inst)) {
     const auto &call = std::get<AilSubprogramCallInstruction>(inst);
+    indexNewInstructions();
     const auto resolution =
         options_.subprogram_target_resolver
             ? options_.subprogram_target_resolver(call.target, label_positions_)
@@ -2112,7 +2823,7 @@ bool AilExecutor::step(int64_t now_ms, IExecutionSink &sink,
     return false;
   }
 
-  if (!wakeBlockedExecutorIfReady(now_ms, &pending_events_, &state_)) {
+  if (!wakeIfReady(now_ms)) {
     return false;
   }
 
@@ -2129,7 +2840,7 @@ bool AilExecutor::step(int64_t now_ms, const IConditionResolver &resolver) {
     return false;
   }
 
-  if (!wakeBlockedExecutorIfReady(now_ms, &pending_events_, &state_)) {
+  if (!wakeIfReady(now_ms)) {
     return false;
   }
 
@@ -59,6 +59,41 @@ nlohmann::json exprToJson(const std::shared_ptr<ExprNode> &expr) {
       expr->node);
 }
 
+nlohmann::json exprToJson(const ExprPool *pool, ExprIndex index) {
+  if (pool == nullptr || index == kNoExpr) {
+    return nullptr;
+  }
+  const auto &node = pool->node(index);
+  nlohmann::json j;
+  switch (node.op) {
+  case ExprOp::Missing:
+    return nullptr;
+  case ExprOp::Literal:
+    j["kind"] = "literal";
+    j["value"] = node.value;
+    break;
+  case ExprOp::Variable:
+    j["kind"] = node.is_system ? "system_variable" : "variable";
+    j["name"] = pool->text(node.text);
+    break;
+  case ExprOp::Plus:
+  case ExprOp::Negate:
+  case ExprOp::UnknownUnary:
+    j["kind"] = "unary";
+    j["op"] = pool->opText(node);
+    j["operand"] = exprToJson(pool, node.lhs);
+    break;
+  default:
+    j["kind"] = "binary";
+    j["op"] = pool->opText(node);
+    j["lhs"] = exprToJson(pool, node.lhs);
+    j["rhs"] = exprToJson(pool, node.rhs);
+    break;
+  }
+  j["location"] = locationToJson(node.location);
+  return j;
+}
+
 nlohmann::json optionalDoubleToJson(const std::optional<double> &value) {
   return value.has_value() ? nlohmann::json(*value) : nlohmann::json(nullptr);
 }
@@ -88,21 +123,21 @@ nlohmann::json modalToJson(const ModalState &modal) {
 
 nlohmann::json poseToJson(const Pose6 &pose) {
   nlohmann::json j;
-  j["x"] = optionalDoubleToJson(pose.x);
-  j["y"] = optionalDoubleToJson(pose.y);
-  j["z"] = optionalDoubleToJson(pose.z);
-  j["a"] = optionalDoubleToJson(pose.a);
-  j["b"] = optionalDoubleToJson(pose.b);
-  j["c"] = optionalDoubleToJson(pose.c);
+  j["x"] = optionalDoubleToJson(pose.x());
+  j["y"] = optionalDoubleToJson(pose.y());
+  j["z"] = optionalDoubleToJson(pose.z());
+  j["a"] = optionalDoubleToJson(pose.a());
+  j["b"] = optionalDoubleToJson(pose.b());
+  j["c"] = optionalDoubleToJson(pose.c());
   return j;
 }
 
 nlohmann::json arcToJson(const ArcParams &arc) {
   nlohmann::json j;
-  j["i"] = optionalDoubleToJson(arc.i);
-  j["j"] = optionalDoubleToJson(arc.j);
-  j["k"] = optionalDoubleToJson(arc.k);
-  j["r"] = optionalDoubleToJson(arc.r);
+  j["i"] = optionalDoubleToJson(arc.i());
+  j["j"] = optionalDoubleToJson(arc.j());
+  j["k"] = optionalDoubleToJson(arc.k());
+  j["r"] = optionalDoubleToJson(arc.r());
   return j;
 }
 
@@ -268,7 +303,7 @@ nlohmann::json instructionToJson(const AilInstruction &instruction) {
           j["kind"] = "assign";
           j["source"] = sourceToJson(inst.source);
           j["lhs"] = inst.lhs;
-          j["rhs"] = exprToJson(inst.rhs);
+          j["rhs"] = exprToJson(inst.expressions.get(), inst.rhs);
         } else if constexpr (std::is_same_v<T, AilLabelInstruction>) {
           j["kind"] = "label";
           j["source"] = sourceToJson(inst.source);
@@ -0,0 +1,330 @@
+#include "gcode/compact_ail.h"
+
+#include <type_traits>
+#include <utility>
+
+namespace gcode {
+namespace {
+
+constexpr size_t kCompactLowerBatch = 1024;
+
+std::optional<ModalCode> modalCodeFromText(const std::string &code) {
+  if (code.empty()) {
+    return ModalCode::None;
+  }
+  if (code == "G0") {
+    return ModalCode::G0;
+  }
+  if (code == "G1") {
+    return ModalCode::G1;
+  }
+  if (code == "G2") {
+    return ModalCode::G2;
+  }
+  if (code == "G3") {
+    return ModalCode::G3;
+  }
+  if (code == "G4") {
+    return ModalCode::G4;
+  }
+  return std::nullopt;
+}
+
+const char *modalCodeText(ModalCode code) {
+  switch (code) {
+  case ModalCode::G0:
+    return "G0";
+  case ModalCode::G1:
+    return "G1";
+  case ModalCode::G2:
+    return "G2";
+  case ModalCode::G3:
+    return "G3";
+  case ModalCode::G4:
+    return "G4";
+  case ModalCode::None:
+    break;
+  }
+  return "";
+}
+
+ModalState toModalState(const CompactModalState &modal) {
+  ModalState out;
+  out.group = modal.group;
+  out.code = modalCodeText(modal.code);
+  out.updates_state = modal.updates_state;
+  return out;
+}
+
+class CompactAilBuilder {
+public:
+  explicit CompactAilBuilder(CompactAilResult *result) : result_(result) {}
+
+  // Takes a const AilInstruction & or an AilInstruction &&; only
+  // instructions stored out of line are copied (or moved) whole.
+  template <typename Instruction> void add(Instruction &&instruction) {
+    const bool added = std::visit(
+        [this](const auto &inst) { return addCompact(inst); }, instruction);
+    if (!added) {
+      addOutOfLine(AilInstruction(std::forward<Instruction>(instruction)));
+    }
+  }
+
+private:
+  bool compactSource(const SourceInfo &source, CompactSourceInfo *out) {
+    out->line = source.line;
+    out->has_line_number = source.line_number.has_value();
+    out->line_number = source.line_number.value_or(0);
+    out->file = kNoAilFile;
+    if (!source.filename.has_value()) {
+      return true;
+    }
+    if (last_file_ < result_->files.size() &&
+        result_->files[last_file_] == *source.filename) {
+      out->file = static_cast<AilFileId>(last_file_);
+      return true;
+    }
+    for (size_t i = 0; i < result_->files.size(); ++i) {
+      if (result_->files[i] == *source.filename) {
+        last_file_ = i;
+        out->file = static_cast<AilFileId>(i);
+        return true;
+      }
+    }
+    if (result_->files.size() >= kNoAilFile) {
+      return false;
+    }
+    last_file_ = result_->files.size();
+    result_->files.push_back(*source.filename);
+    out->file = static_cast<AilFileId>(last_file_);
+    return true;
+  }
+
+  bool compactModal(const ModalState &modal, CompactModalState *out) {
+    const auto code = modalCodeFromText(modal.code);
+    if (!code.has_value()) {
+      return false;
+    }
+    out->group = modal.group;
+    out->code = *code;
+    out->updates_state = modal.updates_state;
+    return true;
+  }
+
+  bool push(CompactAilInstruction instruction) {
+    result_->instructions.push_back(std::move(instruction));
+    return true;
+  }
+
+  // Appends the compact form of `inst`; false if it has none.
+  template <typename T> bool addCompact(const T &inst) {
+    if constexpr (std::is_same_v<T, AilLinearMoveInstruction>) {
+      CompactAilLinearMove out;
+      if (!compactSource(inst.source, &out.source) ||
+          !compactModal(inst.modal, &out.modal) ||
+          !inst.target_system_variables.empty() ||
+          (inst.opcode != "G0" && inst.opcode != "G1")) {
+        return false;
+      }
+      out.rapid = inst.opcode == "G0";
+      out.rapid_mode_effective = inst.rapid_mode_effective;
+      out.target_pose = inst.target_pose;
+      out.feed = inst.feed;
+      return push(out);
+    } else if constexpr (std::is_same_v<T, AilArcMoveInstruction>) {
+      CompactAilArcMove out;
+      if (!compactSource(inst.source, &out.source) ||
+          !compactModal(inst.modal, &out.modal)) {
+        return false;
+      }
+      out.clockwise = inst.clockwise;
+      out.plane_effective = inst.plane_effective;
+      out.geometry = static_cast<uint32_t>(result_->arcs.size());
+      result_->arcs.push_back({inst.target_pose, inst.arc, inst.feed});
+      return push(out);
+    } else if constexpr (std::is_same_v<T, AilDwellInstruction>) {
+      CompactAilDwell out;
+      if (!compactSource(inst.source, &out.source) ||
+          !compactModal(inst.modal, &out.modal)) {
+        return false;
+      }
+      out.dwell_mode = inst.dwell_mode;
+      out.dwell_value = inst.dwell_value;
+      return push(out);
+    } else if constexpr (std::is_same_v<T, AilMCodeInstruction>) {
+      CompactAilMCode out;
+      if (!compactSource(inst.source, &out.source)) {
+        return false;
+      }
+      out.address_extension = inst.address_extension;
+      out.value = inst.value;
+      return push(out);
+    } else if constexpr (std::is_same_v<T, AilRapidTraverseModeInstruction>) {
+      CompactAilRapidTraverseMode out;
+      if (compactSource(inst.source, &out.source)) {
+        out.mode = inst.mode;
+        return push(out);
+      }
+    } else if constexpr (std::is_same_v<T, AilToolRadiusCompInstruction>) {
+      CompactAilToolRadiusComp out;
+      if (compactSource(inst.source, &out.source)) {
+        out.mode = inst.mode;
+        return push(out);
+      }
+    } else if constexpr (std::is_same_v<T, AilWorkingPlaneInstruction>) {
+      CompactAilWorkingPlane out;
+      if (compactSource(inst.source, &out.source)) {
+        out.plane = inst.plane;
+        return push(out);
+      }
+    } else if constexpr (std::is_same_v<T, AilToolChangeInstruction>) {
+      CompactAilToolChange out;
+      if (compactSource(inst.source, &out.source)) {
+        out.timing = inst.timing;
+        return push(out);
+      }
+    }
+    return false;
+  }
+
+  void addOutOfLine(AilInstruction instruction) {
+    CompactAilOutOfLine out;
+    out.index = static_cast<uint32_t>(result_->out_of_line.size());
+    auto &source =
+        std::visit([](auto &inst) -> SourceInfo & { return inst.source; },
+                   instruction);
+    if (compactSource(source, &out.source)) {
+      source.filename.reset();
+    }
+    result_->out_of_line.push_back(std::move(instruction));
+    result_->instructions.push_back(out);
+  }
+
+  CompactAilResult *result_;
+  size_t last_file_ = 0;
+};
+
+} // namespace
+
+CompactAilResult
+lowerToCompactAil(const Program &program,
+                  const std::vector<Diagnostic> &parse_diagnostics,
+                  const LowerOptions &options) {
+  CompactAilResult result;
+  // Most lines lower to one instruction.
+  result.instructions.reserve(program.lines.size());
+  CompactAilBuilder builder(&result);
+  AilLowerer lowerer(program, parse_diagnostics, options);
+  std::vector<AilInstruction> batch;
+  batch.reserve(kCompactLowerBatch);
+  while (!lowerer.done()) {
+    batch.clear();
+    lowerer.nextBatch(&batch, kCompactLowerBatch);
+    for (auto &instruction : batch) {
+      builder.add(std::move(instruction));
+    }
+  }
+  result.diagnostics = lowerer.diagnostics();
+  result.rejected_lines = lowerer.rejected_lines();
+  return result;
+}
+
+CompactAilResult toCompactAil(const AilResult &result) {
+  CompactAilResult out;
+  out.instructions.reserve(result.instructions.size());
+  CompactAilBuilder builder(&out);
+  for (const auto &instruction : result.instructions) {
+    builder.add(instruction);
+  }
+  out.diagnostics = result.diagnostics;
+  out.rejected_lines = result.rejected_lines;
+  return out;
+}
+
+SourceInfo toSourceInfo(const CompactAilResult &result,
+                        const CompactSourceInfo &source) {
+  SourceInfo out;
+  if (source.file != kNoAilFile) {
+    out.filename = result.files[source.file];
+  }
+  out.line = source.line;
+  if (source.has_line_number) {
+    out.line_number = source.line_number;
+  }
+  return out;
+}
+
+AilInstruction toAilInstruction(const CompactAilResult &result,
+                                const CompactAilInstruction &instruction) {
+  return std::visit(
+      [&result](const auto &inst) -> AilInstruction {
+        using T = std::decay_t<decltype(inst)>;
+        if constexpr (std::is_same_v<T, CompactAilLinearMove>) {
+          AilLinearMoveInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.modal = toModalState(inst.modal);
+          out.opcode = inst.rapid ? "G0" : "G1";
+          out.target_pose = inst.target_pose;
+          out.feed = inst.feed;
+          out.rapid_mode_effective = inst.rapid_mode_effective;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilArcMove>) {
+          const auto &geometry = result.arcs[inst.geometry];
+          AilArcMoveInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.modal = toModalState(inst.modal);
+          out.clockwise = inst.clockwise;
+          out.plane_effective = inst.plane_effective;
+          out.target_pose = geometry.target_pose;
+          out.arc = geometry.arc;
+          out.feed = geometry.feed;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilDwell>) {
+          AilDwellInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.modal = toModalState(inst.modal);
+          out.dwell_mode = inst.dwell_mode;
+          out.dwell_value = inst.dwell_value;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilMCode>) {
+          AilMCodeInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.address_extension = inst.address_extension;
+          out.value = inst.value;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilRapidTraverseMode>) {
+          AilRapidTraverseModeInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.mode = inst.mode;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilToolRadiusComp>) {
+          AilToolRadiusCompInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.mode = inst.mode;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilWorkingPlane>) {
+          AilWorkingPlaneInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.plane = inst.plane;
+          return out;
+        } else if constexpr (std::is_same_v<T, CompactAilToolChange>) {
+          AilToolChangeInstruction out;
+          out.source = toSourceInfo(result, inst.source);
+          out.timing = inst.timing;
+          return out;
+        } else {
+          AilInstruction out = result.out_of_line[inst.index];
+          if (inst.source.file != kNoAilFile) {
+            std::visit(
+                [&](auto &stored) {
+                  stored.source.filename = result.files[inst.source.file];
+                },
+                out);
+          }
+          return out;
+        }
+      },
+      instruction);
+}
+
+} // namespace gcode
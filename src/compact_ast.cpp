@@ -0,0 +1,196 @@
+#include "compact_ast_builder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "word_builder.h"
+
+namespace gcode {
+
+static_assert(std::is_trivially_destructible_v<CompactLineItem>);
+static_assert(std::is_trivially_destructible_v<CompactLine>);
+
+namespace {
+
+constexpr size_t kTextBlockBytes = 64 * 1024;
+
+bool hasLowercaseAscii(std::string_view text) {
+  return std::any_of(text.begin(), text.end(),
+                     [](char c) { return c >= 'a' && c <= 'z'; });
+}
+
+bool endsWith(std::string_view text, std::string_view suffix) {
+  return text.size() >= suffix.size() &&
+         text.substr(text.size() - suffix.size()) == suffix;
+}
+
+} // namespace
+
+std::string_view CompactTextStorage::store(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  if (blocks_.empty() || block_size_ - block_used_ < text.size()) {
+    block_size_ = std::max(kTextBlockBytes, text.size());
+    blocks_.push_back(std::make_unique<char[]>(block_size_));
+    block_used_ = 0;
+  }
+  char *out = blocks_.back().get() + block_used_;
+  std::memcpy(out, text.data(), text.size());
+  block_used_ += text.size();
+  return {out, text.size()};
+}
+
+CompactProgramBuilder::CompactProgramBuilder(CompactParseResult *result,
+                                             CompactTextStorage *storage)
+    : result_(result), storage_(storage) {}
+
+CompactWord CompactProgramBuilder::makeCompactWord(std::string_view text,
+                                                   const Location &location) {
+  const auto parts = splitWordText(text);
+  CompactWord word;
+  word.text = text;
+  word.head = hasLowercaseAscii(parts.head)
+                  ? storage_->store(toUpperAscii(std::string(parts.head)))
+                  : parts.head;
+  word.symbol = wordSymbolFromHead(word.head);
+  word.value = parts.value;
+  if (parts.value.has_value()) {
+    word.number = parseNumberPrefix(*parts.value);
+    word.integer = parseIntegerPrefix(*parts.value);
+  }
+  word.has_equal = parts.has_equal;
+  word.location = location;
+  return word;
+}
+
+void CompactProgramBuilder::addFastBlock(const FastBlock &block,
+                                         int line_index) {
+  CompactLine line;
+  line.line_index = line_index;
+  if (block.block_delete) {
+    line.block_delete = true;
+    line.block_delete_location = block.block_delete_location;
+    if (block.block_delete_level_raw.has_value()) {
+      line.block_delete_level_raw = block.block_delete_level_raw;
+      line.block_delete_level_location = block.block_delete_level_location;
+      line.block_delete_level =
+          parseUnsignedIntStrict(*block.block_delete_level_raw);
+    }
+  }
+  line.line_number = block.line_number;
+  line.first_item = static_cast<uint32_t>(result_->items.size());
+  for (const auto &item : block.items) {
+    if (item.comment) {
+      result_->items.emplace_back(CompactComment{item.text, item.location});
+    } else {
+      result_->items.emplace_back(makeCompactWord(item.text, item.location));
+    }
+  }
+  line.item_count =
+      static_cast<uint32_t>(result_->items.size() - line.first_item);
+  result_->lines.push_back(line);
+}
+
+void CompactProgramBuilder::addLine(const Line &source) {
+  CompactLine line;
+  line.line_index = source.line_index;
+  line.block_delete = source.block_delete;
+  line.block_delete_location = source.block_delete_location;
+  line.block_delete_level = source.block_delete_level;
+  if (source.block_delete_level_raw.has_value()) {
+    line.block_delete_level_raw =
+        storage_->store(*source.block_delete_level_raw);
+  }
+  line.block_delete_level_location = source.block_delete_level_location;
+  line.line_number = source.line_number;
+  line.first_item = static_cast<uint32_t>(result_->items.size());
+  for (const auto &item : source.items) {
+    if (const auto *comment = std::get_if<Comment>(&item)) {
+      result_->items.emplace_back(
+          CompactComment{storage_->store(comment->text), comment->location});
+      continue;
+    }
+    const auto &word = std::get<Word>(item);
+    CompactWord compact;
+    compact.text = storage_->store(word.text);
+    compact.head = compact.text.substr(0, word.head.size()) == word.head
+                       ? compact.text.substr(0, word.head.size())
+                       : storage_->store(word.head);
+    compact.symbol = wordSymbol(word);
+    if (word.value.has_value()) {
+      compact.value =
+          endsWith(compact.text, *word.value)
+              ? compact.text.substr(compact.text.size() - word.value->size())
+              : storage_->store(*word.value);
+    }
+    compact.number = wordNumber(word);
+    compact.integer = wordInteger(word);
+    compact.has_equal = word.has_equal;
+    compact.quoted = word.quoted;
+    compact.location = word.location;
+    result_->items.emplace_back(compact);
+  }
+  line.item_count =
+      static_cast<uint32_t>(result_->items.size() - line.first_item);
+  if (source.statement.has_value()) {
+    line.statement_index =
+        static_cast<int32_t>(result_->statement_lines.size());
+    Line statement = source;
+    statement.items.clear();
+    result_->statement_lines.push_back(std::move(statement));
+  }
+  result_->lines.push_back(line);
+}
+
+void CompactProgramBuilder::clearLines() {
+  result_->lines.clear();
+  result_->items.clear();
+  result_->statement_lines.clear();
+}
+
+Line toLine(const CompactParseResult &result, const CompactLine &line) {
+  Line out = line.statement_index >= 0
+                 ? result.statement_lines[static_cast<size_t>(
+                       line.statement_index)]
+                 : Line{};
+  out.block_delete = line.block_delete;
+  out.block_delete_location = line.block_delete_location;
+  out.block_delete_level = line.block_delete_level;
+  out.block_delete_level_raw.reset();
+  if (line.block_delete_level_raw.has_value()) {
+    out.block_delete_level_raw = std::string(*line.block_delete_level_raw);
+  }
+  out.block_delete_level_location = line.block_delete_level_location;
+  out.line_number = line.line_number;
+  out.line_index = line.line_index;
+  out.items.clear();
+  out.items.reserve(line.item_count);
+  for (uint32_t i = 0; i < line.item_count; ++i) {
+    const auto &item = result.items[line.first_item + i];
+    if (const auto *comment = std::get_if<CompactComment>(&item)) {
+      out.items.emplace_back(
+          Comment{std::string(comment->text), comment->location});
+      continue;
+    }
+    const auto &compact = std::get<CompactWord>(item);
+    Word word;
+    word.text = std::string(compact.text);
+    word.head = std::string(compact.head);
+    word.symbol = compact.symbol;
+    if (compact.value.has_value()) {
+      word.value = std::string(*compact.value);
+    }
+    word.number = compact.number;
+    word.integer = compact.integer;
+    word.numbers_cached = true;
+    word.has_equal = compact.has_equal;
+    word.quoted = compact.quoted;
+    word.location = compact.location;
+    out.items.emplace_back(std::move(word));
+  }
+  return out;
+}
+
+} // namespace gcode
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fast_block_scanner.h"
+#include "gcode/compact_ast.h"
+
+namespace gcode {
+
+// Text behind the views of a CompactParseResult: the copied input and an
+// append-only arena for text that is not a slice of it (upper-cased heads,
+// text of lines built by the ANTLR parser).
+struct CompactTextStorage {
+  std::string source;
+
+  std::string_view store(std::string_view text);
+
+private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t block_used_ = 0;
+  size_t block_size_ = 0;
+};
+
+// Appends lines to a CompactParseResult in program order.
+class CompactProgramBuilder {
+public:
+  CompactProgramBuilder(CompactParseResult *result,
+                        CompactTextStorage *storage);
+
+  // `block` must view text inside `storage->source`.
+  void addFastBlock(const FastBlock &block, int line_index);
+  void addLine(const Line &line);
+  void clearLines();
+
+private:
+  CompactWord makeCompactWord(std::string_view text, const Location &location);
+
+  CompactParseResult *result_;
+  CompactTextStorage *storage_;
+};
+
+} // namespace gcode
@@ -18,12 +18,7 @@ LinearMoveCommand buildLinearMoveCommand(const AilLinearMoveInstruction &inst,
   LinearMoveCommand cmd;
   cmd.source = toSourceRef(inst.source);
   cmd.source.line = line;
-  cmd.target.x = inst.target_pose.x;
-  cmd.target.y = inst.target_pose.y;
-  cmd.target.z = inst.target_pose.z;
-  cmd.target.a = inst.target_pose.a;
-  cmd.target.b = inst.target_pose.b;
-  cmd.target.c = inst.target_pose.c;
+  cmd.target = inst.target_pose;
   cmd.feed = inst.feed;
   cmd.effective = state;
   return cmd;
@@ -35,12 +30,7 @@ ArcMoveCommand buildArcMoveCommand(const AilArcMoveInstruction &inst, int line,
   cmd.source = toSourceRef(inst.source);
   cmd.source.line = line;
   cmd.clockwise = inst.clockwise;
-  cmd.target.x = inst.target_pose.x;
-  cmd.target.y = inst.target_pose.y;
-  cmd.target.z = inst.target_pose.z;
-  cmd.target.a = inst.target_pose.a;
-  cmd.target.b = inst.target_pose.b;
-  cmd.target.c = inst.target_pose.c;
+  cmd.target = inst.target_pose;
   cmd.arc = inst.arc;
   cmd.feed = inst.feed;
   cmd.effective = state;
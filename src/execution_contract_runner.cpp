@@ -44,12 +44,12 @@ optionalDoubleToJson(const std::optional<double> &value) {
 
 nlohmann::ordered_json poseTargetToJson(const PoseTarget &target) {
   nlohmann::ordered_json j;
-  j["x"] = optionalDoubleToJson(target.x);
-  j["y"] = optionalDoubleToJson(target.y);
-  j["z"] = optionalDoubleToJson(target.z);
-  j["a"] = optionalDoubleToJson(target.a);
-  j["b"] = optionalDoubleToJson(target.b);
-  j["c"] = optionalDoubleToJson(target.c);
+  j["x"] = optionalDoubleToJson(target.x());
+  j["y"] = optionalDoubleToJson(target.y());
+  j["z"] = optionalDoubleToJson(target.z());
+  j["a"] = optionalDoubleToJson(target.a());
+  j["b"] = optionalDoubleToJson(target.b());
+  j["c"] = optionalDoubleToJson(target.c());
   return j;
 }
 
@@ -160,10 +160,10 @@ public:
     nlohmann::ordered_json data;
     data["clockwise"] = cmd.clockwise;
     data["target"] = poseTargetToJson(cmd.target);
-    data["arc"] = {{"i", optionalDoubleToJson(cmd.arc.i)},
-                   {"j", optionalDoubleToJson(cmd.arc.j)},
-                   {"k", optionalDoubleToJson(cmd.arc.k)},
-                   {"r", optionalDoubleToJson(cmd.arc.r)}};
+    data["arc"] = {{"i", optionalDoubleToJson(cmd.arc.i())},
+                   {"j", optionalDoubleToJson(cmd.arc.j())},
+                   {"k", optionalDoubleToJson(cmd.arc.k())},
+                   {"r", optionalDoubleToJson(cmd.arc.r())}};
     data["feed"] = optionalDoubleToJson(cmd.feed);
     data["effective"] = effectiveToJson(cmd.effective);
     events_->push_back({"arc_move", cmd.source, std::move(data)});
@@ -2,6 +2,7 @@
 
 #include <utility>
 
+#include "line_buffer.h"
 #include "streaming_execution_engine.h"
 
 namespace gcode {
@@ -11,7 +12,8 @@ ExecutionSession::ExecutionSession(IExecutionSink &sink, IRuntime &runtime,
                                    const LowerOptions &options)
     : sink_(sink), runtime_(runtime), cancellation_(cancellation),
       options_(options), engine_(std::make_unique<StreamingExecutionEngine>(
-                             sink, runtime, cancellation, options)) {}
+                             sink, runtime, cancellation, options)),
+      input_(std::make_unique<LineBuffer>()) {}
 
 ExecutionSession::ExecutionSession(IExecutionSink &sink,
                                    IExecutionRuntime &runtime,
@@ -31,7 +33,7 @@ bool ExecutionSession::pushChunk(std::string_view chunk) {
       state_ == EngineState::Faulted || state_ == EngineState::Completed) {
     return false;
   }
-  input_buffer_.append(chunk.data(), chunk.size());
+  input_->append(chunk);
   return enqueueCompleteLinesFromBuffer();
 }
 
@@ -74,9 +76,10 @@ StepResult ExecutionSession::pump() {
 
 StepResult ExecutionSession::finish() {
   input_finished_ = true;
-  if (!input_buffer_.empty()) {
-    editable_lines_.push_back(input_buffer_);
-    input_buffer_.clear();
+  LineBuffer::Span last_line;
+  if (input_->finishLine(&last_line)) {
+    editable_lines_.emplace_back(input_->text(last_line));
+    input_->clear();
     engine_dirty_ = true;
   }
   return pump();
@@ -102,7 +105,7 @@ bool ExecutionSession::replaceEditableSuffix(
     return false;
   }
   editable_lines_.clear();
-  input_buffer_.clear();
+  input_->clear();
   appendReplacementText(replacement_text);
   rejected_.reset();
   rebuildEngineFromLockedPrefix();
@@ -111,6 +114,16 @@ bool ExecutionSession::replaceEditableSuffix(
   return true;
 }
 
+void ExecutionSession::setMaxMotionsInFlight(size_t count) {
+  max_motions_in_flight_ = count;
+  engine_->setMaxMotionsInFlight(count);
+}
+
+void ExecutionSession::setMaxLinearMoveBatch(size_t count) {
+  max_linear_move_batch_ = count;
+  engine_->setMaxLinearMoveBatch(count);
+}
+
 std::optional<int> ExecutionSession::rejectedLine() const {
   if (!rejected_.has_value()) {
     return std::nullopt;
@@ -119,22 +132,13 @@ std::optional<int> ExecutionSession::rejectedLine() const {
 }
 
 bool ExecutionSession::enqueueCompleteLinesFromBuffer() {
-  size_t start = 0;
+  LineBuffer::Span line;
   bool appended = false;
-  while (start < input_buffer_.size()) {
-    const size_t newline_pos = input_buffer_.find('\n', start);
-    if (newline_pos == std::string::npos) {
-      break;
-    }
-    std::string line = input_buffer_.substr(start, newline_pos - start);
-    if (!line.empty() && line.back() == '\r') {
-      line.pop_back();
-    }
-    editable_lines_.push_back(std::move(line));
+  while (input_->nextLine(&line)) {
+    editable_lines_.emplace_back(input_->text(line));
     appended = true;
-    start = newline_pos + 1;
   }
-  input_buffer_.erase(0, start);
+  input_->dropCompleteLines();
   if (appended) {
     engine_dirty_ = true;
   }
@@ -142,11 +146,12 @@ bool ExecutionSession::enqueueCompleteLinesFromBuffer() {
 }
 
 void ExecutionSession::appendReplacementText(std::string_view text) {
-  input_buffer_.append(text.data(), text.size());
+  input_->append(text);
   (void)enqueueCompleteLinesFromBuffer();
-  if (input_finished_ && !input_buffer_.empty()) {
-    editable_lines_.push_back(input_buffer_);
-    input_buffer_.clear();
+  LineBuffer::Span last_line;
+  if (input_finished_ && input_->finishLine(&last_line)) {
+    editable_lines_.emplace_back(input_->text(last_line));
+    input_->clear();
     engine_dirty_ = true;
   }
 }
@@ -159,6 +164,8 @@ void ExecutionSession::rebuildEngineFromLockedPrefix() {
     engine_ = std::make_unique<StreamingExecutionEngine>(
         sink_, runtime_, cancellation_, options_);
   }
+  engine_->setMaxMotionsInFlight(max_motions_in_flight_);
+  engine_->setMaxLinearMoveBatch(max_linear_move_batch_);
   engine_->importInitialState(
       prefix_state_, static_cast<int>(locked_prefix_lines_.size() + 1));
   engine_dirty_ = false;
@@ -0,0 +1,139 @@
+#include "gcode/expr_pool.h"
+
+#include <variant>
+
+#include "word_builder.h"
+
+namespace gcode {
+namespace {
+
+ExprOp unaryOp(const std::string &op) {
+  if (op == "+") {
+    return ExprOp::Plus;
+  }
+  if (op == "-") {
+    return ExprOp::Negate;
+  }
+  return ExprOp::UnknownUnary;
+}
+
+ExprOp binaryOp(const std::string &op) {
+  if (op == "+") {
+    return ExprOp::Add;
+  }
+  if (op == "-") {
+    return ExprOp::Subtract;
+  }
+  if (op == "*") {
+    return ExprOp::Multiply;
+  }
+  if (op == "/") {
+    return ExprOp::Divide;
+  }
+  return ExprOp::UnknownBinary;
+}
+
+} // namespace
+
+ExprIndex ExprPool::add(const std::shared_ptr<ExprNode> &expr) {
+  return expr ? append(expr.get()) : kNoExpr;
+}
+
+ExprIndex ExprPool::merge(const ExprPool &other) {
+  const auto node_offset = static_cast<ExprIndex>(nodes_.size());
+  std::vector<uint32_t> text_map;
+  text_map.reserve(other.texts_.size());
+  for (const auto &text : other.texts_) {
+    text_map.push_back(addText(text));
+  }
+  nodes_.reserve(nodes_.size() + other.nodes_.size());
+  for (ExprPoolNode node : other.nodes_) {
+    node.first += node_offset;
+    if (node.lhs != kNoExpr) {
+      node.lhs += node_offset;
+    }
+    if (node.rhs != kNoExpr) {
+      node.rhs += node_offset;
+    }
+    if (node.op == ExprOp::Variable) {
+      node.text = text_map[node.text];
+      node.key = text_map[node.key];
+    } else if (node.op == ExprOp::UnknownUnary ||
+               node.op == ExprOp::UnknownBinary) {
+      node.text = text_map[node.text];
+    }
+    nodes_.push_back(node);
+  }
+  return node_offset;
+}
+
+uint32_t ExprPool::addText(std::string_view text) {
+  std::string key(text);
+  const auto it = text_indices_.find(key);
+  if (it != text_indices_.end()) {
+    return it->second;
+  }
+  const auto index = static_cast<uint32_t>(texts_.size());
+  texts_.push_back(key);
+  text_indices_.emplace(std::move(key), index);
+  return index;
+}
+
+ExprIndex ExprPool::append(const ExprNode *expr) {
+  const auto first = static_cast<ExprIndex>(nodes_.size());
+  ExprPoolNode node;
+  node.first = first;
+  if (expr == nullptr) {
+    node.op = ExprOp::Missing;
+  } else if (const auto *literal = std::get_if<ExprLiteral>(&expr->node)) {
+    node.op = ExprOp::Literal;
+    node.value = literal->value;
+    node.location = literal->location;
+  } else if (const auto *variable = std::get_if<ExprVariable>(&expr->node)) {
+    node.op = ExprOp::Variable;
+    node.is_system = variable->is_system;
+    node.text = addText(variable->name);
+    node.key = addText(toUpperAscii(variable->name));
+    node.location = variable->location;
+  } else if (const auto *unary = std::get_if<ExprUnary>(&expr->node)) {
+    node.op = unaryOp(unary->op);
+    if (node.op == ExprOp::UnknownUnary) {
+      node.text = addText(unary->op);
+    }
+    node.lhs = append(unary->operand.get());
+    node.location = unary->location;
+  } else {
+    const auto &binary = std::get<ExprBinary>(expr->node);
+    node.op = binaryOp(binary.op);
+    if (node.op == ExprOp::UnknownBinary) {
+      node.text = addText(binary.op);
+    }
+    node.lhs = append(binary.lhs.get());
+    node.rhs = append(binary.rhs.get());
+    node.location = binary.location;
+  }
+  nodes_.push_back(node);
+  return static_cast<ExprIndex>(nodes_.size() - 1);
+}
+
+std::string_view ExprPool::opText(const ExprPoolNode &node) const {
+  switch (node.op) {
+  case ExprOp::Plus:
+  case ExprOp::Add:
+    return "+";
+  case ExprOp::Negate:
+  case ExprOp::Subtract:
+    return "-";
+  case ExprOp::Multiply:
+    return "*";
+  case ExprOp::Divide:
+    return "/";
+  case ExprOp::UnknownUnary:
+  case ExprOp::UnknownBinary:
+    return texts_[node.text];
+  default:
+    return {};
+  }
+}
+
+} // namespace gcode
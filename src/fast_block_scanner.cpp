@@ -0,0 +1,323 @@
+#include "fast_block_scanner.h"
+
+#include <array>
+#include <string>
+
+#include "utf8_text.h"
+#include "word_builder.h"
+
+namespace gcode {
+namespace {
+
+constexpr size_t kNoMatch = std::string_view::npos;
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool isAsciiLetter(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+// WORD_HEAD first character: any letter except N, or underscore.
+bool isWordHeadStart(char c) {
+  return c == '_' || (isAsciiLetter(c) && c != 'N' && c != 'n');
+}
+
+bool isWordHeadChar(char c) {
+  return c == '_' || isAsciiLetter(c) || isDigit(c);
+}
+
+bool isPrintableAscii(char c) {
+  return (c >= 0x20 && c <= 0x7e) || c == '\t';
+}
+
+bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    char a = lhs[i];
+    char b = rhs[i];
+    if (a >= 'a' && a <= 'z') {
+      a = static_cast<char>(a - 'a' + 'A');
+    }
+    if (b >= 'a' && b <= 'z') {
+      b = static_cast<char>(b - 'a' + 'A');
+    }
+    if (a != b) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Keyword tokens win over WORD on equal-length matches in GCode.g4.
+bool isKeyword(std::string_view text) {
+  static constexpr std::array<std::string_view, 18> kKeywords = {
+      "IF",
+      "THEN",
+      "ELSE",
+      "AND",
+      "GOTO",
+      "GOTOF",
+      "GOTOB",
+      "GOTOC",
+      "ENDIF",
+      "WHILE",
+      "ENDWHILE",
+      "FOR",
+      "TO",
+      "ENDFOR",
+      "REPEAT",
+      "UNTIL",
+      "LOOP",
+      "ENDLOOP",
+  };
+  for (const auto keyword : kKeywords) {
+    if (equalsIgnoreCase(text, keyword)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t skipBlanks(std::string_view text, size_t pos) {
+  while (pos < text.size() && isBlank(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+size_t skipDigits(std::string_view text, size_t pos) {
+  while (pos < text.size() && isDigit(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// SIGN? (DIGIT+ ('.' DIGIT*)? | '.' DIGIT+); returns the end or kNoMatch.
+size_t matchSignedNumber(std::string_view text, size_t pos) {
+  if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+    ++pos;
+  }
+  if (pos < text.size() && isDigit(text[pos])) {
+    pos = skipDigits(text, pos);
+    if (pos < text.size() && text[pos] == '.') {
+      pos = skipDigits(text, pos + 1);
+    }
+    return pos;
+  }
+  if (pos + 1 < text.size() && text[pos] == '.' && isDigit(text[pos + 1])) {
+    return skipDigits(text, pos + 1);
+  }
+  return kNoMatch;
+}
+
+// AC_NUMBER: [Aa][Cc] '(' <unsigned-or-signed number> ')'.
+size_t matchAcNumber(std::string_view text, size_t pos) {
+  if (pos + 3 > text.size() || !equalsIgnoreCase(text.substr(pos, 2), "AC") ||
+      text[pos + 2] != '(') {
+    return kNoMatch;
+  }
+  const size_t number_end = matchSignedNumber(text, pos + 3);
+  if (number_end == kNoMatch || number_end >= text.size() ||
+      text[number_end] != ')') {
+    return kNoMatch;
+  }
+  return number_end + 1;
+}
+
+// Longest WORD match starting at `begin`, mirroring the lexer's maximal munch
+// over WORD_HEAD (EQUAL WORD_VALUE | WORD_VALUE)?. Returns kNoMatch when the
+// longest match needs a $ value, or when the following characters would form
+// a token the scanner does not handle.
+size_t matchWord(std::string_view text, size_t begin) {
+  size_t end = begin + 1;
+  while (end < text.size() && isWordHeadChar(text[end])) {
+    ++end;
+  }
+  if (end >= text.size()) {
+    return end;
+  }
+
+  const char next = text[end];
+  if (next == '(') {
+    const bool head_ends_with_ac =
+        end - begin >= 3 && equalsIgnoreCase(text.substr(end - 2, 2), "AC");
+    // X AC(5) is one WORD; without a well-formed AC value leave it to ANTLR.
+    return head_ends_with_ac ? matchAcNumber(text, end - 2) : end;
+  }
+  if (next == '.') {
+    if (isDigit(text[end - 1])) {
+      // The trailing digits of the head become DIGIT+ '.' DIGIT*.
+      return skipDigits(text, end + 1);
+    }
+    return matchSignedNumber(text, end);
+  }
+  if (next == '+' || next == '-') {
+    return matchSignedNumber(text, end);
+  }
+  if (next == '=') {
+    const size_t ac_end = matchAcNumber(text, end + 1);
+    return ac_end != kNoMatch ? ac_end : matchSignedNumber(text, end + 1);
+  }
+  if (next == '$') {
+    return kNoMatch;
+  }
+  return end;
+}
+
+Location locationAt(int line_number, size_t pos) {
+  return {line_number, static_cast<int>(pos) + 1};
+}
+
+} // namespace
+
+bool scanFastBlock(std::string_view text, int line_number, FastBlock *block) {
+  block->block_delete = false;
+  block->block_delete_level_raw.reset();
+  block->line_number.reset();
+  block->items.clear();
+
+  size_t pos = skipBlanks(text, 0);
+  if (pos < text.size() && text[pos] == '/') {
+    if (pos + 1 < text.size() && text[pos + 1] == '/') {
+      return false;
+    }
+    block->block_delete = true;
+    block->block_delete_location = locationAt(line_number, pos);
+    pos = skipBlanks(text, pos + 1);
+    if (pos < text.size() && isDigit(text[pos])) {
+      const size_t level_end = skipDigits(text, pos);
+      if (level_end < text.size() && text[level_end] == '.') {
+        return false;
+      }
+      block->block_delete_level_raw = text.substr(pos, level_end - pos);
+      block->block_delete_level_location = locationAt(line_number, pos);
+      pos = level_end;
+    }
+    pos = skipBlanks(text, pos);
+  }
+
+  if (pos + 1 < text.size() && (text[pos] == 'N' || text[pos] == 'n') &&
+      isDigit(text[pos + 1])) {
+    const size_t number_end = skipDigits(text, pos + 1);
+    LineNumber number;
+    number.location = locationAt(line_number, pos);
+    number.value =
+        parseUnsignedIntStrict(text.substr(pos + 1, number_end - pos - 1))
+            .value_or(0);
+    block->line_number = number;
+    pos = number_end;
+  }
+
+  while (true) {
+    pos = skipBlanks(text, pos);
+    if (pos >= text.size()) {
+      break;
+    }
+    const char c = text[pos];
+    if (c == ';') {
+      const std::string_view rest = text.substr(pos);
+      for (const char ch : rest) {
+        if (ch == '\r' || ch == '\n' ||
+            (static_cast<unsigned char>(ch) < 0x80 && !isPrintableAscii(ch))) {
+          return false;
+        }
+      }
+      if (!isValidUtf8(rest)) {
+        return false;
+      }
+      block->items.push_back({true, rest, locationAt(line_number, pos)});
+      break;
+    }
+    if (c == '(') {
+      if (pos + 1 < text.size() && text[pos + 1] == '*') {
+        return false;
+      }
+      size_t close = pos + 1;
+      while (close < text.size() && text[close] != ')') {
+        if (!isPrintableAscii(text[close])) {
+          return false;
+        }
+        ++close;
+      }
+      if (close >= text.size()) {
+        // An unclosed paren comment may continue on a later line.
+        return false;
+      }
+      block->items.push_back({true, text.substr(pos, close + 1 - pos),
+                              locationAt(line_number, pos)});
+      pos = close + 1;
+      continue;
+    }
+    if ((c == 'N' || c == 'n') && pos + 1 < text.size() &&
+        isDigit(text[pos + 1])) {
+      const size_t number_end = skipDigits(text, pos + 1);
+      block->items.push_back({false, text.substr(pos, number_end - pos),
+                              locationAt(line_number, pos)});
+      pos = number_end;
+      continue;
+    }
+    if (isWordHeadStart(c)) {
+      const size_t word_end = matchWord(text, pos);
+      if (word_end == kNoMatch) {
+        return false;
+      }
+      const std::string_view word_text = text.substr(pos, word_end - pos);
+      if (isKeyword(word_text)) {
+        return false;
+      }
+      block->items.push_back({false, word_text, locationAt(line_number, pos)});
+      pos = word_end;
+      continue;
+    }
+    return false;
+  }
+
+  return true;
+}
+
+Line makeFastBlockLine(const FastBlock &block, int line_number) {
+  Line line;
+  line.line_index = line_number;
+  if (block.block_delete) {
+    line.block_delete = true;
+    line.block_delete_location = block.block_delete_location;
+    if (block.block_delete_level_raw.has_value()) {
+      line.block_delete_level_raw = std::string(*block.block_delete_level_raw);
+      line.block_delete_level_location = block.block_delete_level_location;
+      line.block_delete_level =
+          parseUnsignedIntStrict(*block.block_delete_level_raw);
+    }
+  }
+  line.line_number = block.line_number;
+  line.items.reserve(block.items.size());
+  for (const auto &item : block.items) {
+    if (item.comment) {
+      Comment comment;
+      comment.text = std::string(item.text);
+      comment.location = item.location;
+      line.items.emplace_back(std::move(comment));
+    } else {
+      line.items.emplace_back(makeWord(std::string(item.text), item.location));
+    }
+  }
+  return line;
+}
+
+std::optional<Line> scanFastBlock(std::string_view text, int line_number) {
+  FastBlock block;
+  if (!scanFastBlock(text, line_number, &block)) {
+    return std::nullopt;
+  }
+  return makeFastBlockLine(block, line_number);
+}
+
+bool allowsLineSegmentedParse(std::string_view text) {
+  return text.find("(*") == std::string_view::npos &&
+         text.find("\xEF\xBB\xBF", 1) == std::string_view::npos;
+}
+
+} // namespace gcode
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "gcode/ast.h"
+
+namespace gcode {
+
+// Hand-written scanner for the common CAM block shape:
+//   [/[level]] [N<digits>] (address word | N<digits> | (comment))* [; comment]
+// `text` is one physical line without its end-of-line characters and
+// `line_number` is its 1-based line. Returns std::nullopt for anything the
+// scanner cannot prove the grammar would tokenize the same way (keywords,
+// assignments, expressions, AC(...), $ values, quoted words, block comments,
+// non-ASCII outside a trailing `;` comment, stray characters); those lines
+// must go through the ANTLR parser.
+std::optional<Line> scanFastBlock(std::string_view text, int line_number);
+
+// A block accepted by the scanner, with text fields viewing the scanned line.
+struct FastBlock {
+  struct Item {
+    bool comment = false;
+    std::string_view text;
+    Location location;
+  };
+
+  bool block_delete = false;
+  Location block_delete_location;
+  std::optional<std::string_view> block_delete_level_raw;
+  Location block_delete_level_location;
+  std::optional<LineNumber> line_number;
+  std::vector<Item> items;
+};
+
+// Same as above, filling `block` (whose item storage is reused) instead of
+// building a Line. Returns false where the other overload returns nullopt.
+bool scanFastBlock(std::string_view text, int line_number, FastBlock *block);
+
+Line makeFastBlockLine(const FastBlock &block, int line_number);
+
+// Whether `text` may be split into line ranges that are parsed on their own
+// (fast/ANTLR segments, parallel chunks). Block comments `(* ... *)` can
+// swallow later lines without a diagnostic in the range that opened them, so
+// inputs containing one are parsed in one piece. A
+// byte order mark after the first byte also disables splitting: the char
+// stream skips a leading BOM, which would drop it from a later segment.
+bool allowsLineSegmentedParse(std::string_view text);
+
+} // namespace gcode
@@ -0,0 +1,88 @@
+#include "file_source.h"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gcode {
+namespace {
+
+class FdCloser {
+public:
+  explicit FdCloser(int fd) : fd_(fd) {}
+  ~FdCloser() { ::close(fd_); }
+
+  FdCloser(const FdCloser &) = delete;
+  FdCloser &operator=(const FdCloser &) = delete;
+
+private:
+  int fd_;
+};
+
+bool readAll(int fd, std::string *out) {
+  constexpr size_t kReadChunkBytes = 64 * 1024;
+  size_t used = 0;
+  while (true) {
+    out->resize(used + kReadChunkBytes);
+    const ssize_t count = ::read(fd, out->data() + used, kReadChunkBytes);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      out->clear();
+      return false;
+    }
+    if (count == 0) {
+      out->resize(used);
+      return true;
+    }
+    used += static_cast<size_t>(count);
+  }
+}
+
+} // namespace
+
+FileSource::~FileSource() { reset(); }
+
+void FileSource::reset() {
+  if (mapping_ != nullptr) {
+    ::munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+  }
+  buffer_.clear();
+  text_ = {};
+}
+
+bool FileSource::open(const std::string &path) {
+  reset();
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  FdCloser closer(fd);
+
+  struct stat info {};
+  if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    const auto size = static_cast<size_t>(info.st_size);
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      ::madvise(mapping, size, MADV_SEQUENTIAL);
+      mapping_ = mapping;
+      mapping_size_ = size;
+      text_ = std::string_view(static_cast<const char *>(mapping), size);
+      return true;
+    }
+  }
+
+  if (!readAll(fd, &buffer_)) {
+    return false;
+  }
+  text_ = buffer_;
+  return true;
+}
+
+} // namespace gcode
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace gcode {
+
+// Read-only contents of a program file. Regular files are memory-mapped, so
+// parsing starts without copying the file and the pages are shared with the
+// page cache and other processes reading the same file. Pipes, FIFOs, and
+// files that cannot be mapped are read into an owned buffer instead.
+//
+// text() stays valid until the next open() or destruction. A mapped file
+// that is truncated by another process while in use may raise SIGBUS.
+class FileSource {
+public:
+  FileSource() = default;
+  ~FileSource();
+
+  FileSource(const FileSource &) = delete;
+  FileSource &operator=(const FileSource &) = delete;
+
+  // False when the file cannot be opened or read.
+  bool open(const std::string &path);
+
+  std::string_view text() const { return text_; }
+  bool isMapped() const { return mapping_ != nullptr; }
+
+private:
+  void reset();
+
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  std::string buffer_;
+  std::string_view text_;
+};
+
+} // namespace gcode
@@ -6,11 +6,17 @@
 #include <string>
 #include <string_view>
 
-#include "GCodeBaseVisitor.h"
+#include "GCodeBaseListener.h"
 #include "GCodeLexer.h"
 #include "GCodeParser.h"
 #include "antlr4-runtime.h"
+#include "compact_ast_builder.h"
+#include "fast_block_scanner.h"
+#include "parallel_for.h"
 #include "semantic_rules.h"
+#include "utf8_char_stream.h"
+#include "utf8_text.h"
+#include "word_builder.h"
 
 namespace gcode {
 namespace {
@@ -23,64 +29,6 @@ Location locationFromToken(const antlr4::Token *token) {
           static_cast<int>(token->getCharPositionInLine()) + 1};
 }
 
-std::string toUpper(std::string value) {
-  std::transform(
-      value.begin(), value.end(), value.begin(),
-      [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
-  return value;
-}
-
-struct WordParts {
-  std::string head;
-  std::optional<std::string> value;
-  bool has_equal = false;
-};
-
-WordParts splitWordText(const std::string &text) {
-  WordParts parts;
-  auto eq_pos = text.find('=');
-  if (eq_pos != std::string::npos) {
-    parts.has_equal = true;
-    parts.head = text.substr(0, eq_pos);
-    if (eq_pos + 1 < text.size()) {
-      parts.value = text.substr(eq_pos + 1);
-    }
-    return parts;
-  }
-
-  auto is_value_char = [](char c) {
-    return std::isdigit(static_cast<unsigned char>(c)) || c == '+' ||
-           c == '-' || c == '.';
-  };
-
-  for (size_t i = 1; i < text.size(); ++i) {
-    if (is_value_char(text[i])) {
-      parts.head = text.substr(0, i);
-      parts.value = text.substr(i);
-      return parts;
-    }
-  }
-
-  parts.head = text;
-  return parts;
-}
-
-std::optional<int> parseUnsignedIntStrict(std::string_view text) {
-  if (text.empty()) {
-    return std::nullopt;
-  }
-  for (char c : text) {
-    if (!std::isdigit(static_cast<unsigned char>(c))) {
-      return std::nullopt;
-    }
-  }
-  try {
-    return std::stoi(std::string(text));
-  } catch (...) {
-    return std::nullopt;
-  }
-}
-
 bool isBlankLine(std::string_view line) {
   for (char ch : line) {
     if (ch != ' ' && ch != '\t' && ch != '\r') {
@@ -260,92 +208,96 @@ void shiftConditionLines(Condition *condition, int delta) {
   shiftExprLines(condition->rhs, delta);
 }
 
+void shiftLineLocations(Line &line, int delta) {
+  line.line_index += delta;
+  if (line.block_delete_location.has_value()) {
+    shiftLocationLines(&*line.block_delete_location, delta);
+  }
+  if (line.block_delete_level_location.has_value()) {
+    shiftLocationLines(&*line.block_delete_level_location, delta);
+  }
+  if (line.line_number.has_value()) {
+    shiftLocationLines(&line.line_number->location, delta);
+  }
+  for (auto &item : line.items) {
+    if (std::holds_alternative<Word>(item)) {
+      shiftLocationLines(&std::get<Word>(item).location, delta);
+    } else {
+      shiftLocationLines(&std::get<Comment>(item).location, delta);
+    }
+  }
+  if (line.assignment().has_value()) {
+    shiftLocationLines(&line.assignment()->location, delta);
+    shiftExprLines(line.assignment()->rhs, delta);
+  }
+  if (line.label_definition().has_value()) {
+    shiftLocationLines(&line.label_definition()->location, delta);
+  }
+  if (line.goto_statement().has_value()) {
+    shiftLocationLines(&line.goto_statement()->keyword_location, delta);
+    shiftLocationLines(&line.goto_statement()->target_location, delta);
+  }
+  if (line.if_goto_statement().has_value()) {
+    shiftLocationLines(&line.if_goto_statement()->keyword_location, delta);
+    shiftConditionLines(&line.if_goto_statement()->condition, delta);
+    shiftLocationLines(
+        &line.if_goto_statement()->then_branch.keyword_location, delta);
+    shiftLocationLines(
+        &line.if_goto_statement()->then_branch.target_location, delta);
+    if (line.if_goto_statement()->else_branch.has_value()) {
+      shiftLocationLines(
+          &line.if_goto_statement()->else_branch->keyword_location, delta);
+      shiftLocationLines(
+          &line.if_goto_statement()->else_branch->target_location, delta);
+    }
+  }
+  if (line.if_block_start_statement().has_value()) {
+    shiftLocationLines(&line.if_block_start_statement()->keyword_location,
+                       delta);
+    shiftConditionLines(&line.if_block_start_statement()->condition, delta);
+  }
+  if (line.else_statement().has_value()) {
+    shiftLocationLines(&line.else_statement()->keyword_location, delta);
+  }
+  if (line.endif_statement().has_value()) {
+    shiftLocationLines(&line.endif_statement()->keyword_location, delta);
+  }
+  if (line.while_statement().has_value()) {
+    shiftLocationLines(&line.while_statement()->keyword_location, delta);
+    shiftConditionLines(&line.while_statement()->condition, delta);
+  }
+  if (line.endwhile_statement().has_value()) {
+    shiftLocationLines(&line.endwhile_statement()->keyword_location, delta);
+  }
+  if (line.for_statement().has_value()) {
+    shiftLocationLines(&line.for_statement()->keyword_location, delta);
+    shiftExprLines(line.for_statement()->start, delta);
+    shiftExprLines(line.for_statement()->end, delta);
+  }
+  if (line.endfor_statement().has_value()) {
+    shiftLocationLines(&line.endfor_statement()->keyword_location, delta);
+  }
+  if (line.repeat_statement().has_value()) {
+    shiftLocationLines(&line.repeat_statement()->keyword_location, delta);
+  }
+  if (line.until_statement().has_value()) {
+    shiftLocationLines(&line.until_statement()->keyword_location, delta);
+    shiftConditionLines(&line.until_statement()->condition, delta);
+  }
+  if (line.loop_statement().has_value()) {
+    shiftLocationLines(&line.loop_statement()->keyword_location, delta);
+  }
+  if (line.endloop_statement().has_value()) {
+    shiftLocationLines(&line.endloop_statement()->keyword_location, delta);
+  }
+}
+
 void shiftProgramLines(Program *program, int delta) {
   if (!program || delta == 0) {
     return;
   }
   for (auto &line : program->lines) {
-    line.line_index += delta;
-    if (line.block_delete_location.has_value()) {
-      shiftLocationLines(&*line.block_delete_location, delta);
-    }
-    if (line.block_delete_level_location.has_value()) {
-      shiftLocationLines(&*line.block_delete_level_location, delta);
-    }
-    if (line.line_number.has_value()) {
-      shiftLocationLines(&line.line_number->location, delta);
-    }
-    for (auto &item : line.items) {
-      if (std::holds_alternative<Word>(item)) {
-        shiftLocationLines(&std::get<Word>(item).location, delta);
-      } else {
-        shiftLocationLines(&std::get<Comment>(item).location, delta);
-      }
-    }
-    if (line.assignment.has_value()) {
-      shiftLocationLines(&line.assignment->location, delta);
-      shiftExprLines(line.assignment->rhs, delta);
-    }
-    if (line.label_definition.has_value()) {
-      shiftLocationLines(&line.label_definition->location, delta);
-    }
-    if (line.goto_statement.has_value()) {
-      shiftLocationLines(&line.goto_statement->keyword_location, delta);
-      shiftLocationLines(&line.goto_statement->target_location, delta);
-    }
-    if (line.if_goto_statement.has_value()) {
-      shiftLocationLines(&line.if_goto_statement->keyword_location, delta);
-      shiftConditionLines(&line.if_goto_statement->condition, delta);
-      shiftLocationLines(&line.if_goto_statement->then_branch.keyword_location,
-                         delta);
-      shiftLocationLines(&line.if_goto_statement->then_branch.target_location,
-                         delta);
-      if (line.if_goto_statement->else_branch.has_value()) {
-        shiftLocationLines(
-            &line.if_goto_statement->else_branch->keyword_location, delta);
-        shiftLocationLines(
-            &line.if_goto_statement->else_branch->target_location, delta);
-      }
-    }
-    if (line.if_block_start_statement.has_value()) {
-      shiftLocationLines(&line.if_block_start_statement->keyword_location,
-                         delta);
-      shiftConditionLines(&line.if_block_start_statement->condition, delta);
-    }
-    if (line.else_statement.has_value()) {
-      shiftLocationLines(&line.else_statement->keyword_location, delta);
-    }
-    if (line.endif_statement.has_value()) {
-      shiftLocationLines(&line.endif_statement->keyword_location, delta);
-    }
-    if (line.while_statement.has_value()) {
-      shiftLocationLines(&line.while_statement->keyword_location, delta);
-      shiftConditionLines(&line.while_statement->condition, delta);
-    }
-    if (line.endwhile_statement.has_value()) {
-      shiftLocationLines(&line.endwhile_statement->keyword_location, delta);
-    }
-    if (line.for_statement.has_value()) {
-      shiftLocationLines(&line.for_statement->keyword_location, delta);
-      shiftExprLines(line.for_statement->start, delta);
-      shiftExprLines(line.for_statement->end, delta);
-    }
-    if (line.endfor_statement.has_value()) {
-      shiftLocationLines(&line.endfor_statement->keyword_location, delta);
-    }
-    if (line.repeat_statement.has_value()) {
-      shiftLocationLines(&line.repeat_statement->keyword_location, delta);
-    }
-    if (line.until_statement.has_value()) {
-      shiftLocationLines(&line.until_statement->keyword_location, delta);
-      shiftConditionLines(&line.until_statement->condition, delta);
-    }
-    if (line.loop_statement.has_value()) {
-      shiftLocationLines(&line.loop_statement->keyword_location, delta);
-    }
-    if (line.endloop_statement.has_value()) {
-      shiftLocationLines(&line.endloop_statement->keyword_location, delta);
-    }
+    shiftLineLocations(line, delta);
   }
 }
 
@@ -391,39 +343,34 @@ private:
   std::vector<Diagnostic> *out_;
 };
 
-class AstBuilder : public GCodeBaseVisitor {
+// Builds each Line as soon as the parser exits its rule and appends it to
+// `lines`, so the AST is produced during the parse instead of by a second
+// walk over the finished tree and no Line is copied through antlrcpp::Any.
+class AstBuilder : public GCodeBaseListener {
 public:
-  Program program;
+  // With `skip_failed_lines`, lines whose rule exits with an exception are
+  // dropped; in bail mode that exit is the parse being cancelled.
+  AstBuilder(std::vector<Line> *lines, bool skip_failed_lines)
+      : lines_(lines), skip_failed_lines_(skip_failed_lines) {}
 
-  antlrcpp::Any visitProgram(GCodeParser::ProgramContext *ctx) override {
-    program.lines.clear();
-    for (auto *line_ctx : ctx->line()) {
-      auto line_any = visitLine(line_ctx);
-      if (auto *line_ptr = std::any_cast<Line>(&line_any)) {
-        program.lines.push_back(*line_ptr);
-      }
-    }
-    if (auto *tail_ctx = ctx->line_no_eol()) {
-      if (tail_ctx->block_delete() || tail_ctx->line_number() ||
-          tail_ctx->statement()) {
-        auto line_any = visitLine_no_eol(tail_ctx);
-        if (auto *line_ptr = std::any_cast<Line>(&line_any)) {
-          program.lines.push_back(*line_ptr);
-        }
-      }
+  void exitLine(GCodeParser::LineContext *ctx) override {
+    if (skip_failed_lines_ && ctx->exception) {
+      return;
     }
-    return program;
-  }
-
-  antlrcpp::Any visitLine(GCodeParser::LineContext *ctx) override {
-    return buildLine(ctx->getStart(), ctx->block_delete(), ctx->skip_level(),
-                     ctx->line_number(), ctx->statement());
+    lines_->push_back(buildLine(ctx->getStart(), ctx->block_delete(),
+                                ctx->skip_level(), ctx->line_number(),
+                                ctx->statement()));
   }
 
-  antlrcpp::Any
-  visitLine_no_eol(GCodeParser::Line_no_eolContext *ctx) override {
-    return buildLine(ctx->getStart(), ctx->block_delete(), ctx->skip_level(),
-                     ctx->line_number(), ctx->statement());
+  void exitLine_no_eol(GCodeParser::Line_no_eolContext *ctx) override {
+    if (skip_failed_lines_ && ctx->exception) {
+      return;
+    }
+    if (ctx->block_delete() || ctx->line_number() || ctx->statement()) {
+      lines_->push_back(buildLine(ctx->getStart(), ctx->block_delete(),
+                                  ctx->skip_level(), ctx->line_number(),
+                                  ctx->statement()));
+    }
   }
 
 private:
@@ -502,11 +449,11 @@ private:
     stmt.keyword_location = jumpKeywordLocation(ctx->jump_keyword());
     auto *target = ctx->goto_target();
     if (target->WORD()) {
-      stmt.target = toUpper(target->WORD()->getText());
+      stmt.target = toUpperAscii(target->WORD()->getText());
       stmt.target_kind = "label";
       stmt.target_location = locationFromToken(target->WORD()->getSymbol());
     } else if (target->LINE_NUMBER()) {
-      stmt.target = toUpper(target->LINE_NUMBER()->getText());
+      stmt.target = toUpperAscii(target->LINE_NUMBER()->getText());
       stmt.target_kind = "line_number";
       stmt.target_location =
           locationFromToken(target->LINE_NUMBER()->getSymbol());
@@ -515,7 +462,7 @@ private:
       stmt.target_kind = "number";
       stmt.target_location = locationFromToken(target->NUMBER()->getSymbol());
     } else if (target->SYSTEM_VAR()) {
-      stmt.target = toUpper(target->SYSTEM_VAR()->getText());
+      stmt.target = toUpperAscii(target->SYSTEM_VAR()->getText());
       stmt.target_kind = "system_variable";
       stmt.target_location =
           locationFromToken(target->SYSTEM_VAR()->getSymbol());
@@ -585,11 +532,8 @@ private:
     if (ctx->NUMBER()) {
       ExprLiteral literal;
       literal.location = locationFromToken(ctx->NUMBER()->getSymbol());
-      try {
-        literal.value = std::stod(ctx->NUMBER()->getText());
-      } catch (...) {
-        literal.value = 0.0;
-      }
+      literal.value =
+          parseNumberPrefix(ctx->NUMBER()->getText()).value_or(0.0);
       node->node = std::move(literal);
       return node;
     }
@@ -597,10 +541,10 @@ private:
     ExprVariable variable;
     variable.location = locationFromToken(ctx->getStart());
     if (ctx->SYSTEM_VAR()) {
-      variable.name = toUpper(ctx->SYSTEM_VAR()->getText());
+      variable.name = toUpperAscii(ctx->SYSTEM_VAR()->getText());
       variable.is_system = true;
     } else if (ctx->WORD()) {
-      variable.name = toUpper(ctx->WORD()->getText());
+      variable.name = toUpperAscii(ctx->WORD()->getText());
     }
     node->node = std::move(variable);
     return node;
@@ -629,29 +573,26 @@ private:
       number.location = locationFromToken(token);
       std::string text = token->getText();
       if (text.size() > 1) {
-        try {
-          number.value = std::stoi(text.substr(1));
-        } catch (...) {
-          number.value = 0;
-        }
+        number.value =
+            parseIntegerPrefix(std::string_view(text).substr(1)).value_or(0);
       }
       line.line_number = number;
     }
     if (statement_ctx && statement_ctx->assignment_stmt()) {
       auto *assign_ctx = statement_ctx->assignment_stmt();
       Assignment assignment;
-      assignment.lhs = toUpper(assign_ctx->WORD()->getText());
+      assignment.lhs = toUpperAscii(assign_ctx->WORD()->getText());
       assignment.location = locationFromToken(assign_ctx->WORD()->getSymbol());
       assignment.rhs = buildExpr(assign_ctx->expr());
-      line.assignment = std::move(assignment);
+      line.statement.emplace(std::move(assignment));
     } else if (statement_ctx && statement_ctx->label_stmt()) {
       auto *label_ctx = statement_ctx->label_stmt();
       LabelDefinition label;
-      label.name = toUpper(label_ctx->WORD()->getText());
+      label.name = toUpperAscii(label_ctx->WORD()->getText());
       label.location = locationFromToken(label_ctx->WORD()->getSymbol());
-      line.label_definition = std::move(label);
+      line.statement.emplace(std::move(label));
     } else if (statement_ctx && statement_ctx->goto_stmt()) {
-      line.goto_statement = buildGotoStatement(statement_ctx->goto_stmt());
+      line.statement.emplace(buildGotoStatement(statement_ctx->goto_stmt()));
     } else if (statement_ctx && statement_ctx->if_goto_stmt()) {
       auto *if_ctx = statement_ctx->if_goto_stmt();
       IfGotoStatement if_stmt;
@@ -662,112 +603,90 @@ private:
       if (if_ctx->goto_stmt().size() > 1) {
         if_stmt.else_branch = buildGotoStatement(if_ctx->goto_stmt(1));
       }
-      line.if_goto_statement = std::move(if_stmt);
+      line.statement.emplace(std::move(if_stmt));
     } else if (statement_ctx && statement_ctx->if_block_start_stmt()) {
       auto *if_ctx = statement_ctx->if_block_start_stmt();
       IfBlockStartStatement if_stmt;
       if_stmt.keyword_location =
           locationFromToken(if_ctx->IF_KW()->getSymbol());
       if_stmt.condition = buildCondition(if_ctx->condition());
-      line.if_block_start_statement = std::move(if_stmt);
+      line.statement.emplace(std::move(if_stmt));
     } else if (statement_ctx && statement_ctx->else_stmt()) {
       ElseStatement else_stmt;
       else_stmt.keyword_location =
           locationFromToken(statement_ctx->else_stmt()->ELSE_KW()->getSymbol());
-      line.else_statement = else_stmt;
+      line.statement.emplace(else_stmt);
     } else if (statement_ctx && statement_ctx->endif_stmt()) {
       EndIfStatement endif_stmt;
       endif_stmt.keyword_location = locationFromToken(
           statement_ctx->endif_stmt()->ENDIF_KW()->getSymbol());
-      line.endif_statement = endif_stmt;
+      line.statement.emplace(endif_stmt);
     } else if (statement_ctx && statement_ctx->while_stmt()) {
       auto *while_ctx = statement_ctx->while_stmt();
       WhileStatement while_stmt;
       while_stmt.keyword_location =
           locationFromToken(while_ctx->WHILE_KW()->getSymbol());
       while_stmt.condition = buildCondition(while_ctx->condition());
-      line.while_statement = std::move(while_stmt);
+      line.statement.emplace(std::move(while_stmt));
     } else if (statement_ctx && statement_ctx->endwhile_stmt()) {
       EndWhileStatement endwhile_stmt;
       endwhile_stmt.keyword_location = locationFromToken(
           statement_ctx->endwhile_stmt()->ENDWHILE_KW()->getSymbol());
-      line.endwhile_statement = endwhile_stmt;
+      line.statement.emplace(endwhile_stmt);
     } else if (statement_ctx && statement_ctx->for_stmt()) {
       auto *for_ctx = statement_ctx->for_stmt();
       ForStatement for_stmt;
       for_stmt.keyword_location =
           locationFromToken(for_ctx->FOR_KW()->getSymbol());
-      for_stmt.variable = toUpper(for_ctx->WORD()->getText());
+      for_stmt.variable = toUpperAscii(for_ctx->WORD()->getText());
       for_stmt.start = buildExpr(for_ctx->expr(0));
       for_stmt.end = buildExpr(for_ctx->expr(1));
-      line.for_statement = std::move(for_stmt);
+      line.statement.emplace(std::move(for_stmt));
     } else if (statement_ctx && statement_ctx->endfor_stmt()) {
       EndForStatement endfor_stmt;
       endfor_stmt.keyword_location = locationFromToken(
           statement_ctx->endfor_stmt()->ENDFOR_KW()->getSymbol());
-      line.endfor_statement = endfor_stmt;
+      line.statement.emplace(endfor_stmt);
     } else if (statement_ctx && statement_ctx->repeat_stmt()) {
       RepeatStatement repeat_stmt;
       repeat_stmt.keyword_location = locationFromToken(
           statement_ctx->repeat_stmt()->REPEAT_KW()->getSymbol());
-      line.repeat_statement = repeat_stmt;
+      line.statement.emplace(repeat_stmt);
     } else if (statement_ctx && statement_ctx->until_stmt()) {
       auto *until_ctx = statement_ctx->until_stmt();
       UntilStatement until_stmt;
       until_stmt.keyword_location =
           locationFromToken(until_ctx->UNTIL_KW()->getSymbol());
       until_stmt.condition = buildCondition(until_ctx->condition());
-      line.until_statement = std::move(until_stmt);
+      line.statement.emplace(std::move(until_stmt));
     } else if (statement_ctx && statement_ctx->loop_stmt()) {
       LoopStatement loop_stmt;
       loop_stmt.keyword_location =
           locationFromToken(statement_ctx->loop_stmt()->LOOP_KW()->getSymbol());
-      line.loop_statement = loop_stmt;
+      line.statement.emplace(loop_stmt);
     } else if (statement_ctx && statement_ctx->endloop_stmt()) {
       EndLoopStatement endloop_stmt;
       endloop_stmt.keyword_location = locationFromToken(
           statement_ctx->endloop_stmt()->ENDLOOP_KW()->getSymbol());
-      line.endloop_statement = endloop_stmt;
+      line.statement.emplace(endloop_stmt);
     } else if (statement_ctx) {
       for (auto *item_ctx : statement_ctx->item()) {
         if (auto *word_node = item_ctx->WORD()) {
           auto *token = word_node->getSymbol();
-          Word word;
-          word.text = token->getText();
-          word.location = locationFromToken(token);
-          auto parts = splitWordText(word.text);
-          word.head = toUpper(parts.head);
-          word.value = parts.value;
-          word.has_equal = parts.has_equal;
-          line.items.emplace_back(std::move(word));
+          line.items.emplace_back(
+              makeWord(token->getText(), locationFromToken(token)));
           continue;
         }
         if (auto *quoted_word_node = item_ctx->QUOTED_WORD()) {
           auto *token = quoted_word_node->getSymbol();
-          Word word;
-          word.text = token->getText();
-          if (word.text.size() >= 2 && word.text.front() == '"' &&
-              word.text.back() == '"') {
-            word.text = word.text.substr(1, word.text.size() - 2);
-          }
-          word.location = locationFromToken(token);
-          word.head = toUpper(word.text);
-          word.value = std::nullopt;
-          word.has_equal = false;
-          word.quoted = true;
-          line.items.emplace_back(std::move(word));
+          line.items.emplace_back(
+              makeQuotedWord(token->getText(), locationFromToken(token)));
           continue;
         }
         if (auto *line_number_node = item_ctx->LINE_NUMBER()) {
           auto *token = line_number_node->getSymbol();
-          Word word;
-          word.text = token->getText();
-          word.location = locationFromToken(token);
-          auto parts = splitWordText(word.text);
-          word.head = toUpper(parts.head);
-          word.value = parts.value;
-          word.has_equal = parts.has_equal;
-          line.items.emplace_back(std::move(word));
+          line.items.emplace_back(
+              makeWord(token->getText(), locationFromToken(token)));
           continue;
         }
         if (auto *comment_node = item_ctx->COMMENT()) {
@@ -785,36 +704,36 @@ private:
       } else {
         line.line_index = std::get<Comment>(line.items.front()).location.line;
       }
-    } else if (line.assignment.has_value()) {
-      line.line_index = line.assignment->location.line;
-    } else if (line.label_definition.has_value()) {
-      line.line_index = line.label_definition->location.line;
-    } else if (line.goto_statement.has_value()) {
-      line.line_index = line.goto_statement->keyword_location.line;
-    } else if (line.if_goto_statement.has_value()) {
-      line.line_index = line.if_goto_statement->keyword_location.line;
-    } else if (line.if_block_start_statement.has_value()) {
-      line.line_index = line.if_block_start_statement->keyword_location.line;
-    } else if (line.else_statement.has_value()) {
-      line.line_index = line.else_statement->keyword_location.line;
-    } else if (line.endif_statement.has_value()) {
-      line.line_index = line.endif_statement->keyword_location.line;
-    } else if (line.while_statement.has_value()) {
-      line.line_index = line.while_statement->keyword_location.line;
-    } else if (line.endwhile_statement.has_value()) {
-      line.line_index = line.endwhile_statement->keyword_location.line;
-    } else if (line.for_statement.has_value()) {
-      line.line_index = line.for_statement->keyword_location.line;
-    } else if (line.endfor_statement.has_value()) {
-      line.line_index = line.endfor_statement->keyword_location.line;
-    } else if (line.repeat_statement.has_value()) {
-      line.line_index = line.repeat_statement->keyword_location.line;
-    } else if (line.until_statement.has_value()) {
-      line.line_index = line.until_statement->keyword_location.line;
-    } else if (line.loop_statement.has_value()) {
-      line.line_index = line.loop_statement->keyword_location.line;
-    } else if (line.endloop_statement.has_value()) {
-      line.line_index = line.endloop_statement->keyword_location.line;
+    } else if (line.assignment().has_value()) {
+      line.line_index = line.assignment()->location.line;
+    } else if (line.label_definition().has_value()) {
+      line.line_index = line.label_definition()->location.line;
+    } else if (line.goto_statement().has_value()) {
+      line.line_index = line.goto_statement()->keyword_location.line;
+    } else if (line.if_goto_statement().has_value()) {
+      line.line_index = line.if_goto_statement()->keyword_location.line;
+    } else if (line.if_block_start_statement().has_value()) {
+      line.line_index = line.if_block_start_statement()->keyword_location.line;
+    } else if (line.else_statement().has_value()) {
+      line.line_index = line.else_statement()->keyword_location.line;
+    } else if (line.endif_statement().has_value()) {
+      line.line_index = line.endif_statement()->keyword_location.line;
+    } else if (line.while_statement().has_value()) {
+      line.line_index = line.while_statement()->keyword_location.line;
+    } else if (line.endwhile_statement().has_value()) {
+      line.line_index = line.endwhile_statement()->keyword_location.line;
+    } else if (line.for_statement().has_value()) {
+      line.line_index = line.for_statement()->keyword_location.line;
+    } else if (line.endfor_statement().has_value()) {
+      line.line_index = line.endfor_statement()->keyword_location.line;
+    } else if (line.repeat_statement().has_value()) {
+      line.line_index = line.repeat_statement()->keyword_location.line;
+    } else if (line.until_statement().has_value()) {
+      line.line_index = line.until_statement()->keyword_location.line;
+    } else if (line.loop_statement().has_value()) {
+      line.line_index = line.loop_statement()->keyword_location.line;
+    } else if (line.endloop_statement().has_value()) {
+      line.line_index = line.endloop_statement()->keyword_location.line;
     } else if (line.line_number.has_value()) {
       line.line_index = line.line_number->location.line;
     } else if (line.block_delete_location.has_value()) {
@@ -824,86 +743,628 @@ private:
     }
     return line;
   }
+
+  std::vector<Line> *lines_;
+  bool skip_failed_lines_;
 };
 
-void addBlockLengthDiagnostics(std::string_view input,
-                               std::vector<Diagnostic> *diagnostics) {
-  if (!diagnostics) {
-    return;
+std::vector<antlr4::dfa::DFA> makeDecisionDfas(const antlr4::atn::ATN &atn) {
+  std::vector<antlr4::dfa::DFA> dfas;
+  dfas.reserve(atn.getNumberOfDecisions());
+  for (size_t decision = 0; decision < atn.getNumberOfDecisions();
+       ++decision) {
+    dfas.emplace_back(atn.getDecisionState(decision), decision);
   }
-  constexpr int kMaxBlockLength = 512;
+  return dfas;
+}
 
-  int line = 1;
-  int line_length = 0;
-  for (size_t i = 0; i < input.size(); ++i) {
-    const char ch = input[i];
-    if (ch == '\n') {
-      const int block_length =
-          line_length + 1; // LF is counted by Siemens rule.
-      if (block_length > kMaxBlockLength) {
-        Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Error;
-        diag.message =
-            "block length exceeds 512 characters (including end-of-block LF)";
-        diag.location = {line, kMaxBlockLength + 1};
-        diagnostics->push_back(std::move(diag));
+// Lexer and parser simulators over DFA caches of their own, for
+// ParserDfaCache::PerContext. The generated recognizers' simulators use the
+// process-wide caches instead.
+struct PrivateDfaCache {
+  PrivateDfaCache(GCodeLexer *lexer, GCodeParser *parser)
+      : lexer_dfa(makeDecisionDfas(lexer->getATN())),
+        parser_dfa(makeDecisionDfas(parser->getATN())),
+        lexer_simulator(lexer, lexer->getATN(), lexer_dfa,
+                        lexer_context_cache),
+        parser_simulator(parser, parser->getATN(), parser_dfa,
+                         parser_context_cache) {}
+
+  std::vector<antlr4::dfa::DFA> lexer_dfa;
+  std::vector<antlr4::dfa::DFA> parser_dfa;
+  antlr4::atn::PredictionContextCache lexer_context_cache;
+  antlr4::atn::PredictionContextCache parser_context_cache;
+  antlr4::atn::LexerATNSimulator lexer_simulator;
+  antlr4::atn::ParserATNSimulator parser_simulator;
+};
+
+// Lexer, token stream and parser reused from one ANTLR run to the next, so a
+// parse of a few lines does not pay for constructing them (and their ATN
+// simulators) each time. Between runs the lexer reads an empty stream, the
+// tokens and parse tree of the last run are released, and the recognizers
+// hold their own (shared-cache) simulators, which they delete.
+struct AntlrParser {
+  AntlrParser()
+      : lexer(&idle_input), tokens(&lexer), parser(&tokens),
+        shared_lexer_simulator(
+            lexer.getInterpreter<antlr4::atn::LexerATNSimulator>()),
+        shared_parser_simulator(
+            parser.getInterpreter<antlr4::atn::ParserATNSimulator>()) {}
+
+  Utf8ViewCharStream idle_input{std::string_view()};
+  GCodeLexer lexer;
+  antlr4::CommonTokenStream tokens;
+  GCodeParser parser;
+  antlr4::atn::LexerATNSimulator *shared_lexer_simulator;
+  antlr4::atn::ParserATNSimulator *shared_parser_simulator;
+  // Made by the first ParserDfaCache::PerContext run.
+  std::unique_ptr<PrivateDfaCache> private_dfa;
+  const std::shared_ptr<antlr4::ANTLRErrorStrategy> recover_strategy =
+      std::make_shared<antlr4::DefaultErrorStrategy>();
+  const std::shared_ptr<antlr4::ANTLRErrorStrategy> bail_strategy =
+      std::make_shared<antlr4::BailErrorStrategy>();
+};
+
+// Used by parse() calls that do not pass a ParserContext, and by the worker
+// threads of a parallel parse.
+AntlrParser &threadAntlrParser() {
+  thread_local AntlrParser antlr;
+  return antlr;
+}
+
+// Detaches `antlr` from one run's stream and listeners when the run ends,
+// however it ends.
+class AntlrRunScope {
+public:
+  explicit AntlrRunScope(AntlrParser *antlr) : antlr_(antlr) {}
+  AntlrRunScope(const AntlrRunScope &) = delete;
+  AntlrRunScope &operator=(const AntlrRunScope &) = delete;
+
+  ~AntlrRunScope() {
+    antlr_->lexer.setInputStream(&antlr_->idle_input);
+    antlr_->lexer.removeErrorListeners();
+    antlr_->tokens.setTokenSource(&antlr_->lexer);
+    antlr_->parser.removeErrorListeners();
+    antlr_->parser.removeParseListeners();
+    antlr_->parser.reset();
+    antlr_->lexer.setInterpreter(antlr_->shared_lexer_simulator);
+    antlr_->parser.setInterpreter(antlr_->shared_parser_simulator);
+  }
+
+private:
+  AntlrParser *antlr_;
+};
+
+// One ANTLR run over `text`. With `sll_bail` the parser predicts in SLL mode
+// and gives up at the first syntax error (returns false, nothing recorded);
+// otherwise it runs full LL with error recovery and reports diagnostics.
+// Valid UTF-8 is lexed in place; anything else still goes through
+// ANTLRInputStream so malformed input is rejected exactly as before.
+std::unique_ptr<antlr4::CharStream> makeCharStream(std::string_view text) {
+  if (isValidUtf8(text)) {
+    return std::make_unique<Utf8ViewCharStream>(text);
+  }
+  return std::make_unique<antlr4::ANTLRInputStream>(text);
+}
+
+bool runAntlrParse(AntlrParser *antlr, std::string_view text, bool sll_bail,
+                   ParserDfaCache dfa_cache, Program *program,
+                   std::vector<Diagnostic> *diagnostics) {
+  // The parser still builds each line's subtree (the builder reads it when
+  // the line rule exits), but lines go straight into `program` as the parse
+  // runs instead of through a second walk over the finished tree.
+  program->lines.clear();
+  program->lines.reserve(
+      static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) + 1);
+  AstBuilder builder(&program->lines, sll_bail);
+  DiagnosticErrorListener error_listener(diagnostics);
+
+  const auto stream = makeCharStream(text);
+  AntlrRunScope scope(antlr);
+  auto &lexer = antlr->lexer;
+  auto &parser = antlr->parser;
+  if (dfa_cache == ParserDfaCache::PerContext) {
+    if (!antlr->private_dfa) {
+      antlr->private_dfa = std::make_unique<PrivateDfaCache>(&lexer, &parser);
+    }
+    lexer.setInterpreter(&antlr->private_dfa->lexer_simulator);
+    parser.setInterpreter(&antlr->private_dfa->parser_simulator);
+  }
+  lexer.setInputStream(stream.get());
+  antlr->tokens.setTokenSource(&lexer);
+  lexer.addErrorListener(&error_listener);
+  parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(
+      sll_bail ? antlr4::atn::PredictionMode::SLL
+               : antlr4::atn::PredictionMode::LL);
+  if (sll_bail) {
+    parser.setErrorHandler(antlr->bail_strategy);
+  } else {
+    parser.setErrorHandler(antlr->recover_strategy);
+    parser.addErrorListener(&error_listener);
+  }
+  // Also resets the parser and the error strategy.
+  parser.setTokenStream(&antlr->tokens);
+
+  parser.addParseListener(&builder);
+  parser.setBuildParseTree(true);
+  try {
+    parser.program();
+  } catch (const antlr4::ParseCancellationException &) {
+    return false;
+  }
+  return true;
+}
+
+ParsePredictionStage laterStage(ParsePredictionStage lhs,
+                                ParsePredictionStage rhs) {
+  return static_cast<int>(lhs) >= static_cast<int>(rhs) ? lhs : rhs;
+}
+
+// If SLL parses without a syntax error the input is valid and full LL would
+// build the same tree, so the only diagnostics are the lexer's. Otherwise the
+// SLL attempt is discarded and full LL re-lexes and re-parses from scratch,
+// which keeps diagnostics (and their order) identical to a plain LL parse.
+ParsePredictionStage parseWithAntlr(AntlrParser *antlr, std::string_view text,
+                                    const ParseOptions &options,
+                                    Program *program,
+                                    std::vector<Diagnostic> *diagnostics) {
+  if (options.prediction_mode == ParsePredictionMode::SllThenLl) {
+    Program sll_program;
+    std::vector<Diagnostic> sll_diagnostics;
+    if (runAntlrParse(antlr, text, true, options.dfa_cache, &sll_program,
+                      &sll_diagnostics)) {
+      program->lines = std::move(sll_program.lines);
+      for (auto &diagnostic : sll_diagnostics) {
+        diagnostics->push_back(std::move(diagnostic));
       }
-      ++line;
-      line_length = 0;
-      continue;
+      return ParsePredictionStage::Sll;
     }
-    if (ch != '\r') {
-      ++line_length;
+  }
+  runAntlrParse(antlr, text, false, options.dfa_cache, program, diagnostics);
+  return ParsePredictionStage::Ll;
+}
+
+// Receives the lines built by parseWithFastBlockPath in program order.
+class LineSegmentSink {
+public:
+  virtual ~LineSegmentSink() = default;
+  virtual void addFastBlock(const FastBlock &block, int line_number) = 0;
+  // Lines of an ANTLR-parsed segment, already shifted to their text lines.
+  virtual void addSegment(Program *segment) = 0;
+};
+
+class ProgramLineSink : public LineSegmentSink {
+public:
+  explicit ProgramLineSink(Program *program) : program_(program) {}
+
+  void addFastBlock(const FastBlock &block, int line_number) override {
+    program_->lines.push_back(makeFastBlockLine(block, line_number));
+  }
+
+  void addSegment(Program *segment) override {
+    for (auto &line : segment->lines) {
+      program_->lines.push_back(std::move(line));
+    }
+  }
+
+private:
+  Program *program_;
+};
+
+class CompactLineSink : public LineSegmentSink {
+public:
+  explicit CompactLineSink(CompactProgramBuilder *builder)
+      : builder_(builder) {}
+
+  void addFastBlock(const FastBlock &block, int line_number) override {
+    builder_->addFastBlock(block, line_number);
+  }
+
+  void addSegment(Program *segment) override {
+    for (const auto &line : segment->lines) {
+      builder_->addLine(line);
     }
   }
+
+private:
+  CompactProgramBuilder *builder_;
+};
+
+// Plain blocks are built by the fast scanner; every maximal run of other
+// lines is parsed by ANTLR on its own and spliced back in order. A clean
+// segment parse matches the whole-program parse because the grammar is
+// line-oriented, but ANTLR error recovery may cross a segment boundary, so a
+// segment with diagnostics makes the caller re-parse everything with ANTLR
+// (returns false). A single segment covering the whole text is the
+// whole-program parse and is accepted as is. `first_line` is the line number
+// of the first line of `text`.
+bool parseWithFastBlockPath(AntlrParser *antlr, std::string_view text,
+                            int first_line, const ParseOptions &options,
+                            LineSegmentSink *sink,
+                            std::vector<Diagnostic> *diagnostics,
+                            ParsePredictionStage *stage) {
+  if (!allowsLineSegmentedParse(text)) {
+    return false;
+  }
+
+  size_t segment_begin = std::string_view::npos;
+  int segment_first_line = 0;
+  auto flush_segment = [&](size_t segment_end) {
+    if (segment_begin == std::string_view::npos) {
+      return true;
+    }
+    Program segment;
+    std::vector<Diagnostic> segment_diagnostics;
+    *stage = laterStage(
+        *stage,
+        parseWithAntlr(antlr,
+                       text.substr(segment_begin, segment_end - segment_begin),
+                       options, &segment, &segment_diagnostics));
+    const bool whole_text = segment_begin == 0 && segment_end == text.size();
+    if (!segment_diagnostics.empty() && !whole_text) {
+      return false;
+    }
+    shiftProgramLines(&segment, segment_first_line - 1);
+    shiftDiagnosticLines(&segment_diagnostics, segment_first_line - 1);
+    sink->addSegment(&segment);
+    for (auto &diagnostic : segment_diagnostics) {
+      diagnostics->push_back(std::move(diagnostic));
+    }
+    segment_begin = std::string_view::npos;
+    return true;
+  };
+
+  FastBlock block;
+  size_t offset = 0;
+  int line_number = first_line;
+  while (offset < text.size()) {
+    const size_t newline = text.find('\n', offset);
+    const size_t body_end =
+        newline == std::string_view::npos ? text.size() : newline;
+    std::string_view body = text.substr(offset, body_end - offset);
+    // A trailing CR is part of CRLF, or a lone-CR EOL on the last line.
+    bool terminated = newline != std::string_view::npos;
+    if (!body.empty() && body.back() == '\r') {
+      body.remove_suffix(1);
+      terminated = true;
+    }
+
+    if (scanFastBlock(body, line_number, &block)) {
+      if (!flush_segment(offset)) {
+        return false;
+      }
+      // Like line_no_eol, an unterminated last line needs some content.
+      if (terminated || block.block_delete || block.line_number.has_value() ||
+          !block.items.empty()) {
+        sink->addFastBlock(block, line_number);
+      }
+    } else if (segment_begin == std::string_view::npos) {
+      segment_begin = offset;
+      segment_first_line = line_number;
+    }
+
+    if (newline == std::string_view::npos) {
+      break;
+    }
+    offset = newline + 1;
+    ++line_number;
+  }
+  return flush_segment(text.size());
 }
 
-} // namespace
+ParsePredictionStage parseLines(AntlrParser *antlr, std::string_view text,
+                                const ParseOptions &options, Program *program,
+                                std::vector<Diagnostic> *diagnostics) {
+  ParsePredictionStage stage = ParsePredictionStage::None;
+  ProgramLineSink sink(program);
+  if (options.enable_fast_block_path &&
+      parseWithFastBlockPath(antlr, text, 1, options, &sink, diagnostics,
+                             &stage)) {
+    return stage;
+  }
+  program->lines.clear();
+  diagnostics->clear();
+  return parseWithAntlr(antlr, text, options, program, diagnostics);
+}
 
-ParseResult parse(std::string_view input, const ParseOptions &options) {
+constexpr size_t kMinParallelChunkBytes = 64 * 1024;
+constexpr size_t kParallelChunksPerThread = 4;
+
+// Start offsets of chunks of roughly equal size, each beginning right after
+// a '\n'. The first offset is always 0.
+std::vector<size_t> splitAtLineStarts(std::string_view text,
+                                      size_t max_chunks) {
+  std::vector<size_t> starts{0};
+  const size_t target =
+      std::max(kMinParallelChunkBytes, text.size() / max_chunks);
+  while (text.size() - starts.back() > target) {
+    const size_t newline = text.find('\n', starts.back() + target);
+    if (newline == std::string_view::npos || newline + 1 >= text.size()) {
+      break;
+    }
+    starts.push_back(newline + 1);
+  }
+  return starts;
+}
+
+struct ChunkParse {
+  Program program;
+  std::vector<Diagnostic> diagnostics;
+  ParsePredictionStage stage = ParsePredictionStage::None;
+  int newline_count = 0;
+  bool clean = false;
+};
+
+// Chunks are parsed concurrently and stitched in input order. A chunk that
+// parses without diagnostics ends on a line boundary with nothing left open,
+// so it parses exactly as it does inside the whole text. From the first
+// chunk that reports anything (an unclosed comment, error recovery that may
+// run into the next chunk, or a decoding exception), the rest of the text is
+// parsed serially in one piece, which keeps diagnostics identical to the
+// serial parse. Chunks use the ANTLR objects of the thread they run on;
+// `antlr` serves the serial parts.
+ParsePredictionStage parseLinesParallel(AntlrParser *antlr,
+                                        std::string_view text,
+                                        const ParseOptions &options,
+                                        unsigned threads, Program *program,
+                                        std::vector<Diagnostic> *diagnostics) {
+  const auto starts =
+      splitAtLineStarts(text, threads * kParallelChunksPerThread);
+  if (starts.size() < 2 || !allowsLineSegmentedParse(text)) {
+    return parseLines(antlr, text, options, program, diagnostics);
+  }
+
+  std::vector<ChunkParse> chunks(starts.size());
+  parallelFor(chunks.size(), threads, [&](size_t index) {
+    const size_t end =
+        index + 1 < starts.size() ? starts[index + 1] : text.size();
+    const std::string_view chunk_text =
+        text.substr(starts[index], end - starts[index]);
+    auto &chunk = chunks[index];
+    chunk.newline_count = static_cast<int>(
+        std::count(chunk_text.begin(), chunk_text.end(), '\n'));
+    try {
+      chunk.stage = parseLines(&threadAntlrParser(), chunk_text, options,
+                               &chunk.program, &chunk.diagnostics);
+      chunk.clean = chunk.diagnostics.empty();
+    } catch (...) {
+      chunk.clean = false;
+    }
+  });
+
+  ParsePredictionStage stage = ParsePredictionStage::None;
+  int line_offset = 0;
+  for (size_t index = 0; index < chunks.size(); ++index) {
+    auto &chunk = chunks[index];
+    if (!chunk.clean) {
+      Program rest;
+      std::vector<Diagnostic> rest_diagnostics;
+      stage = laterStage(stage,
+                         parseLines(antlr, text.substr(starts[index]), options,
+                                    &rest, &rest_diagnostics));
+      shiftProgramLines(&rest, line_offset);
+      shiftDiagnosticLines(&rest_diagnostics, line_offset);
+      for (auto &line : rest.lines) {
+        program->lines.push_back(std::move(line));
+      }
+      for (auto &diagnostic : rest_diagnostics) {
+        diagnostics->push_back(std::move(diagnostic));
+      }
+      break;
+    }
+    shiftProgramLines(&chunk.program, line_offset);
+    for (auto &line : chunk.program.lines) {
+      program->lines.push_back(std::move(line));
+    }
+    stage = laterStage(stage, chunk.stage);
+    line_offset += chunk.newline_count;
+  }
+  return stage;
+}
+
+// One of every statement form, plus address words, comments, block delete
+// and a syntax error, so that warming up with it reaches most parser
+// decisions.
+constexpr std::string_view kWarmUpProgram =
+    "%MAIN\n"
+    "N10 G0 X0 Y0 Z5 (rapid)\n"
+    "/1 N20 G1 X1.5 Y-2 F1200 ; feed\n"
+    "G2 X10 Y5 I=AC(1) J=AC(2) CR=-5 AP=90 RP=10\n"
+    "M3 S1000 T=\"DRILL\" D1 M2=4\n"
+    "R1 = 1\n"
+    "R2 = -(R1 + 2) * 3 / $AA_IM[X] - 4\n"
+    "START_1:\n"
+    "IF R1 >= 10 AND R2 <> 0 GOTOF END_1 ELSE GOTOB START_1\n"
+    "IF R1 == 1 THEN GOTO N20\n"
+    "IF $P_TOOL < 2\n"
+    "G1 X=R1\n"
+    "ELSE\n"
+    "G1 Y=R2\n"
+    "ENDIF\n"
+    "WHILE R1 <= 3\n"
+    "R1 = R1 + 1\n"
+    "ENDWHILE\n"
+    "FOR R3 = 1 TO 5\n"
+    "ENDFOR\n"
+    "REPEAT\n"
+    "UNTIL R1 > 4\n"
+    "LOOP\n"
+    "ENDLOOP\n"
+    "GOTOC 100\n"
+    "END_1:\n"
+    "G1 X1 =\n"
+    "M30";
+
+ParseResult parseWith(AntlrParser *antlr, std::string_view input,
+                      const ParseOptions &options) {
   ParseResult result;
   size_t consumed_chars = 0;
   if (const auto program_name = parseLeadingProgramName(input, &consumed_chars);
       program_name.has_value()) {
     result.program.program_name = *program_name;
   }
-  const auto preserved_program_name = result.program.program_name;
-  const int skipped_lines = preserved_program_name.has_value()
-                                ? preserved_program_name->location.line
+  const int skipped_lines = result.program.program_name.has_value()
+                                ? result.program.program_name->location.line
                                 : 0;
   const std::string_view parse_input = input.substr(consumed_chars);
-  antlr4::ANTLRInputStream stream{std::string(parse_input)};
-  GCodeLexer lexer(&stream);
-  antlr4::CommonTokenStream tokens(&lexer);
-  GCodeParser parser(&tokens);
-
-  DiagnosticErrorListener error_listener(&result.diagnostics);
-  lexer.removeErrorListeners();
-  parser.removeErrorListeners();
-  lexer.addErrorListener(&error_listener);
-  parser.addErrorListener(&error_listener);
+  const unsigned threads = resolveThreadCount(options.parse_threads);
+  result.prediction_stage =
+      threads > 1
+          ? parseLinesParallel(antlr, parse_input, options, threads,
+                               &result.program, &result.diagnostics)
+          : parseLines(antlr, parse_input, options, &result.program,
+                       &result.diagnostics);
+  shiftProgramLines(&result.program, skipped_lines);
 
-  parser.setBuildParseTree(true);
-  auto *tree = parser.program();
-  if (tree) {
-    AstBuilder builder;
-    auto program_any = builder.visitProgram(tree);
-    if (auto *program_ptr = std::any_cast<Program>(&program_any)) {
-      result.program = *program_ptr;
-      result.program.program_name = preserved_program_name;
-      shiftProgramLines(&result.program, skipped_lines);
+  shiftDiagnosticLines(&result.diagnostics, skipped_lines);
+  addValidationDiagnostics(input, options, threads, result);
+  if (options.first_line != 1) {
+    const int delta = options.first_line - 1;
+    if (result.program.program_name.has_value()) {
+      shiftLocationLines(&result.program.program_name->location, delta);
     }
+    shiftProgramLines(&result.program, delta);
+    shiftDiagnosticLines(&result.diagnostics, delta);
   }
-
-  shiftDiagnosticLines(&result.diagnostics, skipped_lines);
-  addBlockLengthDiagnostics(input, &result.diagnostics);
-  addSemanticDiagnostics(result, options.enable_double_slash_comments,
-                         options.tool_management, options.enable_iso_m98_calls);
   return result;
 }
 
+// shiftProgramLines() for a compact result.
+void shiftCompactLines(CompactParseResult *result, int delta) {
+  if (delta == 0) {
+    return;
+  }
+  for (auto &line : result->lines) {
+    line.line_index += delta;
+    if (line.block_delete_location.has_value()) {
+      shiftLocationLines(&*line.block_delete_location, delta);
+    }
+    if (line.block_delete_level_location.has_value()) {
+      shiftLocationLines(&*line.block_delete_level_location, delta);
+    }
+    if (line.line_number.has_value()) {
+      shiftLocationLines(&line.line_number->location, delta);
+    }
+  }
+  for (auto &item : result->items) {
+    if (std::holds_alternative<CompactWord>(item)) {
+      shiftLocationLines(&std::get<CompactWord>(item).location, delta);
+    } else {
+      shiftLocationLines(&std::get<CompactComment>(item).location, delta);
+    }
+  }
+  for (auto &line : result->statement_lines) {
+    shiftLineLocations(line, delta);
+  }
+}
+
+} // namespace
+
+struct ParserContext::Impl {
+  AntlrParser antlr;
+};
+
+ParserContext::ParserContext() : impl_(std::make_unique<Impl>()) {}
+ParserContext::~ParserContext() = default;
+ParserContext::ParserContext(ParserContext &&) noexcept = default;
+ParserContext &ParserContext::operator=(ParserContext &&) noexcept = default;
+
+ParseResult parse(std::string_view input, const ParseOptions &options,
+                  ParserContext &context) {
+  return parseWith(&context.impl_->antlr, input, options);
+}
+
+ParseResult parse(std::string_view input, const ParseOptions &options) {
+  return parseWith(&threadAntlrParser(), input, options);
+}
+
 ParseResult parse(std::string_view input) {
   return parse(input, ParseOptions{});
 }
 
+void warmUpParser(const std::vector<std::string_view> &programs) {
+  ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  ParseOptions ll_only = antlr_only;
+  ll_only.prediction_mode = ParsePredictionMode::Ll;
+  auto warm_up = [&](std::string_view program) {
+    for (const auto &options : {ParseOptions{}, antlr_only, ll_only}) {
+      parse(program, options);
+    }
+  };
+  warm_up(kWarmUpProgram);
+  for (const auto program : programs) {
+    warm_up(program);
+  }
+}
+
+void clearParserCaches() {
+  auto &antlr = threadAntlrParser();
+  antlr.lexer.getInterpreter<antlr4::atn::LexerATNSimulator>()->clearDFA();
+  antlr.parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->clearDFA();
+  antlr.private_dfa.reset();
+}
+
+CompactParseResult parseCompact(std::string_view input,
+                                const ParseOptions &options) {
+  CompactParseResult result;
+  auto storage = std::make_shared<CompactTextStorage>();
+  storage->source.assign(input.data(), input.size());
+  const std::string_view source = storage->source;
+
+  size_t consumed_chars = 0;
+  result.program_name = parseLeadingProgramName(source, &consumed_chars);
+  const int skipped_lines =
+      result.program_name.has_value() ? result.program_name->location.line : 0;
+  const std::string_view parse_input = source.substr(consumed_chars);
+
+  CompactProgramBuilder builder(&result, storage.get());
+  CompactLineSink sink(&builder);
+  ParsePredictionStage stage = ParsePredictionStage::None;
+  if (!options.enable_fast_block_path ||
+      !parseWithFastBlockPath(&threadAntlrParser(), parse_input,
+                              skipped_lines + 1, options, &sink,
+                              &result.diagnostics, &stage)) {
+    builder.clearLines();
+    result.diagnostics.clear();
+    Program program;
+    stage = parseWithAntlr(&threadAntlrParser(), parse_input, options,
+                           &program, &result.diagnostics);
+    shiftProgramLines(&program, skipped_lines);
+    shiftDiagnosticLines(&result.diagnostics, skipped_lines);
+    sink.addSegment(&program);
+  }
+  result.prediction_stage = stage;
+  addBlockLengthDiagnostics(source, &result.diagnostics);
+
+  bool has_line_number_target_jump = false;
+  for (const auto &line : result.statement_lines) {
+    if (hasLineNumberTargetJump(line)) {
+      has_line_number_target_jump = true;
+      break;
+    }
+  }
+  SemanticLineChecker checker(options.enable_double_slash_comments,
+                              options.tool_management,
+                              options.enable_iso_m98_calls,
+                              has_line_number_target_jump);
+  for (const auto &line : result.lines) {
+    checker.check(result, line, &result.diagnostics);
+  }
+  if (options.first_line != 1) {
+    const int delta = options.first_line - 1;
+    if (result.program_name.has_value()) {
+      shiftLocationLines(&result.program_name->location, delta);
+    }
+    shiftCompactLines(&result, delta);
+    shiftDiagnosticLines(&result.diagnostics, delta);
+  }
+  result.text_storage = std::move(storage);
+  return result;
+}
+
+CompactParseResult parseCompact(std::string_view input) {
+  return parseCompact(input, ParseOptions{});
+}
+
 } // namespace gcode
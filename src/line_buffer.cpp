@@ -0,0 +1,59 @@
+#include "line_buffer.h"
+
+#include <cstring>
+
+namespace gcode {
+
+bool LineBuffer::nextLine(Span *line) {
+  const char *data = text_.data();
+  const void *newline =
+      std::memchr(data + scan_, '\n', text_.size() - scan_);
+  if (newline == nullptr) {
+    if (scan_ != complete_end_) {
+      text_.erase(complete_end_, scan_ - complete_end_);
+      scan_ = complete_end_;
+    }
+    return false;
+  }
+  const size_t newline_pos = static_cast<const char *>(newline) - data;
+  size_t length = newline_pos - scan_;
+  if (length > 0 && data[newline_pos - 1] == '\r') {
+    --length;
+  }
+  if (scan_ != complete_end_) {
+    std::memmove(&text_[complete_end_], data + scan_, length);
+  }
+  line->begin = complete_end_;
+  line->end = complete_end_ + length;
+  text_[line->end] = '\n';
+  complete_end_ = line->end + 1;
+  scan_ = newline_pos + 1;
+  return true;
+}
+
+bool LineBuffer::finishLine(Span *line) {
+  if (scan_ == text_.size()) {
+    return false;
+  }
+  text_.erase(complete_end_, scan_ - complete_end_);
+  line->begin = complete_end_;
+  line->end = text_.size();
+  text_.push_back('\n');
+  complete_end_ = text_.size();
+  scan_ = complete_end_;
+  return true;
+}
+
+void LineBuffer::dropCompleteLines() {
+  text_.erase(0, scan_);
+  complete_end_ = 0;
+  scan_ = 0;
+}
+
+void LineBuffer::clear() {
+  text_.clear();
+  complete_end_ = 0;
+  scan_ = 0;
+}
+
+} // namespace gcode
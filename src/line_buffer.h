@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace gcode {
+
+// Splits streamed text into lines without copying each line out. Lines
+// handed out by nextLine() stay in the buffer back to back, each followed by
+// '\n' and without its trailing '\r', so the text of a run of lines is a
+// single view. Consumed bytes are dropped only by dropCompleteLines(), and
+// the storage is reused, so feeding chunks of a bounded size stops
+// allocating once the buffer has grown to fit them.
+class LineBuffer {
+public:
+  struct Span {
+    size_t begin = 0;
+    size_t end = 0; // excludes the '\n'
+  };
+
+  void append(std::string_view chunk) {
+    text_.append(chunk.data(), chunk.size());
+  }
+  // The next complete line; false once only an unterminated tail is left.
+  bool nextLine(Span *line);
+  // Terminates a non-empty unterminated tail and returns it as the last
+  // line; its trailing '\r', if any, is kept.
+  bool finishLine(Span *line);
+
+  // Handed-out lines from `begin` on, including their '\n' separators.
+  std::string_view textFrom(size_t begin) const {
+    return std::string_view(text_).substr(begin, complete_end_ - begin);
+  }
+  std::string_view text(const Span &line) const {
+    return std::string_view(text_).substr(line.begin, line.end - line.begin);
+  }
+
+  // Drops every handed-out line; spans handed out before become invalid.
+  void dropCompleteLines();
+  void clear();
+
+private:
+  std::string text_;
+  // [0, complete_end_) holds the handed-out lines and [scan_, size) the
+  // bytes not yet split; the gap between them is left by removed '\r's.
+  size_t complete_end_ = 0;
+  size_t scan_ = 0;
+};
+
+} // namespace gcode
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <optional>
-#include <set>
 #include <string>
 #include <vector>
 
@@ -9,19 +8,6 @@
 
 namespace gcode {
 
-inline bool parseDoubleText(const std::optional<std::string> &text,
-                            double *value) {
-  if (!text.has_value()) {
-    return false;
-  }
-  try {
-    *value = std::stod(*text);
-    return true;
-  } catch (...) {
-    return false;
-  }
-}
-
 inline bool isWordItem(const LineItem &item) {
   return std::holds_alternative<Word>(item);
 }
@@ -44,33 +30,55 @@ inline void fillPoseAndFeed(const Line &line, Pose6 *pose,
       continue;
     }
     const auto &word = std::get<Word>(item);
-    double parsed = 0.0;
-    if (word.head == "X" && parseDoubleText(word.value, &parsed)) {
-      pose->x = parsed;
-    } else if (word.head == "Y" && parseDoubleText(word.value, &parsed)) {
-      pose->y = parsed;
-    } else if (word.head == "Z" && parseDoubleText(word.value, &parsed)) {
-      pose->z = parsed;
-    } else if (word.head == "A" && parseDoubleText(word.value, &parsed)) {
-      pose->a = parsed;
-    } else if (word.head == "B" && parseDoubleText(word.value, &parsed)) {
-      pose->b = parsed;
-    } else if (word.head == "C" && parseDoubleText(word.value, &parsed)) {
-      pose->c = parsed;
-    } else if (word.head == "F" && parseDoubleText(word.value, &parsed)) {
-      *feed = parsed;
-    } else if (arc && word.head == "I" &&
-               parseDoubleText(word.value, &parsed)) {
-      arc->i = parsed;
-    } else if (arc && word.head == "J" &&
-               parseDoubleText(word.value, &parsed)) {
-      arc->j = parsed;
-    } else if (arc && word.head == "K" &&
-               parseDoubleText(word.value, &parsed)) {
-      arc->k = parsed;
-    } else if (arc && (word.head == "R" || word.head == "CR") &&
-               parseDoubleText(word.value, &parsed)) {
-      arc->r = parsed;
+    const auto number = wordNumber(word);
+    if (!number.has_value()) {
+      continue;
+    }
+    switch (wordSymbol(word)) {
+    case WordSymbol::X:
+      pose->setX(number);
+      break;
+    case WordSymbol::Y:
+      pose->setY(number);
+      break;
+    case WordSymbol::Z:
+      pose->setZ(number);
+      break;
+    case WordSymbol::A:
+      pose->setA(number);
+      break;
+    case WordSymbol::B:
+      pose->setB(number);
+      break;
+    case WordSymbol::C:
+      pose->setC(number);
+      break;
+    case WordSymbol::F:
+      *feed = number;
+      break;
+    case WordSymbol::I:
+      if (arc) {
+        arc->setI(number);
+      }
+      break;
+    case WordSymbol::J:
+      if (arc) {
+        arc->setJ(number);
+      }
+      break;
+    case WordSymbol::K:
+      if (arc) {
+        arc->setK(number);
+      }
+      break;
+    case WordSymbol::R:
+    case WordSymbol::CR:
+      if (arc) {
+        arc->setR(number);
+      }
+      break;
+    default:
+      break;
     }
   }
 }
@@ -87,17 +95,26 @@ inline void addWarningDiagnostic(std::vector<Diagnostic> *diagnostics,
 
 inline void addArcLoweringWarnings(const Line &line,
                                    std::vector<Diagnostic> *diagnostics) {
-  static const std::set<std::string> unsupported_heads = {
-      "AR", "AP", "RP", "CIP", "CT", "I1", "J1", "K1"};
   for (const auto &item : line.items) {
     if (!isWordItem(item)) {
       continue;
     }
     const auto &word = std::get<Word>(item);
-    if (unsupported_heads.find(word.head) != unsupported_heads.end()) {
+    switch (wordSymbol(word)) {
+    case WordSymbol::AR:
+    case WordSymbol::AP:
+    case WordSymbol::RP:
+    case WordSymbol::CIP:
+    case WordSymbol::CT:
+    case WordSymbol::I1:
+    case WordSymbol::J1:
+    case WordSymbol::K1:
       addWarningDiagnostic(diagnostics, word.location,
                            "lowering ignored unsupported arc word: " +
                                word.head);
+      break;
+    default:
+      break;
     }
   }
 }
@@ -20,15 +20,16 @@ G4Lowerer::lower(const Line &line, const LowerOptions &options,
       continue;
     }
     const auto &word = std::get<Word>(item);
-    double parsed = 0.0;
-    if (word.head == "F" && parseDoubleText(word.value, &parsed)) {
+    const WordSymbol symbol = wordSymbol(word);
+    const auto number = wordNumber(word);
+    if (symbol == WordSymbol::F && number.has_value()) {
       message.dwell_mode = DwellMode::Seconds;
-      message.dwell_value = parsed;
+      message.dwell_value = *number;
       break;
     }
-    if (word.head == "S" && parseDoubleText(word.value, &parsed)) {
+    if (symbol == WordSymbol::S && number.has_value()) {
       message.dwell_mode = DwellMode::Revolutions;
-      message.dwell_value = parsed;
+      message.dwell_value = *number;
       break;
     }
   }
@@ -1,4 +1,3 @@
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -6,6 +5,7 @@
 #include <type_traits>
 
 #include "ast_printer.h"
+#include "file_source.h"
 #include "gcode/ail.h"
 #include "gcode/ail_json.h"
 #include "gcode/gcode_parser.h"
@@ -72,27 +72,32 @@ void appendModal(std::ostringstream &out, const gcode::ModalState &modal) {
       << " updates=" << boolText(modal.updates_state);
 }
 
-std::string exprToDebugText(const std::shared_ptr<gcode::ExprNode> &expr) {
-  if (!expr) {
+std::string exprToDebugText(const gcode::ExprPool *pool,
+                            gcode::ExprIndex index) {
+  if (pool == nullptr || index == gcode::kNoExpr) {
     return "<null>";
   }
-  return std::visit(
-      [](const auto &node) -> std::string {
-        using T = std::decay_t<decltype(node)>;
-        if constexpr (std::is_same_v<T, gcode::ExprLiteral>) {
-          std::ostringstream out;
-          out << std::setprecision(12) << node.value;
-          return out.str();
-        } else if constexpr (std::is_same_v<T, gcode::ExprVariable>) {
-          return node.name;
-        } else if constexpr (std::is_same_v<T, gcode::ExprUnary>) {
-          return "(" + node.op + exprToDebugText(node.operand) + ")";
-        } else {
-          return "(" + exprToDebugText(node.lhs) + " " + node.op + " " +
-                 exprToDebugText(node.rhs) + ")";
-        }
-      },
-      expr->node);
+  const auto &node = pool->node(index);
+  switch (node.op) {
+  case gcode::ExprOp::Missing:
+    return "<null>";
+  case gcode::ExprOp::Literal: {
+    std::ostringstream out;
+    out << std::setprecision(12) << node.value;
+    return out.str();
+  }
+  case gcode::ExprOp::Variable:
+    return pool->text(node.text);
+  case gcode::ExprOp::Plus:
+  case gcode::ExprOp::Negate:
+  case gcode::ExprOp::UnknownUnary:
+    return "(" + std::string(pool->opText(node)) +
+           exprToDebugText(pool, node.lhs) + ")";
+  default:
+    return "(" + exprToDebugText(pool, node.lhs) + " " +
+           std::string(pool->opText(node)) + " " +
+           exprToDebugText(pool, node.rhs) + ")";
+  }
 }
 
 std::string formatLowerDebug(const gcode::MessageResult &result) {
@@ -107,50 +112,50 @@ std::string formatLowerDebug(const gcode::MessageResult &result) {
           if constexpr (std::is_same_v<std::decay_t<decltype(msg)>,
                                        gcode::G0Message>) {
             out << " type=G0";
-            appendOptionalDouble(out, "x", msg.target_pose.x);
-            appendOptionalDouble(out, "y", msg.target_pose.y);
-            appendOptionalDouble(out, "z", msg.target_pose.z);
-            appendOptionalDouble(out, "a", msg.target_pose.a);
-            appendOptionalDouble(out, "b", msg.target_pose.b);
-            appendOptionalDouble(out, "c", msg.target_pose.c);
+            appendOptionalDouble(out, "x", msg.target_pose.x());
+            appendOptionalDouble(out, "y", msg.target_pose.y());
+            appendOptionalDouble(out, "z", msg.target_pose.z());
+            appendOptionalDouble(out, "a", msg.target_pose.a());
+            appendOptionalDouble(out, "b", msg.target_pose.b());
+            appendOptionalDouble(out, "c", msg.target_pose.c());
             appendOptionalDouble(out, "feed", msg.feed);
           } else if constexpr (std::is_same_v<std::decay_t<decltype(msg)>,
                                               gcode::G1Message>) {
             out << " type=G1";
-            appendOptionalDouble(out, "x", msg.target_pose.x);
-            appendOptionalDouble(out, "y", msg.target_pose.y);
-            appendOptionalDouble(out, "z", msg.target_pose.z);
-            appendOptionalDouble(out, "a", msg.target_pose.a);
-            appendOptionalDouble(out, "b", msg.target_pose.b);
-            appendOptionalDouble(out, "c", msg.target_pose.c);
+            appendOptionalDouble(out, "x", msg.target_pose.x());
+            appendOptionalDouble(out, "y", msg.target_pose.y());
+            appendOptionalDouble(out, "z", msg.target_pose.z());
+            appendOptionalDouble(out, "a", msg.target_pose.a());
+            appendOptionalDouble(out, "b", msg.target_pose.b());
+            appendOptionalDouble(out, "c", msg.target_pose.c());
             appendOptionalDouble(out, "feed", msg.feed);
           } else if constexpr (std::is_same_v<std::decay_t<decltype(msg)>,
                                               gcode::G2Message>) {
             out << " type=G2";
-            appendOptionalDouble(out, "x", msg.target_pose.x);
-            appendOptionalDouble(out, "y", msg.target_pose.y);
-            appendOptionalDouble(out, "z", msg.target_pose.z);
-            appendOptionalDouble(out, "a", msg.target_pose.a);
-            appendOptionalDouble(out, "b", msg.target_pose.b);
-            appendOptionalDouble(out, "c", msg.target_pose.c);
-            appendOptionalDouble(out, "i", msg.arc.i);
-            appendOptionalDouble(out, "j", msg.arc.j);
-            appendOptionalDouble(out, "k", msg.arc.k);
-            appendOptionalDouble(out, "r", msg.arc.r);
+            appendOptionalDouble(out, "x", msg.target_pose.x());
+            appendOptionalDouble(out, "y", msg.target_pose.y());
+            appendOptionalDouble(out, "z", msg.target_pose.z());
+            appendOptionalDouble(out, "a", msg.target_pose.a());
+            appendOptionalDouble(out, "b", msg.target_pose.b());
+            appendOptionalDouble(out, "c", msg.target_pose.c());
+            appendOptionalDouble(out, "i", msg.arc.i());
+            appendOptionalDouble(out, "j", msg.arc.j());
+            appendOptionalDouble(out, "k", msg.arc.k());
+            appendOptionalDouble(out, "r", msg.arc.r());
             appendOptionalDouble(out, "feed", msg.feed);
           } else if constexpr (std::is_same_v<std::decay_t<decltype(msg)>,
                                               gcode::G3Message>) {
             out << " type=G3";
-            appendOptionalDouble(out, "x", msg.target_pose.x);
-            appendOptionalDouble(out, "y", msg.target_pose.y);
-            appendOptionalDouble(out, "z", msg.target_pose.z);
-            appendOptionalDouble(out, "a", msg.target_pose.a);
-            appendOptionalDouble(out, "b", msg.target_pose.b);
-            appendOptionalDouble(out, "c", msg.target_pose.c);
-            appendOptionalDouble(out, "i", msg.arc.i);
-            appendOptionalDouble(out, "j", msg.arc.j);
-            appendOptionalDouble(out, "k", msg.arc.k);
-            appendOptionalDouble(out, "r", msg.arc.r);
+            appendOptionalDouble(out, "x", msg.target_pose.x());
+            appendOptionalDouble(out, "y", msg.target_pose.y());
+            appendOptionalDouble(out, "z", msg.target_pose.z());
+            appendOptionalDouble(out, "a", msg.target_pose.a());
+            appendOptionalDouble(out, "b", msg.target_pose.b());
+            appendOptionalDouble(out, "c", msg.target_pose.c());
+            appendOptionalDouble(out, "i", msg.arc.i());
+            appendOptionalDouble(out, "j", msg.arc.j());
+            appendOptionalDouble(out, "k", msg.arc.k());
+            appendOptionalDouble(out, "r", msg.arc.r());
             appendOptionalDouble(out, "feed", msg.feed);
           } else if constexpr (std::is_same_v<std::decay_t<decltype(msg)>,
                                               gcode::G4Message>) {
@@ -206,12 +211,12 @@ std::string formatAilDebug(const gcode::AilResult &result) {
                           ? "linear"
                           : "nonlinear");
             }
-            appendOptionalDouble(out, "x", i.target_pose.x);
-            appendOptionalDouble(out, "y", i.target_pose.y);
-            appendOptionalDouble(out, "z", i.target_pose.z);
-            appendOptionalDouble(out, "a", i.target_pose.a);
-            appendOptionalDouble(out, "b", i.target_pose.b);
-            appendOptionalDouble(out, "c", i.target_pose.c);
+            appendOptionalDouble(out, "x", i.target_pose.x());
+            appendOptionalDouble(out, "y", i.target_pose.y());
+            appendOptionalDouble(out, "z", i.target_pose.z());
+            appendOptionalDouble(out, "a", i.target_pose.a());
+            appendOptionalDouble(out, "b", i.target_pose.b());
+            appendOptionalDouble(out, "c", i.target_pose.c());
             appendAxisSystemVariableRefs(out, i.target_system_variables);
             appendOptionalDouble(out, "feed", i.feed);
           } else if constexpr (std::is_same_v<std::decay_t<decltype(i)>,
@@ -224,16 +229,16 @@ std::string formatAilDebug(const gcode::AilResult &result) {
                         : (i.plane_effective == gcode::WorkingPlane::ZX
                                ? "zx"
                                : "yz"));
-            appendOptionalDouble(out, "x", i.target_pose.x);
-            appendOptionalDouble(out, "y", i.target_pose.y);
-            appendOptionalDouble(out, "z", i.target_pose.z);
-            appendOptionalDouble(out, "a", i.target_pose.a);
-            appendOptionalDouble(out, "b", i.target_pose.b);
-            appendOptionalDouble(out, "c", i.target_pose.c);
-            appendOptionalDouble(out, "i", i.arc.i);
-            appendOptionalDouble(out, "j", i.arc.j);
-            appendOptionalDouble(out, "k", i.arc.k);
-            appendOptionalDouble(out, "r", i.arc.r);
+            appendOptionalDouble(out, "x", i.target_pose.x());
+            appendOptionalDouble(out, "y", i.target_pose.y());
+            appendOptionalDouble(out, "z", i.target_pose.z());
+            appendOptionalDouble(out, "a", i.target_pose.a());
+            appendOptionalDouble(out, "b", i.target_pose.b());
+            appendOptionalDouble(out, "c", i.target_pose.c());
+            appendOptionalDouble(out, "i", i.arc.i());
+            appendOptionalDouble(out, "j", i.arc.j());
+            appendOptionalDouble(out, "k", i.arc.k());
+            appendOptionalDouble(out, "r", i.arc.r());
             appendOptionalDouble(out, "feed", i.feed);
           } else if constexpr (std::is_same_v<std::decay_t<decltype(i)>,
                                               gcode::AilDwellInstruction>) {
@@ -327,7 +332,7 @@ std::string formatAilDebug(const gcode::AilResult &result) {
           } else if constexpr (std::is_same_v<std::decay_t<decltype(i)>,
                                               gcode::AilAssignInstruction>) {
             out << " kind=assign lhs=" << i.lhs << " rhs=\""
-                << exprToDebugText(i.rhs) << "\"";
+                << exprToDebugText(i.expressions.get(), i.rhs) << "\"";
           } else if constexpr (std::is_same_v<std::decay_t<decltype(i)>,
                                               gcode::AilLabelInstruction>) {
             out << " kind=label name=" << i.name;
@@ -404,12 +409,12 @@ std::string formatPacketDebug(const gcode::PacketResult &result) {
                           ? "linear"
                           : "nonlinear");
             }
-            appendOptionalDouble(out, "x", payload.target_pose.x);
-            appendOptionalDouble(out, "y", payload.target_pose.y);
-            appendOptionalDouble(out, "z", payload.target_pose.z);
-            appendOptionalDouble(out, "a", payload.target_pose.a);
-            appendOptionalDouble(out, "b", payload.target_pose.b);
-            appendOptionalDouble(out, "c", payload.target_pose.c);
+            appendOptionalDouble(out, "x", payload.target_pose.x());
+            appendOptionalDouble(out, "y", payload.target_pose.y());
+            appendOptionalDouble(out, "z", payload.target_pose.z());
+            appendOptionalDouble(out, "a", payload.target_pose.a());
+            appendOptionalDouble(out, "b", payload.target_pose.b());
+            appendOptionalDouble(out, "c", payload.target_pose.c());
             appendAxisSystemVariableRefs(out, payload.target_system_variables);
             appendOptionalDouble(out, "feed", payload.feed);
           } else if constexpr (std::is_same_v<T, gcode::MotionArcPayload>) {
@@ -420,16 +425,16 @@ std::string formatPacketDebug(const gcode::PacketResult &result) {
                         : (payload.plane_effective == gcode::WorkingPlane::ZX
                                ? "zx"
                                : "yz"));
-            appendOptionalDouble(out, "x", payload.target_pose.x);
-            appendOptionalDouble(out, "y", payload.target_pose.y);
-            appendOptionalDouble(out, "z", payload.target_pose.z);
-            appendOptionalDouble(out, "a", payload.target_pose.a);
-            appendOptionalDouble(out, "b", payload.target_pose.b);
-            appendOptionalDouble(out, "c", payload.target_pose.c);
-            appendOptionalDouble(out, "i", payload.arc.i);
-            appendOptionalDouble(out, "j", payload.arc.j);
-            appendOptionalDouble(out, "k", payload.arc.k);
-            appendOptionalDouble(out, "r", payload.arc.r);
+            appendOptionalDouble(out, "x", payload.target_pose.x());
+            appendOptionalDouble(out, "y", payload.target_pose.y());
+            appendOptionalDouble(out, "z", payload.target_pose.z());
+            appendOptionalDouble(out, "a", payload.target_pose.a());
+            appendOptionalDouble(out, "b", payload.target_pose.b());
+            appendOptionalDouble(out, "c", payload.target_pose.c());
+            appendOptionalDouble(out, "i", payload.arc.i());
+            appendOptionalDouble(out, "j", payload.arc.j());
+            appendOptionalDouble(out, "k", payload.arc.k());
+            appendOptionalDouble(out, "r", payload.arc.r());
             appendOptionalDouble(out, "feed", payload.feed);
           } else {
             out << " dwell_mode="
@@ -520,17 +525,14 @@ int main(int argc, const char **argv) {
     return 2;
   }
 
-  std::ifstream input_file(file_path, std::ios::in);
-  if (!input_file) {
+  gcode::FileSource source;
+  if (!source.open(file_path)) {
     std::cerr << "Failed to open file: " << file_path << "\n";
     return 2;
   }
 
-  std::stringstream buffer;
-  buffer << input_file.rdbuf();
-
   if (mode == "parse") {
-    const auto result = gcode::parse(buffer.str());
+    const auto result = gcode::parse(source.text());
     if (format == "json") {
       std::cout << gcode::formatJson(result);
     } else {
@@ -542,7 +544,7 @@ int main(int argc, const char **argv) {
   if (mode == "ail") {
     gcode::LowerOptions options;
     options.filename = file_path;
-    const auto result = gcode::parseAndLowerAil(buffer.str(), options);
+    const auto result = gcode::parseAndLowerAil(source.text(), options);
     if (format == "json") {
       std::cout << gcode::ailToJsonString(result);
     } else {
@@ -554,7 +556,7 @@ int main(int argc, const char **argv) {
   if (mode == "packet") {
     gcode::LowerOptions options;
     options.filename = file_path;
-    const auto result = gcode::parseLowerAndPacketize(buffer.str(), options);
+    const auto result = gcode::parseLowerAndPacketize(source.text(), options);
     if (format == "json") {
       std::cout << gcode::packetToJsonString(result);
     } else {
@@ -565,7 +567,7 @@ int main(int argc, const char **argv) {
 
   gcode::LowerOptions options;
   options.filename = file_path;
-  const auto result = gcode::parseAndLower(buffer.str(), options);
+  const auto result = gcode::parseAndLower(source.text(), options);
   if (format == "json") {
     std::cout << gcode::toJsonString(result);
   } else {
@@ -30,17 +30,19 @@ bool sourceEqual(const SourceInfo &lhs, const SourceInfo &rhs) {
 }
 
 bool poseEqual(const Pose6 &lhs, const Pose6 &rhs) {
-  return optionalDoubleEqual(lhs.x, rhs.x) &&
-         optionalDoubleEqual(lhs.y, rhs.y) &&
-         optionalDoubleEqual(lhs.z, rhs.z) &&
-         optionalDoubleEqual(lhs.a, rhs.a) &&
-         optionalDoubleEqual(lhs.b, rhs.b) && optionalDoubleEqual(lhs.c, rhs.c);
+  return optionalDoubleEqual(lhs.x(), rhs.x()) &&
+         optionalDoubleEqual(lhs.y(), rhs.y()) &&
+         optionalDoubleEqual(lhs.z(), rhs.z()) &&
+         optionalDoubleEqual(lhs.a(), rhs.a()) &&
+         optionalDoubleEqual(lhs.b(), rhs.b()) &&
+         optionalDoubleEqual(lhs.c(), rhs.c());
 }
 
 bool arcEqual(const ArcParams &lhs, const ArcParams &rhs) {
-  return optionalDoubleEqual(lhs.i, rhs.i) &&
-         optionalDoubleEqual(lhs.j, rhs.j) &&
-         optionalDoubleEqual(lhs.k, rhs.k) && optionalDoubleEqual(lhs.r, rhs.r);
+  return optionalDoubleEqual(lhs.i(), rhs.i()) &&
+         optionalDoubleEqual(lhs.j(), rhs.j()) &&
+         optionalDoubleEqual(lhs.k(), rhs.k()) &&
+         optionalDoubleEqual(lhs.r(), rhs.r());
 }
 
 bool modalEqual(const ModalState &lhs, const ModalState &rhs) {
@@ -1,18 +1,18 @@
 #include "messages.h"
 
 #include <algorithm>
-#include <fstream>
-#include <sstream>
+#include <atomic>
+#include <iterator>
 #include <unordered_map>
 
+#include "file_source.h"
 #include "gcode/gcode_parser.h"
 #include "lowering_family.h"
+#include "parallel_for.h"
 
 namespace gcode {
 namespace {
 
-enum class WorkingPlaneState { XY, ZX, YZ };
-
 bool lineHasError(const std::vector<Diagnostic> &diagnostics, int line) {
   for (const auto &diag : diagnostics) {
     if (diag.severity == Diagnostic::Severity::Error &&
@@ -52,35 +52,26 @@ bool shouldSkipLine(const Line &line, const LowerOptions &options) {
 }
 
 int motionCode(const Word &word) {
-  if (word.head != "G" || !word.value.has_value()) {
-    return -1;
-  }
-  try {
-    return std::stoi(*word.value);
-  } catch (...) {
+  if (wordSymbol(word) != WordSymbol::G || !word.value.has_value()) {
     return -1;
   }
+  return wordInteger(word).value_or(-1);
 }
 
 std::optional<WorkingPlaneState> planeFromWord(const Word &word) {
-  if (word.head != "G" || !word.value.has_value()) {
+  if (wordSymbol(word) != WordSymbol::G || !word.value.has_value()) {
     return std::nullopt;
   }
-  try {
-    const int code = std::stoi(*word.value);
-    if (code == 17) {
-      return WorkingPlaneState::XY;
-    }
-    if (code == 18) {
-      return WorkingPlaneState::ZX;
-    }
-    if (code == 19) {
-      return WorkingPlaneState::YZ;
-    }
-  } catch (...) {
+  switch (wordInteger(word).value_or(-1)) {
+  case 17:
+    return WorkingPlaneState::XY;
+  case 18:
+    return WorkingPlaneState::ZX;
+  case 19:
+    return WorkingPlaneState::YZ;
+  default:
     return std::nullopt;
   }
-  return std::nullopt;
 }
 
 void addErrorDiagnostic(std::vector<Diagnostic> *diagnostics,
@@ -99,18 +90,20 @@ void validateArcPlaneWords(const Line &line, WorkingPlaneState plane,
       continue;
     }
     const auto &word = std::get<Word>(item);
-    if ((word.head != "I" && word.head != "J" && word.head != "K") ||
+    const WordSymbol symbol = wordSymbol(word);
+    if ((symbol != WordSymbol::I && symbol != WordSymbol::J &&
+         symbol != WordSymbol::K) ||
         !word.value.has_value()) {
       continue;
     }
 
     bool allowed = false;
     if (plane == WorkingPlaneState::XY) {
-      allowed = (word.head == "I" || word.head == "J");
+      allowed = symbol != WordSymbol::K;
     } else if (plane == WorkingPlaneState::ZX) {
-      allowed = (word.head == "I" || word.head == "K");
+      allowed = symbol != WordSymbol::J;
     } else {
-      allowed = (word.head == "J" || word.head == "K");
+      allowed = symbol != WordSymbol::I;
     }
 
     if (!allowed) {
@@ -171,98 +164,402 @@ void emitParseDiagnostics(const std::vector<Diagnostic> &diagnostics,
   }
 }
 
-} // namespace
+struct LineMotion {
+  bool has_motion = false;
+  // The line's motion code (0-4), or -1 when it has two different ones.
+  int found_motion = 0;
+  std::optional<WorkingPlaneState> plane_override;
+};
 
-MessageResult lowerToMessages(const Program &program,
-                              const std::vector<Diagnostic> &parse_diagnostics,
-                              const LowerOptions &options) {
-  MessageResult result;
-  result.diagnostics = parse_diagnostics;
-  const auto lowerers = createMotionFamilyLowerers();
-  const auto indexed_lowerers = indexLowerers(lowerers);
-  WorkingPlaneState current_plane = WorkingPlaneState::XY;
-
-  for (const auto &line : program.lines) {
-    if (shouldSkipLine(line, options)) {
+LineMotion scanLineMotion(const Line &line) {
+  LineMotion motion;
+  for (const auto &item : line.items) {
+    if (!isWord(item)) {
       continue;
     }
-    const bool has_line_error =
-        lineHasError(result.diagnostics, line.line_index);
-    if (has_line_error) {
-      RejectedLine rejected;
-      rejected.source.filename = options.filename;
-      rejected.source.line = line.line_index;
-      if (line.line_number.has_value()) {
-        rejected.source.line_number = line.line_number->value;
+    const auto &word = std::get<Word>(item);
+    const auto parsed_plane = planeFromWord(word);
+    if (parsed_plane.has_value()) {
+      motion.plane_override = *parsed_plane;
+    }
+    const int code = motionCode(word);
+    if (code >= 0 && code <= 4) {
+      if (motion.has_motion && code != motion.found_motion) {
+        motion.found_motion = -1;
+        break;
       }
-      rejected.reasons = collectLineErrors(result.diagnostics, line.line_index);
-      result.rejected_lines.push_back(std::move(rejected));
-      break;
+      motion.has_motion = true;
+      motion.found_motion = code;
     }
+  }
+  return motion;
+}
 
-    bool has_motion = false;
-    int found_motion = 0;
-    std::optional<WorkingPlaneState> line_plane_override;
-    for (const auto &item : line.items) {
-      if (!isWord(item)) {
-        continue;
+RejectedLine makeRejectedLine(const Line &line, const LowerOptions &options,
+                              std::vector<Diagnostic> reasons) {
+  RejectedLine rejected;
+  rejected.source.filename = options.filename;
+  rejected.source.line = line.line_index;
+  if (line.line_number.has_value()) {
+    rejected.source.line_number = line.line_number->value;
+  }
+  rejected.reasons = std::move(reasons);
+  return rejected;
+}
+
+// Reports to the callbacks of lowerToMessagesStream() and applies its limits;
+// the bool-returning calls return false once lowering must stop.
+class CallbackStreamSink {
+public:
+  CallbackStreamSink(const StreamCallbacks &callbacks,
+                     const StreamOptions &stream_options,
+                     size_t diagnostics_seen)
+      : callbacks_(callbacks), stream_options_(stream_options),
+        diagnostics_seen_(diagnostics_seen) {}
+
+  bool beginLine() {
+    ++lines_seen_;
+    return !stop();
+  }
+  void rejectLine(const RejectedLine &rejected) {
+    if (callbacks_.on_rejected_line) {
+      callbacks_.on_rejected_line(rejected);
+    }
+  }
+  void planeDiagnostic(const Diagnostic &diag) {
+    if (callbacks_.on_diagnostic) {
+      callbacks_.on_diagnostic(diag);
+    }
+    ++diagnostics_seen_;
+  }
+  bool message(const ParsedMessage &message) {
+    if (callbacks_.on_message) {
+      callbacks_.on_message(message);
+    }
+    ++messages_seen_;
+    return !stop();
+  }
+  bool loweringDiagnostic(const Diagnostic &diag) {
+    planeDiagnostic(diag);
+    return !stop();
+  }
+
+private:
+  bool stop() const {
+    return shouldStop(stream_options_, lines_seen_, messages_seen_,
+                      diagnostics_seen_);
+  }
+
+  const StreamCallbacks &callbacks_;
+  const StreamOptions &stream_options_;
+  size_t lines_seen_ = 0;
+  size_t messages_seen_ = 0;
+  size_t diagnostics_seen_;
+};
+
+// `count` consecutive beginLine() calls.
+struct StreamLinesBegun {
+  size_t count = 0;
+};
+struct StreamPlaneDiagnostic {
+  Diagnostic diagnostic;
+};
+// A Diagnostic alternative is a loweringDiagnostic() call.
+using StreamEvent = std::variant<StreamLinesBegun, StreamPlaneDiagnostic,
+                                 ParsedMessage, Diagnostic, RejectedLine>;
+
+// Records the sink calls of one chunk for replay in program order.
+class RecordingStreamSink {
+public:
+  bool beginLine() {
+    if (events.empty() ||
+        !std::holds_alternative<StreamLinesBegun>(events.back())) {
+      events.emplace_back(StreamLinesBegun{});
+    }
+    ++std::get<StreamLinesBegun>(events.back()).count;
+    return true;
+  }
+  void rejectLine(RejectedLine rejected) {
+    events.emplace_back(std::move(rejected));
+  }
+  void planeDiagnostic(const Diagnostic &diag) {
+    events.emplace_back(StreamPlaneDiagnostic{diag});
+  }
+  bool message(ParsedMessage message) {
+    events.emplace_back(std::move(message));
+    return true;
+  }
+  bool loweringDiagnostic(const Diagnostic &diag) {
+    events.emplace_back(diag);
+    return true;
+  }
+
+  std::vector<StreamEvent> events;
+};
+
+bool replayStreamEvents(const std::vector<StreamEvent> &events,
+                        CallbackStreamSink *sink) {
+  for (const auto &event : events) {
+    if (const auto *begun = std::get_if<StreamLinesBegun>(&event)) {
+      for (size_t i = 0; i < begun->count; ++i) {
+        if (!sink->beginLine()) {
+          return false;
+        }
       }
-      const auto &word = std::get<Word>(item);
-      const auto parsed_plane = planeFromWord(word);
-      if (parsed_plane.has_value()) {
-        line_plane_override = *parsed_plane;
+    } else if (const auto *plane_diag =
+                   std::get_if<StreamPlaneDiagnostic>(&event)) {
+      sink->planeDiagnostic(plane_diag->diagnostic);
+    } else if (const auto *message = std::get_if<ParsedMessage>(&event)) {
+      if (!sink->message(*message)) {
+        return false;
       }
-      const int code = motionCode(word);
-      if (code >= 0 && code <= 4) {
-        if (has_motion && code != found_motion) {
-          found_motion = -1;
-          break;
-        }
-        has_motion = true;
-        found_motion = code;
+    } else if (const auto *diag = std::get_if<Diagnostic>(&event)) {
+      if (!sink->loweringDiagnostic(*diag)) {
+        return false;
       }
+    } else {
+      sink->rejectLine(std::get<RejectedLine>(event));
+      return false;
     }
+  }
+  return true;
+}
 
-    if (!has_motion) {
-      if (line_plane_override.has_value()) {
-        current_plane = *line_plane_override;
+// One line of lowerToMessagesStream(); returns false once lowering stops.
+template <typename Sink>
+bool lowerStreamLine(
+    const Line &line, const std::vector<Diagnostic> &parse_diagnostics,
+    const LowerOptions &options,
+    const std::unordered_map<int, const MotionFamilyLowerer *> &lowerers,
+    WorkingPlaneState *current_plane, Sink *sink) {
+  if (!sink->beginLine()) {
+    return false;
+  }
+  if (shouldSkipLine(line, options)) {
+    return true;
+  }
+  if (lineHasError(parse_diagnostics, line.line_index)) {
+    sink->rejectLine(makeRejectedLine(
+        line, options, collectLineErrors(parse_diagnostics, line.line_index)));
+    return false;
+  }
+
+  const LineMotion motion = scanLineMotion(line);
+  if (!motion.has_motion) {
+    if (motion.plane_override.has_value()) {
+      *current_plane = *motion.plane_override;
+    }
+    return true;
+  }
+  const WorkingPlaneState effective_plane =
+      motion.plane_override.value_or(*current_plane);
+  if (motion.found_motion == 2 || motion.found_motion == 3) {
+    std::vector<Diagnostic> plane_diags;
+    validateArcPlaneWords(line, effective_plane, &plane_diags);
+    for (const auto &diag : plane_diags) {
+      sink->planeDiagnostic(diag);
+    }
+    const bool has_plane_error = std::any_of(
+        plane_diags.begin(), plane_diags.end(), [](const Diagnostic &diag) {
+          return diag.severity == Diagnostic::Severity::Error;
+        });
+    if (has_plane_error) {
+      sink->rejectLine(makeRejectedLine(line, options, std::move(plane_diags)));
+      return false;
+    }
+  }
+  const auto found = lowerers.find(motion.found_motion);
+  if (found != lowerers.end()) {
+    std::vector<Diagnostic> lowering_diags;
+    auto message = found->second->lower(line, options, &lowering_diags);
+    if (!sink->message(std::move(message))) {
+      return false;
+    }
+    for (const auto &diag : lowering_diags) {
+      if (!sink->loweringDiagnostic(diag)) {
+        return false;
       }
-      continue;
     }
+  }
+  if (motion.plane_override.has_value()) {
+    *current_plane = *motion.plane_override;
+  }
+  return true;
+}
 
+} // namespace
+
+MessageLineLowerer::MessageLineLowerer(const LowerOptions &options,
+                                       WorkingPlaneState plane)
+    : options_(options), lowerers_(createMotionFamilyLowerers()),
+      indexed_lowerers_(indexLowerers(lowerers_)), current_plane_(plane) {}
+
+MessageLineLowerer::~MessageLineLowerer() = default;
+
+bool MessageLineLowerer::lowerLine(const Line &line, MessageResult *result) {
+  if (shouldSkipLine(line, options_)) {
+    return true;
+  }
+  const auto reject = [&] {
+    result->rejected_lines.push_back(
+        makeRejectedLine(line, options_,
+                         collectLineErrors(result->diagnostics,
+                                           line.line_index)));
+    return false;
+  };
+  if (lineHasError(result->diagnostics, line.line_index)) {
+    return reject();
+  }
+
+  const LineMotion motion = scanLineMotion(line);
+  if (motion.has_motion) {
     const WorkingPlaneState effective_plane =
-        line_plane_override.value_or(current_plane);
-
-    if (found_motion == 2 || found_motion == 3) {
-      validateArcPlaneWords(line, effective_plane, &result.diagnostics);
-      if (lineHasError(result.diagnostics, line.line_index)) {
-        RejectedLine rejected;
-        rejected.source.filename = options.filename;
-        rejected.source.line = line.line_index;
-        if (line.line_number.has_value()) {
-          rejected.source.line_number = line.line_number->value;
-        }
-        rejected.reasons =
-            collectLineErrors(result.diagnostics, line.line_index);
-        result.rejected_lines.push_back(std::move(rejected));
-        break;
+        motion.plane_override.value_or(current_plane_);
+    if (motion.found_motion == 2 || motion.found_motion == 3) {
+      validateArcPlaneWords(line, effective_plane, &result->diagnostics);
+      if (lineHasError(result->diagnostics, line.line_index)) {
+        return reject();
       }
     }
+    const auto found = indexed_lowerers_.find(motion.found_motion);
+    if (found != indexed_lowerers_.end()) {
+      result->messages.push_back(
+          found->second->lower(line, options_, &result->diagnostics));
+    }
+  }
+  if (motion.plane_override.has_value()) {
+    current_plane_ = *motion.plane_override;
+  }
+  return true;
+}
 
-    const auto found = indexed_lowerers.find(found_motion);
-    if (found == indexed_lowerers.end()) {
-      if (line_plane_override.has_value()) {
-        current_plane = *line_plane_override;
+std::vector<LineChunk> splitLowerChunks(const Program &program,
+                                        size_t max_chunks) {
+  const size_t line_count = program.lines.size();
+  const size_t count =
+      std::min(max_chunks, line_count / kMinLinesPerLowerChunk);
+  bool increasing = count >= 2;
+  for (size_t i = 1; increasing && i < line_count; ++i) {
+    increasing =
+        program.lines[i - 1].line_index < program.lines[i].line_index;
+  }
+  if (!increasing) {
+    return {LineChunk{0, line_count}};
+  }
+  std::vector<LineChunk> chunks(count);
+  for (size_t i = 0; i < count; ++i) {
+    chunks[i].begin = line_count * i / count;
+    chunks[i].end = line_count * (i + 1) / count;
+  }
+  return chunks;
+}
+
+std::vector<std::vector<Diagnostic>>
+diagnosticsByChunk(const std::vector<Diagnostic> &diagnostics,
+                   const Program &program,
+                   const std::vector<LineChunk> &chunks) {
+  std::vector<int> starts;
+  for (size_t i = 1; i < chunks.size(); ++i) {
+    starts.push_back(program.lines[chunks[i].begin].line_index);
+  }
+  std::vector<std::vector<Diagnostic>> by_chunk(chunks.size());
+  for (const auto &diag : diagnostics) {
+    const auto chunk = static_cast<size_t>(
+        std::upper_bound(starts.begin(), starts.end(), diag.location.line) -
+        starts.begin());
+    by_chunk[chunk].push_back(diag);
+  }
+  return by_chunk;
+}
+
+std::vector<WorkingPlaneState>
+planeCheckpoints(const Program &program, const std::vector<LineChunk> &chunks,
+                 const LowerOptions &options, unsigned threads) {
+  std::vector<std::optional<WorkingPlaneState>> last_selection(chunks.size());
+  parallelFor(chunks.size(), threads, [&](size_t chunk) {
+    for (size_t i = chunks[chunk].begin; i < chunks[chunk].end; ++i) {
+      const Line &line = program.lines[i];
+      if (shouldSkipLine(line, options)) {
+        continue;
+      }
+      const auto plane = scanLineMotion(line).plane_override;
+      if (plane.has_value()) {
+        last_selection[chunk] = plane;
       }
-      continue;
     }
-    result.messages.push_back(
-        found->second->lower(line, options, &result.diagnostics));
-    if (line_plane_override.has_value()) {
-      current_plane = *line_plane_override;
+  });
+  std::vector<WorkingPlaneState> checkpoints(chunks.size(),
+                                             WorkingPlaneState::XY);
+  for (size_t i = 1; i < chunks.size(); ++i) {
+    checkpoints[i] = last_selection[i - 1].value_or(checkpoints[i - 1]);
+  }
+  return checkpoints;
+}
+
+MessageResult lowerToMessages(const Program &program,
+                              const std::vector<Diagnostic> &parse_diagnostics,
+                              const LowerOptions &options) {
+  const unsigned threads = resolveThreadCount(options.lower_threads);
+  const auto chunks = splitLowerChunks(
+      program, threads > 1 ? threads * kLowerChunksPerThread : 1);
+  MessageResult result;
+  result.diagnostics = parse_diagnostics;
+  if (chunks.size() == 1) {
+    MessageLineLowerer lowerer(options);
+    for (const auto &line : program.lines) {
+      if (!lowerer.lowerLine(line, &result)) {
+        break;
+      }
     }
+    return result;
   }
 
+  auto chunk_diagnostics =
+      diagnosticsByChunk(parse_diagnostics, program, chunks);
+  const auto planes = planeCheckpoints(program, chunks, options, threads);
+  std::vector<MessageResult> parts(chunks.size());
+  std::vector<size_t> parse_diagnostic_counts(chunks.size());
+  // Chunks after a rejected line are dropped, so they need not be lowered.
+  std::atomic<size_t> first_rejected{chunks.size()};
+  parallelFor(chunks.size(), threads, [&](size_t chunk) {
+    if (chunk > first_rejected.load()) {
+      return;
+    }
+    MessageResult &part = parts[chunk];
+    part.diagnostics = std::move(chunk_diagnostics[chunk]);
+    parse_diagnostic_counts[chunk] = part.diagnostics.size();
+    MessageLineLowerer lowerer(options, planes[chunk]);
+    for (size_t i = chunks[chunk].begin; i < chunks[chunk].end; ++i) {
+      if (!lowerer.lowerLine(program.lines[i], &part)) {
+        size_t current = first_rejected.load();
+        while (chunk < current &&
+               !first_rejected.compare_exchange_weak(current, chunk)) {
+        }
+        break;
+      }
+    }
+  });
+
+  size_t message_count = 0;
+  for (const auto &part : parts) {
+    message_count += part.messages.size();
+  }
+  result.messages.reserve(message_count);
+  for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+    auto &part = parts[chunk];
+    result.diagnostics.insert(
+        result.diagnostics.end(),
+        std::make_move_iterator(part.diagnostics.begin() +
+                                parse_diagnostic_counts[chunk]),
+        std::make_move_iterator(part.diagnostics.end()));
+    result.messages.insert(result.messages.end(),
+                           std::make_move_iterator(part.messages.begin()),
+                           std::make_move_iterator(part.messages.end()));
+    if (!part.rejected_lines.empty()) {
+      result.rejected_lines = std::move(part.rejected_lines);
+      break;
+    }
+  }
   return result;
 }
 
@@ -277,12 +574,6 @@ bool lowerToMessagesStream(const Program &program,
                            const LowerOptions &options,
                            const StreamCallbacks &callbacks,
                            const StreamOptions &stream_options) {
-  const auto lowerers = createMotionFamilyLowerers();
-  const auto indexed_lowerers = indexLowerers(lowerers);
-  WorkingPlaneState current_plane = WorkingPlaneState::XY;
-
-  size_t lines_seen = 0;
-  size_t messages_seen = 0;
   size_t diagnostics_seen = 0;
   bool stopped = false;
   emitParseDiagnostics(parse_diagnostics, callbacks, stream_options,
@@ -290,125 +581,51 @@ bool lowerToMessagesStream(const Program &program,
   if (stopped) {
     return false;
   }
+  CallbackStreamSink sink(callbacks, stream_options, diagnostics_seen);
+  const auto lowerers = createMotionFamilyLowerers();
+  const auto indexed_lowerers = indexLowerers(lowerers);
 
-  for (const auto &line : program.lines) {
-    ++lines_seen;
-    if (shouldStop(stream_options, lines_seen, messages_seen,
-                   diagnostics_seen)) {
-      return false;
-    }
-    if (shouldSkipLine(line, options)) {
-      continue;
-    }
-
-    const bool has_line_error =
-        lineHasError(parse_diagnostics, line.line_index);
-    if (has_line_error) {
-      RejectedLine rejected;
-      rejected.source.filename = options.filename;
-      rejected.source.line = line.line_index;
-      if (line.line_number.has_value()) {
-        rejected.source.line_number = line.line_number->value;
-      }
-      rejected.reasons = collectLineErrors(parse_diagnostics, line.line_index);
-      if (callbacks.on_rejected_line) {
-        callbacks.on_rejected_line(rejected);
+  const unsigned threads = resolveThreadCount(options.lower_threads);
+  const auto chunks = splitLowerChunks(
+      program, threads > 1 ? program.lines.size() / kMinLinesPerLowerChunk
+                           : 1);
+  if (chunks.size() == 1) {
+    WorkingPlaneState current_plane = WorkingPlaneState::XY;
+    for (const auto &line : program.lines) {
+      if (!lowerStreamLine(line, parse_diagnostics, options, indexed_lowerers,
+                           &current_plane, &sink)) {
+        return false;
       }
-      return false;
     }
+    return true;
+  }
 
-    bool has_motion = false;
-    int found_motion = 0;
-    std::optional<WorkingPlaneState> line_plane_override;
-    for (const auto &item : line.items) {
-      if (!isWord(item)) {
-        continue;
-      }
-      const auto &word = std::get<Word>(item);
-      const auto parsed_plane = planeFromWord(word);
-      if (parsed_plane.has_value()) {
-        line_plane_override = *parsed_plane;
-      }
-      const int code = motionCode(word);
-      if (code >= 0 && code <= 4) {
-        if (has_motion && code != found_motion) {
-          found_motion = -1;
+  // Chunks are recorded a wave at a time and replayed into the callbacks in
+  // order, so a stopped stream wastes at most one wave and at most one wave
+  // of events is held.
+  const auto planes = planeCheckpoints(program, chunks, options, threads);
+  const size_t wave_size = static_cast<size_t>(threads) * kLowerChunksPerThread;
+  std::vector<RecordingStreamSink> recorded(wave_size);
+  for (size_t wave = 0; wave < chunks.size(); wave += wave_size) {
+    const size_t count = std::min(wave_size, chunks.size() - wave);
+    parallelFor(count, threads, [&](size_t i) {
+      const LineChunk &chunk = chunks[wave + i];
+      WorkingPlaneState current_plane = planes[wave + i];
+      recorded[i].events.clear();
+      for (size_t line = chunk.begin; line < chunk.end; ++line) {
+        if (!lowerStreamLine(program.lines[line], parse_diagnostics, options,
+                             indexed_lowerers, &current_plane,
+                             &recorded[i])) {
           break;
         }
-        has_motion = true;
-        found_motion = code;
-      }
-    }
-
-    if (!has_motion) {
-      if (line_plane_override.has_value()) {
-        current_plane = *line_plane_override;
-      }
-      continue;
-    }
-    const WorkingPlaneState effective_plane =
-        line_plane_override.value_or(current_plane);
-    if (found_motion == 2 || found_motion == 3) {
-      std::vector<Diagnostic> plane_diags;
-      validateArcPlaneWords(line, effective_plane, &plane_diags);
-      for (const auto &diag : plane_diags) {
-        if (callbacks.on_diagnostic) {
-          callbacks.on_diagnostic(diag);
-        }
-        ++diagnostics_seen;
-      }
-      const bool has_plane_error = std::any_of(
-          plane_diags.begin(), plane_diags.end(), [](const Diagnostic &diag) {
-            return diag.severity == Diagnostic::Severity::Error;
-          });
-      if (has_plane_error) {
-        RejectedLine rejected;
-        rejected.source.filename = options.filename;
-        rejected.source.line = line.line_index;
-        if (line.line_number.has_value()) {
-          rejected.source.line_number = line.line_number->value;
-        }
-        rejected.reasons = std::move(plane_diags);
-        if (callbacks.on_rejected_line) {
-          callbacks.on_rejected_line(rejected);
-        }
-        return false;
-      }
-    }
-    const auto found = indexed_lowerers.find(found_motion);
-    if (found == indexed_lowerers.end()) {
-      if (line_plane_override.has_value()) {
-        current_plane = *line_plane_override;
-      }
-      continue;
-    }
-
-    std::vector<Diagnostic> lowering_diags;
-    auto message = found->second->lower(line, options, &lowering_diags);
-    if (callbacks.on_message) {
-      callbacks.on_message(message);
-    }
-    ++messages_seen;
-    if (shouldStop(stream_options, lines_seen, messages_seen,
-                   diagnostics_seen)) {
-      return false;
-    }
-
-    for (const auto &diag : lowering_diags) {
-      if (callbacks.on_diagnostic) {
-        callbacks.on_diagnostic(diag);
       }
-      ++diagnostics_seen;
-      if (shouldStop(stream_options, lines_seen, messages_seen,
-                     diagnostics_seen)) {
+    });
+    for (size_t i = 0; i < count; ++i) {
+      if (!replayStreamEvents(recorded[i].events, &sink)) {
         return false;
       }
     }
-    if (line_plane_override.has_value()) {
-      current_plane = *line_plane_override;
-    }
   }
-
   return true;
 }
 
@@ -424,8 +641,8 @@ bool parseAndLowerFileStream(const std::string &path,
                              const LowerOptions &options,
                              const StreamCallbacks &callbacks,
                              const StreamOptions &stream_options) {
-  std::ifstream input(path, std::ios::in);
-  if (!input.is_open()) {
+  FileSource source;
+  if (!source.open(path)) {
     if (callbacks.on_diagnostic) {
       Diagnostic diag;
       diag.severity = Diagnostic::Severity::Error;
@@ -436,13 +653,11 @@ bool parseAndLowerFileStream(const std::string &path,
     return false;
   }
 
-  std::stringstream buffer;
-  buffer << input.rdbuf();
   LowerOptions file_options = options;
   if (!file_options.filename.has_value()) {
     file_options.filename = path;
   }
-  return parseAndLowerStream(buffer.str(), file_options, callbacks,
+  return parseAndLowerStream(source.text(), file_options, callbacks,
                              stream_options);
 }
 
@@ -2,9 +2,11 @@
 
 #include <cstddef>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -71,6 +73,61 @@ struct StreamOptions {
   std::function<bool()> should_cancel;
 };
 
+class MotionFamilyLowerer;
+
+enum class WorkingPlaneState { XY, ZX, YZ };
+
+// lowerToMessages() one line at a time, for callers that interleave it with
+// other per-line work. Lines must be passed in program order, and `options`
+// must outlive the lowerer.
+class MessageLineLowerer {
+public:
+  explicit MessageLineLowerer(const LowerOptions &options,
+                              WorkingPlaneState plane = WorkingPlaneState::XY);
+  ~MessageLineLowerer();
+
+  // Appends the line's message and diagnostics to `result`. Returns false
+  // when the line is rejected (it is then appended to result->rejected_lines
+  // and lowering must stop). Block-deleted lines are skipped.
+  bool lowerLine(const Line &line, MessageResult *result);
+
+private:
+  const LowerOptions &options_;
+  std::vector<std::unique_ptr<MotionFamilyLowerer>> lowerers_;
+  std::unordered_map<int, const MotionFamilyLowerer *> indexed_lowerers_;
+  WorkingPlaneState current_plane_;
+};
+
+// Parallel lowering (LowerOptions::lower_threads) splits the lines of a
+// program into chunks that are lowered independently and merged in order.
+struct LineChunk {
+  size_t begin = 0;
+  size_t end = 0;
+};
+
+// At most `max_chunks` chunks of at least kMinLinesPerLowerChunk lines, or a
+// single chunk when that would be fewer than two or when line indices are not
+// strictly increasing (diagnostics are assigned to chunks by line index).
+inline constexpr size_t kMinLinesPerLowerChunk = 4096;
+inline constexpr size_t kLowerChunksPerThread = 4;
+std::vector<LineChunk> splitLowerChunks(const Program &program,
+                                        size_t max_chunks);
+
+// The parse diagnostics located on each chunk's lines, in their original
+// order. Diagnostics before the first line go to the first chunk.
+std::vector<std::vector<Diagnostic>>
+diagnosticsByChunk(const std::vector<Diagnostic> &diagnostics,
+                   const Program &program,
+                   const std::vector<LineChunk> &chunks);
+
+// Working plane in effect at the start of each chunk, as line-by-line message
+// lowering tracks it when no earlier line is rejected: the last G17/G18/G19
+// selection of each chunk is found on `threads` threads, then carried
+// forward.
+std::vector<WorkingPlaneState>
+planeCheckpoints(const Program &program, const std::vector<LineChunk> &chunks,
+                 const LowerOptions &options, unsigned threads);
+
 MessageResult lowerToMessages(const Program &program,
                               const std::vector<Diagnostic> &parse_diagnostics,
                               const LowerOptions &options = {});
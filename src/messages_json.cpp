@@ -105,41 +105,41 @@ ModalState modalFromJson(const nlohmann::json &j) {
 
 nlohmann::json poseToJson(const Pose6 &pose) {
   nlohmann::json j;
-  j["x"] = optionalDoubleToJson(pose.x);
-  j["y"] = optionalDoubleToJson(pose.y);
-  j["z"] = optionalDoubleToJson(pose.z);
-  j["a"] = optionalDoubleToJson(pose.a);
-  j["b"] = optionalDoubleToJson(pose.b);
-  j["c"] = optionalDoubleToJson(pose.c);
+  j["x"] = optionalDoubleToJson(pose.x());
+  j["y"] = optionalDoubleToJson(pose.y());
+  j["z"] = optionalDoubleToJson(pose.z());
+  j["a"] = optionalDoubleToJson(pose.a());
+  j["b"] = optionalDoubleToJson(pose.b());
+  j["c"] = optionalDoubleToJson(pose.c());
   return j;
 }
 
 Pose6 poseFromJson(const nlohmann::json &j) {
   Pose6 pose;
-  pose.x = optionalDoubleFromJson(j, "x");
-  pose.y = optionalDoubleFromJson(j, "y");
-  pose.z = optionalDoubleFromJson(j, "z");
-  pose.a = optionalDoubleFromJson(j, "a");
-  pose.b = optionalDoubleFromJson(j, "b");
-  pose.c = optionalDoubleFromJson(j, "c");
+  pose.setX(optionalDoubleFromJson(j, "x"));
+  pose.setY(optionalDoubleFromJson(j, "y"));
+  pose.setZ(optionalDoubleFromJson(j, "z"));
+  pose.setA(optionalDoubleFromJson(j, "a"));
+  pose.setB(optionalDoubleFromJson(j, "b"));
+  pose.setC(optionalDoubleFromJson(j, "c"));
   return pose;
 }
 
 nlohmann::json arcToJson(const ArcParams &arc) {
   nlohmann::json j;
-  j["i"] = optionalDoubleToJson(arc.i);
-  j["j"] = optionalDoubleToJson(arc.j);
-  j["k"] = optionalDoubleToJson(arc.k);
-  j["r"] = optionalDoubleToJson(arc.r);
+  j["i"] = optionalDoubleToJson(arc.i());
+  j["j"] = optionalDoubleToJson(arc.j());
+  j["k"] = optionalDoubleToJson(arc.k());
+  j["r"] = optionalDoubleToJson(arc.r());
   return j;
 }
 
 ArcParams arcFromJson(const nlohmann::json &j) {
   ArcParams arc;
-  arc.i = optionalDoubleFromJson(j, "i");
-  arc.j = optionalDoubleFromJson(j, "j");
-  arc.k = optionalDoubleFromJson(j, "k");
-  arc.r = optionalDoubleFromJson(j, "r");
+  arc.setI(optionalDoubleFromJson(j, "i"));
+  arc.setJ(optionalDoubleFromJson(j, "j"));
+  arc.setK(optionalDoubleFromJson(j, "k"));
+  arc.setR(optionalDoubleFromJson(j, "r"));
   return arc;
 }
 
@@ -0,0 +1,126 @@
+#include "gcode/motion_table.h"
+
+#include <type_traits>
+
+#include "packet.h"
+
+namespace gcode {
+namespace {
+
+class MotionTableBuilder {
+public:
+  MotionTableBuilder(MotionTable *table, size_t rows) : table_(table) {
+    table_->kind.reserve(rows);
+    table_->source_line.reserve(rows);
+    table_->instruction.reserve(rows);
+    for (auto *column : {&table_->x, &table_->y, &table_->z, &table_->a,
+                         &table_->b, &table_->c, &table_->feed}) {
+      column->reserve(rows);
+    }
+  }
+
+  void addLinear(size_t index, const SourceInfo &source, bool rapid,
+                 const Pose6 &target, const std::optional<double> &feed) {
+    addRow(index, source, rapid ? MotionKind::Rapid : MotionKind::Linear,
+           target, feed);
+  }
+
+  void addArc(size_t index, const SourceInfo &source, bool clockwise,
+              WorkingPlane plane, const Pose6 &target, const ArcParams &arc,
+              const std::optional<double> &feed) {
+    auto &arcs = table_->arcs;
+    arcs.row.push_back(static_cast<uint32_t>(table_->size()));
+    arcs.plane.push_back(plane);
+    arcs.i.push(arc.i());
+    arcs.j.push(arc.j());
+    arcs.k.push(arc.k());
+    arcs.r.push(arc.r());
+    addRow(index, source,
+           clockwise ? MotionKind::ArcClockwise
+                     : MotionKind::ArcCounterClockwise,
+           target, feed);
+  }
+
+private:
+  void addRow(size_t index, const SourceInfo &source, MotionKind kind,
+              const Pose6 &target, const std::optional<double> &feed) {
+    table_->kind.push_back(kind);
+    table_->source_line.push_back(source.line);
+    table_->instruction.push_back(static_cast<uint32_t>(index));
+    table_->x.push(target.x());
+    table_->y.push(target.y());
+    table_->z.push(target.z());
+    table_->a.push(target.a());
+    table_->b.push(target.b());
+    table_->c.push(target.c());
+    table_->feed.push(feed);
+  }
+
+  MotionTable *table_;
+};
+
+} // namespace
+
+void MotionColumn::push(std::optional<double> value) {
+  const size_t row = values.size();
+  if (row % 64 == 0) {
+    present.push_back(0);
+  }
+  values.push_back(value.value_or(0.0));
+  if (value.has_value()) {
+    present.back() |= uint64_t{1} << (row % 64);
+  }
+}
+
+void MotionColumn::reserve(size_t rows) {
+  values.reserve(rows);
+  present.reserve((rows + 63) / 64);
+}
+
+MotionTable buildMotionTable(const AilResult &result) {
+  size_t rows = 0;
+  for (const auto &instruction : result.instructions) {
+    rows += std::holds_alternative<AilLinearMoveInstruction>(instruction) ||
+            std::holds_alternative<AilArcMoveInstruction>(instruction);
+  }
+  MotionTable table;
+  MotionTableBuilder builder(&table, rows);
+  for (size_t index = 0; index < result.instructions.size(); ++index) {
+    const auto &instruction = result.instructions[index];
+    if (const auto *linear =
+            std::get_if<AilLinearMoveInstruction>(&instruction)) {
+      builder.addLinear(index, linear->source, linear->opcode == "G0",
+                        linear->target_pose, linear->feed);
+    } else if (const auto *arc =
+                   std::get_if<AilArcMoveInstruction>(&instruction)) {
+      builder.addArc(index, arc->source, arc->clockwise, arc->plane_effective,
+                     arc->target_pose, arc->arc, arc->feed);
+    }
+  }
+  return table;
+}
+
+MotionTable buildMotionTable(const PacketResult &result) {
+  size_t rows = 0;
+  for (const auto &packet : result.packets) {
+    rows += packet.type != PacketType::Dwell;
+  }
+  MotionTable table;
+  MotionTableBuilder builder(&table, rows);
+  for (size_t index = 0; index < result.packets.size(); ++index) {
+    const auto &packet = result.packets[index];
+    if (const auto *linear =
+            std::get_if<MotionLinearPayload>(&packet.payload)) {
+      builder.addLinear(index, packet.source, packet.modal.code == "G0",
+                        linear->target_pose, linear->feed);
+    } else if (const auto *arc =
+                   std::get_if<MotionArcPayload>(&packet.payload)) {
+      builder.addArc(index, packet.source, arc->clockwise,
+                     arc->plane_effective, arc->target_pose, arc->arc,
+                     arc->feed);
+    }
+  }
+  return table;
+}
+
+} // namespace gcode
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "gcode/ail.h"
+#include "gcode/motion_table.h"
 
 namespace gcode {
 
@@ -54,4 +55,7 @@ PacketResult lowerAilToPackets(const AilResult &ail_result);
 PacketResult parseLowerAndPacketize(std::string_view input,
                                     const LowerOptions &options = {});
 
+// Rows for the linear and arc move packets of `result`.
+MotionTable buildMotionTable(const PacketResult &result);
+
 } // namespace gcode
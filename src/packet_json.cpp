@@ -85,21 +85,21 @@ nlohmann::json modalToJson(const ModalState &modal) {
 
 nlohmann::json poseToJson(const Pose6 &pose) {
   nlohmann::json j;
-  j["x"] = optionalDoubleToJson(pose.x);
-  j["y"] = optionalDoubleToJson(pose.y);
-  j["z"] = optionalDoubleToJson(pose.z);
-  j["a"] = optionalDoubleToJson(pose.a);
-  j["b"] = optionalDoubleToJson(pose.b);
-  j["c"] = optionalDoubleToJson(pose.c);
+  j["x"] = optionalDoubleToJson(pose.x());
+  j["y"] = optionalDoubleToJson(pose.y());
+  j["z"] = optionalDoubleToJson(pose.z());
+  j["a"] = optionalDoubleToJson(pose.a());
+  j["b"] = optionalDoubleToJson(pose.b());
+  j["c"] = optionalDoubleToJson(pose.c());
   return j;
 }
 
 nlohmann::json arcToJson(const ArcParams &arc) {
   nlohmann::json j;
-  j["i"] = optionalDoubleToJson(arc.i);
-  j["j"] = optionalDoubleToJson(arc.j);
-  j["k"] = optionalDoubleToJson(arc.k);
-  j["r"] = optionalDoubleToJson(arc.r);
+  j["i"] = optionalDoubleToJson(arc.i());
+  j["j"] = optionalDoubleToJson(arc.j());
+  j["k"] = optionalDoubleToJson(arc.k());
+  j["r"] = optionalDoubleToJson(arc.r());
   return j;
 }
 
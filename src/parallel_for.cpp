@@ -0,0 +1,45 @@
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace gcode {
+
+void parallelFor(size_t count, unsigned threads,
+                 const std::function<void(size_t)> &fn) {
+  const size_t worker_count =
+      std::min(count, static_cast<size_t>(std::max(threads, 1u)));
+  if (worker_count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  auto drain = [&]() {
+    for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+      fn(i);
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count - 1);
+  for (size_t i = 1; i < worker_count; ++i) {
+    workers.emplace_back(drain);
+  }
+  drain();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+unsigned resolveThreadCount(unsigned requested) {
+  if (requested != 0) {
+    return requested;
+  }
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+} // namespace gcode
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace gcode {
+
+// Runs fn(0) .. fn(count - 1) on up to `threads` threads, the calling thread
+// included, and returns once every call has finished. Indices are handed out
+// in increasing order, but calls may finish in any order, so fn should write
+// only to per-index slots. fn must not throw.
+void parallelFor(size_t count, unsigned threads,
+                 const std::function<void(size_t)> &fn);
+
+// Number of threads a `0 = automatic` option resolves to (at least 1).
+unsigned resolveThreadCount(unsigned requested);
+
+} // namespace gcode
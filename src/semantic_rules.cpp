@@ -1,52 +1,103 @@
 #include "semantic_rules.h"
 
+#include <algorithm>
 #include <cctype>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <memory>
 #include <optional>
 #include <string_view>
-#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "gcode/compact_ast.h"
+
 #include "lowering_family_common.h"
+#include "parallel_for.h"
 
 namespace gcode {
 namespace {
 
-class LineSemanticRule {
-public:
-  virtual ~LineSemanticRule() = default;
-  virtual void apply(const Line &line,
-                     std::vector<Diagnostic> *diagnostics) const = 0;
+// A CompactLine with the items and statement line of its result, which the
+// rules read in place of an owning Line.
+struct CompactLineRef {
+  const CompactLine *line = nullptr;
+  const CompactLineItem *items_begin = nullptr;
+  const CompactLineItem *items_end = nullptr;
+  // The line's CompactParseResult::statement_lines entry, or nullptr.
+  const Line *statement_line = nullptr;
+
+  const CompactLineItem *begin() const { return items_begin; }
+  const CompactLineItem *end() const { return items_end; }
+};
+
+template <typename LineT> struct LineTypes {
+  using WordT = Word;
+  using CommentT = Comment;
 };
+template <> struct LineTypes<CompactLineRef> {
+  using WordT = CompactWord;
+  using CommentT = CompactComment;
+};
+
+const std::vector<LineItem> &itemsOf(const Line &line) { return line.items; }
+const CompactLineRef &itemsOf(const CompactLineRef &line) { return line; }
+
+const Line &lineFields(const Line &line) { return line; }
+const CompactLine &lineFields(const CompactLineRef &line) {
+  return *line.line;
+}
+
+StatementRef<const Assignment> assignmentOf(const Line &line) {
+  return line.assignment();
+}
+StatementRef<const Assignment> assignmentOf(const CompactLineRef &line) {
+  return line.statement_line != nullptr
+             ? line.statement_line->assignment()
+             : StatementRef<const Assignment>(nullptr);
+}
+
+// Compact words carry their symbol and numbers already resolved.
+WordSymbol wordSymbol(const CompactWord &word) { return word.symbol; }
+std::optional<double> wordNumber(const CompactWord &word) {
+  return word.number;
+}
+std::optional<int> wordInteger(const CompactWord &word) {
+  return word.integer;
+}
 
-bool isMotionWord(const Word &word, int *out_code) {
-  if (word.head != "G" || !word.value.has_value()) {
+template <typename WordT> bool isMotionWord(const WordT &word, int *out_code) {
+  if (wordSymbol(word) != WordSymbol::G || !word.value.has_value()) {
     return false;
   }
-  try {
-    int code = std::stoi(*word.value);
-    if (code == 0 || code == 1 || code == 2 || code == 3 || code == 4) {
-      if (out_code) {
-        *out_code = code;
-      }
-      return true;
-    }
-  } catch (...) {
+  const auto code = wordInteger(word);
+  if (!code.has_value() || *code < 0 || *code > 4) {
     return false;
   }
-  return false;
+  if (out_code) {
+    *out_code = *code;
+  }
+  return true;
 }
 
-bool isCartesianWord(const Word &word) {
-  return word.head == "X" || word.head == "Y" || word.head == "Z" ||
-         word.head == "A";
+template <typename WordT> bool isCartesianWord(const WordT &word) {
+  switch (wordSymbol(word)) {
+  case WordSymbol::X:
+  case WordSymbol::Y:
+  case WordSymbol::Z:
+  case WordSymbol::A:
+    return true;
+  default:
+    return false;
+  }
 }
 
-bool isPolarWord(const Word &word) {
-  return word.head == "AP" || word.head == "RP";
+template <typename WordT> bool isPolarWord(const WordT &word) {
+  const WordSymbol symbol = wordSymbol(word);
+  return symbol == WordSymbol::AP || symbol == WordSymbol::RP;
 }
 
 void addDiagnostic(std::vector<Diagnostic> *diagnostics, const Location &loc,
@@ -58,7 +109,7 @@ void addDiagnostic(std::vector<Diagnostic> *diagnostics, const Location &loc,
   diagnostics->push_back(std::move(diag));
 }
 
-bool isUnsignedIntegerText(const std::string &text) {
+bool isUnsignedIntegerText(std::string_view text) {
   if (text.empty()) {
     return false;
   }
@@ -83,7 +134,7 @@ bool equalsIgnoreAsciiCase(std::string_view lhs, std::string_view rhs) {
   return true;
 }
 
-bool isSubprogramTargetWord(const Word &word) {
+template <typename WordT> bool isSubprogramTargetWord(const WordT &word) {
   if (word.quoted) {
     return !word.text.empty();
   }
@@ -101,12 +152,14 @@ bool isSubprogramTargetWord(const Word &word) {
       return false;
     }
   }
-  if (equalsIgnoreAsciiCase(word.head, "RET") ||
-      equalsIgnoreAsciiCase(word.head, "RTLION") ||
-      equalsIgnoreAsciiCase(word.head, "RTLIOF")) {
+  switch (wordSymbol(word)) {
+  case WordSymbol::RET:
+  case WordSymbol::RTLION:
+  case WordSymbol::RTLIOF:
     return false;
+  default:
+    return true;
   }
-  return true;
 }
 
 std::optional<int64_t> parseInt64Strict(std::string_view text) {
@@ -129,17 +182,18 @@ std::optional<int64_t> parseInt64Strict(std::string_view text) {
   return value;
 }
 
-class MotionExclusivityRule final : public LineSemanticRule {
+class MotionExclusivityRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
     int motion_code = 0;
     bool has_motion = false;
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
+      const auto &word = std::get<WordT>(item);
       int code = 0;
       if (!isMotionWord(word, &code)) {
         continue;
@@ -160,20 +214,21 @@ public:
   }
 };
 
-class G4BlockRule final : public LineSemanticRule {
+class G4BlockRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
-    const Word *g4_word = nullptr;
-    const Word *f_word = nullptr;
-    const Word *s_word = nullptr;
-    const Word *first_other_word = nullptr;
-
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
+    const WordT *g4_word = nullptr;
+    const WordT *f_word = nullptr;
+    const WordT *s_word = nullptr;
+    const WordT *first_other_word = nullptr;
+
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
+      const auto &word = std::get<WordT>(item);
       int code = 0;
       if (isMotionWord(word, &code) && code == 4) {
         if (!g4_word) {
@@ -183,7 +238,8 @@ public:
         }
         continue;
       }
-      if (word.head == "F") {
+      const WordSymbol symbol = wordSymbol(word);
+      if (symbol == WordSymbol::F) {
         if (!f_word) {
           f_word = &word;
         } else if (!first_other_word) {
@@ -191,7 +247,7 @@ public:
         }
         continue;
       }
-      if (word.head == "S") {
+      if (symbol == WordSymbol::S) {
         if (!s_word) {
           s_word = &word;
         } else if (!first_other_word) {
@@ -228,29 +284,29 @@ public:
       return;
     }
 
-    const Word *dwell_word = f_word ? f_word : s_word;
-    double parsed_value = 0.0;
-    if (!parseDoubleText(dwell_word->value, &parsed_value)) {
+    const WordT *dwell_word = f_word ? f_word : s_word;
+    if (!wordNumber(*dwell_word).has_value()) {
       addDiagnostic(diagnostics, dwell_word->location,
                     "G4 dwell value must be numeric");
     }
   }
 };
 
-class G1CoordinateModeRule final : public LineSemanticRule {
+class G1CoordinateModeRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
     int motion_code = 0;
     bool has_motion = false;
     bool has_cartesian = false;
     bool has_polar = false;
 
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
+      const auto &word = std::get<WordT>(item);
       int code = 0;
       if (isMotionWord(word, &code)) {
         has_motion = true;
@@ -275,16 +331,17 @@ public:
   }
 };
 
-class LineNumberWordRule final : public LineSemanticRule {
+class LineNumberWordRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
-      if (word.head != "N") {
+      const auto &word = std::get<WordT>(item);
+      if (wordSymbol(word) != WordSymbol::N) {
         continue;
       }
       if (!word.value.has_value() || !isUnsignedIntegerText(*word.value)) {
@@ -299,37 +356,40 @@ public:
   }
 };
 
-class BlockSkipLevelRule final : public LineSemanticRule {
+class BlockSkipLevelRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
-    if (!line.block_delete) {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    const auto &fields = lineFields(line);
+    if (!fields.block_delete) {
       return;
     }
-    if (!line.block_delete_level_raw.has_value()) {
+    if (!fields.block_delete_level_raw.has_value()) {
       return;
     }
-    const Location loc = line.block_delete_level_location.value_or(Location{});
+    const Location loc =
+        fields.block_delete_level_location.value_or(Location{});
 
-    if (!line.block_delete_level.has_value()) {
+    if (!fields.block_delete_level.has_value()) {
       addDiagnostic(diagnostics, loc, "invalid skip level; use /0 through /9");
       return;
     }
-    if (*line.block_delete_level < 0 || *line.block_delete_level > 9) {
+    if (*fields.block_delete_level < 0 || *fields.block_delete_level > 9) {
       addDiagnostic(diagnostics, loc, "invalid skip level; use /0 through /9");
     }
   }
 };
 
-class AssignmentShapeRule final : public LineSemanticRule {
+class AssignmentShapeRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
+      const auto &word = std::get<WordT>(item);
       if (!word.value.has_value()) {
         continue;
       }
@@ -347,26 +407,35 @@ public:
   }
 };
 
-class ProcDeclarationShapeRule final : public LineSemanticRule {
+class ProcDeclarationShapeRule {
 public:
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
-    if (line.assignment.has_value() &&
-        equalsIgnoreAsciiCase(line.assignment->lhs, "PROC")) {
-      addDiagnostic(diagnostics, line.assignment->location,
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
+    if (assignmentOf(line).has_value() &&
+        equalsIgnoreAsciiCase(assignmentOf(line)->lhs, "PROC")) {
+      addDiagnostic(diagnostics, assignmentOf(line)->location,
                     "malformed PROC declaration; expected PROC <name>");
       return;
     }
 
-    std::vector<const Word *> words;
-    words.reserve(line.items.size());
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+    // Only the first three words matter: PROC, the name, and anything after.
+    const WordT *words[3] = {};
+    size_t word_count = 0;
+    for (const auto &item : itemsOf(line)) {
+      const auto *word = std::get_if<WordT>(&item);
+      if (!word) {
         continue;
       }
-      words.push_back(&std::get<Word>(item));
+      if (word_count == 0 && wordSymbol(*word) != WordSymbol::PROC) {
+        return;
+      }
+      words[word_count++] = word;
+      if (word_count == 3) {
+        break;
+      }
     }
-    if (words.empty() || !equalsIgnoreAsciiCase(words[0]->head, "PROC")) {
+    if (word_count == 0) {
       return;
     }
     if (words[0]->has_equal || words[0]->value.has_value()) {
@@ -374,7 +443,7 @@ public:
                     "malformed PROC declaration; expected PROC <name>");
       return;
     }
-    if (words.size() == 1) {
+    if (word_count == 1) {
       addDiagnostic(diagnostics, words[0]->location,
                     "malformed PROC declaration; expected PROC <name>");
       return;
@@ -384,7 +453,7 @@ public:
                     "malformed PROC declaration; expected PROC <name>");
       return;
     }
-    if (words.size() > 2) {
+    if (word_count > 2) {
       addDiagnostic(diagnostics, words[2]->location,
                     "malformed PROC declaration; expected PROC <name>");
       return;
@@ -392,25 +461,26 @@ public:
   }
 };
 
-class MCodeShapeRule final : public LineSemanticRule {
+class MCodeShapeRule {
 public:
   explicit MCodeShapeRule(bool enable_iso_m98_calls)
       : enable_iso_m98_calls_(enable_iso_m98_calls) {}
 
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
     constexpr int64_t kMCodeMin = 0;
     constexpr int64_t kMCodeMax = 2147483647;
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
+      const auto &word = std::get<WordT>(item);
       if (word.head.empty() || word.head[0] != 'M') {
         continue;
       }
 
-      const std::string ext = word.head.substr(1);
+      const std::string_view ext = std::string_view(word.head).substr(1);
       const bool has_extension = !ext.empty();
       if (has_extension && !isUnsignedIntegerText(ext)) {
         continue;
@@ -443,12 +513,13 @@ public:
       }
 
       if (!enable_iso_m98_calls_ && *value == 98 && !has_extension) {
-        for (const auto &line_item : line.items) {
-          if (!std::holds_alternative<Word>(line_item)) {
+        for (const auto &line_item : itemsOf(line)) {
+          if (!std::holds_alternative<WordT>(line_item)) {
             continue;
           }
-          const auto &candidate = std::get<Word>(line_item);
-          if (candidate.head == "P" && candidate.value.has_value()) {
+          const auto &candidate = std::get<WordT>(line_item);
+          if (wordSymbol(candidate) == WordSymbol::P &&
+              candidate.value.has_value()) {
             addDiagnostic(
                 diagnostics, word.location,
                 "M98 subprogram call requires ISO compatibility mode");
@@ -463,27 +534,28 @@ private:
   bool enable_iso_m98_calls_ = false;
 };
 
-class ToolSelectorShapeRule final : public LineSemanticRule {
+class ToolSelectorShapeRule {
 public:
   explicit ToolSelectorShapeRule(bool tool_management)
       : tool_management_(tool_management) {}
 
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
-    if (line.assignment.has_value() &&
-        isToolSelectorHead(line.assignment->lhs)) {
-      if (!isValidToolSelectorAssignment(*line.assignment)) {
-        addDiagnostic(diagnostics, line.assignment->location,
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using WordT = typename LineTypes<LineT>::WordT;
+    if (assignmentOf(line).has_value() &&
+        isToolSelectorHead(assignmentOf(line)->lhs)) {
+      if (!isValidToolSelectorAssignment(*assignmentOf(line))) {
+        addDiagnostic(diagnostics, assignmentOf(line)->location,
                       invalidSelectorMessage());
       }
       return;
     }
 
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Word>(item)) {
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<WordT>(item)) {
         continue;
       }
-      const auto &word = std::get<Word>(item);
+      const auto &word = std::get<WordT>(item);
       if (!isToolSelectorHead(word.head)) {
         continue;
       }
@@ -508,7 +580,7 @@ private:
     return true;
   }
 
-  static bool isToolSelectorHead(const std::string &head) {
+  static bool isToolSelectorHead(std::string_view head) {
     if (head == "T") {
       return true;
     }
@@ -518,7 +590,7 @@ private:
     return isDigits(std::string_view(head).substr(1));
   }
 
-  bool isValidToolSelector(const Word &word) const {
+  template <typename WordT> bool isValidToolSelector(const WordT &word) const {
     if (!word.value.has_value()) {
       return false;
     }
@@ -580,20 +652,21 @@ private:
   bool tool_management_ = false;
 };
 
-class DoubleSlashCommentRule final : public LineSemanticRule {
+class DoubleSlashCommentRule {
 public:
   explicit DoubleSlashCommentRule(bool enabled) : enabled_(enabled) {}
 
-  void apply(const Line &line,
-             std::vector<Diagnostic> *diagnostics) const override {
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    using CommentT = typename LineTypes<LineT>::CommentT;
     if (enabled_) {
       return;
     }
-    for (const auto &item : line.items) {
-      if (!std::holds_alternative<Comment>(item)) {
+    for (const auto &item : itemsOf(line)) {
+      if (!std::holds_alternative<CommentT>(item)) {
         continue;
       }
-      const auto &comment = std::get<Comment>(item);
+      const auto &comment = std::get<CommentT>(item);
       if (comment.text.rfind("//", 0) != 0) {
         continue;
       }
@@ -607,80 +680,295 @@ private:
   bool enabled_ = false;
 };
 
-std::vector<std::unique_ptr<LineSemanticRule>>
-makeRules(bool enable_double_slash_comments, bool tool_management,
-          bool enable_iso_m98_calls) {
-  std::vector<std::unique_ptr<LineSemanticRule>> rules;
-  rules.push_back(std::make_unique<G4BlockRule>());
-  rules.push_back(std::make_unique<MotionExclusivityRule>());
-  rules.push_back(std::make_unique<G1CoordinateModeRule>());
-  rules.push_back(std::make_unique<LineNumberWordRule>());
-  rules.push_back(std::make_unique<BlockSkipLevelRule>());
-  rules.push_back(std::make_unique<ProcDeclarationShapeRule>());
-  rules.push_back(std::make_unique<AssignmentShapeRule>());
-  rules.push_back(std::make_unique<MCodeShapeRule>(enable_iso_m98_calls));
-  rules.push_back(std::make_unique<ToolSelectorShapeRule>(tool_management));
-  rules.push_back(
-      std::make_unique<DoubleSlashCommentRule>(enable_double_slash_comments));
-  return rules;
+// Every line rule, applied in order to a Line or a CompactLineRef; a line
+// gets at most one rule diagnostic, from the first rule that reports. The rules are members rather than a list
+// of virtual objects so a line's checks inline into one call.
+class LineRules {
+public:
+  LineRules(bool enable_double_slash_comments, bool tool_management,
+            bool enable_iso_m98_calls)
+      : m_code_(enable_iso_m98_calls), tool_selector_(tool_management),
+        double_slash_comment_(enable_double_slash_comments) {}
+
+  template <typename LineT>
+  void apply(const LineT &line, std::vector<Diagnostic> *diagnostics) const {
+    applyFirstReporting(line, diagnostics, g4_block_, motion_exclusivity_,
+                        g1_coordinate_mode_, line_number_word_,
+                        block_skip_level_, proc_declaration_shape_,
+                        assignment_shape_, m_code_, tool_selector_,
+                        double_slash_comment_);
+  }
+
+private:
+  template <typename LineT, typename... Rules>
+  static void applyFirstReporting(const LineT &line,
+                                  std::vector<Diagnostic> *diagnostics,
+                                  const Rules &...rules) {
+    const size_t before = diagnostics->size();
+    (void)((rules.apply(line, diagnostics), diagnostics->size() != before) ||
+           ...);
+  }
+
+  G4BlockRule g4_block_;
+  MotionExclusivityRule motion_exclusivity_;
+  G1CoordinateModeRule g1_coordinate_mode_;
+  LineNumberWordRule line_number_word_;
+  BlockSkipLevelRule block_skip_level_;
+  ProcDeclarationShapeRule proc_declaration_shape_;
+  AssignmentShapeRule assignment_shape_;
+  MCodeShapeRule m_code_;
+  ToolSelectorShapeRule tool_selector_;
+  DoubleSlashCommentRule double_slash_comment_;
+};
+
+bool isLineNumberTargetKind(const std::string &target_kind) {
+  return target_kind == "line_number" || target_kind == "number";
 }
 
-} // namespace
+// Lines per range below which checking a program on several threads costs
+// more than it saves.
+constexpr size_t kMinLinesPerRange = 4096;
+constexpr size_t kRangesPerThread = 4;
 
-void addSemanticDiagnostics(ParseResult &result,
-                            bool enable_double_slash_comments,
-                            bool tool_management, bool enable_iso_m98_calls) {
-  auto rules = makeRules(enable_double_slash_comments, tool_management,
-                         enable_iso_m98_calls);
-  std::unordered_map<int, Location> first_line_number_at;
+Diagnostic duplicateLineNumberWarning(const LineNumber &line_number) {
+  Diagnostic diag;
+  diag.severity = Diagnostic::Severity::Warning;
+  diag.message = "duplicate N-address N" + std::to_string(line_number.value) +
+                 "; jumps by line number may be ambiguous";
+  diag.location = line_number.location;
+  return diag;
+}
+
+// A line's N-address and the number of diagnostics before the line's own,
+// which is where a duplicate N-address warning for the line goes.
+struct NumberedLine {
+  size_t diagnostic_index = 0;
+  const LineNumber *line_number = nullptr;
+};
+
+// Result of checking one range of lines on a worker thread.
+struct LineRangeCheck {
+  std::vector<Diagnostic> diagnostics;
+  std::vector<NumberedLine> numbered_lines;
   bool has_line_number_target_jump = false;
-  for (const auto &line : result.program.lines) {
-    if (line.goto_statement.has_value()) {
-      const auto &target_kind = line.goto_statement->target_kind;
-      if (target_kind == "line_number" || target_kind == "number") {
-        has_line_number_target_jump = true;
-        break;
-      }
+};
+
+// Applies the rules to [begin, end) and records what the duplicate N-address
+// check needs, so a program is walked once whether or not it has jumps.
+void checkLines(const Line *begin, const Line *end, const LineRules &rules,
+                std::vector<Diagnostic> *diagnostics,
+                std::vector<NumberedLine> *numbered_lines,
+                bool *has_line_number_target_jump) {
+  for (const Line *line = begin; line != end; ++line) {
+    if (line->line_number.has_value()) {
+      numbered_lines->push_back({diagnostics->size(), &*line->line_number});
     }
-    if (line.if_goto_statement.has_value()) {
-      const auto &then_kind = line.if_goto_statement->then_branch.target_kind;
-      if (then_kind == "line_number" || then_kind == "number") {
-        has_line_number_target_jump = true;
-        break;
-      }
-      if (line.if_goto_statement->else_branch.has_value()) {
-        const auto &else_kind =
-            line.if_goto_statement->else_branch->target_kind;
-        if (else_kind == "line_number" || else_kind == "number") {
-          has_line_number_target_jump = true;
-          break;
-        }
-      }
+    if (!*has_line_number_target_jump && hasLineNumberTargetJump(*line)) {
+      *has_line_number_target_jump = true;
+    }
+    rules.apply(*line, diagnostics);
+  }
+}
+
+// Puts a warning for every repeated N-address in front of the diagnostics of
+// the line that repeats it.
+void insertDuplicateLineNumberWarnings(
+    const std::vector<NumberedLine> &numbered_lines,
+    std::vector<Diagnostic> *diagnostics) {
+  std::unordered_set<int> seen;
+  std::vector<std::pair<size_t, Diagnostic>> warnings;
+  for (const auto &numbered : numbered_lines) {
+    if (!seen.insert(numbered.line_number->value).second) {
+      warnings.emplace_back(numbered.diagnostic_index,
+                            duplicateLineNumberWarning(*numbered.line_number));
+    }
+  }
+  if (warnings.empty()) {
+    return;
+  }
+  std::vector<Diagnostic> merged;
+  merged.reserve(diagnostics->size() + warnings.size());
+  size_t next = 0;
+  for (auto &[index, warning] : warnings) {
+    for (; next < index; ++next) {
+      merged.push_back(std::move((*diagnostics)[next]));
+    }
+    merged.push_back(std::move(warning));
+  }
+  for (; next < diagnostics->size(); ++next) {
+    merged.push_back(std::move((*diagnostics)[next]));
+  }
+  diagnostics->swap(merged);
+}
+
+} // namespace
+
+bool hasLineNumberTargetJump(const Line &line) {
+  if (line.goto_statement().has_value() &&
+      isLineNumberTargetKind(line.goto_statement()->target_kind)) {
+    return true;
+  }
+  if (line.if_goto_statement().has_value()) {
+    if (isLineNumberTargetKind(
+            line.if_goto_statement()->then_branch.target_kind)) {
+      return true;
+    }
+    if (line.if_goto_statement()->else_branch.has_value() &&
+        isLineNumberTargetKind(
+            line.if_goto_statement()->else_branch->target_kind)) {
+      return true;
     }
   }
+  return false;
+}
 
-  for (const auto &line : result.program.lines) {
-    if (has_line_number_target_jump && line.line_number.has_value()) {
-      const int n = line.line_number->value;
-      const auto [it, inserted] =
-          first_line_number_at.emplace(n, line.line_number->location);
-      if (!inserted) {
+void addBlockLengthDiagnostics(std::string_view input,
+                               std::vector<Diagnostic> *diagnostics) {
+  if (!diagnostics) {
+    return;
+  }
+  constexpr size_t kMaxBlockLength = 512;
+
+  int line = 1;
+  size_t start = 0;
+  while (start < input.size()) {
+    const auto *newline = static_cast<const char *>(
+        std::memchr(input.data() + start, '\n', input.size() - start));
+    if (!newline) {
+      break;
+    }
+    const size_t end = static_cast<size_t>(newline - input.data());
+    // The LF is counted by the Siemens rule, CR is not. CRs are only counted
+    // for the rare line that is too long with them.
+    if (end - start + 1 > kMaxBlockLength) {
+      const auto cr_count = static_cast<size_t>(
+          std::count(input.data() + start, newline, '\r'));
+      if (end - start - cr_count + 1 > kMaxBlockLength) {
         Diagnostic diag;
-        diag.severity = Diagnostic::Severity::Warning;
-        diag.message = "duplicate N-address N" + std::to_string(n) +
-                       "; jumps by line number may be ambiguous";
-        diag.location = line.line_number->location;
-        result.diagnostics.push_back(std::move(diag));
+        diag.severity = Diagnostic::Severity::Error;
+        diag.message =
+            "block length exceeds 512 characters (including end-of-block LF)";
+        diag.location = {line, static_cast<int>(kMaxBlockLength) + 1};
+        diagnostics->push_back(std::move(diag));
       }
     }
-    for (const auto &rule : rules) {
-      const size_t before = result.diagnostics.size();
-      rule->apply(line, &result.diagnostics);
-      if (result.diagnostics.size() != before) {
-        break;
+    ++line;
+    start = end + 1;
+  }
+}
+
+struct SemanticLineChecker::State {
+  State(bool enable_double_slash_comments, bool tool_management,
+        bool enable_iso_m98_calls)
+      : rules(enable_double_slash_comments, tool_management,
+              enable_iso_m98_calls) {}
+
+  LineRules rules;
+  bool has_line_number_target_jump = false;
+  std::unordered_set<int> seen_line_numbers;
+};
+
+SemanticLineChecker::SemanticLineChecker(bool enable_double_slash_comments,
+                                         bool tool_management,
+                                         bool enable_iso_m98_calls,
+                                         bool has_line_number_target_jump)
+    : state_(std::make_unique<State>(enable_double_slash_comments,
+                                     tool_management, enable_iso_m98_calls)) {
+  state_->has_line_number_target_jump = has_line_number_target_jump;
+}
+
+SemanticLineChecker::~SemanticLineChecker() = default;
+
+void SemanticLineChecker::check(const Line &line,
+                                std::vector<Diagnostic> *diagnostics) {
+  if (state_->has_line_number_target_jump && line.line_number.has_value() &&
+      !state_->seen_line_numbers.insert(line.line_number->value).second) {
+    diagnostics->push_back(duplicateLineNumberWarning(*line.line_number));
+  }
+  state_->rules.apply(line, diagnostics);
+}
+
+void SemanticLineChecker::check(const CompactParseResult &result,
+                                const CompactLine &line,
+                                std::vector<Diagnostic> *diagnostics) {
+  if (state_->has_line_number_target_jump && line.line_number.has_value() &&
+      !state_->seen_line_numbers.insert(line.line_number->value).second) {
+    diagnostics->push_back(duplicateLineNumberWarning(*line.line_number));
+  }
+  CompactLineRef ref;
+  ref.line = &line;
+  ref.items_begin = result.items.data() + line.first_item;
+  ref.items_end = ref.items_begin + line.item_count;
+  if (line.statement_index >= 0) {
+    ref.statement_line = &result.statement_lines[line.statement_index];
+  }
+  state_->rules.apply(ref, diagnostics);
+}
+
+void addValidationDiagnostics(std::string_view input,
+                              const ParseOptions &options, unsigned threads,
+                              ParseResult &result) {
+  const LineRules rules(options.enable_double_slash_comments,
+                        options.tool_management, options.enable_iso_m98_calls);
+  const auto &lines = result.program.lines;
+  const size_t range_count =
+      threads > 1 ? std::min(static_cast<size_t>(threads) * kRangesPerThread,
+                             lines.size() / kMinLinesPerRange)
+                  : 0;
+
+  std::vector<NumberedLine> numbered_lines;
+  bool has_line_number_target_jump = false;
+  if (range_count < 2) {
+    addBlockLengthDiagnostics(input, &result.diagnostics);
+    checkLines(lines.data(), lines.data() + lines.size(), rules,
+               &result.diagnostics, &numbered_lines,
+               &has_line_number_target_jump);
+  } else {
+    // Task 0 scans the block lengths, the others check one line range each.
+    std::vector<Diagnostic> block_length_diagnostics;
+    std::vector<LineRangeCheck> ranges(range_count);
+    parallelFor(range_count + 1, threads, [&](size_t task) {
+      if (task == 0) {
+        addBlockLengthDiagnostics(input, &block_length_diagnostics);
+        return;
+      }
+      const size_t index = task - 1;
+      const size_t begin = lines.size() * index / range_count;
+      const size_t end = lines.size() * (index + 1) / range_count;
+      auto &range = ranges[index];
+      checkLines(lines.data() + begin, lines.data() + end, rules,
+                 &range.diagnostics, &range.numbered_lines,
+                 &range.has_line_number_target_jump);
+    });
+
+    for (auto &diagnostic : block_length_diagnostics) {
+      result.diagnostics.push_back(std::move(diagnostic));
+    }
+    for (auto &range : ranges) {
+      const size_t base = result.diagnostics.size();
+      for (auto numbered : range.numbered_lines) {
+        numbered.diagnostic_index += base;
+        numbered_lines.push_back(numbered);
+      }
+      has_line_number_target_jump |= range.has_line_number_target_jump;
+      for (auto &diagnostic : range.diagnostics) {
+        result.diagnostics.push_back(std::move(diagnostic));
       }
     }
   }
+  if (has_line_number_target_jump) {
+    insertDuplicateLineNumberWarnings(numbered_lines, &result.diagnostics);
+  }
+}
+
+void addSemanticDiagnostics(ParseResult &result,
+                            bool enable_double_slash_comments,
+                            bool tool_management, bool enable_iso_m98_calls) {
+  ParseOptions options;
+  options.enable_double_slash_comments = enable_double_slash_comments;
+  options.tool_management = tool_management;
+  options.enable_iso_m98_calls = enable_iso_m98_calls;
+  addValidationDiagnostics({}, options, 1, result);
 }
 
 } // namespace gcode
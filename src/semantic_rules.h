@@ -1,12 +1,58 @@
 #pragma once
 
+#include <memory>
+#include <string_view>
+#include <vector>
+
 #include "gcode/gcode_parser.h"
 
 namespace gcode {
 
+struct CompactLine;
+struct CompactParseResult;
+
+// Appends the block-length diagnostics of `input`, then the semantic
+// diagnostics of result.program.lines, to result.diagnostics. The lines are
+// walked once. With `threads` > 1 a large program is checked as line ranges on
+// several threads, the block-length scan running alongside; the diagnostics
+// and their order are the same as with one thread.
+void addValidationDiagnostics(std::string_view input,
+                              const ParseOptions &options, unsigned threads,
+                              ParseResult &result);
+
+// The semantic half of addValidationDiagnostics, on one thread.
 void addSemanticDiagnostics(ParseResult &result,
                             bool enable_double_slash_comments,
                             bool tool_management = false,
                             bool enable_iso_m98_calls = false);
 
+// Whether `line` jumps to a line number (GOTO N.., IF .. GOTOF 100, ...).
+// Duplicate N addresses are only reported for programs with such a jump.
+bool hasLineNumberTargetJump(const Line &line);
+
+// Error for every LF-terminated line of `input` longer than 512 characters,
+// LF included and CR excluded.
+void addBlockLengthDiagnostics(std::string_view input,
+                               std::vector<Diagnostic> *diagnostics);
+
+// Line-at-a-time form of addSemanticDiagnostics for callers that do not hold
+// a whole Program. Lines must be checked in program order.
+class SemanticLineChecker {
+public:
+  SemanticLineChecker(bool enable_double_slash_comments, bool tool_management,
+                      bool enable_iso_m98_calls,
+                      bool has_line_number_target_jump);
+  ~SemanticLineChecker();
+
+  void check(const Line &line, std::vector<Diagnostic> *diagnostics);
+  // check() of `line` of `result`, read in place; only the line's statement
+  // is in Line form (its CompactParseResult::statement_lines entry).
+  void check(const CompactParseResult &result, const CompactLine &line,
+             std::vector<Diagnostic> *diagnostics);
+
+private:
+  struct State;
+  std::unique_ptr<State> state_;
+};
+
 } // namespace gcode
@@ -22,12 +22,12 @@ nlohmann::json optionalDoubleToJson(const std::optional<double> &value) {
 }
 
 nlohmann::json poseTargetToJson(const PoseTarget &target) {
-  return {{"x", optionalDoubleToJson(target.x)},
-          {"y", optionalDoubleToJson(target.y)},
-          {"z", optionalDoubleToJson(target.z)},
-          {"a", optionalDoubleToJson(target.a)},
-          {"b", optionalDoubleToJson(target.b)},
-          {"c", optionalDoubleToJson(target.c)}};
+  return {{"x", optionalDoubleToJson(target.x())},
+          {"y", optionalDoubleToJson(target.y())},
+          {"z", optionalDoubleToJson(target.z())},
+          {"a", optionalDoubleToJson(target.a())},
+          {"b", optionalDoubleToJson(target.b())},
+          {"c", optionalDoubleToJson(target.c())}};
 }
 
 nlohmann::json
@@ -84,10 +84,10 @@ nlohmann::json arcMoveToJson(const ArcMoveCommand &cmd) {
   j["source"] = sourceToJson(cmd.source);
   j["clockwise"] = cmd.clockwise;
   j["target"] = poseTargetToJson(cmd.target);
-  j["arc"] = {{"i", optionalDoubleToJson(cmd.arc.i)},
-              {"j", optionalDoubleToJson(cmd.arc.j)},
-              {"k", optionalDoubleToJson(cmd.arc.k)},
-              {"r", optionalDoubleToJson(cmd.arc.r)}};
+  j["arc"] = {{"i", optionalDoubleToJson(cmd.arc.i())},
+              {"j", optionalDoubleToJson(cmd.arc.j())},
+              {"k", optionalDoubleToJson(cmd.arc.k())},
+              {"r", optionalDoubleToJson(cmd.arc.r())}};
   j["feed"] = optionalDoubleToJson(cmd.feed);
   j["effective"] = effectiveModalToJson(cmd.effective);
   return j;
@@ -5,6 +5,7 @@
 
 #include "execution_command_builder.h"
 #include "gcode/gcode_parser.h"
+#include "semantic_rules.h"
 
 namespace gcode {
 namespace {
@@ -21,53 +22,18 @@ bool messageStartsWith(const std::string &text, const std::string &prefix) {
   return text.rfind(prefix, 0) == 0;
 }
 
-bool shouldWaitForMoreInputOnRejected(const RejectedLine &rejected) {
-  for (const auto &reason : rejected.reasons) {
-    if (reason.message == "missing ENDIF for IF block") {
-      return true;
-    }
-  }
-  return false;
-}
-
 bool shouldWaitForMoreInputOnFault(const Diagnostic &diag) {
   return messageStartsWith(diag.message, "unresolved goto target: ") ||
          messageStartsWith(diag.message, "unresolved branch target: ");
 }
 
-std::string joinPendingLines(
-    const std::deque<StreamingExecutionEngine::PendingLine> &lines) {
-  std::string text;
-  for (const auto &line : lines) {
-    text += line.text;
-    text.push_back('\n');
-  }
-  return text;
-}
-
-std::vector<int>
-sourceLineMap(const std::deque<StreamingExecutionEngine::PendingLine> &lines) {
-  std::vector<int> mapping;
-  mapping.reserve(lines.size());
-  for (const auto &line : lines) {
-    mapping.push_back(line.line);
-  }
-  return mapping;
-}
-
-void remapInstructionSourceLines(std::vector<AilInstruction> *instructions,
-                                 const std::vector<int> &line_map) {
-  for (auto &instruction : *instructions) {
-    std::visit(
-        [&line_map](auto &inst) {
-          if (inst.source.line > 0 &&
-              static_cast<size_t>(inst.source.line) <= line_map.size()) {
-            inst.source.line =
-                line_map[static_cast<size_t>(inst.source.line - 1)];
-          }
-        },
-        instruction);
+bool hasError(const std::vector<Diagnostic> &diagnostics) {
+  for (const auto &diag : diagnostics) {
+    if (diag.severity == Diagnostic::Severity::Error) {
+      return true;
+    }
   }
+  return false;
 }
 
 class RuntimeOnlyExecutionRuntime final : public IExecutionRuntime {
@@ -109,6 +75,11 @@ public:
     return runtime_.cancelWait(token);
   }
 
+  RuntimeBatchResult submitLinearMoveBatch(const LinearMoveCommand *cmds,
+                                           size_t count) override {
+    return runtime_.submitLinearMoveBatch(cmds, count);
+  }
+
 private:
   IRuntime &runtime_;
 };
@@ -136,7 +107,7 @@ bool StreamingExecutionEngine::pushChunk(std::string_view chunk) {
       state_ == EngineState::Faulted || state_ == EngineState::Rejected) {
     return false;
   }
-  input_buffer_.append(chunk.data(), chunk.size());
+  input_.append(chunk);
   return enqueueCompleteLines();
 }
 
@@ -181,10 +152,7 @@ StepResult StreamingExecutionEngine::pump() {
     return executePendingProgram();
   }
   if (input_finished_) {
-    state_ = EngineState::Completed;
-    StepResult result;
-    result.status = StepStatus::Completed;
-    return result;
+    return completeInput();
   }
   state_ = EngineState::ReadyToExecute;
   StepResult result;
@@ -194,9 +162,9 @@ StepResult StreamingExecutionEngine::pump() {
 
 StepResult StreamingExecutionEngine::finish() {
   input_finished_ = true;
-  if (!input_buffer_.empty()) {
-    pending_lines_.push_back({next_line_number_++, input_buffer_});
-    input_buffer_.clear();
+  LineBuffer::Span last_line;
+  if (input_.finishLine(&last_line)) {
+    pending_lines_.push_back({next_line_number_++, last_line});
   }
   return pump();
 }
@@ -213,48 +181,149 @@ StepResult StreamingExecutionEngine::resume(const WaitToken &token) {
   }
   if (active_executor_ != nullptr) {
     active_executor_->notifyEvent(token);
+  } else if (!motions_in_flight_.empty() &&
+             motions_in_flight_.front() == token) {
+    motions_in_flight_.erase(motions_in_flight_.begin());
   }
   blocked_.reset();
   rejected_.reset();
-  state_ =
-      active_executor_ == nullptr && pending_lines_.empty() && input_finished_
-          ? EngineState::Completed
-          : EngineState::ReadyToExecute;
-  if (state_ == EngineState::Completed) {
-    StepResult result;
-    result.status = StepStatus::Completed;
-    return result;
+  if (active_executor_ == nullptr && pending_lines_.empty() &&
+      input_finished_) {
+    return completeInput();
   }
+  state_ = EngineState::ReadyToExecute;
   StepResult result;
   result.status = StepStatus::Progress;
   return result;
 }
 
 void StreamingExecutionEngine::cancel() {
+  std::optional<WaitToken> cancelled_token;
   if (state_ == EngineState::Blocked && blocked_.has_value()) {
     (void)runtime_.cancelWait(blocked_->token);
+    cancelled_token = blocked_->token;
     blocked_.reset();
   }
-  active_executor_.reset();
+  // Moves still in flight are queued in the runtime.
+  const auto cancel_motion = [&](const WaitToken &token) {
+    if (!(cancelled_token.has_value() && *cancelled_token == token)) {
+      (void)runtime_.cancelWait(token);
+    }
+  };
+  if (active_executor_ != nullptr) {
+    for (const auto &token : active_executor_->motionsInFlight()) {
+      cancel_motion(token);
+    }
+  } else {
+    for (const auto &token : motions_in_flight_) {
+      cancel_motion(token);
+    }
+  }
+  motions_in_flight_.clear();
+  active_executor_ = nullptr;
   state_ = EngineState::Cancelled;
 }
 
 bool StreamingExecutionEngine::enqueueCompleteLines() {
-  size_t start = 0;
-  while (start < input_buffer_.size()) {
-    const size_t newline_pos = input_buffer_.find('\n', start);
-    if (newline_pos == std::string::npos) {
-      break;
+  LineBuffer::Span line;
+  while (input_.nextLine(&line)) {
+    pending_lines_.push_back({next_line_number_++, line});
+  }
+  return true;
+}
+
+// Whether `piece`, parsed on its own after the lowered pending lines, misses
+// duplicate N-address warnings that a parse of the whole batch would report.
+// Those are reported in a program with an N-address jump anywhere, so a new
+// piece matters when it repeats an earlier piece's N number, brings the first
+// jump to earlier duplicates, or repeats its own N number without a jump of
+// its own.
+bool StreamingExecutionEngine::changesDuplicateLineNumbers(
+    const Program &piece) const {
+  bool piece_has_jump = false;
+  bool piece_has_duplicate = false;
+  bool repeats_earlier_piece = false;
+  std::unordered_set<int> piece_line_numbers;
+  for (const auto &line : piece.lines) {
+    piece_has_jump |= hasLineNumberTargetJump(line);
+    if (!line.line_number.has_value()) {
+      continue;
     }
-    std::string line = input_buffer_.substr(start, newline_pos - start);
-    if (!line.empty() && line.back() == '\r') {
-      line.pop_back();
+    const int value = line.line_number->value;
+    repeats_earlier_piece |= pending_line_numbers_.count(value) > 0;
+    piece_has_duplicate |= !piece_line_numbers.insert(value).second;
+  }
+  if (repeats_earlier_piece) {
+    return pending_has_line_number_jump_ || piece_has_jump;
+  }
+  if (piece_has_jump && !pending_has_line_number_jump_) {
+    return pending_has_duplicate_line_number_;
+  }
+  return pending_has_line_number_jump_ && !piece_has_jump &&
+         piece_has_duplicate;
+}
+
+void StreamingExecutionEngine::notePendingLineNumbers(const Program &piece) {
+  for (const auto &line : piece.lines) {
+    pending_has_line_number_jump_ |= hasLineNumberTargetJump(line);
+    if (line.line_number.has_value() &&
+        !pending_line_numbers_.insert(line.line_number->value).second) {
+      pending_has_duplicate_line_number_ = true;
     }
-    pending_lines_.push_back({next_line_number_++, std::move(line)});
-    start = newline_pos + 1;
   }
-  input_buffer_.erase(0, start);
-  return true;
+}
+
+// Parses and lowers the pending lines that arrived since the last call onto
+// the lines before them, so each line is parsed and lowered once however
+// many pumps its batch waits for an ENDIF. The whole batch is parsed again
+// in one piece, as a batch that arrived at once would be, when the new lines
+// parsed on their own differ from that: their parse reports an error, they
+// start with a byte-order mark or a program name line, or they change the
+// batch's duplicate N-address warnings.
+void StreamingExecutionEngine::lowerNewPendingLines() {
+  if (lowered_pending_lines_ == pending_lines_.size()) {
+    return;
+  }
+  ParseOptions parse_options;
+  parse_options.enable_iso_m98_calls = options_.enable_iso_m98_calls;
+  parse_options.first_line = pending_lines_[lowered_pending_lines_].line;
+  std::string_view text =
+      input_.textFrom(pending_lines_[lowered_pending_lines_].text.begin);
+  auto parsed = parse(text, parse_options, parser_context_);
+  if (lowered_pending_lines_ > 0 &&
+      (hasError(parsed.diagnostics) || text.rfind("\xEF\xBB\xBF", 0) == 0 ||
+       parsed.program.program_name.has_value() ||
+       changesDuplicateLineNumbers(parsed.program))) {
+    clearPendingProgram();
+    parse_options.first_line = pending_lines_.front().line;
+    text = input_.textFrom(pending_lines_.front().text.begin);
+    parsed = parse(text, parse_options, parser_context_);
+  }
+  notePendingLineNumbers(parsed.program);
+  for (auto &line : parsed.program.lines) {
+    pending_program_.lines.push_back(std::move(line));
+  }
+  if (pending_lowerer_ == nullptr) {
+    pending_lowerer_ = std::make_unique<AilLowerer>(
+        pending_program_, std::vector<Diagnostic>{}, options_);
+  }
+  pending_lowerer_->lowerAppendedLines(parsed.diagnostics);
+  lowered_pending_lines_ = pending_lines_.size();
+}
+
+void StreamingExecutionEngine::clearPendingProgram() {
+  pending_lowerer_.reset();
+  pending_program_.lines.clear();
+  lowered_pending_lines_ = 0;
+  pending_line_numbers_.clear();
+  pending_has_line_number_jump_ = false;
+  pending_has_duplicate_line_number_ = false;
+}
+
+void StreamingExecutionEngine::clearPendingLines() {
+  pending_lines_.clear();
+  input_.dropCompleteLines();
+  clearPendingProgram();
 }
 
 StepResult StreamingExecutionEngine::executePendingProgram() {
@@ -263,22 +332,23 @@ StepResult StreamingExecutionEngine::executePendingProgram() {
     result.status = StepStatus::Progress;
     return result;
   }
-  AilResult line_result =
-      parseAndLowerAil(joinPendingLines(pending_lines_), options_);
-  const auto line_map = sourceLineMap(pending_lines_);
-  remapDiagnostics(&line_result.diagnostics, line_map.front());
-  remapRejectedLines(&line_result.rejected_lines, line_map.front());
-  remapInstructionSourceLines(&line_result.instructions, line_map);
+  lowerNewPendingLines();
 
-  if (!line_result.rejected_lines.empty() && !input_finished_ &&
-      shouldWaitForMoreInputOnRejected(line_result.rejected_lines.front())) {
+  // An IF block without its ENDIF, or a GOTOF or GOTO without its target,
+  // yet: wait for more lines, unless a line before the end has been
+  // rejected. Waiting here costs nothing per pump; executing the batch up to
+  // the jump would resubmit its moves on every pump.
+  if (!input_finished_ && pending_lowerer_->rejected_lines().empty() &&
+      (pending_lowerer_->openIfBlockCount() > 0 ||
+       pending_lowerer_->unresolvedForwardJumpCount() > 0)) {
     state_ = EngineState::ReadyToExecute;
     StepResult result;
     result.status = StepStatus::Progress;
     return result;
   }
 
-  if (line_result.instructions.empty()) {
+  AilResult line_result = pending_lowerer_->snapshot(&batch_instructions_);
+  if (batch_instructions_.empty()) {
     emitDiagnostics(line_result.diagnostics);
     if (!line_result.rejected_lines.empty()) {
       if (const auto rejected =
@@ -296,13 +366,13 @@ StepResult StreamingExecutionEngine::executePendingProgram() {
           makeFaultDiagnostic(pending_lines_.front().line, "line rejected"));
       return makeRejectedResult(rejected_state);
     }
-    pending_lines_.clear();
-    state_ =
-        input_finished_ ? EngineState::Completed : EngineState::ReadyToExecute;
+    clearPendingLines();
+    if (input_finished_) {
+      return completeInput();
+    }
+    state_ = EngineState::ReadyToExecute;
     StepResult step_result;
-    step_result.status = state_ == EngineState::Completed
-                             ? StepStatus::Completed
-                             : StepStatus::Progress;
+    step_result.status = StepStatus::Progress;
     return step_result;
   }
 
@@ -316,7 +386,6 @@ StepResult StreamingExecutionEngine::executePendingProgram() {
     deferred_rejected_.reset();
   }
 
-  AilExecutorOptions executor_options;
   AilExecutorInitialState initial_state;
   initial_state.motion_code_current = current_motion_code_;
   initial_state.rapid_mode_current = current_rapid_mode_;
@@ -324,9 +393,22 @@ StepResult StreamingExecutionEngine::executePendingProgram() {
   initial_state.working_plane_current = current_working_plane_;
   initial_state.active_tool_selection = current_active_tool_selection_;
   initial_state.pending_tool_selection = current_pending_tool_selection_;
-  executor_options.initial_state = std::move(initial_state);
-  active_executor_ = std::make_unique<AilExecutor>(
-      std::move(line_result.instructions), std::move(executor_options));
+  initial_state.motions_in_flight = std::move(motions_in_flight_);
+  motions_in_flight_.clear();
+  if (executor_ == nullptr) {
+    AilExecutorOptions executor_options;
+    executor_options.max_motions_in_flight = max_motions_in_flight_;
+    executor_options.max_linear_move_batch = max_linear_move_batch_;
+    executor_options.initial_state = std::move(initial_state);
+    executor_ = std::make_unique<AilExecutor>(std::move(batch_instructions_),
+                                              std::move(executor_options));
+    batch_instructions_.clear();
+  } else {
+    executor_->setMaxMotionsInFlight(max_motions_in_flight_);
+    executor_->setMaxLinearMoveBatch(max_linear_move_batch_);
+    executor_->reset(&batch_instructions_, std::move(initial_state));
+  }
+  active_executor_ = executor_.get();
   active_executor_line_ = pending_lines_.front().line;
   active_executor_emitted_diagnostics_ = 0;
   return advanceActiveExecutor();
@@ -369,7 +451,10 @@ StepResult StreamingExecutionEngine::advanceActiveExecutor() {
               : makeFaultDiagnostic(active_executor_line_,
                                     "executor faulted without diagnostic");
       if (!input_finished_ && shouldWaitForMoreInputOnFault(diag)) {
-        active_executor_.reset();
+        motions_in_flight_.assign(
+            active_executor_->motionsInFlight().begin(),
+            active_executor_->motionsInFlight().end());
+        active_executor_ = nullptr;
         active_executor_emitted_diagnostics_ = 0;
         deferred_rejected_.reset();
         state_ = EngineState::ReadyToExecute;
@@ -382,7 +467,7 @@ StepResult StreamingExecutionEngine::advanceActiveExecutor() {
         sink_.onDiagnostic(
             executor_diagnostics[active_executor_emitted_diagnostics_++]);
       }
-      active_executor_.reset();
+      active_executor_ = nullptr;
       if (!has_executor_fault_diagnostic) {
         return faultWithDiagnostic(diag);
       }
@@ -407,7 +492,9 @@ StepResult StreamingExecutionEngine::advanceActiveExecutor() {
       current_active_tool_selection_ = executor_state.active_tool_selection;
       current_pending_tool_selection_ = executor_state.pending_tool_selection;
       current_user_variables_ = executor_state.user_variables;
-      active_executor_.reset();
+      motions_in_flight_.assign(active_executor_->motionsInFlight().begin(),
+                                active_executor_->motionsInFlight().end());
+      active_executor_ = nullptr;
       active_executor_emitted_diagnostics_ = 0;
       if (deferred_rejected_.has_value()) {
         for (const auto &diag : deferred_rejected_->reasons) {
@@ -419,15 +506,11 @@ StepResult StreamingExecutionEngine::advanceActiveExecutor() {
         deferred_rejected_.reset();
         return makeRejectedResult(rejected);
       }
-      pending_lines_.clear();
-      state_ = pending_lines_.empty() && input_finished_
-                   ? EngineState::Completed
-                   : EngineState::ReadyToExecute;
-      if (state_ == EngineState::Completed) {
-        StepResult result;
-        result.status = StepStatus::Completed;
-        return result;
+      clearPendingLines();
+      if (input_finished_) {
+        return completeInput();
       }
+      state_ = EngineState::ReadyToExecute;
       StepResult result;
       result.status = StepStatus::Progress;
       return result;
@@ -446,6 +529,19 @@ StepResult StreamingExecutionEngine::advanceActiveExecutor() {
   return result;
 }
 
+// Input is finished and every line has executed: completes once the runtime
+// has finished the moves still in flight, blocking on each in turn.
+StepResult StreamingExecutionEngine::completeInput() {
+  if (!motions_in_flight_.empty()) {
+    return makeBlockedResult(active_executor_line_, motions_in_flight_.front(),
+                             "motion in progress");
+  }
+  state_ = EngineState::Completed;
+  StepResult result;
+  result.status = StepStatus::Completed;
+  return result;
+}
+
 StepResult StreamingExecutionEngine::makeBlockedResult(int line,
                                                        const WaitToken &token,
                                                        std::string reason) {
@@ -496,23 +592,6 @@ std::optional<RejectedLineEvent> StreamingExecutionEngine::makeRejectedEvent(
   return event;
 }
 
-void StreamingExecutionEngine::remapDiagnostics(
-    std::vector<Diagnostic> *diagnostics, int line) const {
-  for (auto &diag : *diagnostics) {
-    diag.location.line = line + diag.location.line - 1;
-  }
-}
-
-void StreamingExecutionEngine::remapRejectedLines(
-    std::vector<RejectedLine> *rejected_lines, int line) const {
-  for (auto &rejected : *rejected_lines) {
-    rejected.source.line = line + rejected.source.line - 1;
-    for (auto &diag : rejected.reasons) {
-      diag.location.line = line + diag.location.line - 1;
-    }
-  }
-}
-
 AilExecutorInitialState StreamingExecutionEngine::exportInitialState() const {
   AilExecutorInitialState initial_state;
   initial_state.motion_code_current = current_motion_code_;
@@ -522,6 +601,7 @@ AilExecutorInitialState StreamingExecutionEngine::exportInitialState() const {
   initial_state.active_tool_selection = current_active_tool_selection_;
   initial_state.pending_tool_selection = current_pending_tool_selection_;
   initial_state.user_variables = current_user_variables_;
+  initial_state.motions_in_flight = motions_in_flight_;
   return initial_state;
 }
 
@@ -534,6 +614,7 @@ void StreamingExecutionEngine::importInitialState(
   current_active_tool_selection_ = state.active_tool_selection;
   current_pending_tool_selection_ = state.pending_tool_selection;
   current_user_variables_ = state.user_variables;
+  motions_in_flight_ = state.motions_in_flight;
   next_line_number_ = next_line_number;
 }
 
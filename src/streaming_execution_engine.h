@@ -1,15 +1,17 @@
 #pragma once
 
-#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "gcode/ail.h"
 #include "gcode/execution_interfaces.h"
 #include "gcode/execution_runtime.h"
+#include "line_buffer.h"
 
 namespace gcode {
 
@@ -29,18 +31,30 @@ public:
   StepResult finish();
   StepResult resume(const WaitToken &token);
   void cancel();
+  // Moves the runtime may still be executing while later lines run; see
+  // AilExecutorOptions::max_motions_in_flight. Applies from the next batch.
+  void setMaxMotionsInFlight(size_t count) { max_motions_in_flight_ = count; }
+  // Consecutive linear moves handed to the sink and runtime in one call; see
+  // AilExecutorOptions::max_linear_move_batch. Applies from the next batch.
+  void setMaxLinearMoveBatch(size_t count) { max_linear_move_batch_ = count; }
 
   EngineState state() const { return state_; }
 
   struct PendingLine {
     int line = 0;
-    std::string text;
+    LineBuffer::Span text; // in input_
   };
 
 private:
   bool enqueueCompleteLines();
+  void lowerNewPendingLines();
+  bool changesDuplicateLineNumbers(const Program &piece) const;
+  void notePendingLineNumbers(const Program &piece);
+  void clearPendingProgram();
+  void clearPendingLines();
   StepResult executePendingProgram();
   StepResult advanceActiveExecutor();
+  StepResult completeInput();
   StepResult makeBlockedResult(int line, const WaitToken &token,
                                std::string reason);
   StepResult makeRejectedResult(const RejectedState &rejected);
@@ -48,9 +62,6 @@ private:
   void emitDiagnostics(const std::vector<Diagnostic> &diagnostics);
   std::optional<RejectedLineEvent>
   makeRejectedEvent(const RejectedLine &rejected) const;
-  void remapDiagnostics(std::vector<Diagnostic> *diagnostics, int line) const;
-  void remapRejectedLines(std::vector<RejectedLine> *rejected_lines,
-                          int line) const;
   AilExecutorInitialState exportInitialState() const;
   void importInitialState(const AilExecutorInitialState &state,
                           int next_line_number);
@@ -60,13 +71,33 @@ private:
   IExecutionRuntime *execution_runtime_ = nullptr;
   ICancellation &cancellation_;
   LowerOptions options_;
+  // Every pending batch is parsed with the same ANTLR objects.
+  ParserContext parser_context_;
   EngineState state_ = EngineState::AcceptingInput;
-  std::string input_buffer_;
-  std::deque<PendingLine> pending_lines_;
+  // Holds the text of the pending lines, then the incomplete last line.
+  LineBuffer input_;
+  std::vector<PendingLine> pending_lines_;
+  // The first `lowered_pending_lines_` pending lines, parsed with their
+  // stream line numbers and lowered once; a batch waiting for its ENDIF only
+  // parses and lowers the lines that arrive after them.
+  Program pending_program_;
+  std::unique_ptr<AilLowerer> pending_lowerer_;
+  size_t lowered_pending_lines_ = 0;
+  // N numbers of the lowered pending lines, whether one repeats and whether
+  // any of those lines jumps to an N-address.
+  std::unordered_set<int> pending_line_numbers_;
+  bool pending_has_line_number_jump_ = false;
+  bool pending_has_duplicate_line_number_ = false;
   std::optional<BlockedState> blocked_;
   std::optional<RejectedState> rejected_;
   std::optional<RejectedState> deferred_rejected_;
-  std::unique_ptr<AilExecutor> active_executor_;
+  // One executor, reset for each batch; `active_executor_` points to it while
+  // a batch runs.
+  std::unique_ptr<AilExecutor> executor_;
+  // Filled with each batch's instructions and swapped with the executor's
+  // previous program, so both keep their storage.
+  std::vector<AilInstruction> batch_instructions_;
+  AilExecutor *active_executor_ = nullptr;
   int active_executor_line_ = 0;
   size_t active_executor_emitted_diagnostics_ = 0;
   int next_line_number_ = 1;
@@ -78,6 +109,10 @@ private:
   std::optional<ToolSelectionState> current_active_tool_selection_;
   std::optional<ToolSelectionState> current_pending_tool_selection_;
   std::unordered_map<std::string, double> current_user_variables_;
+  size_t max_motions_in_flight_ = 1;
+  size_t max_linear_move_batch_ = 1;
+  // Moves of finished batches still in flight, oldest first.
+  std::vector<WaitToken> motions_in_flight_;
 
   friend class ExecutionSession;
 };
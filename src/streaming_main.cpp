@@ -1,8 +1,7 @@
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
 
+#include "file_source.h"
 #include "streaming_event_log.h"
 #include "streaming_execution_engine.h"
 
@@ -45,15 +44,12 @@ int main(int argc, const char **argv) {
     return 2;
   }
 
-  std::ifstream input_file(file_path, std::ios::in);
-  if (!input_file) {
+  gcode::FileSource source;
+  if (!source.open(file_path)) {
     std::cerr << "Failed to open file: " << file_path << "\n";
     return 2;
   }
 
-  std::stringstream buffer;
-  buffer << input_file.rdbuf();
-
   gcode::EventLogRecorder recorder;
   gcode::RecordingExecutionSink sink(recorder);
   gcode::ReadyRuntimeRecorder runtime(recorder);
@@ -62,7 +58,7 @@ int main(int argc, const char **argv) {
   options.filename = file_path;
 
   gcode::StreamingExecutionEngine engine(sink, runtime, cancellation, options);
-  engine.pushChunk(buffer.str());
+  engine.pushChunk(source.text());
 
   while (true) {
     const auto step = engine.finish();
@@ -0,0 +1,110 @@
+#include "utf8_char_stream.h"
+
+#include <algorithm>
+
+#include "utf8_text.h"
+
+namespace gcode {
+namespace {
+
+constexpr std::string_view kUtf8Bom = "\xEF\xBB\xBF";
+
+std::string_view stripBom(std::string_view text) {
+  if (text.substr(0, kUtf8Bom.size()) == kUtf8Bom) {
+    text.remove_prefix(kUtf8Bom.size());
+  }
+  return text;
+}
+
+} // namespace
+
+Utf8ViewCharStream::Utf8ViewCharStream(std::string_view text)
+    : text_(stripBom(text)) {}
+
+size_t Utf8ViewCharStream::nextPosition(size_t pos) const {
+  return std::min(
+      text_.size(),
+      pos + utf8SequenceLength(static_cast<unsigned char>(text_[pos])));
+}
+
+size_t Utf8ViewCharStream::previousPosition(size_t pos) const {
+  do {
+    --pos;
+  } while (pos > 0 && (static_cast<unsigned char>(text_[pos]) & 0xc0) == 0x80);
+  return pos;
+}
+
+void Utf8ViewCharStream::consume() {
+  if (position_ >= text_.size()) {
+    throw antlr4::IllegalStateException("cannot consume EOF");
+  }
+  position_ = nextPosition(position_);
+}
+
+size_t Utf8ViewCharStream::LA(ssize_t i) {
+  if (i == 0) {
+    return 0;
+  }
+  size_t pos = position_;
+  if (i > 0) {
+    for (; i > 1 && pos < text_.size(); --i) {
+      pos = nextPosition(pos);
+    }
+    if (pos >= text_.size()) {
+      return antlr4::IntStream::EOF;
+    }
+  } else {
+    for (; i < 0; ++i) {
+      if (pos == 0) {
+        return antlr4::IntStream::EOF;
+      }
+      pos = previousPosition(pos);
+    }
+  }
+  return decodeUtf8At(text_, pos);
+}
+
+ssize_t Utf8ViewCharStream::mark() { return -1; }
+
+void Utf8ViewCharStream::release(ssize_t /*marker*/) {}
+
+size_t Utf8ViewCharStream::index() { return position_; }
+
+void Utf8ViewCharStream::seek(size_t index) {
+  position_ = std::min(index, text_.size());
+}
+
+size_t Utf8ViewCharStream::size() { return text_.size(); }
+
+std::string Utf8ViewCharStream::getSourceName() const {
+  return antlr4::IntStream::UNKNOWN_SOURCE_NAME;
+}
+
+// `b` is inclusive and may point at the first byte of a character (the
+// lexer reports errors up to index()), so the range always runs to the end
+// of the character containing `b`.
+std::string
+Utf8ViewCharStream::getText(const antlr4::misc::Interval &interval) {
+  if (interval.a < 0 || interval.b < 0 || text_.empty()) {
+    return "";
+  }
+  const auto start = static_cast<size_t>(interval.a);
+  const auto stop =
+      std::min(static_cast<size_t>(interval.b), text_.size() - 1);
+  if (start >= text_.size() || stop < start) {
+    return "";
+  }
+  size_t stop_char = stop;
+  while (stop_char > 0 &&
+         (static_cast<unsigned char>(text_[stop_char]) & 0xc0) == 0x80) {
+    --stop_char;
+  }
+  const size_t end = nextPosition(stop_char);
+  return std::string(text_.substr(start, end - start));
+}
+
+std::string Utf8ViewCharStream::toString() const {
+  return std::string(text_);
+}
+
+} // namespace gcode
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "antlr4-runtime.h"
+
+namespace gcode {
+
+// Read-only CharStream over caller-owned UTF-8 text. ANTLRInputStream copies
+// the input into a UTF-32 buffer (four bytes per character); this stream
+// decodes code points in place instead, so `text` must stay alive for as
+// long as the lexer and its tokens are used.
+//
+// Indices are byte offsets. Token start/stop indices and getText() agree on
+// that, and the lexer counts columns per consume(), so token text and
+// locations match ANTLRInputStream. `text` must be valid UTF-8 (see
+// isValidUtf8); a leading byte order mark is skipped like ANTLRInputStream
+// does.
+class Utf8ViewCharStream : public antlr4::CharStream {
+public:
+  explicit Utf8ViewCharStream(std::string_view text);
+
+  void consume() override;
+  size_t LA(ssize_t i) override;
+  ssize_t mark() override;
+  void release(ssize_t marker) override;
+  size_t index() override;
+  void seek(size_t index) override;
+  size_t size() override;
+  std::string getSourceName() const override;
+  std::string getText(const antlr4::misc::Interval &interval) override;
+  std::string toString() const override;
+
+private:
+  size_t nextPosition(size_t pos) const;
+  size_t previousPosition(size_t pos) const;
+
+  std::string_view text_;
+  size_t position_ = 0;
+};
+
+} // namespace gcode
@@ -0,0 +1,62 @@
+#include "utf8_text.h"
+
+namespace gcode {
+
+size_t utf8SequenceLength(unsigned char lead) {
+  if ((lead & 0xe0) == 0xc0) {
+    return 2;
+  }
+  if ((lead & 0xf0) == 0xe0) {
+    return 3;
+  }
+  if ((lead & 0xf8) == 0xf0) {
+    return 4;
+  }
+  return 1;
+}
+
+bool isValidUtf8(std::string_view text) {
+  size_t i = 0;
+  while (i < text.size()) {
+    const auto c = static_cast<unsigned char>(text[i]);
+    if (c < 0x80) {
+      ++i;
+      continue;
+    }
+    const size_t length = utf8SequenceLength(c);
+    if (length == 1 || i + length > text.size()) {
+      return false;
+    }
+    uint32_t code_point = c & (0x7f >> length);
+    for (size_t k = 1; k < length; ++k) {
+      const auto next = static_cast<unsigned char>(text[i + k]);
+      if ((next & 0xc0) != 0x80) {
+        return false;
+      }
+      code_point = (code_point << 6) | (next & 0x3f);
+    }
+    static constexpr uint32_t kMinByLength[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (code_point < kMinByLength[length] || code_point > 0x10ffff ||
+        (code_point >= 0xd800 && code_point <= 0xdfff)) {
+      return false;
+    }
+    i += length;
+  }
+  return true;
+}
+
+uint32_t decodeUtf8At(std::string_view text, size_t pos) {
+  const auto lead = static_cast<unsigned char>(text[pos]);
+  if (lead < 0x80) {
+    return lead;
+  }
+  const size_t length = utf8SequenceLength(lead);
+  uint32_t code_point = lead & (0x7f >> length);
+  for (size_t k = 1; k < length; ++k) {
+    code_point = (code_point << 6) |
+                 (static_cast<unsigned char>(text[pos + k]) & 0x3f);
+  }
+  return code_point;
+}
+
+} // namespace gcode
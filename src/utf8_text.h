@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace gcode {
+
+// Strict UTF-8 check with the same rules as the ANTLR runtime's decoder:
+// no overlong forms, surrogates, or code points above U+10FFFF.
+bool isValidUtf8(std::string_view text);
+
+// Byte length of the sequence starting with `lead`; 1 for ASCII and for
+// bytes that cannot start a sequence.
+size_t utf8SequenceLength(unsigned char lead);
+
+// Code point of the sequence at `pos`; `text` must be valid UTF-8 there.
+uint32_t decodeUtf8At(std::string_view text, size_t pos);
+
+} // namespace gcode
@@ -0,0 +1,215 @@
+#include "word_builder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <system_error>
+#include <utility>
+
+namespace gcode {
+
+WordSymbol wordSymbolFromHead(std::string_view head) {
+  if (head.size() == 1) {
+    switch (head[0]) {
+    case 'A':
+      return WordSymbol::A;
+    case 'B':
+      return WordSymbol::B;
+    case 'C':
+      return WordSymbol::C;
+    case 'F':
+      return WordSymbol::F;
+    case 'G':
+      return WordSymbol::G;
+    case 'I':
+      return WordSymbol::I;
+    case 'J':
+      return WordSymbol::J;
+    case 'K':
+      return WordSymbol::K;
+    case 'M':
+      return WordSymbol::M;
+    case 'N':
+      return WordSymbol::N;
+    case 'P':
+      return WordSymbol::P;
+    case 'R':
+      return WordSymbol::R;
+    case 'S':
+      return WordSymbol::S;
+    case 'T':
+      return WordSymbol::T;
+    case 'X':
+      return WordSymbol::X;
+    case 'Y':
+      return WordSymbol::Y;
+    case 'Z':
+      return WordSymbol::Z;
+    default:
+      return WordSymbol::Other;
+    }
+  }
+
+  static constexpr std::pair<std::string_view, WordSymbol> kKeywords[] = {
+      {"AP", WordSymbol::AP},         {"AR", WordSymbol::AR},
+      {"CIP", WordSymbol::CIP},       {"CR", WordSymbol::CR},
+      {"CT", WordSymbol::CT},         {"I1", WordSymbol::I1},
+      {"J1", WordSymbol::J1},         {"K1", WordSymbol::K1},
+      {"PROC", WordSymbol::PROC},     {"RET", WordSymbol::RET},
+      {"RP", WordSymbol::RP},         {"RTLIOF", WordSymbol::RTLIOF},
+      {"RTLION", WordSymbol::RTLION},
+  };
+  for (const auto &[text, symbol] : kKeywords) {
+    if (head == text) {
+      return symbol;
+    }
+  }
+  return WordSymbol::Other;
+}
+
+namespace {
+
+std::string_view skipLeadingSpace(std::string_view text) {
+  size_t pos = 0;
+  while (pos < text.size() &&
+         std::isspace(static_cast<unsigned char>(text[pos]))) {
+    ++pos;
+  }
+  return text.substr(pos);
+}
+
+} // namespace
+
+std::optional<double> parseNumberPrefix(std::string_view text) {
+  text = skipLeadingSpace(text);
+  bool negative = false;
+  if (!text.empty() && (text[0] == '+' || text[0] == '-')) {
+    negative = text[0] == '-';
+    text.remove_prefix(1);
+    if (!text.empty() && (text[0] == '+' || text[0] == '-')) {
+      return std::nullopt;
+    }
+  }
+  double value = 0.0;
+  std::from_chars_result result{};
+  if (text.size() > 1 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    // Hex floats, which from_chars only accepts without the prefix; a bare
+    // "0x" reads as the leading 0.
+    const bool signed_digits =
+        text.size() > 2 && (text[2] == '+' || text[2] == '-');
+    result = std::from_chars(text.data() + 2, text.data() + text.size(),
+                             value, std::chars_format::hex);
+    if (signed_digits || result.ec == std::errc::invalid_argument) {
+      value = 0.0;
+      result.ec = std::errc();
+    }
+  } else {
+    result = std::from_chars(text.data(), text.data() + text.size(), value);
+  }
+  // std::stod also rejects results that underflow into subnormals.
+  if (result.ec != std::errc() || std::fpclassify(value) == FP_SUBNORMAL) {
+    return std::nullopt;
+  }
+  return negative ? -value : value;
+}
+
+std::optional<int> parseIntegerPrefix(std::string_view text) {
+  text = skipLeadingSpace(text);
+  if (!text.empty() && text[0] == '+') {
+    text.remove_prefix(1);
+    if (!text.empty() && text[0] == '-') {
+      return std::nullopt;
+    }
+  }
+  int value = 0;
+  const auto result =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (result.ec != std::errc()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+WordTextParts splitWordText(std::string_view text) {
+  WordTextParts parts;
+  auto eq_pos = text.find('=');
+  if (eq_pos != std::string_view::npos) {
+    parts.has_equal = true;
+    parts.head = text.substr(0, eq_pos);
+    if (eq_pos + 1 < text.size()) {
+      parts.value = text.substr(eq_pos + 1);
+    }
+    return parts;
+  }
+
+  auto is_value_char = [](char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) || c == '+' ||
+           c == '-' || c == '.';
+  };
+
+  for (size_t i = 1; i < text.size(); ++i) {
+    if (is_value_char(text[i])) {
+      parts.head = text.substr(0, i);
+      parts.value = text.substr(i);
+      return parts;
+    }
+  }
+
+  parts.head = text;
+  return parts;
+}
+
+std::string toUpperAscii(std::string value) {
+  std::transform(
+      value.begin(), value.end(), value.begin(),
+      [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+  return value;
+}
+
+Word makeWord(std::string text, const Location &location) {
+  Word word;
+  const auto parts = splitWordText(text);
+  word.head = toUpperAscii(std::string(parts.head));
+  word.symbol = wordSymbolFromHead(word.head);
+  if (parts.value.has_value()) {
+    word.value = std::string(*parts.value);
+    word.number = parseNumberPrefix(*parts.value);
+    word.integer = parseIntegerPrefix(*parts.value);
+  }
+  word.numbers_cached = true;
+  word.has_equal = parts.has_equal;
+  word.text = std::move(text);
+  word.location = location;
+  return word;
+}
+
+Word makeQuotedWord(std::string text, const Location &location) {
+  Word word;
+  word.text = std::move(text);
+  if (word.text.size() >= 2 && word.text.front() == '"' &&
+      word.text.back() == '"') {
+    word.text = word.text.substr(1, word.text.size() - 2);
+  }
+  word.location = location;
+  word.head = toUpperAscii(word.text);
+  word.symbol = wordSymbolFromHead(word.head);
+  word.value = std::nullopt;
+  word.has_equal = false;
+  word.quoted = true;
+  return word;
+}
+
+std::optional<int> parseUnsignedIntStrict(std::string_view text) {
+  if (text.empty()) {
+    return std::nullopt;
+  }
+  for (char c : text) {
+    if (!std::isdigit(static_cast<unsigned char>(c))) {
+      return std::nullopt;
+    }
+  }
+  return parseIntegerPrefix(text);
+}
+
+} // namespace gcode
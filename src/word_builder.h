@@ -0,0 +1,32 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "gcode/ast.h"
+
+namespace gcode {
+
+// Address word text split into its head and optional value, viewing `text`:
+// `X=5` -> X / 5 (has_equal), `G01` -> G / 01, `AP=` -> AP / none. The head
+// keeps its source case.
+struct WordTextParts {
+  std::string_view head;
+  std::optional<std::string_view> value;
+  bool has_equal = false;
+};
+
+WordTextParts splitWordText(std::string_view text);
+
+// Shared by the ANTLR AST builder and the fast block scanner so both paths
+// produce identical words and line numbers.
+Word makeWord(std::string text, const Location &location);
+Word makeQuotedWord(std::string text, const Location &location);
+
+std::string toUpperAscii(std::string value);
+
+// Digits-only text to int; std::nullopt when empty, non-digit, or out of range.
+std::optional<int> parseUnsignedIntStrict(std::string_view text);
+
+} // namespace gcode
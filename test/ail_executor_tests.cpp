@@ -3,6 +3,7 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -126,6 +127,12 @@ public:
     tool_changes.push_back(cmd);
   }
 
+  void onLinearMoveBatch(const gcode::LinearMoveCommand *cmds,
+                         size_t count) override {
+    linear_move_batches.push_back(count);
+    gcode::IExecutionSink::onLinearMoveBatch(cmds, count);
+  }
+
   std::vector<gcode::Diagnostic> diagnostics;
   std::vector<gcode::RejectedLineEvent> rejected_lines;
   std::vector<gcode::ModalUpdateEvent> modal_updates;
@@ -133,6 +140,7 @@ public:
   std::vector<gcode::ArcMoveCommand> arc_moves;
   std::vector<gcode::DwellCommand> dwells;
   std::vector<gcode::ToolChangeCommand> tool_changes;
+  std::vector<size_t> linear_move_batches;
 };
 
 class RecordingExecutionRuntime final : public gcode::IExecutionRuntime {
@@ -224,6 +232,51 @@ TEST(AilExecutorTest, ResolvesGotoAndCompletes) {
   EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
 }
 
+TEST(AilExecutorTest, ResetAndAppendReuseExecutor) {
+  gcode::AilExecutor exec(
+      gcode::parseAndLowerAil("GOTO MISSING\n").instructions);
+  const auto resolver = [](const gcode::Condition &,
+                           const gcode::SourceInfo &) {
+    gcode::ConditionResolution r;
+    r.kind = gcode::ConditionResolutionKind::False;
+    return r;
+  };
+  ASSERT_TRUE(exec.step(0, resolver));
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Fault);
+
+  gcode::AilExecutorInitialState initial_state;
+  initial_state.motion_code_current = "G0";
+  exec.reset(gcode::parseAndLowerAil("GOTOF L1\nL1:\n").instructions,
+             initial_state);
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Ready);
+  EXPECT_EQ(exec.state().motion_code_current, "G0");
+  EXPECT_TRUE(exec.diagnostics().empty());
+  ASSERT_TRUE(exec.step(0, resolver)); // GOTOF L1
+  ASSERT_EQ(exec.state().pc, 1u);
+  ASSERT_TRUE(exec.step(0, resolver)); // label L1
+  ASSERT_TRUE(exec.step(0, resolver)); // complete
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+
+  exec.append(
+      gcode::parseAndLowerAil("GOTOF L2\nG1 X1\nL2:\n").instructions);
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Ready);
+  ASSERT_TRUE(exec.step(0, resolver)); // GOTOF L2
+  EXPECT_EQ(exec.state().pc, 4u);
+  ASSERT_TRUE(exec.step(0, resolver)); // label L2
+  ASSERT_TRUE(exec.step(0, resolver)); // complete
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+  EXPECT_TRUE(exec.diagnostics().empty());
+
+  // The pointer overload swaps: the previous program comes back.
+  auto next = gcode::parseAndLowerAil("G1 X2\n").instructions;
+  exec.reset(&next, std::nullopt);
+  EXPECT_EQ(next.size(), 5u);
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Ready);
+  ASSERT_TRUE(exec.step(0, resolver)); // G1 X2
+  ASSERT_TRUE(exec.step(0, resolver)); // complete
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+}
+
 TEST(AilExecutorTest, AcceptsInjectedConditionResolverInterface) {
   const auto lowered = gcode::parseAndLowerAil("IF R1 == 1 GOTOF TARGET\n");
   gcode::AilExecutor exec(lowered.instructions);
@@ -317,8 +370,8 @@ TEST(AilExecutorTest, MotionStepWithSinkAndRuntimeDispatchesLinearMove) {
   ASSERT_EQ(runtime.linear_moves.size(), 1u);
   EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Ready);
   EXPECT_EQ(exec.state().pc, 1u);
-  ASSERT_TRUE(sink.linear_moves.front().target.x.has_value());
-  EXPECT_DOUBLE_EQ(*sink.linear_moves.front().target.x, 1.0);
+  ASSERT_TRUE(sink.linear_moves.front().target.x().has_value());
+  EXPECT_DOUBLE_EQ(*sink.linear_moves.front().target.x(), 1.0);
   ASSERT_TRUE(sink.linear_moves.front().feed.has_value());
   EXPECT_DOUBLE_EQ(*sink.linear_moves.front().feed, 2.0);
 
@@ -356,6 +409,259 @@ TEST(AilExecutorTest, MotionStepCanBlockAndResumeOnRuntimeWaitToken) {
   EXPECT_EQ(runtime.linear_moves.size(), 1u);
 }
 
+TEST(AilExecutorTest, MotionWindowKeepsMovesInFlightUntilDwell) {
+  gcode::AilExecutorOptions options;
+  options.max_motions_in_flight = 2;
+  gcode::AilExecutor exec(
+      gcode::parseAndLowerAil("G1 X1\nG1 X2\nG1 X3\nG4 F1\n").instructions,
+      options);
+  RecordingExecutionSink sink;
+  int submitted = 0;
+  int dwells = 0;
+  gcode::FunctionExecutionRuntime runtime(
+      [](const gcode::Condition &, const gcode::SourceInfo &) {
+        return gcode::ConditionResolution{};
+      },
+      [&submitted](const gcode::LinearMoveCommand &) {
+        gcode::RuntimeResult<gcode::WaitToken> result;
+        result.status = gcode::RuntimeCallStatus::Pending;
+        result.wait_token =
+            gcode::WaitToken{"motion", std::to_string(++submitted)};
+        return result;
+      },
+      [](const gcode::ArcMoveCommand &) { return readyRuntimeResult(); },
+      [&dwells](const gcode::DwellCommand &) {
+        ++dwells;
+        return readyRuntimeResult();
+      },
+      [](const gcode::ToolChangeCommand &) { return readyRuntimeResult(); },
+      [](std::string_view) { return gcode::RuntimeResult<double>{}; },
+      [](const gcode::WaitToken &) { return readyRuntimeResult(); });
+
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // X1 in flight
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Ready);
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // X2 fills the window
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Blocked);
+  EXPECT_EQ(exec.state().blocked->wait_token->id, "1");
+  EXPECT_FALSE(exec.step(0, sink, runtime));
+
+  exec.notifyEvent(gcode::WaitToken{"motion", "1"});
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // X3
+  EXPECT_EQ(submitted, 3);
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Blocked);
+  EXPECT_EQ(exec.state().blocked->wait_token->id, "2");
+
+  // The dwell waits for every move in flight, oldest first.
+  exec.notifyEvent(gcode::WaitToken{"motion", "2"});
+  ASSERT_TRUE(exec.step(0, sink, runtime));
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Blocked);
+  EXPECT_EQ(exec.state().blocked->wait_token->id, "3");
+  EXPECT_EQ(dwells, 0);
+
+  exec.notifyEvent(gcode::WaitToken{"motion", "3"});
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // dwell
+  EXPECT_EQ(dwells, 1);
+  EXPECT_TRUE(exec.motionsInFlight().empty());
+  ASSERT_TRUE(exec.step(0, sink, runtime));
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+}
+
+TEST(AilExecutorTest, LinearMoveBatchStopsAtPendingMove) {
+  gcode::AilExecutorOptions options;
+  options.max_linear_move_batch = 8;
+  gcode::AilExecutor exec(
+      gcode::parseAndLowerAil("G1 X1\nG1 X2\nG1 X3\nG1 X4\nG4 F1\n")
+          .instructions,
+      options);
+  RecordingExecutionSink sink;
+  std::vector<double> submitted;
+  gcode::FunctionExecutionRuntime runtime(
+      [](const gcode::Condition &, const gcode::SourceInfo &) {
+        return gcode::ConditionResolution{};
+      },
+      [&submitted](const gcode::LinearMoveCommand &cmd) {
+        submitted.push_back(cmd.target.x().value_or(0.0));
+        if (submitted.size() != 2) {
+          return readyRuntimeResult();
+        }
+        gcode::RuntimeResult<gcode::WaitToken> result;
+        result.status = gcode::RuntimeCallStatus::Pending;
+        result.wait_token = gcode::WaitToken{"motion", "2"};
+        return result;
+      },
+      [](const gcode::ArcMoveCommand &) { return readyRuntimeResult(); },
+      [](const gcode::DwellCommand &) { return readyRuntimeResult(); },
+      [](const gcode::ToolChangeCommand &) { return readyRuntimeResult(); },
+      [](std::string_view) { return gcode::RuntimeResult<double>{}; },
+      [](const gcode::WaitToken &) { return readyRuntimeResult(); });
+
+  // The default batch adapter stops after the pending X2, and the sink sees
+  // only the moves the runtime took.
+  ASSERT_TRUE(exec.step(0, sink, runtime));
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Blocked);
+  EXPECT_EQ(exec.state().blocked->wait_token->id, "2");
+  EXPECT_EQ(submitted, (std::vector<double>{1.0, 2.0}));
+  EXPECT_EQ(sink.linear_move_batches, (std::vector<size_t>{2}));
+
+  exec.notifyEvent(gcode::WaitToken{"motion", "2"});
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // X3 and X4
+  EXPECT_EQ(submitted, (std::vector<double>{1.0, 2.0, 3.0, 4.0}));
+  EXPECT_EQ(sink.linear_move_batches, (std::vector<size_t>{2, 2}));
+  ASSERT_EQ(sink.linear_moves.size(), 4u);
+  EXPECT_EQ(sink.linear_moves[3].source.line, 4);
+
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // dwell
+  EXPECT_EQ(sink.dwells.size(), 1u);
+  ASSERT_TRUE(exec.step(0, sink, runtime));
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+}
+
+TEST(AilExecutorTest, LinearMoveBatchMatchesSingleMoveEvents) {
+  class EventLogSink : public gcode::IExecutionSink {
+  public:
+    explicit EventLogSink(std::vector<std::string> *log) : log_(log) {}
+    void onDiagnostic(const gcode::Diagnostic &) override {}
+    void onRejectedLine(const gcode::RejectedLineEvent &) override {}
+    void onModalUpdate(const gcode::ModalUpdateEvent &) override {}
+    void onLinearMove(const gcode::LinearMoveCommand &cmd) override {
+      log_->push_back("sink " + std::to_string(cmd.source.line));
+    }
+    void onArcMove(const gcode::ArcMoveCommand &) override {}
+    void onDwell(const gcode::DwellCommand &cmd) override {
+      log_->push_back("sink " + std::to_string(cmd.source.line));
+    }
+    void onToolChange(const gcode::ToolChangeCommand &) override {}
+
+  private:
+    std::vector<std::string> *log_;
+  };
+
+  // The events of a run, and those sent before the executor first blocked.
+  using Logs = std::pair<std::vector<std::string>, std::vector<std::string>>;
+  const auto run = [](size_t max_linear_move_batch) {
+    gcode::AilExecutorOptions options;
+    options.max_linear_move_batch = max_linear_move_batch;
+    gcode::AilExecutor exec(
+        gcode::parseAndLowerAil("G1 X1\nG1 X2\nG1 X3\nG1 X4\nG4 F1\nG1 X5\n"
+                                "G1 X6\n")
+            .instructions,
+        options);
+    std::vector<std::string> log;
+    std::optional<std::vector<std::string>> log_at_block;
+    EventLogSink sink(&log);
+    gcode::FunctionExecutionRuntime runtime(
+        [](const gcode::Condition &, const gcode::SourceInfo &) {
+          return gcode::ConditionResolution{};
+        },
+        [&log](const gcode::LinearMoveCommand &cmd) {
+          log.push_back("runtime " + std::to_string(cmd.source.line));
+          if (cmd.source.line != 2) {
+            return readyRuntimeResult();
+          }
+          gcode::RuntimeResult<gcode::WaitToken> result;
+          result.status = gcode::RuntimeCallStatus::Pending;
+          result.wait_token = gcode::WaitToken{"motion", "2"};
+          return result;
+        },
+        [](const gcode::ArcMoveCommand &) { return readyRuntimeResult(); },
+        [&log](const gcode::DwellCommand &cmd) {
+          log.push_back("runtime " + std::to_string(cmd.source.line));
+          return readyRuntimeResult();
+        },
+        [](const gcode::ToolChangeCommand &) { return readyRuntimeResult(); },
+        [](std::string_view) { return gcode::RuntimeResult<double>{}; },
+        [](const gcode::WaitToken &) { return readyRuntimeResult(); });
+    for (int i = 0; i < 32 && exec.state().status !=
+                                  gcode::ExecutorStatus::Completed;
+         ++i) {
+      if (exec.state().status == gcode::ExecutorStatus::Blocked) {
+        if (!log_at_block.has_value()) {
+          log_at_block = log;
+        }
+        exec.notifyEvent(*exec.state().blocked->wait_token);
+      }
+      EXPECT_TRUE(exec.step(0, sink, runtime));
+    }
+    EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+    return Logs{log, log_at_block.value_or(std::vector<std::string>{})};
+  };
+  const auto events_of = [](const std::vector<std::string> &log,
+                            const std::string &prefix) {
+    std::vector<std::string> events;
+    for (const auto &event : log) {
+      if (event.rfind(prefix, 0) == 0) {
+        events.push_back(event.substr(prefix.size()));
+      }
+    }
+    return events;
+  };
+
+  const auto single = run(1);
+  const auto batched = run(8);
+  const std::vector<std::string> lines{"1", "2", "3", "4", "5", "6", "7"};
+  for (const auto *logs : {&single, &batched}) {
+    const auto &log = logs->first;
+    EXPECT_EQ(events_of(log, "sink "), lines);
+    EXPECT_EQ(events_of(log, "runtime "), lines);
+    // X1 to X4 reach both the sink and the runtime before the dwell does.
+    EXPECT_EQ(std::find(log.begin(), log.end(), "sink 5") - log.begin(), 8);
+    // While X2 blocks, nothing after it has reached either.
+    EXPECT_EQ(events_of(logs->second, "sink "),
+              (std::vector<std::string>{"1", "2"}));
+    EXPECT_EQ(events_of(logs->second, "runtime "),
+              (std::vector<std::string>{"1", "2"}));
+  }
+}
+
+TEST(AilExecutorTest, LinearMoveBatchShrunkMidRunSendsEachMoveOnce) {
+  gcode::AilExecutorOptions options;
+  options.max_linear_move_batch = 8;
+  gcode::AilExecutor exec(
+      gcode::parseAndLowerAil("G1 X1\nG1 X2\nG1 X3\nG1 X4\nG1 X5\nG1 X6\n"
+                              "G1 X7\nG1 X8\n")
+          .instructions,
+      options);
+  RecordingExecutionSink sink;
+  int submitted = 0;
+  gcode::FunctionExecutionRuntime runtime(
+      [](const gcode::Condition &, const gcode::SourceInfo &) {
+        return gcode::ConditionResolution{};
+      },
+      [&submitted](const gcode::LinearMoveCommand &) {
+        if (++submitted != 1) {
+          return readyRuntimeResult();
+        }
+        gcode::RuntimeResult<gcode::WaitToken> result;
+        result.status = gcode::RuntimeCallStatus::Pending;
+        result.wait_token = gcode::WaitToken{"motion", "1"};
+        return result;
+      },
+      [](const gcode::ArcMoveCommand &) { return readyRuntimeResult(); },
+      [](const gcode::DwellCommand &) { return readyRuntimeResult(); },
+      [](const gcode::ToolChangeCommand &) { return readyRuntimeResult(); },
+      [](std::string_view) { return gcode::RuntimeResult<double>{}; },
+      [](const gcode::WaitToken &) { return readyRuntimeResult(); });
+
+  ASSERT_TRUE(exec.step(0, sink, runtime));
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Blocked);
+  exec.notifyEvent(gcode::WaitToken{"motion", "1"});
+  exec.setMaxLinearMoveBatch(2);
+  ASSERT_TRUE(exec.step(0, sink, runtime)); // X2 and X3
+  exec.setMaxLinearMoveBatch(1);
+  for (int i = 0; i < 16 &&
+                  exec.state().status != gcode::ExecutorStatus::Completed;
+       ++i) {
+    ASSERT_TRUE(exec.step(0, sink, runtime));
+  }
+  ASSERT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
+  EXPECT_EQ(submitted, 8);
+  std::vector<int> sink_lines;
+  for (const auto &cmd : sink.linear_moves) {
+    sink_lines.push_back(cmd.source.line);
+  }
+  EXPECT_EQ(sink_lines, (std::vector<int>{1, 2, 3, 4, 5, 6, 7, 8}));
+}
+
 TEST(AilExecutorTest, MotionRuntimeErrorFaultsExecutor) {
   const auto lowered = gcode::parseAndLowerAil("G1 X1\n");
   gcode::AilExecutor exec(lowered.instructions);
@@ -725,11 +1031,51 @@ TEST(AilExecutorTest, RuntimeBackedSystemVariableConditionCanTakeTrueBranch) {
 
   EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
   ASSERT_EQ(sink.linear_moves.size(), 1u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 10.0);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 10.0);
   EXPECT_TRUE(sink.diagnostics.empty());
 }
 
+TEST(AilExecutorTest, AssignmentsAndBranchesEvaluatePooledExpressions) {
+  const auto lowered = gcode::parseAndLowerAil("R1 = 2\n"
+                                               "R2 = -R1 * 3 + R1 / 4\n"
+                                               "IF R2 == -5.5 GOTOF TARGET\n"
+                                               "G1 X20\n"
+                                               "GOTO END\n"
+                                               "TARGET:\n"
+                                               "G1 X10\n"
+                                               "END:\n"
+                                               "R3 = R2 / R4\n");
+  ASSERT_TRUE(lowered.diagnostics.empty());
+
+  gcode::AilExecutor exec(lowered.instructions);
+  RecordingExecutionSink sink;
+  RecordingExecutionRuntime runtime(
+      [](const gcode::Condition &, const gcode::SourceInfo &) {
+        gcode::ConditionResolution r;
+        r.kind = gcode::ConditionResolutionKind::Error;
+        r.error_message = "fallback resolver should not be used";
+        return r;
+      });
+
+  int guard = 0;
+  while (exec.state().status != gcode::ExecutorStatus::Completed &&
+         exec.state().status != gcode::ExecutorStatus::Fault && guard < 32) {
+    ASSERT_TRUE(exec.step(0, sink, runtime));
+    ++guard;
+  }
+
+  EXPECT_EQ(exec.state().user_variables.at("R1"), 2.0);
+  EXPECT_EQ(exec.state().user_variables.at("R2"), -5.5);
+  ASSERT_EQ(sink.linear_moves.size(), 1u);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 10.0);
+  EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Fault);
+  ASSERT_FALSE(exec.diagnostics().empty());
+  EXPECT_NE(exec.diagnostics().back().message.find("division by zero"),
+            std::string::npos);
+}
+
 TEST(AilExecutorTest,
      RuntimeBackedSingleSelectorSystemVariableConditionCanTakeTrueBranch) {
   const auto lowered =
@@ -761,8 +1107,8 @@ TEST(AilExecutorTest,
 
   EXPECT_EQ(exec.state().status, gcode::ExecutorStatus::Completed);
   ASSERT_EQ(sink.linear_moves.size(), 1u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 10.0);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 10.0);
   EXPECT_TRUE(sink.diagnostics.empty());
 }
 
@@ -937,7 +1283,7 @@ TEST(AilExecutorTest, SubprogramSearchPolicyCanFallbackToBareName) {
   gcode::AilLinearMoveInstruction move;
   move.source.line = 8;
   move.opcode = "G1";
-  move.target_pose.x = 1.0;
+  move.target_pose.setX(1.0);
 
   std::vector<gcode::AilInstruction> instructions;
   instructions.push_back(goto_start);
@@ -1025,7 +1371,7 @@ TEST(AilExecutorTest, SubprogramPolicyCanOverrideResolution) {
   gcode::AilLinearMoveInstruction move;
   move.source.line = 6;
   move.opcode = "G1";
-  move.target_pose.x = 1.0;
+  move.target_pose.setX(1.0);
 
   std::vector<gcode::AilInstruction> instructions;
   instructions.push_back(goto_start);
@@ -7,6 +7,9 @@
 
 #include "gcode/ail.h"
 #include "gcode/ail_json.h"
+#include "gcode/compact_ail.h"
+#include "gcode/expr_pool.h"
+#include "gcode/motion_table.h"
 
 namespace {
 
@@ -30,8 +33,8 @@ TEST(AilTest, LowersMotionSubsetIntoAilInstructions) {
   EXPECT_EQ(l0.source.line, 1);
   EXPECT_EQ(l0.modal.group, gcode::ModalGroupId::Motion);
   EXPECT_EQ(l0.modal.code, "G1");
-  ASSERT_TRUE(l0.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*l0.target_pose.x, 1.0));
+  ASSERT_TRUE(l0.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*l0.target_pose.x(), 1.0));
   ASSERT_TRUE(l0.feed.has_value());
   EXPECT_TRUE(closeEnough(*l0.feed, 3.0));
 
@@ -42,8 +45,8 @@ TEST(AilTest, LowersMotionSubsetIntoAilInstructions) {
   EXPECT_TRUE(l1.clockwise);
   EXPECT_EQ(l1.modal.code, "G2");
   EXPECT_EQ(l1.plane_effective, gcode::WorkingPlane::XY);
-  ASSERT_TRUE(l1.arc.i.has_value());
-  EXPECT_TRUE(closeEnough(*l1.arc.i, 6.0));
+  ASSERT_TRUE(l1.arc.i().has_value());
+  EXPECT_TRUE(closeEnough(*l1.arc.i(), 6.0));
 
   ASSERT_TRUE(std::holds_alternative<gcode::AilDwellInstruction>(
       result.instructions[2]));
@@ -85,10 +88,10 @@ TEST(AilTest, G0LowersToLinearInstructionWithG0Opcode) {
       std::get<gcode::AilLinearMoveInstruction>(result.instructions[0]);
   EXPECT_EQ(move.opcode, "G0");
   EXPECT_EQ(move.modal.code, "G0");
-  ASSERT_TRUE(move.target_pose.x.has_value());
-  ASSERT_TRUE(move.target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*move.target_pose.x, 10.0));
-  EXPECT_TRUE(closeEnough(*move.target_pose.y, 20.0));
+  ASSERT_TRUE(move.target_pose.x().has_value());
+  ASSERT_TRUE(move.target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*move.target_pose.x(), 10.0));
+  EXPECT_TRUE(closeEnough(*move.target_pose.y(), 20.0));
   ASSERT_TRUE(move.feed.has_value());
   EXPECT_TRUE(closeEnough(*move.feed, 500.0));
 
@@ -1032,7 +1035,15 @@ TEST(AilTest, AssignmentProducesTypedExpressionTree) {
   const auto &assign =
       std::get<gcode::AilAssignInstruction>(result.instructions[0]);
   EXPECT_EQ(assign.lhs, "R1");
-  ASSERT_TRUE(assign.rhs != nullptr);
+  ASSERT_NE(assign.rhs, gcode::kNoExpr);
+  ASSERT_NE(assign.expressions, nullptr);
+  // Post-order pool: $P_ACT_X, 2, R2, (2*R2), (+) at the root.
+  const auto &root = assign.expressions->node(assign.rhs);
+  EXPECT_EQ(root.op, gcode::ExprOp::Add);
+  EXPECT_EQ(root.first, assign.rhs - 4);
+  EXPECT_EQ(assign.expressions->node(root.lhs).op, gcode::ExprOp::Variable);
+  EXPECT_TRUE(assign.expressions->node(root.lhs).is_system);
+  EXPECT_EQ(assign.expressions->node(root.rhs).op, gcode::ExprOp::Multiply);
 
   const auto json = nlohmann::json::parse(gcode::ailToJsonString(result));
   EXPECT_EQ(json["instructions"][0]["kind"], "assign");
@@ -1042,6 +1053,36 @@ TEST(AilTest, AssignmentProducesTypedExpressionTree) {
   EXPECT_EQ(json["instructions"][0]["rhs"]["lhs"]["name"], "$P_ACT_X");
 }
 
+TEST(AilTest, ExprPoolInternsVariableNames) {
+  const auto variable = [](const std::string &name) {
+    auto node = std::make_shared<gcode::ExprNode>();
+    node->node = gcode::ExprVariable{name, false, {}};
+    return node;
+  };
+  const auto sum = [](std::shared_ptr<gcode::ExprNode> lhs,
+                      std::shared_ptr<gcode::ExprNode> rhs) {
+    auto node = std::make_shared<gcode::ExprNode>();
+    node->node = gcode::ExprBinary{"+", std::move(lhs), std::move(rhs), {}};
+    return node;
+  };
+
+  gcode::ExprPool pool;
+  const auto root = pool.add(sum(variable("R1"), variable("r1")));
+  const auto &upper = pool.node(pool.node(root).lhs);
+  const auto &lower = pool.node(pool.node(root).rhs);
+  EXPECT_EQ(upper.key, upper.text);
+  EXPECT_EQ(lower.key, upper.key);
+  EXPECT_NE(lower.text, upper.text);
+  EXPECT_EQ(pool.text(lower.text), "r1");
+
+  gcode::ExprPool other;
+  other.add(sum(variable("r1"), variable("R2")));
+  const auto offset = pool.merge(other);
+  EXPECT_EQ(pool.node(offset).text, lower.text);
+  EXPECT_EQ(pool.node(offset).key, upper.key);
+  EXPECT_EQ(pool.text(pool.node(offset + 1).key), "R2");
+}
+
 TEST(AilTest, PreservesSingleSelectorSystemVariableAxisWordInJson) {
   const auto result = gcode::parseAndLowerAil("G1 X=$AA_IM[X]\n");
   ASSERT_TRUE(result.diagnostics.empty());
@@ -1207,10 +1248,163 @@ TEST(AilTest, ActiveSkipLevelRemovesMatchingLinesFromInstructionStream) {
       std::get<gcode::AilLinearMoveInstruction>(result.instructions[0]);
   const auto &second =
       std::get<gcode::AilLinearMoveInstruction>(result.instructions[1]);
-  ASSERT_TRUE(first.target_pose.x.has_value());
-  ASSERT_TRUE(second.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*first.target_pose.x, 20.0));
-  EXPECT_TRUE(closeEnough(*second.target_pose.x, 30.0));
+  ASSERT_TRUE(first.target_pose.x().has_value());
+  ASSERT_TRUE(second.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*first.target_pose.x(), 20.0));
+  EXPECT_TRUE(closeEnough(*second.target_pose.x(), 30.0));
+}
+
+// Long enough to be lowered as several chunks, with an IF block, rapid mode
+// and working plane that span chunk boundaries.
+std::string makeChunkedLoweringProgram(size_t line_count) {
+  std::string text = "IF R9 == 0\n";
+  for (size_t i = 0; i < line_count; ++i) {
+    const std::string n = std::to_string(i);
+    if (i == line_count / 2) {
+      text += "ELSE\n";
+    } else if (i % 2500 == 0) {
+      text += (i / 2500) % 2 == 0 ? "G18 RTLIOF\n" : "G17 RTLION\n";
+    } else if (i % 7 == 0) {
+      text += "IF R1 > " + n + "\nR1 = R1 + " + n + "\nELSE\nG0 X" + n +
+              "\nENDIF\n";
+    } else if (i % 3 == 0) {
+      text += "G2 X1 Y1 Z1 CR=5\n";
+    } else {
+      text += "G0 X" + n + " Y1\n";
+    }
+  }
+  return text + "ENDIF\nELSE\n";
+}
+
+TEST(AilTest, ParallelLoweringMatchesSerialLowering) {
+  const auto parsed = gcode::parse(makeChunkedLoweringProgram(20000));
+  const auto serial = gcode::lowerToAil(parsed.program, parsed.diagnostics);
+  ASSERT_FALSE(serial.instructions.empty());
+  ASSERT_FALSE(serial.diagnostics.empty());
+
+  for (const unsigned threads : {2u, 4u, 0u}) {
+    gcode::LowerOptions options;
+    options.lower_threads = threads;
+    const auto parallel =
+        gcode::lowerToAil(parsed.program, parsed.diagnostics, options);
+    EXPECT_EQ(gcode::ailToJsonString(parallel), gcode::ailToJsonString(serial))
+        << "threads " << threads;
+  }
+}
+
+TEST(AilLowererTest, PulledInstructionsMatchLowerToAil) {
+  const std::string input = "G1 X1\nIF R1 == 1\nG1 X2\nIF R2 == 2\nG0 Y1\n"
+                            "ELSE\nG1 Y2\nENDIF\nM3\nELSE\nG1 X3\nENDIF\n"
+                            "ELSE\nIF R3 == 3\nG1 Z1\n";
+  const auto expected = gcode::ailToJsonString(gcode::parseAndLowerAil(input));
+
+  for (const size_t batch : {size_t{1}, size_t{2}, size_t{3}, size_t{64}}) {
+    gcode::AilLowerer lowerer(input);
+    gcode::AilResult pulled;
+    while (lowerer.nextBatch(&pulled.instructions, batch) == batch) {
+    }
+    EXPECT_TRUE(lowerer.done());
+    pulled.diagnostics = lowerer.diagnostics();
+    pulled.rejected_lines = lowerer.rejected_lines();
+    EXPECT_EQ(gcode::ailToJsonString(pulled), expected) << "batch " << batch;
+  }
+
+  gcode::AilLowerer lowerer(input);
+  gcode::AilResult pulled;
+  while (auto instruction = lowerer.next()) {
+    pulled.instructions.push_back(std::move(*instruction));
+  }
+  pulled.diagnostics = lowerer.diagnostics();
+  pulled.rejected_lines = lowerer.rejected_lines();
+  EXPECT_EQ(gcode::ailToJsonString(pulled), expected);
+}
+
+TEST(AilLowererTest, LowersOnlyTheLinesNeededForTheNextInstruction) {
+  gcode::AilLowerer lowerer("G1 X1\nG17 G2 X1 K1\nG1 X2\n");
+  const auto first = lowerer.next();
+  ASSERT_TRUE(first.has_value());
+  EXPECT_TRUE(std::holds_alternative<gcode::AilLinearMoveInstruction>(*first));
+  EXPECT_TRUE(lowerer.diagnostics().empty());
+  EXPECT_FALSE(lowerer.done());
+
+  // The arc line is rejected, which ends the program.
+  EXPECT_FALSE(lowerer.next().has_value());
+  EXPECT_TRUE(lowerer.done());
+  EXPECT_FALSE(lowerer.diagnostics().empty());
+  ASSERT_EQ(lowerer.rejected_lines().size(), 1u);
+  EXPECT_EQ(lowerer.rejected_lines()[0].source.line, 2);
+}
+
+gcode::AilResult expandCompactAil(const gcode::CompactAilResult &compact) {
+  gcode::AilResult result;
+  for (const auto &instruction : compact.instructions) {
+    result.instructions.push_back(
+        gcode::toAilInstruction(compact, instruction));
+  }
+  result.diagnostics = compact.diagnostics;
+  result.rejected_lines = compact.rejected_lines;
+  return result;
+}
+
+TEST(CompactAilTest, RestoresTheInstructionsOfLowerToAil) {
+  const std::string input =
+      "N10 G1 X1 Y2 F3\nG0 X=$AA_IM[X]\nG18 G3 X1 Z2 K1\nG4 S2\nM3\n"
+      "RTLIOF G0 Y1\nG41 T12 M6\nSTART:\nR1 = R1 + 1\n"
+      "IF R1 < 3 GOTOB START\nIF R2 == 1\nG1 Z1\nELSE\nM5\nENDIF\n"
+      "G2 X1 I1\n";
+  gcode::LowerOptions options;
+  options.filename = "/programs/fixtures/part_roughing.mpf";
+  const auto parsed = gcode::parse(input);
+  const auto expected =
+      gcode::lowerToAil(parsed.program, parsed.diagnostics, options);
+  ASSERT_FALSE(expected.rejected_lines.empty());
+
+  const auto compact =
+      gcode::lowerToCompactAil(parsed.program, parsed.diagnostics, options);
+  ASSERT_EQ(compact.files.size(), 1u);
+  EXPECT_EQ(compact.files[0], *options.filename);
+  EXPECT_EQ(compact.arcs.size(), 1u);
+  EXPECT_FALSE(compact.out_of_line.empty());
+  EXPECT_LT(compact.out_of_line.size(), compact.instructions.size());
+  EXPECT_EQ(gcode::ailToJsonString(expandCompactAil(compact)),
+            gcode::ailToJsonString(expected));
+  EXPECT_EQ(gcode::ailToJsonString(
+                expandCompactAil(gcode::toCompactAil(expected))),
+            gcode::ailToJsonString(expected));
+}
+
+TEST(MotionTableTest, ColumnsHoldTheMovesOfAnAilResult) {
+  std::string input = "G0 X1 Y2 Z3\nM3\nG18 G3 X4 Z5 K6 F7\nG4 S1\n";
+  for (int i = 0; i < 70; ++i) {
+    input += i % 2 == 0 ? "G1 X" + std::to_string(i) + "\n" : "G1 Y1 F9\n";
+  }
+  const auto result = gcode::parseAndLowerAil(input);
+  ASSERT_TRUE(result.diagnostics.empty());
+  const auto table = gcode::buildMotionTable(result);
+
+  ASSERT_EQ(table.size(), 72u);
+  EXPECT_EQ(table.kind[0], gcode::MotionKind::Rapid);
+  EXPECT_EQ(table.kind[1], gcode::MotionKind::ArcCounterClockwise);
+  EXPECT_EQ(table.kind[2], gcode::MotionKind::Linear);
+  EXPECT_EQ(table.source_line[1], 3);
+  EXPECT_EQ(table.instruction[1], 3u);
+  EXPECT_EQ(table.x.get(0), std::optional<double>(1.0));
+  EXPECT_EQ(table.z.get(1), std::optional<double>(5.0));
+  EXPECT_FALSE(table.y.has(1));
+  EXPECT_FALSE(table.feed.has(0));
+  EXPECT_EQ(table.feed.get(1), std::optional<double>(7.0));
+
+  // Rows past the first 64-bit presence word.
+  EXPECT_EQ(table.x.get(70), std::optional<double>(68.0));
+  EXPECT_FALSE(table.x.has(71));
+  EXPECT_EQ(table.x.values[71], 0.0);
+  EXPECT_EQ(table.y.get(71), std::optional<double>(1.0));
+
+  ASSERT_EQ(table.arcs.row.size(), 1u);
+  EXPECT_EQ(table.arcs.row[0], 1u);
+  EXPECT_EQ(table.arcs.plane[0], gcode::WorkingPlane::ZX);
+  EXPECT_EQ(table.arcs.k.get(0), std::optional<double>(6.0));
+  EXPECT_FALSE(table.arcs.i.has(0));
 }
 
 } // namespace
@@ -75,6 +75,40 @@ TEST(CliFormatTest, DebugFormatMatchesExistingGoldenOutput) {
   EXPECT_TRUE(result.stderr_text.empty());
 }
 
+#ifdef __unix__
+TEST(CliFormatTest, PipedInputMatchesFileInput) {
+  const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
+  const auto input_path = source_dir / "testdata" / "g2g3_samples.ngc";
+  const auto golden_path = source_dir / "testdata" / "g2g3_samples.golden.txt";
+
+  const std::string command = std::string("cat \"") + input_path.string() +
+                              "\" | \"" + GCODE_PARSE_BIN +
+                              "\" --format debug /dev/stdin";
+  const auto result = runCommand(command);
+
+  EXPECT_EQ(result.exit_code, 0);
+  EXPECT_EQ(result.stdout_text, readFile(golden_path));
+  EXPECT_TRUE(result.stderr_text.empty());
+}
+#endif
+
+TEST(CliFormatTest, MissingInputFileReturnsOpenError) {
+  const auto missing_path =
+      std::filesystem::temp_directory_path() / "gcode_cli_missing_input.ngc";
+  std::error_code ec;
+  std::filesystem::remove(missing_path, ec);
+
+  for (const char *bin : {GCODE_PARSE_BIN, GCODE_STREAM_EXEC_BIN}) {
+    const auto result = runCommand(std::string("\"") + bin + "\" \"" +
+                                   missing_path.string() + "\"");
+    EXPECT_EQ(result.exit_code, 2) << bin;
+    EXPECT_TRUE(result.stdout_text.empty()) << bin;
+    EXPECT_NE(result.stderr_text.find("Failed to open file"),
+              std::string::npos)
+        << bin;
+  }
+}
+
 TEST(CliFormatTest, JsonFormatOutputsStableSchema) {
   const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
   const auto input_path = source_dir / "testdata" / "g2g3_samples.ngc";
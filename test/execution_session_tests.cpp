@@ -165,12 +165,12 @@ TEST(ExecutionSessionTest, RejectedSuffixCanBeReplacedAndExecutionContinues) {
   EXPECT_EQ(completed.status, gcode::StepStatus::Completed);
 
   ASSERT_EQ(sink.linear_moves.size(), 3u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  ASSERT_TRUE(sink.linear_moves[1].target.x.has_value());
-  ASSERT_TRUE(sink.linear_moves[2].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 10.0);
-  EXPECT_EQ(*sink.linear_moves[1].target.x, 15.0);
-  EXPECT_EQ(*sink.linear_moves[2].target.x, 20.0);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  ASSERT_TRUE(sink.linear_moves[1].target.x().has_value());
+  ASSERT_TRUE(sink.linear_moves[2].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 10.0);
+  EXPECT_EQ(*sink.linear_moves[1].target.x(), 15.0);
+  EXPECT_EQ(*sink.linear_moves[2].target.x(), 20.0);
 }
 
 TEST(ExecutionSessionTest, ReplaceEditableSuffixOnlyWorksInRejectedState) {
@@ -239,10 +239,10 @@ TEST(ExecutionSessionTest,
   EXPECT_EQ(step.status, gcode::StepStatus::Completed);
   EXPECT_EQ(session.state(), gcode::EngineState::Completed);
   ASSERT_EQ(sink.linear_moves.size(), 2u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  ASSERT_TRUE(sink.linear_moves[1].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 1.0);
-  EXPECT_EQ(*sink.linear_moves[1].target.x, 2.0);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  ASSERT_TRUE(sink.linear_moves[1].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 1.0);
+  EXPECT_EQ(*sink.linear_moves[1].target.x(), 2.0);
 }
 
 TEST(ExecutionSessionTest,
@@ -305,11 +305,11 @@ TEST(ExecutionSessionTest,
   EXPECT_EQ(runtime.read_names[1], "$P_ACT_X");
   EXPECT_EQ(runtime.linear_calls, 1);
   ASSERT_EQ(runtime.submitted_moves.size(), 1u);
-  ASSERT_TRUE(runtime.submitted_moves[0].target.x.has_value());
-  EXPECT_EQ(*runtime.submitted_moves[0].target.x, 12.5);
+  ASSERT_TRUE(runtime.submitted_moves[0].target.x().has_value());
+  EXPECT_EQ(*runtime.submitted_moves[0].target.x(), 12.5);
   ASSERT_EQ(sink.linear_moves.size(), 1u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 12.5);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 12.5);
 }
 
 TEST(ExecutionSessionTest, ForwardGotoFaultEmitsSingleDiagnostic) {
@@ -347,8 +347,8 @@ TEST(ExecutionSessionTest, ForwardGotoResolvesAcrossBufferedLines) {
   EXPECT_EQ(step.status, gcode::StepStatus::Completed);
   EXPECT_EQ(session.state(), gcode::EngineState::Completed);
   ASSERT_EQ(sink.linear_moves.size(), 1u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 20.0);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 20.0);
   EXPECT_TRUE(sink.diagnostics.empty());
 }
 
@@ -369,8 +369,8 @@ TEST(ExecutionSessionTest, StructuredIfElseExecutesTrueBranchAcrossLines) {
   EXPECT_EQ(step.status, gcode::StepStatus::Completed);
   EXPECT_EQ(session.state(), gcode::EngineState::Completed);
   ASSERT_EQ(sink.linear_moves.size(), 1u);
-  ASSERT_TRUE(sink.linear_moves[0].target.x.has_value());
-  EXPECT_EQ(*sink.linear_moves[0].target.x, 10.0);
+  ASSERT_TRUE(sink.linear_moves[0].target.x().has_value());
+  EXPECT_EQ(*sink.linear_moves[0].target.x(), 10.0);
   EXPECT_TRUE(sink.diagnostics.empty());
 }
 
@@ -9,6 +9,7 @@
 
 #include "gtest/gtest.h"
 
+#include "ast_printer.h"
 #include "gcode/gcode_parser.h"
 #include "messages.h"
 
@@ -93,6 +94,53 @@ TEST(FuzzSmokeTest, CorpusAndGeneratedInputsDoNotCrashOrHang) {
   EXPECT_LT(elapsed_ms, 5000);
 }
 
+TEST(FuzzSmokeTest, FastBlockPathMatchesAntlrOnlyParse) {
+  const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
+  const auto corpus_dir = source_dir / "testdata" / "fuzz" / "corpus";
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+
+  auto expect_same = [&](const std::string &input) {
+    EXPECT_EQ(gcode::formatJson(gcode::parse(input), false),
+              gcode::formatJson(gcode::parse(input, antlr_only), false))
+        << "fast block path mismatch for input:\n"
+        << input;
+  };
+
+  for (const auto &file : collectCorpus(corpus_dir)) {
+    expect_same(readFile(file));
+  }
+  std::mt19937 rng(0xFA57u);
+  for (int i = 0; i < 2000; ++i) {
+    expect_same(generateInput(rng));
+  }
+}
+
+TEST(FuzzSmokeTest, SllThenLlPredictionMatchesLlOnly) {
+  const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
+  const auto corpus_dir = source_dir / "testdata" / "fuzz" / "corpus";
+  gcode::ParseOptions ll_only;
+  ll_only.enable_fast_block_path = false;
+  ll_only.prediction_mode = gcode::ParsePredictionMode::Ll;
+  gcode::ParseOptions two_stage;
+  two_stage.enable_fast_block_path = false;
+
+  auto expect_same = [&](const std::string &input) {
+    EXPECT_EQ(gcode::formatJson(gcode::parse(input, two_stage), false),
+              gcode::formatJson(gcode::parse(input, ll_only), false))
+        << "prediction mode mismatch for input:\n"
+        << input;
+  };
+
+  for (const auto &file : collectCorpus(corpus_dir)) {
+    expect_same(readFile(file));
+  }
+  std::mt19937 rng(0x511u);
+  for (int i = 0; i < 2000; ++i) {
+    expect_same(generateInput(rng));
+  }
+}
+
 TEST(FuzzSmokeTest, LongProgramInputDoesNotCrashOrHang) {
   static constexpr size_t kLineCount = 20000;
   const std::string input = generateLargeProgram(kLineCount);
@@ -56,10 +56,10 @@ TEST(G1LowererTest, LowersPoseAndFeedAndSourceInfo) {
   ASSERT_TRUE(msg.source.line_number.has_value());
   EXPECT_EQ(*msg.source.line_number, 42);
 
-  ASSERT_TRUE(msg.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*msg.target_pose.x, 10.0));
-  ASSERT_TRUE(msg.target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*msg.target_pose.y, 20.0));
+  ASSERT_TRUE(msg.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*msg.target_pose.x(), 10.0));
+  ASSERT_TRUE(msg.target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*msg.target_pose.y(), 20.0));
   ASSERT_TRUE(msg.feed.has_value());
   EXPECT_TRUE(closeEnough(*msg.feed, 150.0));
   EXPECT_EQ(msg.modal.group, gcode::ModalGroupId::Motion);
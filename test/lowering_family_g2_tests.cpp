@@ -45,18 +45,18 @@ TEST(G2LowererTest, LowersArcAndAddsWarningsForUnsupportedArcWords) {
   ASSERT_TRUE(std::holds_alternative<gcode::G2Message>(lowered));
   const auto &msg = std::get<gcode::G2Message>(lowered);
 
-  ASSERT_TRUE(msg.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*msg.target_pose.x, 1.5));
-  ASSERT_TRUE(msg.target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*msg.target_pose.y, 2.5));
-  ASSERT_TRUE(msg.arc.i.has_value());
-  EXPECT_TRUE(closeEnough(*msg.arc.i, 3.5));
-  ASSERT_TRUE(msg.arc.j.has_value());
-  EXPECT_TRUE(closeEnough(*msg.arc.j, 4.5));
-  ASSERT_TRUE(msg.arc.k.has_value());
-  EXPECT_TRUE(closeEnough(*msg.arc.k, 5.5));
-  ASSERT_TRUE(msg.arc.r.has_value());
-  EXPECT_TRUE(closeEnough(*msg.arc.r, 6.5));
+  ASSERT_TRUE(msg.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*msg.target_pose.x(), 1.5));
+  ASSERT_TRUE(msg.target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*msg.target_pose.y(), 2.5));
+  ASSERT_TRUE(msg.arc.i().has_value());
+  EXPECT_TRUE(closeEnough(*msg.arc.i(), 3.5));
+  ASSERT_TRUE(msg.arc.j().has_value());
+  EXPECT_TRUE(closeEnough(*msg.arc.j(), 4.5));
+  ASSERT_TRUE(msg.arc.k().has_value());
+  EXPECT_TRUE(closeEnough(*msg.arc.k(), 5.5));
+  ASSERT_TRUE(msg.arc.r().has_value());
+  EXPECT_TRUE(closeEnough(*msg.arc.r(), 6.5));
   ASSERT_TRUE(msg.feed.has_value());
   EXPECT_TRUE(closeEnough(*msg.feed, 120.0));
   EXPECT_EQ(msg.modal.group, gcode::ModalGroupId::Motion);
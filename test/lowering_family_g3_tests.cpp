@@ -38,10 +38,10 @@ TEST(G3LowererTest, LowersArcAndSupportsCREqualsAlias) {
 
   ASSERT_TRUE(std::holds_alternative<gcode::G3Message>(lowered));
   const auto &msg = std::get<gcode::G3Message>(lowered);
-  ASSERT_TRUE(msg.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*msg.target_pose.x, 8.0));
-  ASSERT_TRUE(msg.arc.r.has_value());
-  EXPECT_TRUE(closeEnough(*msg.arc.r, 9.0));
+  ASSERT_TRUE(msg.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*msg.target_pose.x(), 8.0));
+  ASSERT_TRUE(msg.arc.r().has_value());
+  EXPECT_TRUE(closeEnough(*msg.arc.r(), 9.0));
   EXPECT_EQ(msg.modal.group, gcode::ModalGroupId::Motion);
   EXPECT_EQ(msg.modal.code, "G3");
   EXPECT_TRUE(msg.modal.updates_state);
@@ -30,8 +30,8 @@ TEST(MessageDiffTest, UpdateLineProducesUpdatedEntry) {
   ASSERT_EQ(applied.size(), after.messages.size());
   const auto *updated = asG1(applied[1]);
   ASSERT_NE(updated, nullptr);
-  ASSERT_TRUE(updated->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*updated->target_pose.x, 22.0));
+  ASSERT_TRUE(updated->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*updated->target_pose.x(), 22.0));
 }
 
 TEST(MessageDiffTest, InsertLineProducesAddedEntry) {
@@ -48,8 +48,8 @@ TEST(MessageDiffTest, InsertLineProducesAddedEntry) {
   ASSERT_EQ(applied.size(), after.messages.size());
   const auto *added = asG1(applied[1]);
   ASSERT_NE(added, nullptr);
-  ASSERT_TRUE(added->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*added->target_pose.x, 2.0));
+  ASSERT_TRUE(added->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*added->target_pose.x(), 2.0));
 }
 
 TEST(MessageDiffTest, DeleteLineProducesRemovedEntry) {
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <optional>
 
 #include "gtest/gtest.h"
 
@@ -60,18 +61,18 @@ TEST(MessagesTest, G1Extraction) {
   ASSERT_TRUE(g1->source.line_number.has_value());
   EXPECT_EQ(*g1->source.line_number, 10);
 
-  ASSERT_TRUE(g1->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.x, 10.0));
-  ASSERT_TRUE(g1->target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.y, 20.0));
-  ASSERT_TRUE(g1->target_pose.z.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.z, 30.0));
-  ASSERT_TRUE(g1->target_pose.a.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.a, 40.0));
-  ASSERT_TRUE(g1->target_pose.b.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.b, 50.0));
-  ASSERT_TRUE(g1->target_pose.c.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.c, 60.0));
+  ASSERT_TRUE(g1->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.x(), 10.0));
+  ASSERT_TRUE(g1->target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.y(), 20.0));
+  ASSERT_TRUE(g1->target_pose.z().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.z(), 30.0));
+  ASSERT_TRUE(g1->target_pose.a().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.a(), 40.0));
+  ASSERT_TRUE(g1->target_pose.b().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.b(), 50.0));
+  ASSERT_TRUE(g1->target_pose.c().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.c(), 60.0));
   ASSERT_TRUE(g1->feed.has_value());
   EXPECT_TRUE(closeEnough(*g1->feed, 100.0));
   EXPECT_EQ(g1->modal.group, gcode::ModalGroupId::Motion);
@@ -93,12 +94,12 @@ TEST(MessagesTest, G0Extraction) {
   EXPECT_EQ(g0->source.line, 1);
   ASSERT_TRUE(g0->source.line_number.has_value());
   EXPECT_EQ(*g0->source.line_number, 10);
-  ASSERT_TRUE(g0->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*g0->target_pose.x, 10.0));
-  ASSERT_TRUE(g0->target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*g0->target_pose.y, 20.0));
-  ASSERT_TRUE(g0->target_pose.z.has_value());
-  EXPECT_TRUE(closeEnough(*g0->target_pose.z, 30.0));
+  ASSERT_TRUE(g0->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*g0->target_pose.x(), 10.0));
+  ASSERT_TRUE(g0->target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*g0->target_pose.y(), 20.0));
+  ASSERT_TRUE(g0->target_pose.z().has_value());
+  EXPECT_TRUE(closeEnough(*g0->target_pose.z(), 30.0));
   ASSERT_TRUE(g0->feed.has_value());
   EXPECT_TRUE(closeEnough(*g0->feed, 100.0));
   EXPECT_EQ(g0->modal.group, gcode::ModalGroupId::Motion);
@@ -124,18 +125,18 @@ TEST(MessagesTest, LowercaseWordsEquivalent) {
   ASSERT_TRUE(g1->source.line_number.has_value());
   EXPECT_EQ(*g1->source.line_number, 7);
 
-  ASSERT_TRUE(g1->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.x, 1.5));
-  ASSERT_TRUE(g1->target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.y, 2.0));
-  ASSERT_TRUE(g1->target_pose.z.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.z, 3.0));
-  ASSERT_TRUE(g1->target_pose.a.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.a, 4.0));
-  ASSERT_TRUE(g1->target_pose.b.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.b, 5.0));
-  ASSERT_TRUE(g1->target_pose.c.has_value());
-  EXPECT_TRUE(closeEnough(*g1->target_pose.c, 6.0));
+  ASSERT_TRUE(g1->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.x(), 1.5));
+  ASSERT_TRUE(g1->target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.y(), 2.0));
+  ASSERT_TRUE(g1->target_pose.z().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.z(), 3.0));
+  ASSERT_TRUE(g1->target_pose.a().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.a(), 4.0));
+  ASSERT_TRUE(g1->target_pose.b().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.b(), 5.0));
+  ASSERT_TRUE(g1->target_pose.c().has_value());
+  EXPECT_TRUE(closeEnough(*g1->target_pose.c(), 6.0));
   ASSERT_TRUE(g1->feed.has_value());
   EXPECT_TRUE(closeEnough(*g1->feed, 7.0));
   EXPECT_EQ(g1->modal.group, gcode::ModalGroupId::Motion);
@@ -173,17 +174,17 @@ TEST(MessagesTest, G2G3Extraction) {
   EXPECT_EQ(g2->source.line, 1);
   ASSERT_TRUE(g2->source.line_number.has_value());
   EXPECT_EQ(*g2->source.line_number, 20);
-  ASSERT_TRUE(g2->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*g2->target_pose.x, 10.0));
-  ASSERT_TRUE(g2->target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*g2->target_pose.y, 20.0));
-  ASSERT_TRUE(g2->arc.i.has_value());
-  EXPECT_TRUE(closeEnough(*g2->arc.i, 1.0));
-  ASSERT_TRUE(g2->arc.j.has_value());
-  EXPECT_TRUE(closeEnough(*g2->arc.j, 2.0));
-  EXPECT_FALSE(g2->arc.k.has_value());
-  ASSERT_TRUE(g2->arc.r.has_value());
-  EXPECT_TRUE(closeEnough(*g2->arc.r, 40.0));
+  ASSERT_TRUE(g2->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*g2->target_pose.x(), 10.0));
+  ASSERT_TRUE(g2->target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*g2->target_pose.y(), 20.0));
+  ASSERT_TRUE(g2->arc.i().has_value());
+  EXPECT_TRUE(closeEnough(*g2->arc.i(), 1.0));
+  ASSERT_TRUE(g2->arc.j().has_value());
+  EXPECT_TRUE(closeEnough(*g2->arc.j(), 2.0));
+  EXPECT_FALSE(g2->arc.k().has_value());
+  ASSERT_TRUE(g2->arc.r().has_value());
+  EXPECT_TRUE(closeEnough(*g2->arc.r(), 40.0));
   ASSERT_TRUE(g2->feed.has_value());
   EXPECT_TRUE(closeEnough(*g2->feed, 100.0));
   EXPECT_EQ(g2->modal.group, gcode::ModalGroupId::Motion);
@@ -195,17 +196,17 @@ TEST(MessagesTest, G2G3Extraction) {
   EXPECT_EQ(g3->source.line, 2);
   ASSERT_TRUE(g3->source.line_number.has_value());
   EXPECT_EQ(*g3->source.line_number, 21);
-  ASSERT_TRUE(g3->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*g3->target_pose.x, 30.0));
-  ASSERT_TRUE(g3->target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*g3->target_pose.y, 40.0));
-  ASSERT_TRUE(g3->arc.i.has_value());
-  EXPECT_TRUE(closeEnough(*g3->arc.i, 4.0));
-  ASSERT_TRUE(g3->arc.j.has_value());
-  EXPECT_TRUE(closeEnough(*g3->arc.j, 5.0));
-  EXPECT_FALSE(g3->arc.k.has_value());
-  ASSERT_TRUE(g3->arc.r.has_value());
-  EXPECT_TRUE(closeEnough(*g3->arc.r, 50.0));
+  ASSERT_TRUE(g3->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*g3->target_pose.x(), 30.0));
+  ASSERT_TRUE(g3->target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*g3->target_pose.y(), 40.0));
+  ASSERT_TRUE(g3->arc.i().has_value());
+  EXPECT_TRUE(closeEnough(*g3->arc.i(), 4.0));
+  ASSERT_TRUE(g3->arc.j().has_value());
+  EXPECT_TRUE(closeEnough(*g3->arc.j(), 5.0));
+  EXPECT_FALSE(g3->arc.k().has_value());
+  ASSERT_TRUE(g3->arc.r().has_value());
+  EXPECT_TRUE(closeEnough(*g3->arc.r(), 50.0));
   ASSERT_TRUE(g3->feed.has_value());
   EXPECT_TRUE(closeEnough(*g3->feed, 200.0));
   EXPECT_EQ(g3->modal.group, gcode::ModalGroupId::Motion);
@@ -234,9 +235,9 @@ TEST(MessagesTest, ArcCenterWordsCanUsePlaneDeclaredInSameBlock) {
   ASSERT_EQ(result.messages.size(), 1u);
   const auto *g2 = asG2(result.messages[0]);
   ASSERT_NE(g2, nullptr);
-  ASSERT_TRUE(g2->arc.i.has_value());
-  ASSERT_TRUE(g2->arc.k.has_value());
-  EXPECT_FALSE(g2->arc.j.has_value());
+  ASSERT_TRUE(g2->arc.i().has_value());
+  ASSERT_TRUE(g2->arc.k().has_value());
+  EXPECT_FALSE(g2->arc.j().has_value());
 }
 
 TEST(MessagesTest, ArcUnsupportedWordsEmitWarningsButKeepMessage) {
@@ -248,10 +249,10 @@ TEST(MessagesTest, ArcUnsupportedWordsEmitWarningsButKeepMessage) {
 
   const auto *g2 = asG2(result.messages[0]);
   ASSERT_NE(g2, nullptr);
-  ASSERT_TRUE(g2->target_pose.x.has_value());
-  ASSERT_TRUE(g2->target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*g2->target_pose.x, 10.0));
-  EXPECT_TRUE(closeEnough(*g2->target_pose.y, 20.0));
+  ASSERT_TRUE(g2->target_pose.x().has_value());
+  ASSERT_TRUE(g2->target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*g2->target_pose.x(), 10.0));
+  EXPECT_TRUE(closeEnough(*g2->target_pose.y(), 20.0));
   ASSERT_TRUE(g2->feed.has_value());
   EXPECT_TRUE(closeEnough(*g2->feed, 100.0));
 
@@ -339,13 +340,13 @@ TEST(MessagesTest, ActiveSkipLevelSkipsMatchingBlockDeleteLines) {
 
   const auto *first = asG1(result.messages[0]);
   ASSERT_NE(first, nullptr);
-  ASSERT_TRUE(first->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*first->target_pose.x, 20.0));
+  ASSERT_TRUE(first->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*first->target_pose.x(), 20.0));
 
   const auto *second = asG1(result.messages[1]);
   ASSERT_NE(second, nullptr);
-  ASSERT_TRUE(second->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*second->target_pose.x, 30.0));
+  ASSERT_TRUE(second->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*second->target_pose.x(), 30.0));
 }
 
 TEST(MessagesTest, SlashWithoutLevelUsesDefaultLevelZero) {
@@ -360,8 +361,34 @@ TEST(MessagesTest, SlashWithoutLevelUsesDefaultLevelZero) {
 
   const auto *msg = asG1(result.messages[0]);
   ASSERT_NE(msg, nullptr);
-  ASSERT_TRUE(msg->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*msg->target_pose.x, 20.0));
+  ASSERT_TRUE(msg->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*msg->target_pose.x(), 20.0));
+}
+
+TEST(PoseTest, PackedPoseBehavesLikeSixOptionals) {
+  static_assert(sizeof(gcode::Pose6) <= 7 * sizeof(double));
+  gcode::Pose6 pose;
+  EXPECT_TRUE(pose.empty());
+  pose.setX(1.5);
+  pose.setC(-2.0);
+  EXPECT_EQ(pose.x(), std::optional<double>(1.5));
+  EXPECT_FALSE(pose.y().has_value());
+  EXPECT_EQ(pose.get(gcode::PoseAxis::C), std::optional<double>(-2.0));
+  EXPECT_EQ(pose.mask(), 0x21u);
+
+  gcode::Pose6 other;
+  other.setX(1.5);
+  other.setY(7.0);
+  EXPECT_NE(pose, other);
+  other.setY(std::nullopt);
+  other.setC(-2.0);
+  EXPECT_EQ(pose, other);
+  EXPECT_FALSE(other.has(gcode::PoseAxis::Y));
+
+  gcode::ArcParams arc;
+  arc.setR(0.0);
+  EXPECT_EQ(arc.r(), std::optional<double>(0.0));
+  EXPECT_FALSE(arc.i().has_value());
 }
 
 } // namespace
@@ -62,8 +62,8 @@ TEST(PacketTest, ConvertsAilMotionInstructionsToPackets) {
       result.packets[0].payload));
   const auto &p0 =
       std::get<gcode::MotionLinearPayload>(result.packets[0].payload);
-  ASSERT_TRUE(p0.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*p0.target_pose.x, 1.0));
+  ASSERT_TRUE(p0.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*p0.target_pose.x(), 1.0));
   ASSERT_TRUE(p0.feed.has_value());
   EXPECT_TRUE(closeEnough(*p0.feed, 3.0));
 
@@ -72,8 +72,8 @@ TEST(PacketTest, ConvertsAilMotionInstructionsToPackets) {
   const auto &p1 = std::get<gcode::MotionArcPayload>(result.packets[1].payload);
   EXPECT_TRUE(p1.clockwise);
   EXPECT_EQ(p1.plane_effective, gcode::WorkingPlane::XY);
-  ASSERT_TRUE(p1.arc.i.has_value());
-  EXPECT_TRUE(closeEnough(*p1.arc.i, 6.0));
+  ASSERT_TRUE(p1.arc.i().has_value());
+  EXPECT_TRUE(closeEnough(*p1.arc.i(), 6.0));
 
   ASSERT_TRUE(
       std::holds_alternative<gcode::DwellPayload>(result.packets[2].payload));
@@ -93,10 +93,10 @@ TEST(PacketTest, ConvertsG0LinearMoveToLinearPacket) {
       result.packets[0].payload));
   const auto &payload =
       std::get<gcode::MotionLinearPayload>(result.packets[0].payload);
-  ASSERT_TRUE(payload.target_pose.x.has_value());
-  ASSERT_TRUE(payload.target_pose.y.has_value());
-  EXPECT_TRUE(closeEnough(*payload.target_pose.x, 10.0));
-  EXPECT_TRUE(closeEnough(*payload.target_pose.y, 20.0));
+  ASSERT_TRUE(payload.target_pose.x().has_value());
+  ASSERT_TRUE(payload.target_pose.y().has_value());
+  EXPECT_TRUE(closeEnough(*payload.target_pose.x(), 10.0));
+  EXPECT_TRUE(closeEnough(*payload.target_pose.y(), 20.0));
   ASSERT_TRUE(payload.feed.has_value());
   EXPECT_TRUE(closeEnough(*payload.feed, 500.0));
 }
@@ -210,6 +210,27 @@ TEST(PacketTest, ArcPacketIncludesEffectiveWorkingPlane) {
   EXPECT_EQ(json["packets"][0]["payload"]["plane_effective"], "yz");
 }
 
+TEST(MotionTableTest, PacketTableMatchesAilTable) {
+  const std::string input = "G1 X1 F2\nM3\nG2 X2 Y2 I1 J0\nG4 S1\nG0 Z5\n";
+  const auto ail = gcode::parseAndLowerAil(input);
+  const auto from_ail = gcode::buildMotionTable(ail);
+  const auto from_packets =
+      gcode::buildMotionTable(gcode::lowerAilToPackets(ail));
+
+  ASSERT_EQ(from_packets.size(), 3u);
+  EXPECT_EQ(from_packets.kind, from_ail.kind);
+  EXPECT_EQ(from_packets.source_line, from_ail.source_line);
+  EXPECT_EQ(from_packets.x.values, from_ail.x.values);
+  EXPECT_EQ(from_packets.x.present, from_ail.x.present);
+  EXPECT_EQ(from_packets.feed.present, from_ail.feed.present);
+  EXPECT_EQ(from_packets.arcs.row, from_ail.arcs.row);
+  EXPECT_EQ(from_packets.arcs.i.values, from_ail.arcs.i.values);
+  // Rows index packets; M3 has none, and G4 has no row.
+  EXPECT_EQ(from_ail.instruction, (std::vector<uint32_t>{0, 2, 4}));
+  EXPECT_EQ(from_packets.instruction, (std::vector<uint32_t>{0, 1, 3}));
+  EXPECT_EQ(from_packets.kind[2], gcode::MotionKind::Rapid);
+}
+
 TEST(PacketTest, JsonContainsStableSchema) {
   const auto result = gcode::parseLowerAndPacketize("G1 X10\nG4 F3\n");
   const auto json = nlohmann::json::parse(gcode::packetToJsonString(result));
@@ -1,13 +1,20 @@
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
 #include "gtest/gtest.h"
 
 #include "ast_printer.h"
+#include "gcode/compact_ast.h"
 #include "gcode/gcode_parser.h"
 
 namespace {
@@ -20,14 +27,24 @@ std::string readFile(const std::filesystem::path &path) {
 }
 
 void expectGolden(const std::filesystem::path &input_path,
-                  const std::filesystem::path &golden_path) {
+                  const std::filesystem::path &golden_path,
+                  const gcode::ParseOptions &options = {}) {
   const auto input = readFile(input_path);
   const auto expected = readFile(golden_path);
-  const auto result = gcode::parse(input);
+  const auto result = gcode::parse(input, options);
   const auto actual = gcode::format(result);
   EXPECT_EQ(actual, expected) << "golden mismatch: " << input_path.filename();
 }
 
+void expectSameAsAntlrOnlyParse(const std::string &input) {
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  EXPECT_EQ(gcode::formatJson(gcode::parse(input), false),
+            gcode::formatJson(gcode::parse(input, antlr_only), false))
+      << "fast block path mismatch for input:\n"
+      << input;
+}
+
 TEST(ParserGoldenTest, G1Samples) {
   const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
   const auto testdata = source_dir / "testdata";
@@ -47,6 +64,433 @@ TEST(ParserGoldenTest, CombinedSamples) {
   expectGolden(testdata / "sample1.ngc", testdata / "sample1.golden.txt");
 }
 
+TEST(ParserFastBlockPathTest, GoldenSamplesMatchWithFastPathDisabled) {
+  const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
+  const auto testdata = source_dir / "testdata";
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  expectGolden(testdata / "g1_samples.ngc", testdata / "g1_samples.golden.txt",
+               antlr_only);
+  expectGolden(testdata / "g2g3_samples.ngc",
+               testdata / "g2g3_samples.golden.txt", antlr_only);
+  expectGolden(testdata / "sample1.ngc", testdata / "sample1.golden.txt",
+               antlr_only);
+}
+
+TEST(ParserFastBlockPathTest, MixedAndEdgeInputsMatchAntlrOnlyParse) {
+  const std::vector<std::string> inputs = {
+      "N1234 G1 X12.345 Y-3.2 F1500\n",
+      "G1X1Y2\nG1 X1.Y.5 Z+3 A-.25\nx1 y2 g1\n",
+      "/ G1 X1\n/3 N10 G1 X2\n/12 G1\n/1.5 G1\n//comment\n",
+      "N10 N20 G1 ; trailing N30 (x\nG1 (a) X1 (b)\n",
+      "G1 X1\r\nG1 X2\r\n\r\nG1 X3",
+      "G1 X1\rG1 X2\n",
+      "G1 X1 (open\nG1 X2\nclose) G1 X3\n",
+      "G1 X1 (* block\nG1 X2\n( inner *)\nG1 X3\n",
+      "G2 X1 I=AC(2) J=AC(-.5) XAC(3)\nG1 X=AC(foo)\n",
+      "R1 = 5\nG1 X=R1\nIF R1 == 5 GOTOF END\nG1 X2\nEND:\nM30\n",
+      "G1 X1\nTO\nfor\nG1 X2\n",
+      "PROC SHAPE\nG1 X1\nM17\n",
+      "G1 @\nG1 X1\nG1 X-\n",
+      "G1 X$AA_IM[X]\nG1 \"SHAPE\" X1\n",
+      "G1 X1 ; \xe6\xb3\xa8\xe9\x87\x8a\nG1 (\xe6\xb3\xa8) X1\n",
+      "%MAIN_PROG\nN10 G1 X1\nR2=3\n",
+      "\n\n   \n\t\nG1",
+      "G1 X1\n   ",
+      "N99999999999 G1\n/99999999999 G1\n",
+      "\xEF\xBB\xBFG1 X1\nR1 = 2\n",
+      "G1 X1\n\xEF\xBB\xBFR1 = 2\nG1 X2\n",
+      "",
+  };
+  for (const auto &input : inputs) {
+    expectSameAsAntlrOnlyParse(input);
+  }
+}
+
+TEST(ParserPredictionModeTest, ReportsPredictionStageUsed) {
+  EXPECT_EQ(gcode::parse("N10 G1 X1\n").prediction_stage,
+            gcode::ParsePredictionStage::None);
+  EXPECT_EQ(gcode::parse("R1 = 5\nG1 X1\n").prediction_stage,
+            gcode::ParsePredictionStage::Sll);
+  EXPECT_EQ(gcode::parse("G1 X1 =\n").prediction_stage,
+            gcode::ParsePredictionStage::Ll);
+
+  gcode::ParseOptions ll_only;
+  ll_only.prediction_mode = gcode::ParsePredictionMode::Ll;
+  EXPECT_EQ(gcode::parse("R1 = 5\n", ll_only).prediction_stage,
+            gcode::ParsePredictionStage::Ll);
+}
+
+TEST(ParserPredictionModeTest, SllThenLlMatchesLlOnly) {
+  const std::vector<std::string> inputs = {
+      "R1 = 5\nIF R1 == 5 GOTOF END\nEND:\n",
+      "WHILE R1 < 3\nR1 = R1 + 1\nENDWHILE\n",
+      "G1 X1 =\nG1 @\nR1 = (2\n",
+      "IF R1 >\nFOR R2 = 1 TO\nGOTO\n",
+      "N10 G1 X1\nG1 X$AA_IM[X]\n\"NAME\" P2\n",
+      // Lines built before the SLL attempt bails must not leak into the
+      // result.
+      "R1 = 1\nR2 = R1 * 2\nG1 X1 =\nR3 = 3\n",
+  };
+  gcode::ParseOptions ll_only;
+  ll_only.enable_fast_block_path = false;
+  ll_only.prediction_mode = gcode::ParsePredictionMode::Ll;
+  gcode::ParseOptions two_stage;
+  two_stage.enable_fast_block_path = false;
+  for (const auto &input : inputs) {
+    EXPECT_EQ(gcode::formatJson(gcode::parse(input, two_stage), false),
+              gcode::formatJson(gcode::parse(input, ll_only), false))
+        << input;
+  }
+}
+
+TEST(ParserContextTest, ReusedContextMatchesFreshContext) {
+  const std::vector<std::string> inputs = {
+      "R1 = 5\nIF R1 == 5 GOTOF END\nEND:\n",
+      "G1 X1 =\nG1 @\nR1 = (2\n",
+      "R1 = 1\nR2 = R1 * 2\nG1 X1 =\nR3 = 3\n",
+      "WHILE R1 < 3\nR1 = R1 + 1\nENDWHILE\n",
+      "G1 X1 (open\n",
+      "R1 = 5",
+      "",
+      "N10 G1 X1\nG1 X$AA_IM[X]\n\"NAME\" P2\n",
+  };
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  gcode::ParseOptions ll_only = antlr_only;
+  ll_only.prediction_mode = gcode::ParsePredictionMode::Ll;
+  gcode::ParserContext reused;
+  // Each input follows parses that failed, bailed out or ended mid-comment.
+  for (int round = 0; round < 2; ++round) {
+    for (const auto &options : {gcode::ParseOptions{}, antlr_only, ll_only}) {
+      for (const auto &input : inputs) {
+        gcode::ParserContext fresh;
+        const std::string expected =
+            gcode::formatJson(gcode::parse(input, options, fresh), false);
+        EXPECT_EQ(gcode::formatJson(gcode::parse(input, options, reused),
+                                    false),
+                  expected)
+            << input;
+        EXPECT_EQ(gcode::formatJson(gcode::parse(input, options), false),
+                  expected)
+            << input;
+      }
+    }
+  }
+}
+
+TEST(ParserContextTest, ConcurrentParsesMatchSerialParseWithEitherDfaCache) {
+  const std::vector<std::string> inputs = {
+      "R1 = 5\nIF R1 == 5 GOTOF END\nEND:\n",
+      "WHILE R1 < 3\nR1 = R1 + 1\nENDWHILE\n",
+      "G1 X1 =\nG1 @\nR1 = (2\n",
+      "N10 G1 X1\nFOR R2 = 1 TO 3\nENDFOR\n",
+  };
+  std::vector<std::string> expected;
+  for (const auto &input : inputs) {
+    expected.push_back(gcode::formatJson(gcode::parse(input), false));
+  }
+  for (const auto dfa_cache :
+       {gcode::ParserDfaCache::Shared, gcode::ParserDfaCache::PerContext}) {
+    gcode::ParseOptions options;
+    options.dfa_cache = dfa_cache;
+    options.enable_fast_block_path = false;
+    std::vector<int> mismatches(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < mismatches.size(); ++t) {
+      threads.emplace_back([&, t]() {
+        gcode::ParserContext context;
+        for (int round = 0; round < 20; ++round) {
+          for (size_t i = 0; i < inputs.size(); ++i) {
+            const auto &result = t % 2 == 0
+                                     ? gcode::parse(inputs[i], options, context)
+                                     : gcode::parse(inputs[i], options);
+            if (gcode::formatJson(result, false) != expected[i]) {
+              ++mismatches[t];
+            }
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    for (int count : mismatches) {
+      EXPECT_EQ(count, 0);
+    }
+  }
+}
+
+TEST(ParserWarmUpTest, WarmUpAndClearingCachesKeepResults) {
+  const std::string input =
+      "R1 = 5\nIF R1 == 5 GOTOF END\nWHILE R1 < 3\nENDWHILE\nG1 X1 =\nEND:\n";
+  const std::string expected = gcode::formatJson(gcode::parse(input), false);
+  gcode::clearParserCaches();
+  EXPECT_EQ(gcode::formatJson(gcode::parse(input), false), expected);
+  gcode::clearParserCaches();
+  gcode::warmUpParser({"R2 = R2 + 1\n", "G1 X1 @\n"});
+  EXPECT_EQ(gcode::formatJson(gcode::parse(input), false), expected);
+}
+
+// About 400 KB of plain blocks with `insert` spliced in at `insert_line`,
+// large enough to be split into several parallel chunks.
+std::string makeLargeProgram(const std::string &insert, int insert_line) {
+  std::string text;
+  for (int i = 1; i <= 20000; ++i) {
+    if (i == insert_line) {
+      text += insert;
+    }
+    text += "N" + std::to_string(i) + " G1 X" + std::to_string(i % 97) +
+            ".5 Y-2 F1200\n";
+  }
+  return text;
+}
+
+TEST(ParserParallelParseTest, ChunkedParseMatchesSerialParse) {
+  const std::vector<std::string> inputs = {
+      makeLargeProgram("", 0),
+      makeLargeProgram("R1 = R1 + 1\nIF R1 > 3 GOTOF END\nEND:\n", 7000),
+      makeLargeProgram("G1 X1 (open\nG1 X2\nclose) G1 X3\n", 9000),
+      makeLargeProgram("G1 @\nR1 = (2\n", 15000),
+      makeLargeProgram("(* block\nG1 X2\n*)\n", 3000),
+      "%MAIN\n" + makeLargeProgram("G1 X1\r\n", 12000) + "G1 X9",
+  };
+  for (const bool fast_path : {true, false}) {
+    gcode::ParseOptions serial;
+    serial.enable_fast_block_path = fast_path;
+    for (const unsigned threads : {4u, 0u}) {
+      gcode::ParseOptions parallel = serial;
+      parallel.parse_threads = threads;
+      for (const auto &input : inputs) {
+        EXPECT_EQ(gcode::formatJson(gcode::parse(input, parallel), false),
+                  gcode::formatJson(gcode::parse(input, serial), false))
+            << "threads=" << threads << " fast_path=" << fast_path;
+      }
+    }
+  }
+}
+
+gcode::ParseResult toParseResult(const gcode::CompactParseResult &compact) {
+  gcode::ParseResult result;
+  result.program.program_name = compact.program_name;
+  for (const auto &line : compact.lines) {
+    result.program.lines.push_back(gcode::toLine(compact, line));
+  }
+  result.diagnostics = compact.diagnostics;
+  result.prediction_stage = compact.prediction_stage;
+  return result;
+}
+
+TEST(ParserCompactAstTest, GoldenSamplesMatchParse) {
+  const std::filesystem::path source_dir(GCODE_SOURCE_DIR);
+  const auto testdata = source_dir / "testdata";
+  for (const char *name : {"g1_samples", "g2g3_samples", "sample1"}) {
+    const auto input = readFile(testdata / (std::string(name) + ".ngc"));
+    const auto expected =
+        readFile(testdata / (std::string(name) + ".golden.txt"));
+    EXPECT_EQ(gcode::format(toParseResult(gcode::parseCompact(input))),
+              expected)
+        << name;
+  }
+}
+
+TEST(ParserCompactAstTest, MixedInputsMatchParse) {
+  const std::vector<std::string> inputs = {
+      "N1234 G1 X12.345 Y-3.2 F1500\n",
+      "G1X1Y2\nx1 y2 g1\nG1 X=R1\n",
+      "/ G1 X1\n/3 N10 G1 X2\n/12 G1\n//comment\n",
+      "G1 X1 (open\nG1 X2\nclose) G1 X3\n",
+      "G1 X1 (* block\nG1 X2\n*)\nG1 X3\n",
+      "R1 = 5\nIF R1 == 5 GOTOF END\nG1 X2\nEND:\nM30\n",
+      "N10 G1\nN10 G1\nGOTOB N10\n",
+      "WHILE R1 < 3\nR1 = R1 + 1\nENDWHILE\n",
+      "G1 @\nG1 X1\nG1 X-\n",
+      "G1 \"SHAPE\" X1\nT=\"DRILL\"\nM6\n",
+      "G0 G1 X1\nG2 X1 AP=3 RP=2\nM3 M5 M99.1\nT1 TX\nM98 P100\n",
+      "%MAIN_PROG\nN10 G1 X1\nR2=3\nG1 X$\n",
+      "G1 X1 ; \xe6\xb3\xa8\xe9\x87\x8a\n\xEF\xBB\xBFR1 = 2\n",
+      makeLargeProgram("R1 = R1 + 1\nG1 @\n", 30),
+      "",
+  };
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  gcode::ParseOptions ll_only;
+  ll_only.prediction_mode = gcode::ParsePredictionMode::Ll;
+  gcode::ParseOptions iso;
+  iso.enable_iso_m98_calls = true;
+  iso.tool_management = true;
+  gcode::ParseOptions shifted;
+  shifted.first_line = 7;
+  for (const auto &options :
+       {gcode::ParseOptions{}, antlr_only, ll_only, iso, shifted}) {
+    for (const auto &input : inputs) {
+      EXPECT_EQ(gcode::formatJson(
+                    toParseResult(gcode::parseCompact(input, options)), false),
+                gcode::formatJson(gcode::parse(input, options), false))
+          << input.substr(0, 200);
+    }
+  }
+}
+
+TEST(ParserCompactAstTest, TextViewsOutliveInput) {
+  static_assert(std::is_trivially_destructible_v<gcode::CompactLineItem>);
+  static_assert(std::is_trivially_destructible_v<gcode::CompactLine>);
+
+  auto input = std::make_unique<std::string>("N10 g1 x1 (cut)\nR1 = 2\n");
+  const auto result = gcode::parseCompact(*input);
+  input.reset();
+
+  ASSERT_EQ(result.lines.size(), 2u);
+  EXPECT_EQ(result.lines[0].item_count, 3u);
+  EXPECT_EQ(result.lines[0].statement_index, -1);
+  const auto &word = std::get<gcode::CompactWord>(result.items[0]);
+  EXPECT_EQ(word.text, "g1");
+  EXPECT_EQ(word.head, "G");
+  ASSERT_TRUE(word.value.has_value());
+  EXPECT_EQ(*word.value, "1");
+  EXPECT_EQ(std::get<gcode::CompactComment>(result.items[2]).text, "(cut)");
+
+  ASSERT_EQ(result.lines[1].statement_index, 0);
+  ASSERT_EQ(result.statement_lines.size(), 1u);
+  EXPECT_TRUE(result.statement_lines[0].assignment().has_value());
+  EXPECT_TRUE(gcode::toLine(result, result.lines[1]).assignment().has_value());
+}
+
+TEST(ParserWordSymbolTest, ParsedWordsCarryResolvedSymbols) {
+  const std::string input = "g1 x1 CR=5 H2 \"PROC\"\nRTLION\nY3\n";
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  for (const auto &options : {gcode::ParseOptions{}, antlr_only}) {
+    const auto result = gcode::parse(input, options);
+    std::vector<gcode::WordSymbol> symbols;
+    for (const auto &line : result.program.lines) {
+      for (const auto &item : line.items) {
+        if (const auto *word = std::get_if<gcode::Word>(&item)) {
+          symbols.push_back(word->symbol);
+        }
+      }
+    }
+    const std::vector<gcode::WordSymbol> expected = {
+        gcode::WordSymbol::G,     gcode::WordSymbol::X,
+        gcode::WordSymbol::CR,    gcode::WordSymbol::Other,
+        gcode::WordSymbol::PROC,  gcode::WordSymbol::RTLION,
+        gcode::WordSymbol::Y};
+    EXPECT_EQ(symbols, expected);
+  }
+
+  gcode::Word hand_built;
+  hand_built.head = "AP";
+  EXPECT_EQ(hand_built.symbol, gcode::WordSymbol::Unresolved);
+  EXPECT_EQ(gcode::wordSymbol(hand_built), gcode::WordSymbol::AP);
+}
+
+TEST(ParserLineStatementTest, LineHoldsOneTaggedStatement) {
+  const auto result = gcode::parse("R1 = 2\nGOTOF END\nG1 X1\n");
+  ASSERT_TRUE(result.diagnostics.empty());
+  ASSERT_EQ(result.program.lines.size(), 3u);
+
+  const auto &assign_line = result.program.lines[0];
+  ASSERT_TRUE(assign_line.statement.has_value());
+  EXPECT_TRUE(
+      std::holds_alternative<gcode::Assignment>(*assign_line.statement));
+  ASSERT_TRUE(assign_line.assignment());
+  EXPECT_EQ(assign_line.assignment()->lhs, "R1");
+  EXPECT_FALSE(assign_line.goto_statement().has_value());
+  EXPECT_THROW(assign_line.goto_statement().value(), std::bad_optional_access);
+
+  EXPECT_EQ(result.program.lines[1].goto_statement()->target, "END");
+  EXPECT_FALSE(result.program.lines[2].statement.has_value());
+  EXPECT_FALSE(result.program.lines[2].assignment().has_value());
+
+  gcode::Line copy = assign_line;
+  copy.assignment()->lhs = "R2";
+  EXPECT_EQ(assign_line.assignment()->lhs, "R1");
+  copy.statement.emplace(gcode::EndIfStatement{});
+  EXPECT_TRUE(copy.endif_statement().has_value());
+  EXPECT_FALSE(copy.assignment().has_value());
+}
+
+TEST(ParserWordNumberTest, ParsedWordsCarryNumericValues) {
+  const std::string input = "G01 X-1.5 Y=AC(2) F.5\n";
+  gcode::ParseOptions antlr_only;
+  antlr_only.enable_fast_block_path = false;
+  for (const auto &options : {gcode::ParseOptions{}, antlr_only}) {
+    const auto result = gcode::parse(input, options);
+    ASSERT_TRUE(result.diagnostics.empty());
+    ASSERT_EQ(result.program.lines.size(), 1u);
+    const auto &items = result.program.lines[0].items;
+    ASSERT_EQ(items.size(), 4u);
+    const auto &g = std::get<gcode::Word>(items[0]);
+    EXPECT_EQ(g.number, 1.0);
+    EXPECT_EQ(g.integer, 1);
+    const auto &x = std::get<gcode::Word>(items[1]);
+    EXPECT_EQ(x.number, -1.5);
+    EXPECT_EQ(x.integer, -1);
+    const auto &y = std::get<gcode::Word>(items[2]);
+    EXPECT_FALSE(y.number.has_value());
+    EXPECT_FALSE(y.integer.has_value());
+    const auto &f = std::get<gcode::Word>(items[3]);
+    EXPECT_EQ(f.number, 0.5);
+    EXPECT_FALSE(f.integer.has_value());
+  }
+
+  gcode::Word hand_built;
+  hand_built.head = "X";
+  hand_built.value = "2.25";
+  EXPECT_EQ(gcode::wordNumber(hand_built), 2.25);
+  EXPECT_EQ(gcode::wordInteger(hand_built), 2);
+  // A resolved symbol alone does not mean the numbers were cached.
+  hand_built.symbol = gcode::WordSymbol::X;
+  EXPECT_EQ(gcode::wordNumber(hand_built), 2.25);
+  EXPECT_EQ(gcode::wordInteger(hand_built), 2);
+}
+
+TEST(ParserWordNumberTest, NumberPrefixesFollowStodAndStoi) {
+  EXPECT_EQ(gcode::parseNumberPrefix(" 7abc"), 7.0);
+  EXPECT_EQ(gcode::parseNumberPrefix("+.25"), 0.25);
+  EXPECT_EQ(gcode::parseNumberPrefix("0x10"), 16.0);
+  EXPECT_FALSE(gcode::parseNumberPrefix("1e-400").has_value());
+  EXPECT_FALSE(gcode::parseNumberPrefix("1e400").has_value());
+  EXPECT_FALSE(gcode::parseNumberPrefix("+-1").has_value());
+  EXPECT_FALSE(gcode::parseNumberPrefix("$P_X").has_value());
+
+  EXPECT_EQ(gcode::parseIntegerPrefix("17.9"), 17);
+  EXPECT_EQ(gcode::parseIntegerPrefix("+4"), 4);
+  EXPECT_EQ(gcode::parseIntegerPrefix("1e3"), 1);
+  EXPECT_FALSE(gcode::parseIntegerPrefix("99999999999").has_value());
+  EXPECT_FALSE(gcode::parseIntegerPrefix("-").has_value());
+}
+
+TEST(ParserCharStreamTest, MultibyteTextKeepsColumnsAndErrorText) {
+  const auto result =
+      gcode::parse("G1 (\xc3\xa9\xc3\xa9) X1 \xe2\x82\xac\n");
+  ASSERT_EQ(result.diagnostics.size(), 1u);
+  EXPECT_NE(result.diagnostics[0].message.find(
+                "token recognition error at: '\xe2\x82\xac'"),
+            std::string::npos);
+  EXPECT_EQ(result.diagnostics[0].location.line, 1);
+  EXPECT_EQ(result.diagnostics[0].location.column, 12);
+
+  ASSERT_EQ(result.program.lines.size(), 1u);
+  const auto &items = result.program.lines[0].items;
+  ASSERT_EQ(items.size(), 3u);
+  const auto *comment = std::get_if<gcode::Comment>(&items[1]);
+  ASSERT_NE(comment, nullptr);
+  EXPECT_EQ(comment->text, "(\xc3\xa9\xc3\xa9)");
+  const auto *word = std::get_if<gcode::Word>(&items[2]);
+  ASSERT_NE(word, nullptr);
+  EXPECT_EQ(word->text, "X1");
+  EXPECT_EQ(word->location.column, 9);
+}
+
+TEST(ParserCharStreamTest, SkipsLeadingByteOrderMark) {
+  const auto result = gcode::parse("\xEF\xBB\xBFR1 = 2\nG1 X1\n");
+  EXPECT_TRUE(result.diagnostics.empty());
+  ASSERT_EQ(result.program.lines.size(), 2u);
+  ASSERT_TRUE(result.program.lines[0].assignment().has_value());
+  EXPECT_EQ(result.program.lines[0].assignment()->location.column, 1);
+}
+
 TEST(ParserDiagnosticsTest, ActionableSyntaxAndSemanticMessages) {
   {
     const auto result = gcode::parse("G1 @\n");
@@ -76,19 +520,19 @@ TEST(ParserExpressionTest, ParsesAssignmentExpressionIntoAst) {
   const auto result = gcode::parse("R1 = $P_ACT_X + 2*R2\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 1u);
-  ASSERT_TRUE(result.program.lines[0].assignment.has_value());
-  EXPECT_EQ(result.program.lines[0].assignment->lhs, "R1");
+  ASSERT_TRUE(result.program.lines[0].assignment().has_value());
+  EXPECT_EQ(result.program.lines[0].assignment()->lhs, "R1");
 }
 
 TEST(ParserExpressionTest, MarksSimpleSystemVariableOperandInAssignmentAst) {
   const auto result = gcode::parse("R1 = $P_ACT_X + 1\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 1u);
-  ASSERT_TRUE(result.program.lines[0].assignment.has_value());
-  ASSERT_TRUE(result.program.lines[0].assignment->rhs != nullptr);
+  ASSERT_TRUE(result.program.lines[0].assignment().has_value());
+  ASSERT_TRUE(result.program.lines[0].assignment()->rhs != nullptr);
 
   const auto *binary = std::get_if<gcode::ExprBinary>(
-      &result.program.lines[0].assignment->rhs->node);
+      &result.program.lines[0].assignment()->rhs->node);
   ASSERT_NE(binary, nullptr);
   const auto *lhs = std::get_if<gcode::ExprVariable>(&binary->lhs->node);
   ASSERT_NE(lhs, nullptr);
@@ -109,22 +553,22 @@ TEST(ParserControlFlowTest, ParsesGotoAndLabelWithUnderscore) {
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 2u);
 
-  ASSERT_TRUE(result.program.lines[0].goto_statement.has_value());
-  EXPECT_EQ(result.program.lines[0].goto_statement->opcode, "GOTO");
-  EXPECT_EQ(result.program.lines[0].goto_statement->target, "END_CODE");
-  EXPECT_EQ(result.program.lines[0].goto_statement->target_kind, "label");
+  ASSERT_TRUE(result.program.lines[0].goto_statement().has_value());
+  EXPECT_EQ(result.program.lines[0].goto_statement()->opcode, "GOTO");
+  EXPECT_EQ(result.program.lines[0].goto_statement()->target, "END_CODE");
+  EXPECT_EQ(result.program.lines[0].goto_statement()->target_kind, "label");
 
-  ASSERT_TRUE(result.program.lines[1].label_definition.has_value());
-  EXPECT_EQ(result.program.lines[1].label_definition->name, "END_CODE");
+  ASSERT_TRUE(result.program.lines[1].label_definition().has_value());
+  EXPECT_EQ(result.program.lines[1].label_definition()->name, "END_CODE");
 }
 
 TEST(ParserControlFlowTest, ParsesIfThenElseGoto) {
   const auto result = gcode::parse("IF R1-2 GOTOF END_CODE ELSE GOTOB RETRY\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 1u);
-  ASSERT_TRUE(result.program.lines[0].if_goto_statement.has_value());
+  ASSERT_TRUE(result.program.lines[0].if_goto_statement().has_value());
 
-  const auto &if_stmt = *result.program.lines[0].if_goto_statement;
+  const auto &if_stmt = *result.program.lines[0].if_goto_statement();
   EXPECT_EQ(if_stmt.then_branch.opcode, "GOTOF");
   EXPECT_EQ(if_stmt.then_branch.target, "END_CODE");
   ASSERT_TRUE(if_stmt.else_branch.has_value());
@@ -137,27 +581,28 @@ TEST(ParserControlFlowTest, ParsesGotoTargetKinds) {
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 3u);
 
-  ASSERT_TRUE(result.program.lines[0].goto_statement.has_value());
-  EXPECT_EQ(result.program.lines[0].goto_statement->target_kind, "line_number");
-  EXPECT_EQ(result.program.lines[0].goto_statement->target, "N100");
+  ASSERT_TRUE(result.program.lines[0].goto_statement().has_value());
+  EXPECT_EQ(result.program.lines[0].goto_statement()->target_kind,
+            "line_number");
+  EXPECT_EQ(result.program.lines[0].goto_statement()->target, "N100");
 
-  ASSERT_TRUE(result.program.lines[1].goto_statement.has_value());
-  EXPECT_EQ(result.program.lines[1].goto_statement->target_kind, "number");
-  EXPECT_EQ(result.program.lines[1].goto_statement->target, "200");
+  ASSERT_TRUE(result.program.lines[1].goto_statement().has_value());
+  EXPECT_EQ(result.program.lines[1].goto_statement()->target_kind, "number");
+  EXPECT_EQ(result.program.lines[1].goto_statement()->target, "200");
 
-  ASSERT_TRUE(result.program.lines[2].goto_statement.has_value());
-  EXPECT_EQ(result.program.lines[2].goto_statement->target_kind,
+  ASSERT_TRUE(result.program.lines[2].goto_statement().has_value());
+  EXPECT_EQ(result.program.lines[2].goto_statement()->target_kind,
             "system_variable");
-  EXPECT_EQ(result.program.lines[2].goto_statement->target, "$DEST");
+  EXPECT_EQ(result.program.lines[2].goto_statement()->target, "$DEST");
 }
 
 TEST(ParserControlFlowTest, ParsesIfConditionWithSimpleSystemVariable) {
   const auto result = gcode::parse("IF $P_ACT_X == 1 GOTOF LBL\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 1u);
-  ASSERT_TRUE(result.program.lines[0].if_goto_statement.has_value());
+  ASSERT_TRUE(result.program.lines[0].if_goto_statement().has_value());
 
-  const auto &cond = result.program.lines[0].if_goto_statement->condition;
+  const auto &cond = result.program.lines[0].if_goto_statement()->condition;
   ASSERT_TRUE(cond.lhs != nullptr);
   const auto *lhs = std::get_if<gcode::ExprVariable>(&cond.lhs->node);
   ASSERT_NE(lhs, nullptr);
@@ -169,11 +614,11 @@ TEST(ParserExpressionTest, ParsesSingleSelectorSystemVariableInAssignment) {
   const auto result = gcode::parse("R1 = $A_IN[1]\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 1u);
-  ASSERT_TRUE(result.program.lines[0].assignment.has_value());
-  ASSERT_TRUE(result.program.lines[0].assignment->rhs != nullptr);
+  ASSERT_TRUE(result.program.lines[0].assignment().has_value());
+  ASSERT_TRUE(result.program.lines[0].assignment()->rhs != nullptr);
 
   const auto *rhs = std::get_if<gcode::ExprVariable>(
-      &result.program.lines[0].assignment->rhs->node);
+      &result.program.lines[0].assignment()->rhs->node);
   ASSERT_NE(rhs, nullptr);
   EXPECT_TRUE(rhs->is_system);
   EXPECT_EQ(rhs->name, "$A_IN[1]");
@@ -183,9 +628,9 @@ TEST(ParserControlFlowTest, ParsesSingleSelectorSystemVariableInCondition) {
   const auto result = gcode::parse("IF $AA_IM[X] == 1 GOTOF LBL\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 1u);
-  ASSERT_TRUE(result.program.lines[0].if_goto_statement.has_value());
+  ASSERT_TRUE(result.program.lines[0].if_goto_statement().has_value());
 
-  const auto &cond = result.program.lines[0].if_goto_statement->condition;
+  const auto &cond = result.program.lines[0].if_goto_statement()->condition;
   ASSERT_TRUE(cond.lhs != nullptr);
   const auto *lhs = std::get_if<gcode::ExprVariable>(&cond.lhs->node);
   ASSERT_NE(lhs, nullptr);
@@ -241,17 +686,17 @@ TEST(ParserControlFlowTest, ParsesStructuredControlFlowStatements) {
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 11u);
 
-  EXPECT_TRUE(result.program.lines[0].if_block_start_statement.has_value());
-  EXPECT_TRUE(result.program.lines[1].else_statement.has_value());
-  EXPECT_TRUE(result.program.lines[2].endif_statement.has_value());
-  EXPECT_TRUE(result.program.lines[3].while_statement.has_value());
-  EXPECT_TRUE(result.program.lines[4].endwhile_statement.has_value());
-  EXPECT_TRUE(result.program.lines[5].for_statement.has_value());
-  EXPECT_TRUE(result.program.lines[6].endfor_statement.has_value());
-  EXPECT_TRUE(result.program.lines[7].repeat_statement.has_value());
-  EXPECT_TRUE(result.program.lines[8].until_statement.has_value());
-  EXPECT_TRUE(result.program.lines[9].loop_statement.has_value());
-  EXPECT_TRUE(result.program.lines[10].endloop_statement.has_value());
+  EXPECT_TRUE(result.program.lines[0].if_block_start_statement().has_value());
+  EXPECT_TRUE(result.program.lines[1].else_statement().has_value());
+  EXPECT_TRUE(result.program.lines[2].endif_statement().has_value());
+  EXPECT_TRUE(result.program.lines[3].while_statement().has_value());
+  EXPECT_TRUE(result.program.lines[4].endwhile_statement().has_value());
+  EXPECT_TRUE(result.program.lines[5].for_statement().has_value());
+  EXPECT_TRUE(result.program.lines[6].endfor_statement().has_value());
+  EXPECT_TRUE(result.program.lines[7].repeat_statement().has_value());
+  EXPECT_TRUE(result.program.lines[8].until_statement().has_value());
+  EXPECT_TRUE(result.program.lines[9].loop_statement().has_value());
+  EXPECT_TRUE(result.program.lines[10].endloop_statement().has_value());
 }
 
 TEST(ParserControlFlowTest, ParsesStructuredIfWithAndParenthesizedConditions) {
@@ -259,10 +704,10 @@ TEST(ParserControlFlowTest, ParsesStructuredIfWithAndParenthesizedConditions) {
       "IF (R1 == 1) AND (R2 > 10)\nG1 Z-5 F10\nELSE\nG0 X0 Y5\nENDIF\n");
   ASSERT_TRUE(result.diagnostics.empty());
   ASSERT_EQ(result.program.lines.size(), 5u);
-  ASSERT_TRUE(result.program.lines[0].if_block_start_statement.has_value());
+  ASSERT_TRUE(result.program.lines[0].if_block_start_statement().has_value());
 
   const auto &condition =
-      result.program.lines[0].if_block_start_statement->condition;
+      result.program.lines[0].if_block_start_statement()->condition;
   EXPECT_TRUE(condition.has_logical_and);
   ASSERT_EQ(condition.and_terms_raw.size(), 2u);
   EXPECT_EQ(condition.and_terms_raw[0], "(R1 == 1)");
@@ -3,19 +3,28 @@
 #include "gtest/gtest.h"
 
 #include "gcode/ail.h"
+#include "gcode/compact_ail.h"
+#include "gcode/compact_ast.h"
 #include "gcode/condition_runtime.h"
 #include "gcode/execution_commands.h"
 #include "gcode/execution_interfaces.h"
 #include "gcode/execution_runtime.h"
 #include "gcode/execution_session.h"
+#include "gcode/expr_pool.h"
 #include "gcode/gcode_parser.h"
+#include "gcode/motion_table.h"
 #include "gcode/lowering_types.h"
 #include "gcode/policy_types.h"
 #include "gcode/runtime_status.h"
 
 TEST(PublicHeadersTest, PublicFacadeHeadersCompileAndExposeKeyTypes) {
   static_assert(std::is_class_v<gcode::ParseResult>);
+  static_assert(std::is_class_v<gcode::CompactParseResult>);
   static_assert(std::is_class_v<gcode::AilResult>);
+  static_assert(std::is_class_v<gcode::CompactAilResult>);
+  static_assert(std::is_class_v<gcode::ExprPool>);
+  static_assert(std::is_class_v<gcode::MotionTable>);
+  static_assert(std::is_class_v<gcode::ParserContext>);
   static_assert(std::is_class_v<gcode::ExecutionSession>);
   static_assert(std::is_class_v<gcode::IExecutionSink>);
   static_assert(std::is_class_v<gcode::IRuntime>);
@@ -1,4 +1,5 @@
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -97,4 +98,61 @@ TEST(SemanticRulesTest, ReportsG4NumericValueRequired) {
             std::string::npos);
 }
 
+TEST(SemanticRulesTest, ReportsDuplicateLineNumberBeforeLineDiagnostics) {
+  gcode::ParseResult result;
+  for (int i = 1; i <= 3; ++i) {
+    auto line = makeLine(i, {makeWord("G", "4", i, 5)});
+    line.line_number = gcode::LineNumber{10, {i, 1}};
+    result.program.lines.push_back(line);
+  }
+  gcode::GotoStatement jump;
+  jump.target_kind = "line_number";
+  result.program.lines[0].statement.emplace<gcode::GotoStatement>(jump);
+
+  gcode::addSemanticDiagnostics(result, false);
+
+  ASSERT_EQ(result.diagnostics.size(), 5u);
+  EXPECT_NE(result.diagnostics[0].message.find("requires F"),
+            std::string::npos);
+  for (size_t i : {1u, 3u}) {
+    EXPECT_EQ(result.diagnostics[i].severity,
+              gcode::Diagnostic::Severity::Warning);
+    EXPECT_NE(result.diagnostics[i].message.find("duplicate N-address N10"),
+              std::string::npos);
+    EXPECT_EQ(result.diagnostics[i + 1].location.line,
+              result.diagnostics[i].location.line);
+  }
+}
+
+TEST(SemanticRulesTest, ParallelValidationMatchesSingleThread) {
+  gcode::ParseResult single;
+  std::string input;
+  for (int i = 1; i <= 40000; ++i) {
+    auto line = i % 7 == 0 ? makeLine(i, {makeWord("G", "1", i, 5),
+                                          makeWord("G", "2", i, 8)})
+                           : makeLine(i, {makeWord("G", "1", i, 5)});
+    line.line_number = gcode::LineNumber{i % 5000, {i, 1}};
+    single.program.lines.push_back(line);
+    input += std::string(i % 9000 == 0 ? 600 : 10, 'x') + "\n";
+  }
+  gcode::GotoStatement jump;
+  jump.target_kind = "line_number";
+  single.program.lines.back().statement.emplace<gcode::GotoStatement>(jump);
+  gcode::ParseResult parallel = single;
+
+  gcode::addValidationDiagnostics(input, gcode::ParseOptions{}, 1, single);
+  gcode::addValidationDiagnostics(input, gcode::ParseOptions{}, 4, parallel);
+
+  ASSERT_EQ(parallel.diagnostics.size(), single.diagnostics.size());
+  EXPECT_NE(single.diagnostics.front().message.find("block length"),
+            std::string::npos);
+  for (size_t i = 0; i < single.diagnostics.size(); ++i) {
+    EXPECT_EQ(parallel.diagnostics[i].message, single.diagnostics[i].message);
+    EXPECT_EQ(parallel.diagnostics[i].location.line,
+              single.diagnostics[i].location.line);
+    EXPECT_EQ(parallel.diagnostics[i].location.column,
+              single.diagnostics[i].location.column);
+  }
+}
+
 } // namespace
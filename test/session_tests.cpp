@@ -39,12 +39,12 @@ TEST(SessionTest, EditAndResumeFromErrorLine) {
   EXPECT_EQ(m1->source.line, 1);
   EXPECT_EQ(m2->source.line, 2);
   EXPECT_EQ(m3->source.line, 3);
-  ASSERT_TRUE(m1->target_pose.x.has_value());
-  ASSERT_TRUE(m2->target_pose.x.has_value());
-  ASSERT_TRUE(m3->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*m1->target_pose.x, 10.0));
-  EXPECT_TRUE(closeEnough(*m2->target_pose.x, 15.0));
-  EXPECT_TRUE(closeEnough(*m3->target_pose.x, 20.0));
+  ASSERT_TRUE(m1->target_pose.x().has_value());
+  ASSERT_TRUE(m2->target_pose.x().has_value());
+  ASSERT_TRUE(m3->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*m1->target_pose.x(), 10.0));
+  EXPECT_TRUE(closeEnough(*m2->target_pose.x(), 15.0));
+  EXPECT_TRUE(closeEnough(*m3->target_pose.x(), 20.0));
 }
 
 TEST(SessionTest, MessageOrderingIsDeterministicAfterEdit) {
@@ -63,8 +63,8 @@ TEST(SessionTest, MessageOrderingIsDeterministicAfterEdit) {
   EXPECT_EQ(m1->source.line, 1);
   EXPECT_EQ(m2->source.line, 2);
   EXPECT_EQ(m3->source.line, 3);
-  ASSERT_TRUE(m2->target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*m2->target_pose.x, 22.0));
+  ASSERT_TRUE(m2->target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*m2->target_pose.x(), 22.0));
 }
 
 } // namespace
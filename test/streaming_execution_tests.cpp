@@ -99,6 +99,194 @@ TEST(StreamingExecutionTest, CrlfInputProducesSingleLogicalLine) {
   EXPECT_EQ(engine.state(), gcode::EngineState::ReadyToExecute);
 }
 
+TEST(StreamingExecutionTest, LineBufferSplitsCrlfAcrossChunks) {
+  gcode::LineBuffer buffer;
+  gcode::LineBuffer::Span line;
+  buffer.append("G1 X1\r");
+  EXPECT_FALSE(buffer.nextLine(&line));
+  buffer.append("\nG1 X2\r\nG1");
+  ASSERT_TRUE(buffer.nextLine(&line));
+  EXPECT_EQ(buffer.text(line), "G1 X1");
+  ASSERT_TRUE(buffer.nextLine(&line));
+  EXPECT_EQ(buffer.text(line), "G1 X2");
+  EXPECT_FALSE(buffer.nextLine(&line));
+  buffer.append(" X3\r");
+  EXPECT_FALSE(buffer.nextLine(&line));
+  ASSERT_TRUE(buffer.finishLine(&line));
+  EXPECT_EQ(buffer.text(line), "G1 X3\r");
+  EXPECT_EQ(buffer.textFrom(0), "G1 X1\nG1 X2\nG1 X3\r\n");
+  EXPECT_FALSE(buffer.finishLine(&line));
+
+  buffer.dropCompleteLines();
+  buffer.append("G1 X4\n");
+  ASSERT_TRUE(buffer.nextLine(&line));
+  EXPECT_EQ(line.begin, 0u);
+  EXPECT_EQ(buffer.textFrom(0), "G1 X4\n");
+}
+
+TEST(StreamingExecutionTest, MotionWindowCompletesAfterMovesInFlight) {
+  class PendingRuntime : public ReadyRuntime {
+  public:
+    gcode::RuntimeResult<gcode::WaitToken>
+    submitLinearMove(const gcode::LinearMoveCommand &) override {
+      gcode::RuntimeResult<gcode::WaitToken> result;
+      result.status = gcode::RuntimeCallStatus::Pending;
+      result.wait_token =
+          gcode::WaitToken{"motion", std::to_string(++linear_calls)};
+      return result;
+    }
+    int linear_calls = 0;
+  };
+
+  NullSink sink;
+  PendingRuntime runtime;
+  StaticCancellation cancellation;
+  gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+  engine.setMaxMotionsInFlight(4);
+
+  ASSERT_TRUE(engine.pushChunk("G1 X1\nG1 X2\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  ASSERT_TRUE(engine.pushChunk("G1 X3\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  EXPECT_EQ(runtime.linear_calls, 3);
+
+  auto step = engine.finish();
+  for (int token = 1; token <= 3; ++token) {
+    ASSERT_EQ(step.status, gcode::StepStatus::Blocked);
+    ASSERT_TRUE(step.blocked.has_value());
+    EXPECT_EQ(step.blocked->token.id, std::to_string(token));
+    step = engine.resume(step.blocked->token);
+  }
+  EXPECT_EQ(step.status, gcode::StepStatus::Completed);
+}
+
+TEST(StreamingExecutionTest, MotionWindowChangeAppliesToNextBatch) {
+  class PendingRuntime : public ReadyRuntime {
+  public:
+    gcode::RuntimeResult<gcode::WaitToken>
+    submitLinearMove(const gcode::LinearMoveCommand &) override {
+      gcode::RuntimeResult<gcode::WaitToken> result;
+      result.status = gcode::RuntimeCallStatus::Pending;
+      result.wait_token =
+          gcode::WaitToken{"motion", std::to_string(++linear_calls)};
+      return result;
+    }
+    int linear_calls = 0;
+  };
+
+  NullSink sink;
+  PendingRuntime runtime;
+  StaticCancellation cancellation;
+  gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+
+  ASSERT_TRUE(engine.pushChunk("G1 X1\n"));
+  auto step = engine.pump();
+  ASSERT_EQ(step.status, gcode::StepStatus::Blocked);
+  EXPECT_EQ(engine.resume(step.blocked->token).status,
+            gcode::StepStatus::Progress);
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+
+  engine.setMaxMotionsInFlight(4);
+  ASSERT_TRUE(engine.pushChunk("G1 X2\nG1 X3\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  EXPECT_EQ(runtime.linear_calls, 3);
+
+  engine.setMaxMotionsInFlight(1);
+  ASSERT_TRUE(engine.pushChunk("G1 X4\n"));
+  step = engine.pump();
+  ASSERT_EQ(step.status, gcode::StepStatus::Blocked);
+  EXPECT_EQ(step.blocked->token.id, "2");
+  EXPECT_EQ(runtime.linear_calls, 4);
+}
+
+TEST(StreamingExecutionTest, ForwardGotoWaitsForTargetWithoutResubmitting) {
+  class CountingRuntime : public ReadyRuntime {
+  public:
+    gcode::RuntimeResult<gcode::WaitToken>
+    submitLinearMove(const gcode::LinearMoveCommand &cmd) override {
+      ++linear_calls;
+      return ReadyRuntime::submitLinearMove(cmd);
+    }
+    int linear_calls = 0;
+  };
+
+  NullSink sink;
+  CountingRuntime runtime;
+  StaticCancellation cancellation;
+  gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+
+  // Nothing runs while the GOTOF's target has not arrived.
+  ASSERT_TRUE(engine.pushChunk("G1 X1\nGOTOF END\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  ASSERT_TRUE(engine.pushChunk("G1 X2\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  EXPECT_EQ(runtime.linear_calls, 0);
+
+  ASSERT_TRUE(engine.pushChunk("END:\nG1 X3\n"));
+  auto step = engine.finish();
+  while (step.status == gcode::StepStatus::Progress) {
+    step = engine.pump();
+  }
+  EXPECT_EQ(step.status, gcode::StepStatus::Completed);
+  EXPECT_EQ(runtime.linear_calls, 2);
+}
+
+TEST(StreamingExecutionTest, LinearMoveBatchReachesRuntime) {
+  class BatchRuntime : public ReadyRuntime {
+  public:
+    gcode::RuntimeBatchResult
+    submitLinearMoveBatch(const gcode::LinearMoveCommand *cmds,
+                          size_t count) override {
+      batches.push_back(count);
+      return gcode::IRuntime::submitLinearMoveBatch(cmds, count);
+    }
+    std::vector<size_t> batches;
+  };
+
+  NullSink sink;
+  BatchRuntime runtime;
+  StaticCancellation cancellation;
+  gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+  engine.setMaxLinearMoveBatch(2);
+
+  ASSERT_TRUE(engine.pushChunk("G1 X1\nG1 X2\nG1 X3\nG4 F1\nG1 X4\n"));
+  EXPECT_EQ(engine.finish().status, gcode::StepStatus::Completed);
+  // X3 and X4 are runs of one and take the single-move path.
+  EXPECT_EQ(runtime.batches, (std::vector<size_t>{2}));
+}
+
+TEST(StreamingExecutionTest, LinearMoveBatchChangeAppliesToNextBatch) {
+  class BatchRuntime : public ReadyRuntime {
+  public:
+    gcode::RuntimeBatchResult
+    submitLinearMoveBatch(const gcode::LinearMoveCommand *cmds,
+                          size_t count) override {
+      batches.push_back(count);
+      return gcode::IRuntime::submitLinearMoveBatch(cmds, count);
+    }
+    std::vector<size_t> batches;
+  };
+
+  NullSink sink;
+  BatchRuntime runtime;
+  StaticCancellation cancellation;
+  gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+
+  ASSERT_TRUE(engine.pushChunk("G1 X1\nG1 X2\nG1 X3\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  EXPECT_TRUE(runtime.batches.empty());
+
+  engine.setMaxLinearMoveBatch(3);
+  ASSERT_TRUE(engine.pushChunk("G1 X4\nG1 X5\nG1 X6\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  EXPECT_EQ(runtime.batches, (std::vector<size_t>{3}));
+
+  engine.setMaxLinearMoveBatch(1);
+  ASSERT_TRUE(engine.pushChunk("G1 X7\nG1 X8\n"));
+  EXPECT_EQ(engine.finish().status, gcode::StepStatus::Completed);
+  EXPECT_EQ(runtime.batches, (std::vector<size_t>{3}));
+}
+
 TEST(StreamingExecutionTest, NoNextLineExecutesWhileBlocked) {
   class BlockingRuntime : public ReadyRuntime {
   public:
@@ -276,4 +464,109 @@ TEST(StreamingExecutionTest, RejectedLineReturnsRejectedStateInsteadOfFault) {
   EXPECT_EQ(engine.state(), gcode::EngineState::Rejected);
 }
 
+TEST(StreamingExecutionTest, IfBlockWaitsForEndIfAcrossChunks) {
+  class RecordingSink : public NullSink {
+  public:
+    void onDiagnostic(const gcode::Diagnostic &diag) override {
+      diagnostics.push_back(diag);
+    }
+    void onLinearMove(const gcode::LinearMoveCommand &cmd) override {
+      linear_move_lines.push_back(cmd.source.line);
+    }
+    std::vector<gcode::Diagnostic> diagnostics;
+    std::vector<int> linear_move_lines;
+  };
+
+  RecordingSink sink;
+  ReadyRuntime runtime;
+  StaticCancellation cancellation;
+  gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+
+  ASSERT_TRUE(engine.pushChunk("R1 = 1\nIF R1 == 0\n"));
+  EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  for (const char *chunk : {"G1 X1\n", "G1 X2\n", "ELSE\n", "G1 X3\n"}) {
+    ASSERT_TRUE(engine.pushChunk(chunk));
+    EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+  }
+  EXPECT_TRUE(sink.linear_move_lines.empty());
+
+  ASSERT_TRUE(engine.pushChunk("ENDIF\nG1 X4\n"));
+  auto step = engine.finish();
+  while (step.status == gcode::StepStatus::Progress) {
+    step = engine.pump();
+  }
+  EXPECT_EQ(step.status, gcode::StepStatus::Completed);
+  EXPECT_EQ(sink.linear_move_lines, (std::vector<int>{6, 8}));
+  EXPECT_TRUE(sink.diagnostics.empty());
+}
+
+TEST(StreamingExecutionTest, ProgramNameLineInIfBlockChunkMatchesWholeBatch) {
+  class RecordingSink : public NullSink {
+  public:
+    void onDiagnostic(const gcode::Diagnostic &diag) override {
+      diagnostics.push_back(std::to_string(diag.location.line) + ": " +
+                            diag.message);
+    }
+    std::vector<std::string> diagnostics;
+  };
+  const auto run = [](const std::vector<const char *> &chunks,
+                      gcode::StepResult *last) {
+    RecordingSink sink;
+    ReadyRuntime runtime;
+    StaticCancellation cancellation;
+    gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+    for (const char *chunk : chunks) {
+      EXPECT_TRUE(engine.pushChunk(chunk));
+      EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+    }
+    *last = engine.finish();
+    return sink.diagnostics;
+  };
+
+  // Only the first line of a program may name it, so %PART is an error
+  // whether or not it starts the chunk.
+  gcode::StepResult whole;
+  gcode::StepResult split;
+  const auto whole_diagnostics =
+      run({"R1 = 1\nIF R1 == 0\n%PART\nENDIF\n"}, &whole);
+  const auto split_diagnostics =
+      run({"R1 = 1\nIF R1 == 0\n", "%PART\nENDIF\n"}, &split);
+  EXPECT_NE(whole.status, gcode::StepStatus::Completed);
+  EXPECT_EQ(split.status, whole.status);
+  EXPECT_EQ(split_diagnostics, whole_diagnostics);
+}
+
+TEST(StreamingExecutionTest, DuplicateLineNumbersAcrossIfBlockChunksWarn) {
+  class RecordingSink : public NullSink {
+  public:
+    void onDiagnostic(const gcode::Diagnostic &diag) override {
+      diagnostics.push_back(diag);
+    }
+    std::vector<gcode::Diagnostic> diagnostics;
+  };
+
+  // The N-address jump comes before, then after, the repeated N10.
+  const std::vector<std::vector<const char *>> programs = {
+      {"R1 = 1\nIF R1 == 0\nGOTOF N20\n", "N10 G1 X1\n", "N10 G1 X2\n",
+       "N20 G1 X3\nENDIF\n"},
+      {"R1 = 1\nIF R1 == 0\nG1 X0\n", "N10 G1 X1\nN10 G1 X2\n",
+       "GOTOF N20\nN20 G1 X3\nENDIF\n"},
+  };
+  for (const auto &chunks : programs) {
+    RecordingSink sink;
+    ReadyRuntime runtime;
+    StaticCancellation cancellation;
+    gcode::StreamingExecutionEngine engine(sink, runtime, cancellation);
+    for (const char *chunk : chunks) {
+      ASSERT_TRUE(engine.pushChunk(chunk));
+      EXPECT_EQ(engine.pump().status, gcode::StepStatus::Progress);
+    }
+    EXPECT_EQ(engine.finish().status, gcode::StepStatus::Completed);
+    ASSERT_EQ(sink.diagnostics.size(), 1u);
+    EXPECT_EQ(sink.diagnostics[0].severity,
+              gcode::Diagnostic::Severity::Warning);
+    EXPECT_EQ(sink.diagnostics[0].location.line, 5);
+  }
+}
+
 } // namespace
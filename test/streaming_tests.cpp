@@ -2,10 +2,12 @@
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <variant>
 #include <vector>
 
 #include "gtest/gtest.h"
 
+#include "gcode/gcode_parser.h"
 #include "messages.h"
 
 namespace {
@@ -55,6 +57,45 @@ TEST(StreamingTest, CancelHookStopsEarly) {
   EXPECT_LT(message_count, 10000u);
 }
 
+TEST(StreamingTest, ParallelLoweringReportsTheSameCallbacks) {
+  const std::string input = "G18\n" + makeProgram(20000) + "G2 X1 Z1 J1\n";
+  const auto parsed = gcode::parse(input);
+  const auto record = [&](unsigned threads,
+                          const gcode::StreamOptions &stream_options) {
+    std::vector<std::string> events;
+    gcode::StreamCallbacks callbacks;
+    callbacks.on_message = [&](const gcode::ParsedMessage &message) {
+      events.push_back(
+          "message " +
+          std::to_string(std::visit(
+              [](const auto &msg) { return msg.source.line; }, message)));
+    };
+    callbacks.on_diagnostic = [&](const gcode::Diagnostic &diagnostic) {
+      events.push_back("diagnostic " + diagnostic.message);
+    };
+    callbacks.on_rejected_line = [&](const gcode::RejectedLine &rejected) {
+      events.push_back("rejected " + std::to_string(rejected.source.line));
+    };
+    gcode::LowerOptions options;
+    options.lower_threads = threads;
+    const bool completed =
+        gcode::lowerToMessagesStream(parsed.program, parsed.diagnostics,
+                                     options, callbacks, stream_options);
+    events.push_back(completed ? "completed" : "stopped");
+    return events;
+  };
+
+  gcode::StreamOptions unlimited;
+  const auto serial = record(1, unlimited);
+  EXPECT_EQ(serial.back(), "stopped");
+  EXPECT_EQ(serial[serial.size() - 2], "rejected 20002");
+  EXPECT_EQ(record(4, unlimited), serial);
+
+  gcode::StreamOptions limited;
+  limited.max_messages = 12345;
+  EXPECT_EQ(record(4, limited), record(1, limited));
+}
+
 TEST(StreamingTest, StreamsRejectedLineOnError) {
   size_t rejected_count = 0;
   size_t message_count = 0;
@@ -96,6 +137,25 @@ TEST(StreamingTest, ParseAndLowerFileStreamWorks) {
   EXPECT_EQ(message_count, 2u);
 }
 
+TEST(StreamingTest, ParseAndLowerFileStreamReportsMissingFile) {
+  const auto missing_file =
+      std::filesystem::temp_directory_path() / "gcode_stream_missing.ngc";
+  std::error_code ec;
+  std::filesystem::remove(missing_file, ec);
+
+  std::vector<gcode::Diagnostic> diagnostics;
+  gcode::StreamCallbacks callbacks;
+  callbacks.on_diagnostic = [&](const gcode::Diagnostic &diag) {
+    diagnostics.push_back(diag);
+  };
+
+  EXPECT_FALSE(
+      gcode::parseAndLowerFileStream(missing_file.string(), {}, callbacks));
+  ASSERT_EQ(diagnostics.size(), 1u);
+  EXPECT_NE(diagnostics[0].message.find("failed to open file"),
+            std::string::npos);
+}
+
 TEST(StreamingTest, StreamsFinalLineWithoutTrailingNewline) {
   const std::string input = "N1 G4 F3";
   std::vector<gcode::ParsedMessage> messages;
@@ -141,11 +201,11 @@ TEST(StreamingTest, CallbackCanCaptureAndValidateDetailedMessages) {
   ASSERT_TRUE(std::holds_alternative<gcode::G1Message>(messages[1]));
   const auto &second = std::get<gcode::G1Message>(messages[1]);
   EXPECT_EQ(second.source.line, 2);
-  ASSERT_TRUE(second.target_pose.x.has_value());
-  ASSERT_TRUE(second.target_pose.y.has_value());
+  ASSERT_TRUE(second.target_pose.x().has_value());
+  ASSERT_TRUE(second.target_pose.y().has_value());
   ASSERT_TRUE(second.feed.has_value());
-  EXPECT_TRUE(closeEnough(*second.target_pose.x, 10.0));
-  EXPECT_TRUE(closeEnough(*second.target_pose.y, 20.0));
+  EXPECT_TRUE(closeEnough(*second.target_pose.x(), 10.0));
+  EXPECT_TRUE(closeEnough(*second.target_pose.y(), 20.0));
   EXPECT_TRUE(closeEnough(*second.feed, 30.0));
   EXPECT_EQ(second.modal.group, gcode::ModalGroupId::Motion);
   EXPECT_EQ(second.modal.code, "G1");
@@ -179,8 +239,8 @@ TEST(StreamingTest, SkipLevelsAreAppliedInStreamingMode) {
   ASSERT_TRUE(std::holds_alternative<gcode::G1Message>(messages[0]));
 
   const auto &g1 = std::get<gcode::G1Message>(messages[0]);
-  ASSERT_TRUE(g1.target_pose.x.has_value());
-  EXPECT_TRUE(closeEnough(*g1.target_pose.x, 20.0));
+  ASSERT_TRUE(g1.target_pose.x().has_value());
+  EXPECT_TRUE(closeEnough(*g1.target_pose.x(), 20.0));
 }
 
 } // namespace